@@ -4,6 +4,7 @@
 
 #include <stdatomic.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include "am/macros.h"
 
 enum am_memory_order {
@@ -38,6 +39,14 @@ static AM_INLINE void *am_atomic_load_ptr_explicit(void *volatile *x, enum am_me
 {
     return atomic_load_explicit(x, order);
 }
+static AM_INLINE void am_atomic_store_ptr(void *volatile *x, void *y)
+{
+    atomic_store(x, y);
+}
+static AM_INLINE void am_atomic_store_ptr_explicit(void *volatile *x, void *y, enum am_memory_order order)
+{
+    atomic_store_explicit(x, y, order);
+}
 static AM_INLINE void *am_atomic_fetch_add_ptr(void *volatile *x, ptrdiff_t y)
 {
     return atomic_fetch_add(x, y);
@@ -46,6 +55,14 @@ static AM_INLINE void *am_atomic_fetch_add_ptr_explicit(void *volatile *x, ptrdi
 {
     return atomic_fetch_add_explicit(x, y, order);
 }
+static AM_INLINE void *am_atomic_exchange_ptr(void *volatile *x, void *y)
+{
+    return atomic_exchange(x, y);
+}
+static AM_INLINE void *am_atomic_exchange_ptr_explicit(void *volatile *x, void *y, enum am_memory_order order)
+{
+    return atomic_exchange_explicit(x, y, order);
+}
 static AM_INLINE bool am_atomic_cas_ptr(void *volatile *x, void **expected, void *desired)
 {
     return atomic_compare_exchange_strong(x, expected, desired);
@@ -55,6 +72,74 @@ static AM_INLINE bool am_atomic_cas_ptr_explicit(void *volatile *x, void **expec
     return atomic_compare_exchange_strong_explicit(x, expected, desired, succ, fail);
 }
 
+/* Plain words shared between threads (ie. fields of a larger structure) */
+
+static AM_INLINE uintptr_t am_atomic_load_uintptr(volatile uintptr_t *x)
+{
+    return atomic_load(x);
+}
+static AM_INLINE uintptr_t am_atomic_load_uintptr_explicit(volatile uintptr_t *x, enum am_memory_order order)
+{
+    return atomic_load_explicit(x, order);
+}
+static AM_INLINE void am_atomic_store_uintptr(volatile uintptr_t *x, uintptr_t y)
+{
+    atomic_store(x, y);
+}
+static AM_INLINE void am_atomic_store_uintptr_explicit(volatile uintptr_t *x, uintptr_t y, enum am_memory_order order)
+{
+    atomic_store_explicit(x, y, order);
+}
+static AM_INLINE uint64_t am_atomic_load_uint64_explicit(volatile uint64_t *x, enum am_memory_order order)
+{
+    return atomic_load_explicit(x, order);
+}
+static AM_INLINE void am_atomic_store_uint64_explicit(volatile uint64_t *x, uint64_t y, enum am_memory_order order)
+{
+    atomic_store_explicit(x, y, order);
+}
+
+/* Pairs of adjacent words (ie. a pointer tagged with a generation)
+ * Only available when the target has a double-width compare and swap,
+ * which on x86-64 requires -mcx16
+ */
+
+#if UINTPTR_MAX == UINT64_MAX && defined(__GCC_HAVE_SYNC_COMPARE_AND_SWAP_16)
+# define AM_ATOMIC_HAVE_CAS_DWORD 1
+typedef unsigned __int128 am__atomic_dword;
+#elif UINTPTR_MAX == UINT32_MAX && defined(__GCC_HAVE_SYNC_COMPARE_AND_SWAP_8)
+# define AM_ATOMIC_HAVE_CAS_DWORD 1
+typedef uint64_t am__atomic_dword;
+#endif
+
+#ifdef AM_ATOMIC_HAVE_CAS_DWORD
+/** @brief Compare and swap two adjacent words, with sequential consistency
+ * @param x Pair of words, aligned to twice the size of a word
+ * @param expected Expected pair, which receives the current one on failure
+ * @param desired Pair to store
+ */
+static AM_INLINE bool am_atomic_cas_dword(volatile uintptr_t *x, uintptr_t *expected, const uintptr_t *desired)
+{
+    am__atomic_dword e, d, old;
+
+    __builtin_memcpy(&e, expected, sizeof e);
+    __builtin_memcpy(&d, desired, sizeof d);
+    old = __sync_val_compare_and_swap((volatile am__atomic_dword *)x, e, d);
+    if (old == e) {
+        return true;
+    }
+    __builtin_memcpy(expected, &old, sizeof old);
+    return false;
+}
+#endif
+
+/* Fences */
+
+static AM_INLINE void am_atomic_thread_fence(enum am_memory_order order)
+{
+    atomic_thread_fence(order);
+}
+
 #undef X
 
 #endif /* ifndef AM_ATOMIC_H */
@@ -1,63 +1,151 @@
+/** @file am/concurrent/array.h
+ * @brief Single-writer, multiple-reader copy-on-write array
+ *
+ * Modeled after ConcurrencyKit's ck_array. The writer stages changes, which
+ * become visible to readers all at once on am_spmc_array_commit. Readers
+ * iterate a stable snapshot without locks or retries.
+ *
+ * Appends go straight into the active snapshot while it has room, and are
+ * published by bumping its committed length. Removals, and appends which
+ * need more room, are staged in a private copy (the transaction), which
+ * replaces the active snapshot on commit.
+ *
+ * Replaced snapshots are retired, not freed, since readers may still be
+ * iterating them. They are released by am_spmc_array_reclaim or
+ * am_spmc_array_destroy, or handed to an epoch (am/concurrent/epoch.h) by
+ * am_spmc_array_reclaim_deferred when readers use epoch sections.
+ */
 
 #ifndef AM_LOCKFREE_ARRAY_H
 #define AM_LOCKFREE_ARRAY_H 1
 
-#include <assert.h>
 #include <stddef.h>
 #include <stdbool.h>
 #include <stdint.h>
+#include "am/macros.h"
 #include "am/alloc.h"
 #include "am/atomic.h"
 
 struct am__spmc_array {
     am_atomic_uint num_committed;
     unsigned length;
+    struct am__spmc_array *next_retired;
     void *values[1]; /* Flexible array member emulation */
 };
 
+struct am_epoch_record;
 struct am_spmc_array {
-    struct am_alloc allocator;
+    struct am_alloc *allocator;
     struct am__spmc_array *active;
-    unsigned num_entries;
-    struct am__spmc_array *transaction;
+    unsigned num_entries;               /* Entries, including uncommitted ones */
+    struct am__spmc_array *transaction; /* Staged copy, or NULL */
+    struct am__spmc_array *retired;     /* Replaced snapshots, pending reclamation */
 };
 
 struct am_spmc_array_iterator {
     struct am__spmc_array *snapshot;
+    unsigned length;
 };
 
-/** @brief Initialize an array */
-AM_ATTR_NON_NULL((1, 2)) AM_PUBLIC
+/** @brief Initialize an array
+ * @param allocator Allocator used for the snapshots
+ * @param length Initial capacity
+ * @return false on allocation failure
+ */
+AM_ATTR_NON_NULL((1, 2)) AM_ATTR_WARN_UNUSED_RESULT AM_PUBLIC
 bool am_spmc_array_init(struct am_spmc_array *arr, struct am_alloc *allocator, unsigned length);
 
-/** @brief Commit changes made to the array */
+/** @brief Commit changes made to the array
+ * Readers which start iterating afterwards see every change at once
+ * @return false if there was nothing to commit
+ */
 AM_ATTR_NON_NULL((1)) AM_PUBLIC
 bool am_spmc_array_commit(struct am_spmc_array *arr);
 
-/** @brief Add an element to the array */
-AM_ATTR_NON_NULL((1)) AM_PUBLIC
+/** @brief Add an element to the array
+ * @return false on allocation failure
+ */
+AM_ATTR_NON_NULL((1)) AM_ATTR_WARN_UNUSED_RESULT AM_PUBLIC
 bool am_spmc_array_put(struct am_spmc_array *arr, void *val);
 
-/** @brief Add an element to the array, if it doesn't already exist */
+/** @brief Add an element to the array, if it doesn't already exist
+ * @return false if the element exists, or on allocation failure
+ */
 AM_ATTR_NON_NULL((1)) AM_PUBLIC
 bool am_spmc_array_put_unique(struct am_spmc_array *arr, void *val);
 
-/** @brief Remove an element from the array */
+/** @brief Remove an element from the array
+ * The order of the remaining elements is not preserved
+ * @return false if the element doesn't exist, or on allocation failure
+ */
 AM_ATTR_NON_NULL((1)) AM_PUBLIC
 bool am_spmc_array_remove(struct am_spmc_array *arr, void *val);
 
-/** @brief Deallocate an array */
+/** @brief Free the snapshots replaced by commits
+ * @note No reader may be iterating the array
+ */
 AM_ATTR_NON_NULL((1)) AM_PUBLIC
-bool am_spmc_array_destroy(struct am_spmc_array *arr);
+void am_spmc_array_reclaim(struct am_spmc_array *arr);
+
+/** @brief Defer freeing the replaced snapshots until readers are done
+ * @param record The writer's epoch record; readers must iterate within
+ *   epoch sections of the same epoch
+ */
+AM_ATTR_NON_NULL((1, 2)) AM_PUBLIC
+void am_spmc_array_reclaim_deferred(struct am_spmc_array *arr, struct am_epoch_record *record);
 
-/** @brief Get the length of the array */
+/** @brief Deallocate an array, including any retired snapshots */
 AM_ATTR_NON_NULL((1)) AM_PUBLIC
+void am_spmc_array_destroy(struct am_spmc_array *arr);
+
+/** @brief Get the number of committed elements */
+AM_ATTR_NON_NULL((1))
+static AM_INLINE
 unsigned am_spmc_array_length(struct am_spmc_array *arr)
 {
-    struct am__spmc_array *a = am_atomic_load_ptr((void **)&arr->active);
-    return am_atomic_load_uint(&a->num_committed);
+    struct am__spmc_array *a = am_atomic_load_ptr_explicit((void **)&arr->active, AM_MEMORY_ORDER_ACQUIRE);
+    return am_atomic_load_uint_explicit(&a->num_committed, AM_MEMORY_ORDER_ACQUIRE);
+}
+
+/** @brief Get access to the underlying buffer of the committed elements
+ * @param length Receives the number of elements
+ * @note The buffer is only valid as long as the snapshot is
+ */
+AM_ATTR_NON_NULL((1, 2))
+static AM_INLINE
+void *const *am_spmc_array_buffer(struct am_spmc_array *arr, unsigned *length)
+{
+    struct am__spmc_array *a = am_atomic_load_ptr_explicit((void **)&arr->active, AM_MEMORY_ORDER_ACQUIRE);
+    *length = am_atomic_load_uint_explicit(&a->num_committed, AM_MEMORY_ORDER_ACQUIRE);
+    return a->values;
+}
+
+/** @brief Take a snapshot of the committed elements */
+AM_ATTR_NON_NULL((1, 2))
+static AM_INLINE
+void am_spmc_array_iterator_init(struct am_spmc_array *arr, struct am_spmc_array_iterator *it)
+{
+    it->snapshot = am_atomic_load_ptr_explicit((void **)&arr->active, AM_MEMORY_ORDER_ACQUIRE);
+    it->length = am_atomic_load_uint_explicit(&it->snapshot->num_committed, AM_MEMORY_ORDER_ACQUIRE);
+}
+
+/** @brief Get an element of a snapshot */
+AM_ATTR_NON_NULL((1))
+static AM_INLINE
+void *am_spmc_array_iterator_get(const struct am_spmc_array_iterator *it, unsigned i)
+{
+    return am_atomic_load_ptr_explicit(&it->snapshot->values[i], AM_MEMORY_ORDER_RELAXED);
 }
 
-/** @brief Get access to the underlying buffer */
+/** @brief Iterate over a snapshot of the array
+ * @param arr The array to iterate over
+ * @param it 'struct am_spmc_array_iterator *' holding the snapshot
+ * @param i 'unsigned' to use as a loop cursor
+ * @param val 'void *' receiving each element
+ */
+#define am_spmc_array_foreach(arr, it, i, val) \
+    for (am_spmc_array_iterator_init(arr, it), (i) = 0; \
+            (i) < (it)->length && ((val) = am_spmc_array_iterator_get(it, i), true); \
+            (i)++)
 
 #endif /* ifndef AM_LOCKFREE_ARRAY_H */
@@ -0,0 +1,168 @@
+/** @file am/concurrent/epoch.h
+ * @brief Epoch-based memory reclamation
+ *
+ * Modeled after ConcurrencyKit's ck_epoch. Readers bracket accesses to shared
+ * memory with am_epoch_begin/am_epoch_end. Writers unlink objects, then defer
+ * their destruction with am_epoch_call or am_epoch_free. Deferred callbacks
+ * run once every reader that could have seen the object has left its
+ * read-side section, which takes two advances of the global epoch.
+ *
+ * Each thread uses its own record, obtained from am_epoch_register.
+ * Pending callbacks are dispatched in batches by am_epoch_poll, which
+ * am_epoch_call invokes every AM_EPOCH_BATCH deferrals. The epoch can be
+ * advanced by any thread, or by a background reclaimer thread.
+ */
+
+#ifndef AM_CONCURRENT_EPOCH_H
+#define AM_CONCURRENT_EPOCH_H 1
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <time.h>
+#include "am/macros.h"
+#include "am/atomic.h"
+#include "am/alloc.h"
+#include "am/threads.h"
+
+/** @brief Number of deferrals after which am_epoch_call polls */
+#define AM_EPOCH_BATCH 64
+/** @brief Number of epochs tracked by a record
+ * A power of two, so consecutive epochs keep distinct buckets when the counter wraps
+ */
+#define AM_EPOCH_LENGTH 4
+
+struct am_epoch_entry;
+/** @brief Deferred callback, run after a grace period */
+typedef void am_epoch_cb(struct am_epoch_entry *entry);
+
+/** @brief Intrusive member of a deferred object */
+struct am_epoch_entry {
+    am_epoch_cb *fn;
+    struct am_epoch_entry *next;
+};
+
+/** @brief Global epoch state */
+struct am_epoch {
+    am_atomic_uint epoch;
+    struct am_epoch_record *records; /* Lock-free stack, records are never removed */
+    struct am_alloc *allocator;      /* Must be threadsafe */
+    am_atomic_int reclaimer_stop;
+    bool reclaimer_running;
+    struct timespec reclaimer_interval;
+    am_thread reclaimer;
+};
+
+/** @brief Per-thread epoch state */
+struct am_epoch_record {
+    /* Read-side, written by the owner */
+    am_atomic_uint active; /* Nesting depth of read-side sections */
+    am_atomic_uint epoch;  /* Epoch observed when the outermost section began */
+    char _pad[AM_CACHELINE - 2 * sizeof(am_atomic_uint)];
+
+    struct am_epoch *global;
+    struct am_epoch_record *next;
+    am_atomic_uint in_use;
+    /* Deferred callbacks, bucketed by the epoch they were deferred in */
+    struct am_epoch_entry *pending[AM_EPOCH_LENGTH];
+    unsigned pending_epoch[AM_EPOCH_LENGTH];
+    unsigned n_pending;
+    unsigned long n_dispatched;
+};
+
+/** @brief Initialize the global epoch
+ * @param allocator Threadsafe allocator used for records and am_epoch_free
+ */
+AM_ATTR_NON_NULL((1, 2)) AM_PUBLIC
+void am_epoch_init(struct am_epoch *epoch, struct am_alloc *allocator);
+
+/** @brief Deallocate all records, stopping the reclaimer if running
+ * @note No thread may be using the epoch, and all records must be unregistered
+ */
+AM_ATTR_NON_NULL((1)) AM_PUBLIC
+void am_epoch_destroy(struct am_epoch *epoch);
+
+/** @brief Obtain a record for the calling thread
+ * @return A record, possibly recycled from an unregistered thread, or NULL
+ */
+AM_ATTR_NON_NULL((1)) AM_ATTR_WARN_UNUSED_RESULT AM_PUBLIC
+struct am_epoch_record *am_epoch_register(struct am_epoch *epoch);
+
+/** @brief Release a record, after dispatching its pending callbacks
+ * @note Blocks for a grace period if callbacks are pending
+ */
+AM_ATTR_NON_NULL((1)) AM_PUBLIC
+void am_epoch_unregister(struct am_epoch_record *record);
+
+/** @brief Begin a read-side section
+ * Sections may be nested
+ */
+AM_ATTR_NON_NULL((1))
+static AM_INLINE
+void am_epoch_begin(struct am_epoch_record *record)
+{
+    unsigned active = am_atomic_load_uint_explicit(&record->active, AM_MEMORY_ORDER_RELAXED);
+
+    am_atomic_store_uint_explicit(&record->active, active + 1, AM_MEMORY_ORDER_RELAXED);
+    if (active == 0) {
+        unsigned epoch;
+        /* The reclaimer must see us active before we read anything shared */
+        am_atomic_thread_fence(AM_MEMORY_ORDER_SEQ_CST);
+        epoch = am_atomic_load_uint_explicit(&record->global->epoch, AM_MEMORY_ORDER_RELAXED);
+        am_atomic_store_uint_explicit(&record->epoch, epoch, AM_MEMORY_ORDER_RELAXED);
+    }
+}
+
+/** @brief End a read-side section */
+AM_ATTR_NON_NULL((1))
+static AM_INLINE
+void am_epoch_end(struct am_epoch_record *record)
+{
+    unsigned active = am_atomic_load_uint_explicit(&record->active, AM_MEMORY_ORDER_RELAXED);
+
+    am_atomic_store_uint_explicit(&record->active, active - 1, AM_MEMORY_ORDER_RELEASE);
+}
+
+/** @brief Defer a callback until no reader can access the entry's object
+ * @note Must not be called within a read-side section of the same record
+ */
+AM_ATTR_NON_NULL((1, 2, 3)) AM_PUBLIC
+void am_epoch_call(struct am_epoch_record *record, struct am_epoch_entry *entry, am_epoch_cb *fn);
+
+/** @brief Defer freeing memory through the epoch's allocator
+ * @param ptr Memory allocated with the epoch's allocator
+ * @param size The size of the allocation
+ * @note If no memory is available to record the deferral, this waits for
+ *   a grace period and frees immediately
+ */
+AM_ATTR_NON_NULL((1)) AM_PUBLIC
+void am_epoch_free(struct am_epoch_record *record, void *ptr, size_t size);
+
+/** @brief Try to advance the epoch, then dispatch callbacks whose grace period passed
+ * @return true if any callbacks were dispatched
+ */
+AM_ATTR_NON_NULL((1)) AM_PUBLIC
+bool am_epoch_poll(struct am_epoch_record *record);
+
+/** @brief Wait until every read-side section active at the time of the call has ended
+ * @note Must not be called within a read-side section
+ */
+AM_ATTR_NON_NULL((1)) AM_PUBLIC
+void am_epoch_synchronize(struct am_epoch_record *record);
+
+/** @brief Wait for a grace period, then dispatch all pending callbacks of the record */
+AM_ATTR_NON_NULL((1)) AM_PUBLIC
+void am_epoch_barrier(struct am_epoch_record *record);
+
+/** @brief Start a thread which advances the epoch periodically
+ * Records then only need to poll to dispatch their callbacks, which
+ * am_epoch_call does every AM_EPOCH_BATCH deferrals
+ * @param interval Time between attempts to advance the epoch
+ */
+AM_ATTR_NON_NULL((1, 2)) AM_ATTR_WARN_UNUSED_RESULT AM_PUBLIC
+bool am_epoch_reclaimer_start(struct am_epoch *epoch, const struct timespec *interval);
+
+/** @brief Stop the reclaimer thread */
+AM_ATTR_NON_NULL((1)) AM_PUBLIC
+void am_epoch_reclaimer_stop(struct am_epoch *epoch);
+
+#endif /* ifndef AM_CONCURRENT_EPOCH_H */
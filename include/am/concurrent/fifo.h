@@ -1,13 +1,220 @@
+/** @file am/concurrent/fifo.h
+ * @brief Unbounded linked FIFO queues
+ *
+ * am_fifo_mpmc is a Michael-Scott queue: any number of threads may enqueue
+ * and dequeue concurrently, without locks. Each thread works through its
+ * own handle, which holds a hazard-pointer record (am/concurrent/hazard.h)
+ * of the queue's domain and a private cache of nodes. Dequeued nodes are
+ * retired to the dequeuing handle, and recycled into its cache once no
+ * other thread can still be reading them. A full cache passes nodes on to
+ * a free list shared by the queue (am/concurrent/stack.h), which an empty
+ * cache refills from in one swap, so a steady-state queue does no
+ * allocation even when producers and consumers are different threads.
+ *
+ * am_fifo_spsc is the cheap case, modeled after ConcurrencyKit's
+ * ck_fifo_spsc: one producer and one consumer, using plain loads and stores
+ * with acquire/release ordering. Its entries are supplied by the producer,
+ * and flow back to it once consumed.
+ */
 
 #ifndef AM_CONCURRENT_FIFO_H
 #define AM_CONCURRENT_FIFO_H 1
 
 #include <stddef.h>
+#include <stdbool.h>
+#include "am/macros.h"
+#include "am/atomic.h"
+#include "am/alloc.h"
+#include "am/concurrent/hazard.h"
+#include "am/concurrent/stack.h"
 
-#error NYI
+/** @brief Nodes kept by a handle for reuse before going to the shared free list */
+#define AM_FIFO_MPMC_CACHE 64
 
+struct am_fifo_mpmc_handle;
+struct am_fifo_mpmc_node {
+    void *value;
+    struct am_fifo_mpmc_node *next;
+    struct am_hazard_entry hazard_entry;
+    struct am_stack_entry free_entry;
+    struct am_fifo_mpmc_handle *owner; /* Handle which retired the node */
+};
+
+struct am_fifo_mpmc {
+    struct am_fifo_mpmc_node *head AM_ATTR_ALIGNED(AM_CACHELINE);
+    struct am_fifo_mpmc_node *tail AM_ATTR_ALIGNED(AM_CACHELINE);
+    struct am_stack free AM_ATTR_ALIGNED(AM_CACHELINE); /* Nodes spilled from full caches */
+    struct am_alloc *allocator AM_ATTR_ALIGNED(AM_CACHELINE);
+    struct am_hazard hp;
+};
+
+/** @brief Per-thread access to a queue */
+struct am_fifo_mpmc_handle {
+    struct am_fifo_mpmc *fifo;
+    struct am_hazard_record *hazard;
+    struct am_fifo_mpmc_node *cache;
+    unsigned n_cached;
+};
+
+/** @brief Initialize a queue
+ * @param allocator Threadsafe allocator used for the nodes
+ * @return false on allocation failure
+ */
+AM_ATTR_NON_NULL((1, 2)) AM_ATTR_WARN_UNUSED_RESULT AM_PUBLIC
+bool am_fifo_mpmc_init(struct am_fifo_mpmc *fifo, struct am_alloc *allocator);
+
+/** @brief Deallocate a queue, dropping any values still queued
+ * @note Every handle must have been released
+ */
+AM_ATTR_NON_NULL((1)) AM_PUBLIC
+void am_fifo_mpmc_destroy(struct am_fifo_mpmc *fifo);
+
+/** @brief Acquire a handle for the calling thread
+ * @return false on allocation failure
+ */
+AM_ATTR_NON_NULL((1, 2)) AM_ATTR_WARN_UNUSED_RESULT AM_PUBLIC
+bool am_fifo_mpmc_handle_init(struct am_fifo_mpmc *fifo, struct am_fifo_mpmc_handle *handle);
+
+/** @brief Release a handle, freeing its cached nodes
+ * @note Blocks while other threads still read nodes the handle retired
+ */
+AM_ATTR_NON_NULL((1)) AM_PUBLIC
+void am_fifo_mpmc_handle_destroy(struct am_fifo_mpmc_handle *handle);
+
+/** @brief Append a value
+ * @return false on allocation failure
+ */
+AM_ATTR_NON_NULL((1)) AM_ATTR_WARN_UNUSED_RESULT AM_PUBLIC
+bool am_fifo_mpmc_enqueue(struct am_fifo_mpmc_handle *handle, void *value);
+
+/** @brief Remove the oldest value
+ * @param value Receives the value
+ * @return false if the queue was empty
+ */
+AM_ATTR_NON_NULL((1, 2)) AM_PUBLIC
+bool am_fifo_mpmc_dequeue(struct am_fifo_mpmc_handle *handle, void **value);
+
+/** @brief Determine if the queue is empty
+ * @note The answer may be stale by the time it is returned
+ */
+AM_ATTR_NON_NULL((1)) AM_PUBLIC
+bool am_fifo_mpmc_is_empty(struct am_fifo_mpmc_handle *handle);
+
+/****************************************************************************/
+
+/** @brief Intrusive node of a single-producer, single-consumer queue */
 struct am_fifo_spsc_entry {
     void *value;
+    struct am_fifo_spsc_entry *next;
+};
+
+/** @brief Single-producer, single-consumer queue
+ * The queue always holds one dummy entry. Entries dequeued by the consumer
+ * stay linked behind the head, from where the producer takes them back
+ * with am_fifo_spsc_recycle, so no atomic read-modify-write is needed
+ */
+struct am_fifo_spsc {
+    /* Consumer */
+    struct am_fifo_spsc_entry *head AM_ATTR_ALIGNED(AM_CACHELINE);
+    /* Producer */
+    struct am_fifo_spsc_entry *tail AM_ATTR_ALIGNED(AM_CACHELINE);
+    struct am_fifo_spsc_entry *head_snapshot; /* Last head seen by the producer */
+    struct am_fifo_spsc_entry *garbage;       /* Oldest consumed entry */
 };
 
+/** @brief Initialize a queue
+ * @param stub Initial dummy entry, owned by the queue from now on
+ */
+AM_ATTR_NON_NULL((1, 2))
+static AM_INLINE
+void am_fifo_spsc_init(struct am_fifo_spsc *fifo, struct am_fifo_spsc_entry *stub)
+{
+    stub->value = NULL;
+    stub->next = NULL;
+    fifo->head = stub;
+    fifo->tail = stub;
+    fifo->head_snapshot = stub;
+    fifo->garbage = stub;
+}
+
+/** @brief Tear down a queue
+ * @param garbage Receives every entry owned by the queue, linked through
+ *   their 'next' fields, for the caller to free
+ */
+AM_ATTR_NON_NULL((1, 2))
+static AM_INLINE
+void am_fifo_spsc_deinit(struct am_fifo_spsc *fifo, struct am_fifo_spsc_entry **garbage)
+{
+    *garbage = fifo->garbage;
+    fifo->head = fifo->tail = fifo->head_snapshot = fifo->garbage = NULL;
+}
+
+/** @brief Append a value
+ * @param entry Unused entry, either fresh or from am_fifo_spsc_recycle
+ * @note Producer only
+ */
+AM_ATTR_NON_NULL((1, 2))
+static AM_INLINE
+void am_fifo_spsc_enqueue(struct am_fifo_spsc *fifo, struct am_fifo_spsc_entry *entry, void *value)
+{
+    entry->value = value;
+    entry->next = NULL;
+    /* The consumer sees the entry's contents before the entry */
+    am_atomic_store_ptr_explicit((void **)&fifo->tail->next, entry, AM_MEMORY_ORDER_RELEASE);
+    fifo->tail = entry;
+}
+
+/** @brief Remove the oldest value
+ * @param value Receives the value
+ * @return false if the queue was empty
+ * @note Consumer only
+ */
+AM_ATTR_NON_NULL((1, 2))
+static AM_INLINE
+bool am_fifo_spsc_dequeue(struct am_fifo_spsc *fifo, void **value)
+{
+    struct am_fifo_spsc_entry *entry;
+
+    entry = am_atomic_load_ptr_explicit((void **)&fifo->head->next, AM_MEMORY_ORDER_ACQUIRE);
+    if (entry == NULL) {
+        return false;
+    }
+    *value = entry->value;
+    /* The producer may reuse the old head once it sees the new one */
+    am_atomic_store_ptr_explicit((void **)&fifo->head, entry, AM_MEMORY_ORDER_RELEASE);
+    return true;
+}
+
+/** @brief Take back an entry the consumer is done with
+ * @return An entry for am_fifo_spsc_enqueue, or NULL if none is available
+ * @note Producer only
+ */
+AM_ATTR_NON_NULL((1))
+static AM_INLINE
+struct am_fifo_spsc_entry *am_fifo_spsc_recycle(struct am_fifo_spsc *fifo)
+{
+    struct am_fifo_spsc_entry *entry;
+
+    if (fifo->head_snapshot == fifo->garbage) {
+        fifo->head_snapshot = am_atomic_load_ptr_explicit((void **)&fifo->head, AM_MEMORY_ORDER_ACQUIRE);
+        if (fifo->head_snapshot == fifo->garbage) {
+            return NULL;
+        }
+    }
+
+    entry = fifo->garbage;
+    fifo->garbage = entry->next;
+    return entry;
+}
+
+/** @brief Determine if the queue is empty
+ * @note Consumer only
+ */
+AM_ATTR_NON_NULL((1))
+static AM_INLINE
+bool am_fifo_spsc_is_empty(struct am_fifo_spsc *fifo)
+{
+    return am_atomic_load_ptr_explicit((void **)&fifo->head->next, AM_MEMORY_ORDER_ACQUIRE) == NULL;
+}
+
 #endif /* ifndef AM_CONCURRENT_FIFO_H */
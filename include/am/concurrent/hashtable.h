@@ -1,3 +1,32 @@
+/** @file am/concurrent/hashtable.h
+ * @brief Single-writer, multiple-reader open-addressing hashtable
+ *
+ * Modeled after ConcurrencyKit's ck_ht:
+ * - Any number of readers may call am_hashtable_get concurrently with
+ *   one writer, without locks
+ * - Probe sequences are bounded by the longest probe ever needed by the writer
+ * - Deleted entries leave tombstones behind, which am_hashtable_gc compacts
+ *
+ * Resizing is incremental: the old map is kept alongside the new one, and
+ * every write moves a bounded number of its buckets over. Readers consult
+ * both maps until the migration completes. Tables grow at 50% load, and
+ * shrink (or are rebuilt in place) once tombstones dominate.
+ *
+ * Maps replaced by a resize are retired, not freed, since readers may still
+ * be probing them. They are released by am_hashtable_reclaim or
+ * am_hashtable_destroy, or handed to an epoch (am/concurrent/epoch.h) by
+ * am_hashtable_reclaim_deferred when readers use epoch sections. Readers
+ * which use am_hashtable_get_hazard instead pin only the maps they probe,
+ * and retired maps go through am_hashtable_reclaim_hazard.
+ *
+ * In AM_HASHTABLE_MODE_INLINE, keys of up to AM_HASHTABLE_INLINE_KEY_MAX
+ * bytes are copied into the slot itself, so a lookup compares them without
+ * leaving the slot's cacheline. Longer keys are stored by pointer, as in
+ * AM_HASHTABLE_MODE_BYTESTRING.
+ *
+ * @note This header shares the am_hashtable_ prefix with am/data/hashtable.h,
+ * so the two should not be included in the same translation unit
+ */
 
 #ifndef AM_LOCKFREE_HASHTABLE_H
 #define AM_LOCKFREE_HASHTABLE_H 1
@@ -11,7 +40,8 @@
 
 enum am_hashtable_mode {
     AM_HASHTABLE_MODE_DIRECT,
-    AM_HASHTABLE_MODE_BYTESTRING
+    AM_HASHTABLE_MODE_BYTESTRING,
+    AM_HASHTABLE_MODE_INLINE
 };
 
 struct am_hashtable_entry {
@@ -21,23 +51,42 @@ struct am_hashtable_entry {
     uintptr_t hash;
 } /* __attribute__((aligned(32))) */;
 
+/** @brief Longest key stored within the slot in AM_HASHTABLE_MODE_INLINE */
+#define AM_HASHTABLE_INLINE_KEY_MAX 32
+
+/** @brief Slot layout of AM_HASHTABLE_MODE_INLINE tables
+ * @note Entries returned by am_hashtable_next point at the inline copy of
+ *   the key, which is only valid until the entry is removed
+ */
+struct am_hashtable_entry_inline {
+    struct am_hashtable_entry entry;
+    uintptr_t key_inline[AM_HASHTABLE_INLINE_KEY_MAX / sizeof(uintptr_t)];
+} AM_ATTR_ALIGNED(AM_CACHELINE);
+
 #define AM_HASHTABLE_KEY_EMPTY     ((uintptr_t)0)
 #define AM_HASHTABLE_KEY_TOMBSTONE (~((uintptr_t)0))
 
 typedef uint64_t am_hashtable_hash_fn(const void *data, size_t len, uint64_t seed);
 
 struct am_hashtable_map;
+struct am_epoch_record;
+struct am_hazard_record;
 struct am_hashtable {
     struct am_alloc *allocator;
     struct am_hashtable_map *map;
+    struct am_hashtable_map *migrating; /* Map being drained into 'map' by a resize */
+    uintptr_t migrate_cursor;           /* Next slot of 'migrating' to move */
+    struct am_hashtable_map *retired;   /* Replaced maps, pending reclamation */
     unsigned mode;
     uint64_t seed;
     am_hashtable_hash_fn *hash_fn;
 };
 
 struct am_hashtable_stat {
-    uint64_t probe_maximum;
-    uint64_t num_entries;
+    uint64_t probe_maximum;      /**< Longest probe sequence in the active map */
+    uint64_t num_entries;        /**< Number of live entries */
+    uint64_t migration_progress; /**< Slots of the previous map migrated so far */
+    uint64_t migration_total;    /**< Slots in the previous map, or 0 if not resizing */
 };
 
 struct am_hashtable_iterator {
@@ -140,4 +189,161 @@ void am_hashtable_entry_set_direct(
     entry->hash  = hash;
 }
 
+/****************************************************************************/
+
+/** @brief Initialize a hashtable
+ * @param ht The hashtable handle
+ * @param mode AM_HASHTABLE_MODE_DIRECT for word-sized keys,
+ *   AM_HASHTABLE_MODE_BYTESTRING for pointer + length keys,
+ *   AM_HASHTABLE_MODE_INLINE for pointer + length keys copied into short slots
+ * @param hash_fn Hash function, or NULL for the default
+ * @param allocator Allocator used for the entry maps
+ * @param initial_size Initial number of entries to reserve space for
+ * @param seed Seed passed to the hash function
+ * @return false on allocation failure
+ * @note In direct mode, the keys AM_HASHTABLE_KEY_EMPTY and
+ *   AM_HASHTABLE_KEY_TOMBSTONE are reserved
+ */
+AM_ATTR_NON_NULL((1, 4)) AM_ATTR_WARN_UNUSED_RESULT AM_PUBLIC
+bool am_hashtable_init(
+        struct am_hashtable *ht,
+        enum am_hashtable_mode mode,
+        am_hashtable_hash_fn *hash_fn,
+        struct am_alloc *allocator,
+        uint64_t initial_size,
+        uint64_t seed);
+
+/** @brief Deallocate a hashtable, including any retired maps */
+AM_ATTR_NON_NULL((1)) AM_PUBLIC
+void am_hashtable_destroy(struct am_hashtable *ht);
+
+/** @brief Hash a bytestring key */
+AM_ATTR_NON_NULL((1)) AM_PUBLIC
+uint64_t am_hashtable_hash(const struct am_hashtable *ht, const void *key, uint16_t key_length);
+
+/** @brief Hash a direct key */
+AM_ATTR_NON_NULL((1)) AM_PUBLIC
+uint64_t am_hashtable_hash_direct(const struct am_hashtable *ht, uintptr_t key);
+
+/** @brief Look up an entry
+ * @param ht The hashtable handle
+ * @param hash The hash of the key
+ * @param entry Holds the key to search for, and receives the entry on success
+ * @return true if the key was found
+ * @note Safe to call concurrently with a writer
+ */
+AM_ATTR_NON_NULL((1, 3)) AM_PUBLIC
+bool am_hashtable_get(struct am_hashtable *ht, uint64_t hash, struct am_hashtable_entry *entry);
+
+/** @brief Look up many entries, overlapping their cache misses
+ * The keys are hashed and their home slots prefetched a group at a time,
+ * then resolved as by am_hashtable_get
+ * @param entries Hold the keys to search for, and receive the entries found;
+ *   their hashes are filled in
+ * @param found Receives, for each entry, whether its key was found
+ * @param n Number of entries
+ * @return The number of keys found
+ * @note Safe to call concurrently with a writer
+ */
+AM_ATTR_NON_NULL((1)) AM_PUBLIC
+size_t am_hashtable_get_batch(struct am_hashtable *ht, struct am_hashtable_entry *entries, bool *found, size_t n);
+
+/** @brief Number of hazard slots needed by am_hashtable_get_hazard */
+#define AM_HASHTABLE_HAZARD_SLOTS 2
+
+/** @brief Look up an entry, protecting the maps probed with hazard pointers
+ * @param record The reader's hazard record, slots 0 and 1 are used
+ * @see am_hashtable_get
+ */
+AM_ATTR_NON_NULL((1, 2, 4)) AM_PUBLIC
+bool am_hashtable_get_hazard(
+        struct am_hashtable *ht,
+        struct am_hazard_record *record,
+        uint64_t hash,
+        struct am_hashtable_entry *entry);
+
+/** @brief Insert an entry, if the key is not already present
+ * @return false if the key exists or allocation failed
+ * @note Writer only
+ */
+AM_ATTR_NON_NULL((1, 3)) AM_PUBLIC
+bool am_hashtable_put(struct am_hashtable *ht, uint64_t hash, struct am_hashtable_entry *entry);
+
+/** @brief Insert or replace an entry
+ * @param entry The entry to insert, receives the replaced entry (if any)
+ * @return false if allocation failed
+ * @note Writer only. Check am_hashtable_entry_empty to see if a value was replaced
+ */
+AM_ATTR_NON_NULL((1, 3)) AM_PUBLIC
+bool am_hashtable_set(struct am_hashtable *ht, uint64_t hash, struct am_hashtable_entry *entry);
+
+/** @brief Remove an entry
+ * @param entry Holds the key to remove, and receives the removed entry
+ * @return false if the key was not present
+ * @note Writer only
+ */
+AM_ATTR_NON_NULL((1, 3)) AM_PUBLIC
+bool am_hashtable_remove(struct am_hashtable *ht, uint64_t hash, struct am_hashtable_entry *entry);
+
+/** @brief Move entries into tombstones earlier in their probe sequence
+ * If a resize is in progress, the cycles are spent migrating instead
+ * @param cycles Number of entries to visit, or 0 for the whole map
+ * @param seed Offset to begin at, for incremental collection
+ * @return false if the collection was cut short
+ * @note Writer only
+ */
+AM_ATTR_NON_NULL((1)) AM_PUBLIC
+bool am_hashtable_gc(struct am_hashtable *ht, uint64_t cycles, uint64_t seed);
+
+/** @brief Resize the hashtable to hold at least @p capacity entries
+ * The entries are migrated by subsequent writes, or by am_hashtable_gc
+ * @note Writer only
+ */
+AM_ATTR_NON_NULL((1)) AM_ATTR_WARN_UNUSED_RESULT AM_PUBLIC
+bool am_hashtable_grow(struct am_hashtable *ht, uint64_t capacity);
+
+/** @brief Remove all entries
+ * @note Writer only
+ */
+AM_ATTR_NON_NULL((1)) AM_ATTR_WARN_UNUSED_RESULT AM_PUBLIC
+bool am_hashtable_reset(struct am_hashtable *ht);
+
+/** @brief Free maps retired by resizing
+ * @note Writer only, and no reader may be accessing the table
+ */
+AM_ATTR_NON_NULL((1)) AM_PUBLIC
+void am_hashtable_reclaim(struct am_hashtable *ht);
+
+/** @brief Free maps retired by resizing once readers are done with them
+ * @param record The writer's epoch record. Readers must access the table
+ *   within am_epoch_begin/am_epoch_end sections of the same epoch
+ * @note Writer only
+ */
+AM_ATTR_NON_NULL((1, 2)) AM_PUBLIC
+void am_hashtable_reclaim_deferred(struct am_hashtable *ht, struct am_epoch_record *record);
+
+/** @brief Retire maps replaced by resizing to a hazard pointer domain
+ * @param record The writer's hazard record. Readers must use am_hashtable_get_hazard
+ * @note Writer only
+ */
+AM_ATTR_NON_NULL((1, 2)) AM_PUBLIC
+void am_hashtable_reclaim_hazard(struct am_hashtable *ht, struct am_hazard_record *record);
+
+/** @brief Number of entries in the hashtable */
+AM_ATTR_NON_NULL((1)) AM_PUBLIC
+uint64_t am_hashtable_count(struct am_hashtable *ht);
+
+/** @brief Collect statistics about the hashtable */
+AM_ATTR_NON_NULL((1, 2)) AM_PUBLIC
+void am_hashtable_stat(struct am_hashtable *ht, struct am_hashtable_stat *st);
+
+/** @brief Iterate over the entries of the hashtable
+ * @param it An iterator initialized with am_hashtable_iterator_init
+ * @param entry Receives a pointer to the next entry
+ * @return false when there are no more entries
+ * @note Not safe to call concurrently with a writer
+ */
+AM_ATTR_NON_NULL((1, 2, 3)) AM_PUBLIC
+bool am_hashtable_next(struct am_hashtable *ht, struct am_hashtable_iterator *it, struct am_hashtable_entry **entry);
+
 #endif /* ifndef AM_LOCKFREE_HASHTABLE_H */
@@ -0,0 +1,152 @@
+/** @file am/concurrent/hashtable_sharded.h
+ * @brief Multiple-writer hashtable built from independently locked shards
+ *
+ * Keys are partitioned by the high bits of their hash into a power-of-2
+ * number of shards. Each shard is a single-writer am_hashtable guarded by
+ * its own mutex, and lives on its own cachelines, so writers to different
+ * shards never contend. Open addressing within a shard uses the low bits
+ * of the hash, which stay independent of the shard index.
+ *
+ * Readers take no locks: lookups go straight to the shard's table, with the
+ * same guarantees as am_hashtable_get. Maps retired by a shard's resizes
+ * must be reclaimed with one of the am_hashtable_sharded_reclaim functions.
+ *
+ * @note Shares the am_hashtable_ prefix with am/data/hashtable.h
+ */
+
+#ifndef AM_CONCURRENT_HASHTABLE_SHARDED_H
+#define AM_CONCURRENT_HASHTABLE_SHARDED_H 1
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "am/macros.h"
+#include "am/alloc.h"
+#include "am/threads.h"
+#include "am/concurrent/hashtable.h"
+
+/** @brief A single shard, padded to avoid false sharing with its neighbours */
+struct am_hashtable_shard {
+    am_mutex lock;
+    struct am_hashtable table;
+    unsigned long n_writes;    /* Writes performed, protected by 'lock' */
+    unsigned long n_contended; /* Writes that found 'lock' taken */
+} AM_ATTR_ALIGNED(AM_CACHELINE);
+
+struct am_hashtable_sharded {
+    struct am_hashtable_shard *shards;
+    unsigned shard_bits; /* log2 of the number of shards */
+    struct am_alloc *allocator;
+    void *alloc_base;
+    size_t alloc_size;
+};
+
+/** @brief Statistics of a single shard */
+struct am_hashtable_shard_stat {
+    struct am_hashtable_stat table; /**< Statistics of the shard's table */
+    unsigned long n_writes;         /**< Successful and failed writes */
+    unsigned long n_contended;      /**< Writes which had to wait for the lock */
+};
+
+/** @brief Number of shards in a table */
+AM_ATTR_NON_NULL((1))
+static AM_INLINE
+unsigned am_hashtable_sharded_count_shards(const struct am_hashtable_sharded *sh)
+{
+    return 1U << sh->shard_bits;
+}
+
+/** @brief Shard responsible for a hash */
+AM_ATTR_NON_NULL((1))
+static AM_INLINE
+struct am_hashtable_shard *am_hashtable_sharded_shard(const struct am_hashtable_sharded *sh, uint64_t hash)
+{
+    if (sh->shard_bits == 0) {
+        return &sh->shards[0];
+    }
+    return &sh->shards[hash >> (64 - sh->shard_bits)];
+}
+
+/****************************************************************************/
+
+/** @brief Initialize a sharded hashtable
+ * @param n_shards Number of shards, rounded up to a power of 2
+ * @param initial_size Initial number of entries to reserve space for, in total
+ * @see am_hashtable_init for the remaining parameters
+ * @return false on allocation failure
+ */
+AM_ATTR_NON_NULL((1, 4)) AM_ATTR_WARN_UNUSED_RESULT AM_PUBLIC
+bool am_hashtable_sharded_init(
+        struct am_hashtable_sharded *sh,
+        enum am_hashtable_mode mode,
+        am_hashtable_hash_fn *hash_fn,
+        struct am_alloc *allocator,
+        unsigned n_shards,
+        uint64_t initial_size,
+        uint64_t seed);
+
+/** @brief Deallocate a sharded hashtable */
+AM_ATTR_NON_NULL((1)) AM_PUBLIC
+void am_hashtable_sharded_destroy(struct am_hashtable_sharded *sh);
+
+/** @brief Hash a bytestring key */
+AM_ATTR_NON_NULL((1, 2)) AM_PUBLIC
+uint64_t am_hashtable_sharded_hash(const struct am_hashtable_sharded *sh, const void *key, uint16_t key_length);
+
+/** @brief Hash a direct key */
+AM_ATTR_NON_NULL((1)) AM_PUBLIC
+uint64_t am_hashtable_sharded_hash_direct(const struct am_hashtable_sharded *sh, uintptr_t key);
+
+/** @brief Look up an entry without locking
+ * @see am_hashtable_get
+ */
+AM_ATTR_NON_NULL((1, 3)) AM_PUBLIC
+bool am_hashtable_sharded_get(struct am_hashtable_sharded *sh, uint64_t hash, struct am_hashtable_entry *entry);
+
+/** @brief Insert an entry, locking its shard
+ * @see am_hashtable_put
+ */
+AM_ATTR_NON_NULL((1, 3)) AM_PUBLIC
+bool am_hashtable_sharded_put(struct am_hashtable_sharded *sh, uint64_t hash, struct am_hashtable_entry *entry);
+
+/** @brief Insert or replace an entry, locking its shard
+ * @see am_hashtable_set
+ */
+AM_ATTR_NON_NULL((1, 3)) AM_PUBLIC
+bool am_hashtable_sharded_set(struct am_hashtable_sharded *sh, uint64_t hash, struct am_hashtable_entry *entry);
+
+/** @brief Remove an entry, locking its shard
+ * @see am_hashtable_remove
+ */
+AM_ATTR_NON_NULL((1, 3)) AM_PUBLIC
+bool am_hashtable_sharded_remove(struct am_hashtable_sharded *sh, uint64_t hash, struct am_hashtable_entry *entry);
+
+/** @brief Compact every shard, one at a time
+ * @see am_hashtable_gc
+ */
+AM_ATTR_NON_NULL((1)) AM_PUBLIC
+bool am_hashtable_sharded_gc(struct am_hashtable_sharded *sh, uint64_t cycles, uint64_t seed);
+
+/** @brief Free the maps retired by every shard
+ * @note No reader may be accessing the table
+ */
+AM_ATTR_NON_NULL((1)) AM_PUBLIC
+void am_hashtable_sharded_reclaim(struct am_hashtable_sharded *sh);
+
+/** @brief Defer freeing the maps retired by every shard to an epoch
+ * @see am_hashtable_reclaim_deferred
+ */
+AM_ATTR_NON_NULL((1, 2)) AM_PUBLIC
+void am_hashtable_sharded_reclaim_deferred(struct am_hashtable_sharded *sh, struct am_epoch_record *record);
+
+/** @brief Total number of entries, possibly stale */
+AM_ATTR_NON_NULL((1)) AM_PUBLIC
+uint64_t am_hashtable_sharded_count(struct am_hashtable_sharded *sh);
+
+/** @brief Statistics of one shard
+ * @param shard Index of the shard, below am_hashtable_sharded_count_shards
+ */
+AM_ATTR_NON_NULL((1, 3)) AM_PUBLIC
+void am_hashtable_sharded_stat(struct am_hashtable_sharded *sh, unsigned shard, struct am_hashtable_shard_stat *st);
+
+#endif /* ifndef AM_CONCURRENT_HASHTABLE_SHARDED_H */
@@ -0,0 +1,150 @@
+/** @file am/concurrent/hazard.h
+ * @brief Hazard-pointer memory reclamation
+ *
+ * Modeled after ConcurrencyKit's ck_hp. Each thread publishes the pointers
+ * it is about to dereference in a few hazard slots. Retired objects are kept
+ * on a per-thread list, which is scanned against every published hazard
+ * once it reaches the domain's threshold. Unlike epochs, a stalled reader
+ * only pins the objects it protects, so retired memory stays bounded by
+ * threshold + (records * slots) per thread.
+ */
+
+#ifndef AM_CONCURRENT_HAZARD_H
+#define AM_CONCURRENT_HAZARD_H 1
+
+#include <stddef.h>
+#include <stdbool.h>
+#include "am/macros.h"
+#include "am/atomic.h"
+#include "am/alloc.h"
+
+struct am_hazard_entry;
+/** @brief Callback run once no hazard protects the entry's pointer */
+typedef void am_hazard_cb(struct am_hazard_entry *entry);
+
+/** @brief Intrusive member of a retired object */
+struct am_hazard_entry {
+    am_hazard_cb *fn;
+    void *ptr; /* The pointer readers protect */
+    struct am_hazard_entry *next;
+};
+
+/** @brief Hazard pointer domain */
+struct am_hazard {
+    struct am_hazard_record *records; /* Lock-free stack, records are never removed */
+    struct am_alloc *allocator;       /* Must be threadsafe */
+    unsigned n_slots;                 /* Hazard slots per record */
+    unsigned threshold;               /* Retired objects before a scan */
+    am_atomic_uint n_records;
+};
+
+/** @brief Per-thread hazard state */
+struct am_hazard_record {
+    struct am_hazard *global;
+    struct am_hazard_record *next;
+    am_atomic_uint in_use;
+    struct am_hazard_entry *retired;
+    void **scan;      /* Buffer for the hazards gathered by a scan, kept between scans */
+    size_t scan_cap;
+    unsigned n_retired;
+    unsigned long n_reclaimed;
+    void *slots[1]; /* Flexible array member emulation */
+};
+
+/** @brief Initialize a hazard pointer domain
+ * @param allocator Threadsafe allocator used for records and am_hazard_free
+ * @param n_slots Number of hazard slots per thread
+ * @param threshold Number of retired objects which triggers a scan
+ */
+AM_ATTR_NON_NULL((1, 2)) AM_PUBLIC
+void am_hazard_init(struct am_hazard *hp, struct am_alloc *allocator, unsigned n_slots, unsigned threshold);
+
+/** @brief Deallocate all records, running any callbacks still pending
+ * @note No thread may be using the domain
+ */
+AM_ATTR_NON_NULL((1)) AM_PUBLIC
+void am_hazard_destroy(struct am_hazard *hp);
+
+/** @brief Obtain a record for the calling thread
+ * @return A record, possibly recycled along with its retired objects, or NULL
+ */
+AM_ATTR_NON_NULL((1)) AM_ATTR_WARN_UNUSED_RESULT AM_PUBLIC
+struct am_hazard_record *am_hazard_register(struct am_hazard *hp);
+
+/** @brief Release a record
+ * Objects which are still protected stay with the record for its next owner
+ */
+AM_ATTR_NON_NULL((1)) AM_PUBLIC
+void am_hazard_unregister(struct am_hazard_record *record);
+
+/** @brief Publish a hazard
+ * @note The pointer must be validated after publishing, see am_hazard_protect
+ */
+AM_ATTR_NON_NULL((1))
+static AM_INLINE
+void am_hazard_set(struct am_hazard_record *record, unsigned slot, void *ptr)
+{
+    /* Release: replacing a hazard ends the reads made under the old one, like clearing it */
+    am_atomic_store_ptr_explicit(&record->slots[slot], ptr, AM_MEMORY_ORDER_RELEASE);
+    /* Scanners must see the hazard before we re-read the source */
+    am_atomic_thread_fence(AM_MEMORY_ORDER_SEQ_CST);
+}
+
+/** @brief Drop a hazard */
+AM_ATTR_NON_NULL((1))
+static AM_INLINE
+void am_hazard_clear(struct am_hazard_record *record, unsigned slot)
+{
+    am_atomic_store_ptr_explicit(&record->slots[slot], NULL, AM_MEMORY_ORDER_RELEASE);
+}
+
+/** @brief Load a shared pointer and protect it
+ * @param src The shared location
+ * @return The protected pointer, which stays valid until the slot is cleared
+ */
+AM_ATTR_NON_NULL((1, 3))
+static AM_INLINE
+void *am_hazard_protect(struct am_hazard_record *record, unsigned slot, void *volatile *src)
+{
+    void *ptr = am_atomic_load_ptr_explicit(src, AM_MEMORY_ORDER_RELAXED);
+
+    for (;;) {
+        void *again;
+
+        am_hazard_set(record, slot, ptr);
+        again = am_atomic_load_ptr_explicit(src, AM_MEMORY_ORDER_ACQUIRE);
+        if (again == ptr) {
+            return ptr;
+        }
+        ptr = again;
+    }
+}
+
+/** @brief Retire an unlinked object
+ * @param entry Intrusive entry of the object
+ * @param ptr The pointer readers protect for this object
+ * @param fn Called once no hazard protects @p ptr
+ */
+AM_ATTR_NON_NULL((1, 2, 4)) AM_PUBLIC
+void am_hazard_retire(struct am_hazard_record *record, struct am_hazard_entry *entry, void *ptr, am_hazard_cb *fn);
+
+/** @brief Retire memory, freeing it through the domain's allocator
+ * @note If no memory is available to record the retirement, this waits
+ *   until the pointer is unprotected and frees immediately
+ */
+AM_ATTR_NON_NULL((1)) AM_PUBLIC
+void am_hazard_free(struct am_hazard_record *record, void *ptr, size_t size);
+
+/** @brief Scan the hazards, running callbacks for unprotected retired objects
+ * @return The number of objects reclaimed
+ */
+AM_ATTR_NON_NULL((1)) AM_PUBLIC
+unsigned am_hazard_reclaim(struct am_hazard_record *record);
+
+/** @brief Reclaim until the retired list is empty
+ * @note Blocks while other threads protect retired objects
+ */
+AM_ATTR_NON_NULL((1)) AM_PUBLIC
+void am_hazard_purge(struct am_hazard_record *record);
+
+#endif /* ifndef AM_CONCURRENT_HAZARD_H */
@@ -0,0 +1,149 @@
+/** @file am/concurrent/llist.h
+ * @brief Intrusive lock-free list for handing entries to one consumer
+ *
+ * Modeled after Linux's llist. Any number of threads may add entries, or
+ * chains of entries, with a single compare and swap each. The consumer takes
+ * the whole list at once with an atomic exchange, which is immune to ABA,
+ * and walks it privately.
+ *
+ * Entries come out newest first; am_llist_reverse turns a taken chain into
+ * the order it was added in. Unlike am_stack, no double-width compare and
+ * swap is needed, since entries are never removed one at a time while
+ * producers race (except through am_llist_del_first, see there).
+ */
+
+#ifndef AM_CONCURRENT_LLIST_H
+#define AM_CONCURRENT_LLIST_H 1
+
+#include <stddef.h>
+#include <stdbool.h>
+#include "am/macros.h"
+#include "am/atomic.h"
+
+/** @brief Intrusive member of a list entry */
+struct am_llist_node {
+    struct am_llist_node *next;
+};
+
+/** @brief The head of the list */
+struct am_llist_head {
+    struct am_llist_node *first;
+};
+
+/** @brief Initializer for struct am_llist_head */
+#define AM_LLIST_HEAD_INITIALIZER { NULL }
+
+/** @brief Iterate over a chain of entries returned by am_llist_del_all
+ * @param it 'struct am_llist_node *' to use as iterator
+ * @param first The first entry of the chain
+ */
+#define am_llist_foreach(it, first) \
+    for ((it) = (first); (it) != NULL; (it) = (it)->next)
+
+/** @brief Iterate over a chain of entries, safe to freeing them
+ * @param it 'struct am_llist_node *' to use as iterator
+ * @param tmp 'struct am_llist_node *' to use as temporary
+ * @param first The first entry of the chain
+ */
+#define am_llist_foreach_safe(it, tmp, first) \
+    for ((it) = (first); (it) != NULL && ((tmp) = (it)->next, true); (it) = (tmp))
+
+/****************************************************************************/
+
+/** @brief Initialize a list */
+AM_ATTR_NON_NULL((1))
+static AM_INLINE
+void am_llist_head_init(struct am_llist_head *head)
+{
+    head->first = NULL;
+}
+
+/** @brief Determine if a list is empty
+ * @note The answer may be stale by the time it is returned
+ */
+AM_ATTR_NON_NULL((1))
+static AM_INLINE
+bool am_llist_is_empty(struct am_llist_head *head)
+{
+    return am_atomic_load_ptr_explicit((void **)&head->first, AM_MEMORY_ORDER_RELAXED) == NULL;
+}
+
+/** @brief Add a chain of entries, already linked through their 'next' fields
+ * @param first The entry which ends up first
+ * @param last The last entry of the chain, whose 'next' is overwritten
+ * @return true if the list was empty, ie. the consumer may need waking up
+ */
+AM_ATTR_NON_NULL((1, 2, 3))
+static AM_INLINE
+bool am_llist_add_batch(struct am_llist_head *head, struct am_llist_node *first, struct am_llist_node *last)
+{
+    struct am_llist_node *old = am_atomic_load_ptr_explicit((void **)&head->first, AM_MEMORY_ORDER_RELAXED);
+
+    do {
+        last->next = old;
+    } while (!am_atomic_cas_ptr_explicit((void **)&head->first, (void **)&old, first,
+                AM_MEMORY_ORDER_RELEASE, AM_MEMORY_ORDER_RELAXED));
+    return old == NULL;
+}
+
+/** @brief Add an entry
+ * @return true if the list was empty
+ */
+AM_ATTR_NON_NULL((1, 2))
+static AM_INLINE
+bool am_llist_add(struct am_llist_head *head, struct am_llist_node *node)
+{
+    return am_llist_add_batch(head, node, node);
+}
+
+/** @brief Take every entry at once
+ * @return The entries, newest first and linked through 'next', or NULL
+ */
+AM_ATTR_NON_NULL((1))
+static AM_INLINE
+struct am_llist_node *am_llist_del_all(struct am_llist_head *head)
+{
+    if (am_llist_is_empty(head)) {
+        return NULL;
+    }
+    return am_atomic_exchange_ptr_explicit((void **)&head->first, NULL, AM_MEMORY_ORDER_ACQUIRE);
+}
+
+/** @brief Take the newest entry
+ * @return The entry, or NULL if the list was empty
+ * @note Only one thread may take entries, through this or am_llist_del_all:
+ *   then 'first' can't be removed and re-added between being read and
+ *   swapped out. Producers may still add concurrently
+ */
+AM_ATTR_NON_NULL((1))
+static AM_INLINE
+struct am_llist_node *am_llist_del_first(struct am_llist_head *head)
+{
+    struct am_llist_node *first = am_atomic_load_ptr_explicit((void **)&head->first, AM_MEMORY_ORDER_ACQUIRE);
+
+    while (first != NULL && !am_atomic_cas_ptr_explicit((void **)&head->first, (void **)&first, first->next,
+                AM_MEMORY_ORDER_ACQUIRE, AM_MEMORY_ORDER_ACQUIRE)) {
+    }
+    return first;
+}
+
+/** @brief Reverse a chain of entries taken from a list
+ * Turns the newest-first chain of am_llist_del_all into insertion order
+ * @return The new first entry
+ */
+static AM_INLINE
+struct am_llist_node *am_llist_reverse(struct am_llist_node *first)
+{
+    struct am_llist_node *reversed = NULL;
+
+    while (first != NULL) {
+        struct am_llist_node *next = first->next;
+
+        first->next = reversed;
+        reversed = first;
+        first = next;
+    }
+    return reversed;
+}
+
+#endif /* ifndef AM_CONCURRENT_LLIST_H */
@@ -0,0 +1,139 @@
+/** @file am/concurrent/pool.h
+ * @brief Work-stealing thread pool
+ *
+ * Each worker owns a Chase-Lev deque: it pushes and pops tasks at the
+ * bottom, while idle workers steal from the top of a randomly chosen
+ * victim. Tasks spawned from threads outside the pool go through a shared
+ * injection queue. Workers which find nothing to run park on a condition
+ * variable until more work is spawned.
+ *
+ * Tasks are intrusive, and their memory is owned by the caller.
+ * Dependencies are expressed with continuations: a task may name a
+ * continuation, which runs once every one of its children has finished, on
+ * the thread which finished the last one. Continuations are never spawned
+ * directly. A continuation without a function is a join point, which
+ * am_pool_join waits on. Threads waiting in am_pool_join run other tasks in
+ * the meantime, so joining from within a task doesn't deadlock.
+ *
+ * Example:
+ *   struct am_task done, a, b;
+ *   am_task_init(&done, NULL, NULL);
+ *   am_task_add_children(&done, 2);
+ *   am_task_init(&a, work_a, &done);
+ *   am_task_init(&b, work_b, &done);
+ *   am_pool_spawn(pool, &a);
+ *   am_pool_spawn(pool, &b);
+ *   am_pool_join(pool, &done);
+ */
+
+#ifndef AM_CONCURRENT_POOL_H
+#define AM_CONCURRENT_POOL_H 1
+
+#include <stddef.h>
+#include <stdbool.h>
+#include "am/macros.h"
+#include "am/atomic.h"
+#include "am/alloc.h"
+#include "am/threads.h"
+
+struct am_task;
+/** @brief Body of a task
+ * Once called, the task's memory belongs to the function again, which may
+ * free it; the pool no longer touches it, except through its continuation
+ */
+typedef void am_task_fn(struct am_task *task);
+
+/** @brief Intrusive member of a task */
+struct am_task {
+    am_task_fn *fn;
+    struct am_task *continuation; /* Released once this task has run */
+    struct am_task *next;         /* Link in the injection queue */
+    am_atomic_uint pending;       /* Children still to finish */
+};
+
+/** @brief Body of a parallel for-loop, called on sub-ranges [lo, hi) */
+typedef void am_pool_for_fn(size_t lo, size_t hi, void *ud);
+
+struct am_pool_worker;
+struct am_pool {
+    struct am_alloc *allocator;
+    struct am_pool_worker *workers; /* Cacheline-aligned within workers_base */
+    void *workers_base;
+    unsigned n_workers;
+    am_tss current;            /* The calling thread's worker, if any */
+
+    am_mutex lock;             /* Protects the injection queue and parking */
+    am_cond wakeup;
+    struct am_task *inject_head;
+    struct am_task *inject_tail;
+    am_atomic_uint n_injected;
+    am_atomic_uint n_sleeping;
+    am_atomic_int stop;
+};
+
+/** @brief Initialize a task
+ * @param fn The task's body, or NULL for a join point
+ * @param continuation Task released once this one has run, or NULL
+ * @note The continuation's children must be counted with
+ *   am_task_add_children before this task is spawned
+ */
+AM_ATTR_NON_NULL((1))
+static AM_INLINE
+void am_task_init(struct am_task *task, am_task_fn *fn, struct am_task *continuation)
+{
+    task->fn = fn;
+    task->continuation = continuation;
+    task->next = NULL;
+    am_atomic_init_uint(&task->pending, 0);
+}
+
+/** @brief Count more children which must finish before a continuation runs
+ * @note May be called by a running child to add siblings, since the
+ *   continuation can't run before that child finishes
+ */
+AM_ATTR_NON_NULL((1))
+static AM_INLINE
+void am_task_add_children(struct am_task *task, unsigned n)
+{
+    am_atomic_fetch_add_uint_explicit(&task->pending, n, AM_MEMORY_ORDER_RELAXED);
+}
+
+/****************************************************************************/
+
+/** @brief Start a pool
+ * @param allocator Threadsafe allocator for the deques and internal tasks
+ * @param n_workers Number of worker threads, or 0 for one per online CPU
+ * @return false on failure
+ */
+AM_ATTR_NON_NULL((1, 2)) AM_ATTR_WARN_UNUSED_RESULT AM_PUBLIC
+bool am_pool_init(struct am_pool *pool, struct am_alloc *allocator, unsigned n_workers);
+
+/** @brief Stop the workers and deallocate the pool
+ * @note Tasks which haven't started are dropped
+ */
+AM_ATTR_NON_NULL((1)) AM_PUBLIC
+void am_pool_destroy(struct am_pool *pool);
+
+/** @brief Schedule a task
+ * From a worker, the task is pushed onto the worker's own deque; from any
+ * other thread, onto the injection queue
+ * @return false on allocation failure, when a deque can't grow
+ */
+AM_ATTR_NON_NULL((1, 2)) AM_ATTR_WARN_UNUSED_RESULT AM_PUBLIC
+bool am_pool_spawn(struct am_pool *pool, struct am_task *task);
+
+/** @brief Wait until every child of a task has finished, running other tasks meanwhile
+ * @note A continuation with a function runs on the thread which finished its
+ *   last child, possibly after this returns, so only join points may be
+ *   reused right away
+ */
+AM_ATTR_NON_NULL((1, 2)) AM_PUBLIC
+void am_pool_join(struct am_pool *pool, struct am_task *task);
+
+/** @brief Run fn over [begin, end), split recursively into ranges of at most 'grain'
+ * The caller helps run the loop, and returns once it is complete
+ */
+AM_ATTR_NON_NULL((1, 5)) AM_PUBLIC
+void am_pool_parallel_for(struct am_pool *pool, size_t begin, size_t end, size_t grain, am_pool_for_fn *fn, void *ud);
+
+#endif /* ifndef AM_CONCURRENT_POOL_H */
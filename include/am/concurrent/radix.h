@@ -0,0 +1,109 @@
+/** @file am/concurrent/radix.h
+ * @brief Radix tree keyed by integers, with lock-free readers
+ *
+ * A compact radix tree in the style of Linux's xarray: every node has 64
+ * slots indexed by 6 bits of the key, the root is only as tall as the
+ * largest key requires, and empty nodes are removed as soon as their last
+ * entry is. Dense keys, such as file offsets or descriptor numbers, share
+ * nodes, so a lookup is a handful of dependent loads without hashing.
+ *
+ * Each node keeps a bitmap of its non-empty slots, so finding the next
+ * present key skips empty slots with a count of trailing zeros rather than
+ * scanning pointers. am_radix_find and am_radix_foreach_range build range
+ * iteration on top of it.
+ *
+ * Any number of threads may look up and iterate concurrently with one
+ * writer; writers must be serialized by the caller. Nodes are allocated
+ * from the tree's allocator, and removed nodes are reclaimed through epochs
+ * (am/concurrent/epoch.h), so every operation takes the calling thread's
+ * epoch record. Values are opaque non-NULL pointers, owned by the caller.
+ */
+
+#ifndef AM_CONCURRENT_RADIX_H
+#define AM_CONCURRENT_RADIX_H 1
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "am/macros.h"
+#include "am/alloc.h"
+#include "am/concurrent/epoch.h"
+
+/** @brief Key bits consumed by each level */
+#define AM_RADIX_BITS 6
+/** @brief Slots per node */
+#define AM_RADIX_SLOTS (1 << AM_RADIX_BITS)
+
+struct am_radix_node;
+struct am_radix {
+    struct am_alloc *allocator; /* Must be threadsafe */
+    struct am_radix_node *root;
+    size_t count;
+};
+
+/** @brief Initialize an empty tree, which allocates on first insertion
+ * @param allocator Threadsafe allocator for the nodes
+ */
+AM_ATTR_NON_NULL((1, 2)) AM_PUBLIC
+void am_radix_init(struct am_radix *tree, struct am_alloc *allocator);
+
+/** @brief Free every node
+ * @note No thread may be using the tree. Removed nodes still pending in an
+ *   epoch are freed by the epoch
+ */
+AM_ATTR_NON_NULL((1)) AM_PUBLIC
+void am_radix_destroy(struct am_radix *tree);
+
+/** @brief Number of entries
+ * @note Only exact for the writer
+ */
+AM_ATTR_NON_NULL((1))
+static AM_INLINE size_t am_radix_count(const struct am_radix *tree)
+{
+    return tree->count;
+}
+
+/** @brief Look up a key
+ * @return The key's value, or NULL if the key is not present
+ */
+AM_ATTR_NON_NULL((1, 2)) AM_PUBLIC
+void *am_radix_get(struct am_radix *tree, struct am_epoch_record *record, uintptr_t index);
+
+/** @brief Find the first present key in [*index, last]
+ * Keys inserted or removed during the search may or may not be seen
+ * @param index Key to start from, receives the key found
+ * @param value Receives the key's value, may be NULL
+ * @return false if there is no such key
+ */
+AM_ATTR_NON_NULL((1, 2, 3)) AM_PUBLIC
+bool am_radix_find(struct am_radix *tree, struct am_epoch_record *record, uintptr_t *index, uintptr_t last, void **value);
+
+/** @brief Iterate over the present keys in [first, last], in increasing order
+ * @param it uintptr_t variable, receives each key
+ * @param value void * variable, receives each value
+ */
+#define am_radix_foreach_range(tree, record, it, value, first, last) \
+    for (bool am__radix_more = ((it) = (first), true); \
+            am__radix_more && am_radix_find((tree), (record), &(it), (last), &(value)); \
+            am__radix_more = (it)++ != (last))
+
+/** @brief Insert or replace a key
+ * @param value Non-NULL value
+ * @return false on allocation failure
+ * @note Writer only. Must not be called within a read-side section of
+ *   @p record, since emptied nodes are handed to am_epoch_call on failure
+ */
+AM_ATTR_NON_NULL((1, 2, 4)) AM_ATTR_WARN_UNUSED_RESULT AM_PUBLIC
+bool am_radix_set(struct am_radix *tree, struct am_epoch_record *record, uintptr_t index, void *value);
+
+/** @brief Remove a key
+ * Emptied nodes are removed, and the tree is shortened while its root only
+ * holds the lowest keys
+ * @return The removed value, or NULL if the key was not present
+ * @note Writer only. Must not be called within a read-side section of
+ *   @p record, since removed nodes are handed to am_epoch_call
+ */
+AM_ATTR_NON_NULL((1, 2)) AM_PUBLIC
+void *am_radix_erase(struct am_radix *tree, struct am_epoch_record *record, uintptr_t index);
+
+#endif /* ifndef AM_CONCURRENT_RADIX_H */
@@ -9,8 +9,6 @@
 #include "am/macros.h"
 #include "am/atomic.h"
 
-#define AM_CACHELINE 64
-
 struct am_ring {
     am_atomic_uint c_head;
     /* char _pad[AM_CACHELINE - sizeof(am_atomic_uint)]; */
@@ -0,0 +1,96 @@
+/** @file am/concurrent/skiplist.h
+ * @brief Lock-free ordered map
+ *
+ * A skip list after Fraser, and Herlihy and Shavit: every level is a sorted
+ * linked list, and a node is removed by marking the low bit of its 'next'
+ * pointers from the top level down. The mark on the bottom level decides
+ * which remover wins; traversals which run into marked nodes unlink them.
+ * Any number of threads may insert, remove, look up and iterate
+ * concurrently.
+ *
+ * Keys are unsigned 64-bit integers, such as timestamps, ordered by value.
+ * Each node's tower is allocated in one piece from the list's allocator,
+ * with a height derived from a hash of its key.
+ *
+ * Removed nodes are reclaimed through epochs (am/concurrent/epoch.h): every
+ * operation takes the calling thread's epoch record. Lookups and iteration
+ * only read shared memory, so readers never write to a shared cacheline.
+ */
+
+#ifndef AM_CONCURRENT_SKIPLIST_H
+#define AM_CONCURRENT_SKIPLIST_H 1
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "am/macros.h"
+#include "am/alloc.h"
+#include "am/concurrent/epoch.h"
+
+/** @brief Tallest tower, enough for about 4^24 keys */
+#define AM_SKIPLIST_MAX_HEIGHT 24
+
+struct am_skiplist_node;
+struct am_skiplist {
+    struct am_alloc *allocator; /* Must be threadsafe */
+    struct am_skiplist_node *head;
+    uint64_t seed;              /* Salts tower heights */
+};
+
+struct am_skiplist_iterator {
+    struct am_skiplist_node *node;
+};
+
+/** @brief Initialize a skip list
+ * @param allocator Threadsafe allocator for the towers
+ * @return false on allocation failure
+ */
+AM_ATTR_NON_NULL((1, 2)) AM_ATTR_WARN_UNUSED_RESULT AM_PUBLIC
+bool am_skiplist_init(struct am_skiplist *list, struct am_alloc *allocator);
+
+/** @brief Free every node
+ * @note No thread may be using the list. Removed nodes still pending in an
+ *   epoch are freed by the epoch
+ */
+AM_ATTR_NON_NULL((1)) AM_PUBLIC
+void am_skiplist_destroy(struct am_skiplist *list);
+
+/** @brief Look up a key
+ * @param value Receives the key's value, may be NULL
+ * @return false if the key is not present
+ */
+AM_ATTR_NON_NULL((1, 2)) AM_PUBLIC
+bool am_skiplist_get(struct am_skiplist *list, struct am_epoch_record *record, uint64_t key, void **value);
+
+/** @brief Insert a key, if not already present
+ * @return false if the key exists or allocation failed
+ */
+AM_ATTR_NON_NULL((1, 2)) AM_PUBLIC
+bool am_skiplist_put(struct am_skiplist *list, struct am_epoch_record *record, uint64_t key, void *value);
+
+/** @brief Remove a key
+ * @param value Receives the removed value, may be NULL
+ * @return false if the key was not present
+ * @note Must not be called within a read-side section of @p record, since
+ *   the node is handed to am_epoch_call
+ */
+AM_ATTR_NON_NULL((1, 2)) AM_PUBLIC
+bool am_skiplist_remove(struct am_skiplist *list, struct am_epoch_record *record, uint64_t key, void **value);
+
+/** @brief Position an iterator at the first key not less than @p lower
+ * @note The iterator is only valid within a read-side section, which must
+ *   span the whole iteration
+ */
+AM_ATTR_NON_NULL((1, 2)) AM_PUBLIC
+void am_skiplist_seek(struct am_skiplist *list, struct am_skiplist_iterator *it, uint64_t lower);
+
+/** @brief Advance an iterator, in increasing key order
+ * Keys inserted or removed during the iteration may or may not be seen
+ * @param key Receives the key
+ * @param value Receives the value, may be NULL
+ * @return false once past the last key
+ */
+AM_ATTR_NON_NULL((1, 2)) AM_PUBLIC
+bool am_skiplist_next(struct am_skiplist_iterator *it, uint64_t *key, void **value);
+
+#endif /* ifndef AM_CONCURRENT_SKIPLIST_H */
@@ -0,0 +1,221 @@
+/** @file am/concurrent/stack.h
+ * @brief Intrusive lock-free LIFO stack
+ *
+ * A Treiber stack, modeled after ConcurrencyKit's ck_stack. Any number of
+ * threads may push and pop concurrently. Pushes only swing the head
+ * pointer, which is ABA-safe on its own. Pops tag the head with a
+ * generation, bumped by each pop, and swap both with a double-width
+ * compare and swap, so a popper holding a stale head can't succeed once
+ * that head has been popped and pushed again.
+ *
+ * Where no double-width compare and swap is available (see
+ * AM_ATOMIC_HAVE_CAS_DWORD), poppers are serialized by a flag instead,
+ * while pushes stay lock-free.
+ *
+ * @note A popper may read the 'next' field of an entry that has just been
+ *   popped by another thread, so entries must stay mapped while the stack
+ *   is in use (ie. come from a pool or free list)
+ */
+
+#ifndef AM_CONCURRENT_STACK_H
+#define AM_CONCURRENT_STACK_H 1
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "am/macros.h"
+#include "am/atomic.h"
+#include "am/threads.h"
+
+/** @brief Intrusive member of a stack entry */
+struct am_stack_entry {
+    struct am_stack_entry *next;
+};
+
+struct am_stack {
+    struct am_stack_entry *head;
+    uintptr_t generation; /* Bumped by every pop */
+#ifndef AM_ATOMIC_HAVE_CAS_DWORD
+    am_atomic_int popping; /* Held by the only thread allowed to pop */
+#endif
+} AM_ATTR_ALIGNED(2 * sizeof(void *));
+
+/** @brief Initializer for struct am_stack */
+#ifdef AM_ATOMIC_HAVE_CAS_DWORD
+# define AM_STACK_INITIALIZER { NULL, 0 }
+#else
+# define AM_STACK_INITIALIZER { NULL, 0, { 0 } }
+#endif
+
+/** @brief Iterate over a chain of entries returned by am_stack_pop_all
+ * @param it 'struct am_stack_entry *' to use as iterator
+ * @param first The first entry of the chain
+ */
+#define am_stack_foreach(it, first) \
+    for ((it) = (first); (it) != NULL; (it) = (it)->next)
+
+/** @brief Iterate over a chain of entries, safe to freeing them
+ * @param it 'struct am_stack_entry *' to use as iterator
+ * @param tmp 'struct am_stack_entry *' to use as temporary
+ * @param first The first entry of the chain
+ */
+#define am_stack_foreach_safe(it, tmp, first) \
+    for ((it) = (first); (it) != NULL && ((tmp) = (it)->next, true); (it) = (tmp))
+
+/****************************************************************************/
+
+/** @brief Initialize a stack */
+AM_ATTR_NON_NULL((1))
+static AM_INLINE
+void am_stack_init(struct am_stack *stack)
+{
+    stack->head = NULL;
+    stack->generation = 0;
+#ifndef AM_ATOMIC_HAVE_CAS_DWORD
+    am_atomic_init_int(&stack->popping, 0);
+#endif
+}
+
+/** @brief Determine if a stack is empty
+ * @note The answer may be stale by the time it is returned
+ */
+AM_ATTR_NON_NULL((1))
+static AM_INLINE
+bool am_stack_is_empty(struct am_stack *stack)
+{
+    return am_atomic_load_ptr_explicit((void **)&stack->head, AM_MEMORY_ORDER_RELAXED) == NULL;
+}
+
+/** @brief Push a chain of entries, already linked through their 'next' fields
+ * @param first The entry which ends up on top
+ * @param last The last entry of the chain, whose 'next' is overwritten
+ */
+AM_ATTR_NON_NULL((1, 2, 3))
+static AM_INLINE
+void am_stack_push_batch(struct am_stack *stack, struct am_stack_entry *first, struct am_stack_entry *last)
+{
+    struct am_stack_entry *head = am_atomic_load_ptr_explicit((void **)&stack->head, AM_MEMORY_ORDER_RELAXED);
+
+    do {
+        last->next = head;
+    } while (!am_atomic_cas_ptr_explicit((void **)&stack->head, (void **)&head, first,
+                AM_MEMORY_ORDER_RELEASE, AM_MEMORY_ORDER_RELAXED));
+}
+
+/** @brief Push an entry */
+AM_ATTR_NON_NULL((1, 2))
+static AM_INLINE
+void am_stack_push(struct am_stack *stack, struct am_stack_entry *entry)
+{
+    am_stack_push_batch(stack, entry, entry);
+}
+
+#ifdef AM_ATOMIC_HAVE_CAS_DWORD
+
+/** @brief Pop the top entry
+ * @return The entry, or NULL if the stack was empty
+ */
+AM_ATTR_NON_NULL((1))
+static AM_INLINE
+struct am_stack_entry *am_stack_pop(struct am_stack *stack)
+{
+    uintptr_t expected[2], desired[2];
+
+    expected[1] = am_atomic_load_uintptr_explicit(&stack->generation, AM_MEMORY_ORDER_ACQUIRE);
+    expected[0] = (uintptr_t)am_atomic_load_ptr_explicit((void **)&stack->head, AM_MEMORY_ORDER_ACQUIRE);
+    for (;;) {
+        struct am_stack_entry *head = (struct am_stack_entry *)expected[0];
+
+        if (head == NULL) {
+            return NULL;
+        }
+        /* Stale if 'head' was popped meanwhile, which the generation catches */
+        desired[0] = (uintptr_t)am_atomic_load_ptr_explicit((void **)&head->next, AM_MEMORY_ORDER_RELAXED);
+        desired[1] = expected[1] + 1;
+        if (am_atomic_cas_dword((volatile uintptr_t *)stack, expected, desired)) {
+            return head;
+        }
+    }
+}
+
+/** @brief Pop every entry at once
+ * @return The former top of the stack, linked through 'next', or NULL
+ */
+AM_ATTR_NON_NULL((1))
+static AM_INLINE
+struct am_stack_entry *am_stack_pop_all(struct am_stack *stack)
+{
+    uintptr_t expected[2], desired[2];
+
+    expected[1] = am_atomic_load_uintptr_explicit(&stack->generation, AM_MEMORY_ORDER_ACQUIRE);
+    expected[0] = (uintptr_t)am_atomic_load_ptr_explicit((void **)&stack->head, AM_MEMORY_ORDER_ACQUIRE);
+    do {
+        if (expected[0] == 0) {
+            return NULL;
+        }
+        /* A concurrent am_stack_pop must see the head change, even if it is pushed back */
+        desired[0] = 0;
+        desired[1] = expected[1] + 1;
+    } while (!am_atomic_cas_dword((volatile uintptr_t *)stack, expected, desired));
+    return (struct am_stack_entry *)expected[0];
+}
+
+#else /* ifdef AM_ATOMIC_HAVE_CAS_DWORD */
+
+AM_ATTR_NON_NULL((1))
+static AM_INLINE
+void am__stack_pop_lock(struct am_stack *stack)
+{
+    int unlocked = 0;
+
+    while (!am_atomic_cas_int_explicit(&stack->popping, &unlocked, 1,
+                AM_MEMORY_ORDER_ACQUIRE, AM_MEMORY_ORDER_RELAXED)) {
+        unlocked = 0;
+        am_thread_yield();
+    }
+}
+
+AM_ATTR_NON_NULL((1))
+static AM_INLINE
+void am__stack_pop_unlock(struct am_stack *stack)
+{
+    am_atomic_store_int_explicit(&stack->popping, 0, AM_MEMORY_ORDER_RELEASE);
+}
+
+AM_ATTR_NON_NULL((1))
+static AM_INLINE
+struct am_stack_entry *am_stack_pop(struct am_stack *stack)
+{
+    struct am_stack_entry *head, *next;
+
+    am__stack_pop_lock(stack);
+    head = am_atomic_load_ptr_explicit((void **)&stack->head, AM_MEMORY_ORDER_ACQUIRE);
+    do {
+        if (head == NULL) {
+            break;
+        }
+        /* Only pushes race with us, and they never unlink 'head' */
+        next = head->next;
+    } while (!am_atomic_cas_ptr_explicit((void **)&stack->head, (void **)&head, next,
+                AM_MEMORY_ORDER_ACQUIRE, AM_MEMORY_ORDER_ACQUIRE));
+    am__stack_pop_unlock(stack);
+    return head;
+}
+
+AM_ATTR_NON_NULL((1))
+static AM_INLINE
+struct am_stack_entry *am_stack_pop_all(struct am_stack *stack)
+{
+    struct am_stack_entry *head = am_atomic_load_ptr_explicit((void **)&stack->head, AM_MEMORY_ORDER_ACQUIRE);
+
+    am__stack_pop_lock(stack);
+    while (head != NULL && !am_atomic_cas_ptr_explicit((void **)&stack->head, (void **)&head, NULL,
+                AM_MEMORY_ORDER_ACQUIRE, AM_MEMORY_ORDER_ACQUIRE)) {
+    }
+    am__stack_pop_unlock(stack);
+    return head;
+}
+
+#endif /* ifdef AM_ATOMIC_HAVE_CAS_DWORD */
+
+#endif /* ifndef AM_CONCURRENT_STACK_H */
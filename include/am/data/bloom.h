@@ -0,0 +1,315 @@
+/** @file am/data/bloom.h
+ * @brief Cacheline-blocked Bloom filter
+ *
+ * A split block Bloom filter: the filter is an array of cacheline-sized
+ * blocks of eight 64-bit words, and each key sets one bit in every word of
+ * a single block. A query therefore costs one cache miss, however many
+ * bits are tested, rather than one per probe as in a classic Bloom filter,
+ * in exchange for a slightly higher false positive rate at the same size.
+ *
+ * Everything is derived from one 64-bit hash of the key: the high half
+ * picks the block, and the low half, multiplied by eight odd constants,
+ * gives the bit within each word. Keys are hashed with am_bloom_hash, or
+ * the caller passes its own well-mixed hash (such as am_hash_fmix64 of an
+ * integer) to the _hash variants.
+ *
+ * With AVX2, the eight bit positions are computed in one 256-bit multiply,
+ * and the eight words are set and tested as two 256-bit halves; otherwise a
+ * scalar loop does the same. Define AM_BLOOM_NO_SIMD before including to
+ * use the scalar loop even when AVX2 is available. The two produce
+ * identical filters.
+ *
+ * The batch functions prefetch the blocks of upcoming keys, so lookups of
+ * many keys overlap their cache misses.
+ */
+
+#ifndef AM_DATA_BLOOM_H
+#define AM_DATA_BLOOM_H 1
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "am/macros.h"
+#include "am/alloc.h"
+#include "am/data/hash.h"
+
+#if defined(__AVX2__) && !defined(AM_BLOOM_NO_SIMD)
+# include <immintrin.h>
+# define AM_BLOOM_AVX2 1
+#endif
+
+/** @brief Words per block, each receiving one bit per key */
+#define AM_BLOOM_WORDS 8
+/** @brief Bytes per block */
+#define AM_BLOOM_BLOCK_SIZE (AM_BLOOM_WORDS * 8)
+/** @brief How many keys ahead the batch functions prefetch */
+#define AM_BLOOM_PREFETCH_DISTANCE 8
+
+struct am_bloom_block {
+    uint64_t words[AM_BLOOM_WORDS];
+};
+
+struct am_bloom {
+    struct am_alloc *allocator;
+    struct am_bloom_block *blocks; /* Aligned to AM_CACHELINE within 'storage' */
+    void *storage;
+    size_t num_blocks;
+    size_t count;                  /* Insertions, including repeats */
+};
+
+/* One odd multiplier per word */
+static const uint32_t am__bloom_salt[AM_BLOOM_WORDS] = {
+    UINT32_C(0x47b6137b), UINT32_C(0x44974d91), UINT32_C(0x8824ad5b), UINT32_C(0xa2b7289d),
+    UINT32_C(0x705495c7), UINT32_C(0x2df1424b), UINT32_C(0x9efc4947), UINT32_C(0x5c6bfb31)
+};
+
+/** @brief Hash a key for the filter */
+static AM_INLINE
+uint64_t am_bloom_hash(const void *key, unsigned len)
+{
+    return am_hash_fmix64(am_hash_fnva1_64(key, len));
+}
+
+/** @brief Initialize an empty filter sized for @p num_keys keys
+ * @param bits_per_key Filter bits per expected key, 10 for about 1% false positives
+ * @return false on allocation failure
+ */
+AM_ATTR_NON_NULL((1, 2)) AM_ATTR_WARN_UNUSED_RESULT
+static AM_INLINE
+bool am_bloom_init(struct am_bloom *bloom, struct am_alloc *allocator, size_t num_keys, unsigned bits_per_key)
+{
+    size_t bits = AM_MAX(num_keys, (size_t)1) * bits_per_key;
+    size_t num_blocks = AM_MAX((bits + AM_BLOOM_BLOCK_SIZE * 8 - 1) / (AM_BLOOM_BLOCK_SIZE * 8), (size_t)1);
+    uintptr_t aligned;
+
+    bloom->allocator = allocator;
+    bloom->storage = am_malloc(allocator, num_blocks * AM_BLOOM_BLOCK_SIZE + AM_CACHELINE - 1);
+    if (bloom->storage == NULL) {
+        return false;
+    }
+    aligned = ((uintptr_t)bloom->storage + AM_CACHELINE - 1) & ~(uintptr_t)(AM_CACHELINE - 1);
+    bloom->blocks = (struct am_bloom_block *)aligned;
+    bloom->num_blocks = num_blocks;
+    bloom->count = 0;
+    memset(bloom->blocks, 0, num_blocks * AM_BLOOM_BLOCK_SIZE);
+    return true;
+}
+
+/** @brief Free the filter's storage */
+AM_ATTR_NON_NULL((1))
+static AM_INLINE
+void am_bloom_destroy(struct am_bloom *bloom)
+{
+    am_free(bloom->allocator, bloom->storage, bloom->num_blocks * AM_BLOOM_BLOCK_SIZE + AM_CACHELINE - 1);
+    bloom->storage = NULL;
+    bloom->blocks = NULL;
+    bloom->num_blocks = 0;
+}
+
+/** @brief Remove every key */
+AM_ATTR_NON_NULL((1))
+static AM_INLINE
+void am_bloom_clear(struct am_bloom *bloom)
+{
+    memset(bloom->blocks, 0, bloom->num_blocks * AM_BLOOM_BLOCK_SIZE);
+    bloom->count = 0;
+}
+
+/** @brief Size of the filter, in bytes */
+AM_ATTR_NON_NULL((1))
+static AM_INLINE
+size_t am_bloom_size(const struct am_bloom *bloom)
+{
+    return bloom->num_blocks * AM_BLOOM_BLOCK_SIZE;
+}
+
+/* The block for a hash, by multiply-shift of its high half */
+static AM_INLINE
+struct am_bloom_block *am__bloom_block(const struct am_bloom *bloom, uint64_t hash)
+{
+    return &bloom->blocks[((hash >> 32) * (uint64_t)bloom->num_blocks) >> 32];
+}
+
+#ifdef AM_BLOOM_AVX2
+
+/* The bits to set in words 0-3 and 4-7 */
+static AM_INLINE
+void am__bloom_mask(uint64_t hash, __m256i *lo, __m256i *hi)
+{
+    const __m256i salt = _mm256_loadu_si256((const __m256i *)am__bloom_salt);
+    const __m256i one = _mm256_set1_epi64x(1);
+    __m256i bits = _mm256_mullo_epi32(_mm256_set1_epi32((int)(uint32_t)hash), salt);
+
+    bits = _mm256_srli_epi32(bits, 26);
+    *lo = _mm256_sllv_epi64(one, _mm256_cvtepu32_epi64(_mm256_castsi256_si128(bits)));
+    *hi = _mm256_sllv_epi64(one, _mm256_cvtepu32_epi64(_mm256_extracti128_si256(bits, 1)));
+}
+
+static AM_INLINE
+void am__bloom_block_add(struct am_bloom_block *block, uint64_t hash)
+{
+    __m256i *words = (__m256i *)block->words;
+    __m256i lo, hi;
+
+    am__bloom_mask(hash, &lo, &hi);
+    _mm256_store_si256(&words[0], _mm256_or_si256(_mm256_load_si256(&words[0]), lo));
+    _mm256_store_si256(&words[1], _mm256_or_si256(_mm256_load_si256(&words[1]), hi));
+}
+
+static AM_INLINE
+bool am__bloom_block_contains(const struct am_bloom_block *block, uint64_t hash)
+{
+    const __m256i *words = (const __m256i *)block->words;
+    __m256i lo, hi;
+
+    am__bloom_mask(hash, &lo, &hi);
+    /* Whether every bit of the masks is set in the words */
+    return (_mm256_testc_si256(_mm256_load_si256(&words[0]), lo)
+            & _mm256_testc_si256(_mm256_load_si256(&words[1]), hi)) != 0;
+}
+
+#else /* ifdef AM_BLOOM_AVX2 */
+
+static AM_INLINE
+void am__bloom_block_add(struct am_bloom_block *block, uint64_t hash)
+{
+    int i;
+
+    for (i = 0; i < AM_BLOOM_WORDS; i++) {
+        block->words[i] |= UINT64_C(1) << (((uint32_t)hash * am__bloom_salt[i]) >> 26);
+    }
+}
+
+static AM_INLINE
+bool am__bloom_block_contains(const struct am_bloom_block *block, uint64_t hash)
+{
+    uint64_t missing = 0;
+    int i;
+
+    /* No early exit: the block is in one cacheline, and this vectorizes */
+    for (i = 0; i < AM_BLOOM_WORDS; i++) {
+        missing |= ~block->words[i] & (UINT64_C(1) << (((uint32_t)hash * am__bloom_salt[i]) >> 26));
+    }
+    return missing == 0;
+}
+
+#endif /* ifdef AM_BLOOM_AVX2 */
+
+/** @brief Add a key by its hash */
+AM_ATTR_NON_NULL((1))
+static AM_INLINE
+void am_bloom_add_hash(struct am_bloom *bloom, uint64_t hash)
+{
+    am__bloom_block_add(am__bloom_block(bloom, hash), hash);
+    bloom->count++;
+}
+
+/** @brief Test a key by its hash
+ * @return false if the key was never added; true if it probably was
+ */
+AM_ATTR_NON_NULL((1))
+static AM_INLINE
+bool am_bloom_contains_hash(const struct am_bloom *bloom, uint64_t hash)
+{
+    return am__bloom_block_contains(am__bloom_block(bloom, hash), hash);
+}
+
+/** @brief Add a key */
+AM_ATTR_NON_NULL((1, 2))
+static AM_INLINE
+void am_bloom_add(struct am_bloom *bloom, const void *key, unsigned len)
+{
+    am_bloom_add_hash(bloom, am_bloom_hash(key, len));
+}
+
+/** @brief Test a key
+ * @return false if the key was never added; true if it probably was
+ */
+AM_ATTR_NON_NULL((1, 2))
+static AM_INLINE
+bool am_bloom_contains(const struct am_bloom *bloom, const void *key, unsigned len)
+{
+    return am_bloom_contains_hash(bloom, am_bloom_hash(key, len));
+}
+
+/** @brief Add many keys by their hashes */
+AM_ATTR_NON_NULL((1, 2))
+static AM_INLINE
+void am_bloom_add_batch(struct am_bloom *bloom, const uint64_t *hashes, size_t n)
+{
+    size_t i;
+
+    for (i = 0; i < n; i++) {
+        if (i + AM_BLOOM_PREFETCH_DISTANCE < n) {
+            AM_PREFETCH(am__bloom_block(bloom, hashes[i + AM_BLOOM_PREFETCH_DISTANCE]));
+        }
+        am__bloom_block_add(am__bloom_block(bloom, hashes[i]), hashes[i]);
+    }
+    bloom->count += n;
+}
+
+/** @brief Test many keys by their hashes
+ * @param results Receives, for each key, whether it was probably added
+ * @return The number of keys which were probably added
+ */
+AM_ATTR_NON_NULL((1, 2, 4))
+static AM_INLINE
+size_t am_bloom_contains_batch(const struct am_bloom *bloom, const uint64_t *hashes, size_t n, bool *results)
+{
+    size_t i, found = 0;
+
+    for (i = 0; i < n; i++) {
+        if (i + AM_BLOOM_PREFETCH_DISTANCE < n) {
+            AM_PREFETCH(am__bloom_block(bloom, hashes[i + AM_BLOOM_PREFETCH_DISTANCE]));
+        }
+        results[i] = am__bloom_block_contains(am__bloom_block(bloom, hashes[i]), hashes[i]);
+        found += results[i];
+    }
+    return found;
+}
+
+/** @brief Fraction of the filter's bits which are set
+ * @note Reads the whole filter
+ */
+AM_ATTR_NON_NULL((1))
+static AM_INLINE
+double am_bloom_fill_ratio(const struct am_bloom *bloom)
+{
+    uint64_t set = 0;
+    size_t b;
+    int i;
+
+    for (b = 0; b < bloom->num_blocks; b++) {
+        for (i = 0; i < AM_BLOOM_WORDS; i++) {
+            set += (uint64_t)__builtin_popcountll(bloom->blocks[b].words[i]);
+        }
+    }
+    return (double)set / ((double)bloom->num_blocks * AM_BLOOM_BLOCK_SIZE * 8);
+}
+
+/** @brief False positive rate of a query for a key never added
+ * The chance that a random hash finds all its bits set, averaged over the
+ * blocks as they are filled now
+ * @note Reads the whole filter
+ */
+AM_ATTR_NON_NULL((1))
+static AM_INLINE
+double am_bloom_false_positive_rate(const struct am_bloom *bloom)
+{
+    double sum = 0;
+    size_t b;
+    int i;
+
+    for (b = 0; b < bloom->num_blocks; b++) {
+        double p = 1;
+
+        for (i = 0; i < AM_BLOOM_WORDS; i++) {
+            p *= __builtin_popcountll(bloom->blocks[b].words[i]) / 64.0;
+        }
+        sum += p;
+    }
+    return sum / (double)bloom->num_blocks;
+}
+
+#endif /* ifndef AM_DATA_BLOOM_H */
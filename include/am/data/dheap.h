@@ -0,0 +1,182 @@
+/** @file am/data/dheap.h
+ * @brief Typed array-backed 4-ary min-heap
+ *
+ * An implicit heap in which each node has four children, so the tree is
+ * half as deep as a binary heap's, and the children compared when sifting
+ * down sit next to each other, usually in one cacheline. Items are copied
+ * by value into one array, grown by doubling from a struct am_alloc.
+ *
+ * The heap is generated for an item type by AM_DHEAP_DEFINE:
+ *
+ *   static bool event_less(struct event a, struct event b) { return a.when < b.when; }
+ *   AM_DHEAP_DEFINE(eventq, struct event, event_less)
+ *
+ * which defines 'struct eventq' and the functions eventq_init,
+ * eventq_destroy, eventq_size, eventq_reserve, eventq_push, eventq_peek,
+ * eventq_pop and eventq_clear.
+ *
+ * Unlike am_pairing_heap, items have no stable address, so there is no
+ * decrease-key or meld.
+ */
+
+#ifndef AM_DATA_DHEAP_H
+#define AM_DATA_DHEAP_H 1
+
+#include <stddef.h>
+#include <stdbool.h>
+#include "am/macros.h"
+#include "am/alloc.h"
+
+/** @brief Children per node */
+#define AM_DHEAP_ARITY 4
+/** @brief Capacity of the first allocation */
+#define AM_DHEAP_MIN_CAPACITY 16
+
+/****************************************************************************/
+
+/** @brief Define a heap type and its functions
+ * @param name Name of the struct, and prefix of the functions
+ * @param T Item type
+ * @param lessfn 'bool lessfn(T a, T b)', true if @p a comes out first
+ */
+#define AM_DHEAP_DEFINE(name, T, lessfn) \
+    struct name { \
+        struct am_alloc *allocator; \
+        T *items; \
+        size_t size; \
+        size_t capacity; \
+    }; \
+    \
+    /** @brief Initialize an empty heap, which allocates on first push */ \
+    AM_ATTR_NON_NULL((1, 2)) \
+    static AM_INLINE void name##_init(struct name *heap, struct am_alloc *allocator) \
+    { \
+        heap->allocator = allocator; \
+        heap->items = NULL; \
+        heap->size = 0; \
+        heap->capacity = 0; \
+    } \
+    \
+    /** @brief Free the heap's storage */ \
+    AM_ATTR_NON_NULL((1)) \
+    static AM_INLINE void name##_destroy(struct name *heap) \
+    { \
+        if (heap->capacity != 0) { \
+            am_free(heap->allocator, heap->items, heap->capacity * sizeof(T)); \
+        } \
+        name##_init(heap, heap->allocator); \
+    } \
+    \
+    /** @brief Number of items in the heap */ \
+    AM_ATTR_NON_NULL((1)) \
+    static AM_INLINE size_t name##_size(const struct name *heap) \
+    { \
+        return heap->size; \
+    } \
+    \
+    /** @brief Make room for at least @p n items without further allocation \
+     * @return false on allocation failure \
+     */ \
+    AM_ATTR_NON_NULL((1)) \
+    static AM_INLINE bool name##_reserve(struct name *heap, size_t n) \
+    { \
+        size_t capacity = AM_MAX(heap->capacity, (size_t)AM_DHEAP_MIN_CAPACITY); \
+        T *items; \
+        \
+        if (n <= heap->capacity) { \
+            return true; \
+        } \
+        while (capacity < n) { \
+            capacity *= 2; \
+        } \
+        items = am_realloc(heap->allocator, heap->items, heap->capacity * sizeof(T), capacity * sizeof(T)); \
+        if (items == NULL) { \
+            return false; \
+        } \
+        heap->items = items; \
+        heap->capacity = capacity; \
+        return true; \
+    } \
+    \
+    /** @brief Add an item \
+     * @return false on allocation failure \
+     */ \
+    AM_ATTR_NON_NULL((1)) AM_ATTR_WARN_UNUSED_RESULT \
+    static AM_INLINE bool name##_push(struct name *heap, T item) \
+    { \
+        size_t i; \
+        \
+        if (heap->size == heap->capacity && !name##_reserve(heap, heap->size + 1)) { \
+            return false; \
+        } \
+        /* Sift up, moving parents down into the hole */ \
+        i = heap->size++; \
+        while (i > 0) { \
+            size_t parent = (i - 1) / AM_DHEAP_ARITY; \
+            if (!lessfn(item, heap->items[parent])) { \
+                break; \
+            } \
+            heap->items[i] = heap->items[parent]; \
+            i = parent; \
+        } \
+        heap->items[i] = item; \
+        return true; \
+    } \
+    \
+    /** @brief The minimum item, valid until the heap is modified, or NULL */ \
+    AM_ATTR_NON_NULL((1)) \
+    static AM_INLINE T *name##_peek(const struct name *heap) \
+    { \
+        return heap->size != 0 ? &heap->items[0] : NULL; \
+    } \
+    \
+    /** @brief Remove the minimum item \
+     * @param item Receives the item, may be NULL \
+     * @return false if the heap was empty \
+     */ \
+    AM_ATTR_NON_NULL((1)) \
+    static AM_INLINE bool name##_pop(struct name *heap, T *item) \
+    { \
+        size_t i = 0, n; \
+        T last; \
+        \
+        if (heap->size == 0) { \
+            return false; \
+        } \
+        if (item != NULL) { \
+            *item = heap->items[0]; \
+        } \
+        n = --heap->size; \
+        last = heap->items[n]; \
+        /* Sift the last item down from the root, moving the least child up */ \
+        for (;;) { \
+            size_t first = i * AM_DHEAP_ARITY + 1, end, best, c; \
+            \
+            if (first >= n) { \
+                break; \
+            } \
+            end = AM_MIN(first + AM_DHEAP_ARITY, n); \
+            best = first; \
+            for (c = first + 1; c < end; c++) { \
+                if (lessfn(heap->items[c], heap->items[best])) { \
+                    best = c; \
+                } \
+            } \
+            if (!lessfn(heap->items[best], last)) { \
+                break; \
+            } \
+            heap->items[i] = heap->items[best]; \
+            i = best; \
+        } \
+        heap->items[i] = last; \
+        return true; \
+    } \
+    \
+    /** @brief Remove every item, keeping the storage */ \
+    AM_ATTR_NON_NULL((1)) \
+    static AM_INLINE void name##_clear(struct name *heap) \
+    { \
+        heap->size = 0; \
+    }
+
+#endif /* ifndef AM_DATA_DHEAP_H */
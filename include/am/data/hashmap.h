@@ -0,0 +1,429 @@
+/** @file am/data/hashmap.h
+ * @brief Typed open-addressing hashmap, probed a group of slots at a time
+ *
+ * A Swiss table: alongside a flat array of key-value entries, each slot has
+ * a control byte, which is either empty, deleted, or the low 7 bits of the
+ * key's hash. Lookups compare 16 control bytes at once (with SSE2, or with
+ * 64-bit word arithmetic otherwise), so only the keys whose hash bits match
+ * are ever touched. Probing moves between groups quadratically.
+ *
+ * The map is generated for a key and value type by AM_HASHMAP_DEFINE:
+ *
+ *   static uint64_t int_hash(int k) { return am_hash_fmix64(k); }
+ *   static bool int_eq(int a, int b) { return a == b; }
+ *   AM_HASHMAP_DEFINE(intmap, int, double, int_hash, int_eq)
+ *
+ * which defines 'struct intmap', its entry type 'struct intmap_entry', and
+ * the functions intmap_init, intmap_destroy, intmap_get, intmap_set,
+ * intmap_remove, intmap_reserve, intmap_clear, intmap_size and intmap_next.
+ * Keys and values are copied by value. The hash function must mix all 64 bits, since the control byte
+ * and the home slot are taken from different bits.
+ *
+ * Storage (control bytes and entries) is a single allocation from a
+ * struct am_alloc. The map grows once 7/8 of its slots are used.
+ *
+ * Define AM_HASHMAP_NO_SIMD before including to use the portable group
+ * matching even when SSE2 is available.
+ */
+
+#ifndef AM_DATA_HASHMAP_H
+#define AM_DATA_HASHMAP_H 1
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "am/macros.h"
+#include "am/alloc.h"
+
+#if defined(__SSE2__) && !defined(AM_HASHMAP_NO_SIMD)
+# include <emmintrin.h>
+# define AM_HASHMAP_SSE2 1
+#endif
+
+/** @brief Number of control bytes matched at once */
+#define AM_HASHMAP_GROUP 16
+
+/* Control bytes: full slots hold the low 7 bits of the hash */
+#define AM__HASHMAP_EMPTY   ((int8_t)-128) /* 0b10000000 */
+#define AM__HASHMAP_DELETED ((int8_t)-2)   /* 0b11111110 */
+
+/* Bitmask of the bytes in a group, bit i for byte i */
+typedef uint32_t am__hashmap_mask;
+
+#ifdef AM_HASHMAP_SSE2
+
+static AM_INLINE
+am__hashmap_mask am__hashmap_match(const int8_t *group, int8_t h2)
+{
+    __m128i ctrl = _mm_loadu_si128((const __m128i *)group);
+    return (am__hashmap_mask)_mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, _mm_set1_epi8(h2)));
+}
+
+static AM_INLINE
+am__hashmap_mask am__hashmap_match_empty(const int8_t *group)
+{
+    return am__hashmap_match(group, AM__HASHMAP_EMPTY);
+}
+
+/* Empty and deleted bytes are the only ones with the sign bit set */
+static AM_INLINE
+am__hashmap_mask am__hashmap_match_free(const int8_t *group)
+{
+    __m128i ctrl = _mm_loadu_si128((const __m128i *)group);
+    return (am__hashmap_mask)_mm_movemask_epi8(ctrl);
+}
+
+#else /* ifdef AM_HASHMAP_SSE2 */
+
+#define AM__HASHMAP_LSBS UINT64_C(0x0101010101010101)
+#define AM__HASHMAP_MSBS UINT64_C(0x8080808080808080)
+
+static AM_INLINE
+uint64_t am__hashmap_load64(const int8_t *p)
+{
+    uint64_t word;
+
+    memcpy(&word, p, sizeof word);
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    word = __builtin_bswap64(word);
+#endif
+    return word;
+}
+
+/* Gather the top bit of each byte into the low byte */
+static AM_INLINE
+am__hashmap_mask am__hashmap_movemask64(uint64_t msbs)
+{
+    return (am__hashmap_mask)(((msbs & AM__HASHMAP_MSBS) * UINT64_C(0x0002040810204081)) >> 56);
+}
+
+/* Top bit set in each byte equal to 'byte', without false positives */
+static AM_INLINE
+uint64_t am__hashmap_eq64(uint64_t word, int8_t byte)
+{
+    uint64_t x = word ^ (AM__HASHMAP_LSBS * (uint8_t)byte);
+    uint64_t lows = ~AM__HASHMAP_MSBS;
+
+    return ~(((x & lows) + lows) | x | lows);
+}
+
+static AM_INLINE
+am__hashmap_mask am__hashmap_match(const int8_t *group, int8_t h2)
+{
+    return am__hashmap_movemask64(am__hashmap_eq64(am__hashmap_load64(group), h2))
+        | am__hashmap_movemask64(am__hashmap_eq64(am__hashmap_load64(group + 8), h2)) << 8;
+}
+
+static AM_INLINE
+am__hashmap_mask am__hashmap_match_empty(const int8_t *group)
+{
+    return am__hashmap_match(group, AM__HASHMAP_EMPTY);
+}
+
+static AM_INLINE
+am__hashmap_mask am__hashmap_match_free(const int8_t *group)
+{
+    return am__hashmap_movemask64(am__hashmap_load64(group))
+        | am__hashmap_movemask64(am__hashmap_load64(group + 8)) << 8;
+}
+
+#endif /* ifdef AM_HASHMAP_SSE2 */
+
+/** @brief Index of the lowest byte in a non-empty mask */
+static AM_INLINE
+unsigned am__hashmap_mask_first(am__hashmap_mask mask)
+{
+    return (unsigned)__builtin_ctz(mask);
+}
+
+/** @brief Set a control byte, and its mirror past the end of the array
+ * The first group is mirrored so that a group may start at any slot
+ */
+static AM_INLINE
+void am__hashmap_ctrl_set(int8_t *ctrl, size_t mask, size_t i, int8_t h2)
+{
+    ctrl[i] = h2;
+    ctrl[((i - AM_HASHMAP_GROUP) & mask) + AM_HASHMAP_GROUP] = h2;
+}
+
+/** @brief Slots usable before the map grows */
+static AM_INLINE
+size_t am__hashmap_growth(size_t capacity)
+{
+    return capacity - capacity / 8;
+}
+
+static AM_INLINE
+size_t am__hashmap_align(size_t n, size_t align)
+{
+    return (n + align - 1) & ~(align - 1);
+}
+
+/** @brief First slot along the probe sequence which is empty or deleted */
+static AM_INLINE
+size_t am__hashmap_find_free(const int8_t *ctrl, size_t mask, uint64_t hash)
+{
+    size_t pos = (size_t)(hash >> 7) & mask, step = 0;
+    am__hashmap_mask m;
+
+    while ((m = am__hashmap_match_free(ctrl + pos)) == 0) {
+        step += AM_HASHMAP_GROUP;
+        pos = (pos + step) & mask;
+    }
+    return (pos + am__hashmap_mask_first(m)) & mask;
+}
+
+/** @brief Whether a slot can be emptied rather than marked deleted
+ * True unless some group covering the slot has been full, in which case a
+ * probe may have passed over it
+ */
+static AM_INLINE
+bool am__hashmap_can_empty(const int8_t *ctrl, size_t mask, size_t i)
+{
+    am__hashmap_mask after = am__hashmap_match_empty(ctrl + i);
+    am__hashmap_mask before = am__hashmap_match_empty(ctrl + ((i - AM_HASHMAP_GROUP) & mask));
+
+    return after != 0 && before != 0
+        && (unsigned)__builtin_ctz(after)
+            + (unsigned)(__builtin_clz(before) - (32 - AM_HASHMAP_GROUP)) < AM_HASHMAP_GROUP;
+}
+
+/****************************************************************************/
+
+/** @brief Define a hashmap type and its functions
+ * @param name Name of the struct, and prefix of the functions
+ * @param K Key type
+ * @param V Value type
+ * @param hashfn 'uint64_t hashfn(K key)'
+ * @param eqfn 'bool eqfn(K a, K b)'
+ */
+#define AM_HASHMAP_DEFINE(name, K, V, hashfn, eqfn) \
+    struct name##_entry { \
+        K key; \
+        V value; \
+    }; \
+    \
+    struct name { \
+        struct am_alloc *allocator; \
+        int8_t *ctrl; /* capacity + AM_HASHMAP_GROUP control bytes */ \
+        struct name##_entry *entries; \
+        size_t capacity; /* 0, or a power of 2 of at least AM_HASHMAP_GROUP */ \
+        size_t size; \
+        size_t growth_left; /* Empty slots which may still be filled */ \
+    }; \
+    \
+    static AM_INLINE size_t name##__entries_offset(size_t capacity) \
+    { \
+        return am__hashmap_align(capacity + AM_HASHMAP_GROUP, AM_ALIGNOF_TYPE(struct name##_entry)); \
+    } \
+    \
+    static AM_INLINE size_t name##__alloc_size(size_t capacity) \
+    { \
+        return name##__entries_offset(capacity) + capacity * sizeof(struct name##_entry); \
+    } \
+    \
+    /** @brief Initialize an empty map, which allocates on first insertion */ \
+    AM_ATTR_NON_NULL((1, 2)) \
+    static AM_INLINE void name##_init(struct name *map, struct am_alloc *allocator) \
+    { \
+        map->allocator = allocator; \
+        map->ctrl = NULL; \
+        map->entries = NULL; \
+        map->capacity = 0; \
+        map->size = 0; \
+        map->growth_left = 0; \
+    } \
+    \
+    /** @brief Free the map's storage */ \
+    AM_ATTR_NON_NULL((1)) \
+    static AM_INLINE void name##_destroy(struct name *map) \
+    { \
+        if (map->capacity != 0) { \
+            am_free(map->allocator, map->ctrl, name##__alloc_size(map->capacity)); \
+        } \
+        name##_init(map, map->allocator); \
+    } \
+    \
+    /** @brief Number of entries in the map */ \
+    AM_ATTR_NON_NULL((1)) \
+    static AM_INLINE size_t name##_size(const struct name *map) \
+    { \
+        return map->size; \
+    } \
+    \
+    /* Slot holding the key, or map->capacity */ \
+    static AM_INLINE size_t name##__find(const struct name *map, K key, uint64_t hash) \
+    { \
+        const size_t mask = map->capacity - 1; \
+        const int8_t h2 = (int8_t)(hash & 0x7f); \
+        size_t pos = (size_t)(hash >> 7) & mask, step = 0; \
+        \
+        if (map->capacity == 0) { \
+            return 0; \
+        } \
+        for (;;) { \
+            const int8_t *group = map->ctrl + pos; \
+            am__hashmap_mask m = am__hashmap_match(group, h2); \
+            \
+            while (m != 0) { \
+                size_t i = (pos + am__hashmap_mask_first(m)) & mask; \
+                if (AM_LIKELY(eqfn(map->entries[i].key, key))) { \
+                    return i; \
+                } \
+                m &= m - 1; \
+            } \
+            if (am__hashmap_match_empty(group) != 0) { \
+                return map->capacity; \
+            } \
+            step += AM_HASHMAP_GROUP; \
+            pos = (pos + step) & mask; \
+        } \
+    } \
+    \
+    /* Move every entry into fresh storage of the given capacity */ \
+    static AM_INLINE bool name##__resize(struct name *map, size_t capacity) \
+    { \
+        const size_t old_capacity = map->capacity; \
+        int8_t *old_ctrl = map->ctrl; \
+        struct name##_entry *old_entries = map->entries; \
+        char *mem = am_malloc(map->allocator, name##__alloc_size(capacity)); \
+        size_t i; \
+        \
+        if (mem == NULL) { \
+            return false; \
+        } \
+        map->ctrl = (int8_t *)mem; \
+        map->entries = (struct name##_entry *)(mem + name##__entries_offset(capacity)); \
+        map->capacity = capacity; \
+        map->growth_left = am__hashmap_growth(capacity) - map->size; \
+        memset(map->ctrl, AM__HASHMAP_EMPTY, capacity + AM_HASHMAP_GROUP); \
+        \
+        for (i = 0; i < old_capacity; i++) { \
+            if (old_ctrl[i] >= 0) { \
+                uint64_t hash = hashfn(old_entries[i].key); \
+                size_t j = am__hashmap_find_free(map->ctrl, capacity - 1, hash); \
+                am__hashmap_ctrl_set(map->ctrl, capacity - 1, j, (int8_t)(hash & 0x7f)); \
+                map->entries[j] = old_entries[i]; \
+            } \
+        } \
+        if (old_capacity != 0) { \
+            am_free(map->allocator, old_ctrl, name##__alloc_size(old_capacity)); \
+        } \
+        return true; \
+    } \
+    \
+    /** @brief Make room for at least @p n entries without further allocation \
+     * @return false on allocation failure \
+     */ \
+    AM_ATTR_NON_NULL((1)) \
+    static AM_INLINE bool name##_reserve(struct name *map, size_t n) \
+    { \
+        size_t capacity = AM_HASHMAP_GROUP; \
+        \
+        while (am__hashmap_growth(capacity) < n) { \
+            capacity *= 2; \
+        } \
+        return capacity <= map->capacity || name##__resize(map, capacity); \
+    } \
+    \
+    /** @brief Look up a key \
+     * @return Pointer to the key's value, valid until the map is modified, or NULL \
+     */ \
+    AM_ATTR_NON_NULL((1)) \
+    static AM_INLINE V *name##_get(const struct name *map, K key) \
+    { \
+        size_t i = name##__find(map, key, hashfn(key)); \
+        return i < map->capacity ? &map->entries[i].value : NULL; \
+    } \
+    \
+    /** @brief Insert or replace an entry \
+     * @return false on allocation failure \
+     */ \
+    AM_ATTR_NON_NULL((1)) AM_ATTR_WARN_UNUSED_RESULT \
+    static AM_INLINE bool name##_set(struct name *map, K key, V value) \
+    { \
+        const uint64_t hash = hashfn(key); \
+        size_t i = name##__find(map, key, hash); \
+        \
+        if (i < map->capacity) { \
+            map->entries[i].value = value; \
+            return true; \
+        } \
+        if (map->growth_left == 0) { \
+            /* Mostly tombstones: rehash in place rather than grow */ \
+            size_t capacity = map->size <= am__hashmap_growth(map->capacity) / 2 \
+                ? map->capacity : map->capacity * 2; \
+            if (!name##__resize(map, AM_MAX(capacity, (size_t)AM_HASHMAP_GROUP))) { \
+                return false; \
+            } \
+        } \
+        i = am__hashmap_find_free(map->ctrl, map->capacity - 1, hash); \
+        map->growth_left -= map->ctrl[i] == AM__HASHMAP_EMPTY; \
+        am__hashmap_ctrl_set(map->ctrl, map->capacity - 1, i, (int8_t)(hash & 0x7f)); \
+        map->entries[i].key = key; \
+        map->entries[i].value = value; \
+        map->size++; \
+        return true; \
+    } \
+    \
+    /** @brief Remove an entry \
+     * @param value Receives the removed value, may be NULL \
+     * @return false if the key was not present \
+     */ \
+    AM_ATTR_NON_NULL((1)) \
+    static AM_INLINE bool name##_remove(struct name *map, K key, V *value) \
+    { \
+        size_t i = name##__find(map, key, hashfn(key)); \
+        \
+        if (i >= map->capacity) { \
+            return false; \
+        } \
+        if (value != NULL) { \
+            *value = map->entries[i].value; \
+        } \
+        if (am__hashmap_can_empty(map->ctrl, map->capacity - 1, i)) { \
+            am__hashmap_ctrl_set(map->ctrl, map->capacity - 1, i, AM__HASHMAP_EMPTY); \
+            map->growth_left++; \
+        } else { \
+            am__hashmap_ctrl_set(map->ctrl, map->capacity - 1, i, AM__HASHMAP_DELETED); \
+        } \
+        map->size--; \
+        return true; \
+    } \
+    \
+    /** @brief Remove every entry, keeping the storage */ \
+    AM_ATTR_NON_NULL((1)) \
+    static AM_INLINE void name##_clear(struct name *map) \
+    { \
+        if (map->capacity != 0) { \
+            memset(map->ctrl, AM__HASHMAP_EMPTY, map->capacity + AM_HASHMAP_GROUP); \
+        } \
+        map->size = 0; \
+        map->growth_left = am__hashmap_growth(map->capacity); \
+    } \
+    \
+    /** @brief Iterate over the entries, in no particular order \
+     * @param it Cursor, which must start at 0 \
+     * @param key Receives a pointer to the entry's key \
+     * @param value Receives a pointer to the entry's value, may be NULL \
+     * @return false once every entry was visited \
+     * @note The entry under the cursor may be removed during iteration \
+     */ \
+    AM_ATTR_NON_NULL((1, 2, 3)) \
+    static AM_INLINE bool name##_next(const struct name *map, size_t *it, K **key, V **value) \
+    { \
+        while (*it < map->capacity) { \
+            size_t i = (*it)++; \
+            if (map->ctrl[i] >= 0) { \
+                *key = &map->entries[i].key; \
+                if (value != NULL) { \
+                    *value = &map->entries[i].value; \
+                } \
+                return true; \
+            } \
+        } \
+        return false; \
+    }
+
+#endif /* ifndef AM_DATA_HASHMAP_H */
@@ -3,44 +3,289 @@
 #define AM_DATA_HASHTABLE_H 1
 
 #include <stdio.h>
+#include <stdint.h>
+#include <limits.h>
 #include "am/data/hlist.h"
 #include "am/macros.h"
 
+#define AM__HASHTABLE_LONG_BITS (sizeof(unsigned long) * CHAR_BIT)
+
+/* Buckets are followed by a bitmap of those which may be non-empty, so
+ * iterating a sparse table skips over runs of empty buckets */
 #define am_hashtable(bits) \
-    struct { struct am_hlist_head _raw[1 << (bits)]; }
+    struct { \
+        struct am_hlist_head _raw[1 << (bits)]; \
+        unsigned long _occupied[((1 << (bits)) + AM__HASHTABLE_LONG_BITS - 1) / AM__HASHTABLE_LONG_BITS]; \
+    }
+
+/** @brief Intrusive member of an entry which caches its full hash
+ * Chain walks compare the cached hash first, so mismatching entries are
+ * skipped without looking at their keys
+ */
+struct am_hashtable_node {
+    struct am_hlist_node node;
+    unsigned long hash;
+};
 
 /** @brief Initialize a hashtable */
-#define am_hashtable_init(ht) am__hashtable_init((ht)->_raw, AM_ARRAY_SIZE((ht)->_raw))
+#define am_hashtable_init(ht) am__hashtable_init((ht)->_raw, (ht)->_occupied, AM_ARRAY_SIZE((ht)->_raw))
 
 static AM_INLINE
-void am__hashtable_init(struct am_hlist_head *ht, size_t sz)
+void am__hashtable_init(struct am_hlist_head *ht, unsigned long *occupied, size_t sz)
 {
     size_t i;
     for (i = 0; i < sz; i++)
         am_hlist_head_init(&ht[i]);
+    for (i = 0; i < (sz + AM__HASHTABLE_LONG_BITS - 1) / AM__HASHTABLE_LONG_BITS; i++)
+        occupied[i] = 0;
+}
+
+/** @brief Bucket of a key in a table of 'sz' buckets, a power of 2
+ * Fibonacci hashing: the key is multiplied by 2^64 / phi and the top bits
+ * are kept, so keys which only differ in their high bits still spread out,
+ * without a division
+ */
+static AM_INLINE AM_ATTR_CONST
+size_t am__hashtable_index(unsigned long key, size_t sz)
+{
+    if (sz == 1)
+        return 0;
+    return (size_t)(((uint64_t)key * UINT64_C(0x9e3779b97f4a7c15)) >> (64 - __builtin_ctzll(sz)));
+}
+
+/** @brief The bucket holding a key's entries, for reading
+ * @note Nodes must be added through am_hashtable_add or
+ *   am_hashtable_add_hashed, which also mark the bucket in the occupancy
+ *   bitmap. A node linked into the bucket directly is never visited by
+ *   am_hashtable_foreach
+ */
+#define am_hashtable_bucket(ht, key) \
+    (&(ht)->_raw[am__hashtable_index((key), AM_ARRAY_SIZE((ht)->_raw))])
+
+static AM_INLINE
+void am__hashtable_add(
+        struct am_hlist_head *ht,
+        unsigned long *occupied,
+        size_t sz,
+        unsigned long key,
+        struct am_hlist_node *node)
+{
+    size_t i = am__hashtable_index(key, sz);
+
+    am_hlist_add_head(node, &ht[i]);
+    occupied[i / AM__HASHTABLE_LONG_BITS] |= 1UL << (i % AM__HASHTABLE_LONG_BITS);
 }
 
 #define am_hashtable_add(ht, key, node) \
-    am_hlist_add_head(node, &(ht)->_raw[(key) % AM_ARRAY_SIZE((ht)->_raw)])
+    am__hashtable_add((ht)->_raw, (ht)->_occupied, AM_ARRAY_SIZE((ht)->_raw), (key), (node))
+
+/** @brief Add a node which caches its hash, see am_hashtable_foreach_possible_hashed */
+#define am_hashtable_add_hashed(ht, hash_, hnode) \
+    do { \
+        struct am_hashtable_node *am__hnode = (hnode); \
+        am__hnode->hash = (hash_); \
+        am_hashtable_add((ht), am__hnode->hash, &am__hnode->node); \
+    } while (0)
+
+/** @brief Iterate over the nodes which may hold a key
+ * @param ht The hashtable to search
+ * @param key The key, as passed to am_hashtable_add
+ * @param it 'struct am_hlist_node *' to use as iterator
+ */
+#define am_hashtable_foreach_possible(ht, key, it) \
+    am_hlist_foreach(it, am_hashtable_bucket((ht), (key)))
+
+/* First node from 'node' on whose cached hash matches */
+static AM_INLINE
+struct am_hashtable_node *am__hashtable_match_hash(struct am_hlist_node *node, unsigned long hash)
+{
+    for (; node != NULL; node = node->next) {
+        struct am_hashtable_node *hnode = AM_CONTAINER_OF(node, struct am_hashtable_node, node);
+        if (hnode->hash == hash)
+            return hnode;
+    }
+    return NULL;
+}
+
+/* First node of the hash's bucket whose cached hash matches */
+static AM_INLINE
+struct am_hashtable_node *am__hashtable_first_hashed(struct am_hlist_head *ht, size_t sz, unsigned long hash)
+{
+    return am__hashtable_match_hash(ht[am__hashtable_index(hash, sz)].first, hash);
+}
+
+/** @brief Iterate over the nodes whose cached hash matches
+ * @param ht The hashtable to search
+ * @param hash_ The hash, as passed to am_hashtable_add_hashed, evaluated once
+ * @param it 'struct am_hashtable_node *' to use as iterator
+ */
+#define am_hashtable_foreach_possible_hashed(ht, hash_, it) \
+    for ((it) = am__hashtable_first_hashed((ht)->_raw, AM_ARRAY_SIZE((ht)->_raw), (hash_)); \
+            (it) != NULL; \
+            (it) = am__hashtable_match_hash((it)->node.next, (it)->hash))
+
+/** @brief Keys prefetched ahead of being resolved by am_hashtable_get_batch */
+#define AM_HASHTABLE_BATCH 16
+
+/** @brief Predicate deciding whether a node holds the key being looked up */
+typedef bool am_hashtable_match_fn(const struct am_hlist_node *node, unsigned long key, void *ud);
+
+/** @brief Look up a key
+ * @param ht The hashtable to search
+ * @param key The key, as passed to am_hashtable_add
+ * @param match Predicate applied to the nodes of the key's bucket
+ * @param ud Passed to @p match
+ * @return The first matching node, or NULL
+ */
+#define am_hashtable_lookup(ht, key, match, ud) \
+    am__hashtable_lookup((ht)->_raw, AM_ARRAY_SIZE((ht)->_raw), (key), (match), (ud))
+
+static AM_INLINE
+struct am_hlist_node *am__hashtable_lookup(
+        struct am_hlist_head *ht,
+        size_t sz,
+        unsigned long key,
+        am_hashtable_match_fn *match,
+        void *ud)
+{
+    struct am_hlist_node *it;
+
+    am_hlist_foreach(it, &ht[am__hashtable_index(key, sz)]) {
+        if (match(it, key, ud))
+            return it;
+    }
+    return NULL;
+}
+
+/** @brief Look up a key among nodes which cache their hash
+ * @p match is only called on nodes whose hash matches
+ * @return The first matching node, or NULL
+ */
+#define am_hashtable_lookup_hashed(ht, hash, match, ud) \
+    am__hashtable_lookup_hashed((ht)->_raw, AM_ARRAY_SIZE((ht)->_raw), (hash), (match), (ud))
+
+static AM_INLINE
+struct am_hashtable_node *am__hashtable_lookup_hashed(
+        struct am_hlist_head *ht,
+        size_t sz,
+        unsigned long hash,
+        am_hashtable_match_fn *match,
+        void *ud)
+{
+    struct am_hashtable_node *it;
+
+    for (it = am__hashtable_first_hashed(ht, sz, hash);
+            it != NULL;
+            it = am__hashtable_match_hash(it->node.next, hash)) {
+        if (match(&it->node, hash, ud))
+            return it;
+    }
+    return NULL;
+}
+
+/** @brief Look up many keys, overlapping their cache misses
+ * The bucket heads of a group of keys are prefetched, then their first
+ * nodes, before any chain is walked
+ * @param ht The hashtable to search
+ * @param keys Array of 'n' keys, as passed to am_hashtable_add
+ * @param out Receives, for each key, the first matching node or NULL
+ * @param n Number of keys
+ * @param match Predicate applied to the nodes of a key's bucket
+ * @param ud Passed to @p match
+ * @return The number of keys found
+ */
+#define am_hashtable_get_batch(ht, keys, out, n, match, ud) \
+    am__hashtable_get_batch((ht)->_raw, AM_ARRAY_SIZE((ht)->_raw), keys, out, n, match, ud)
+
+static AM_INLINE
+size_t am__hashtable_get_batch(
+        struct am_hlist_head *ht,
+        size_t sz,
+        const unsigned long *keys,
+        struct am_hlist_node **out,
+        size_t n,
+        am_hashtable_match_fn *match,
+        void *ud)
+{
+    size_t i, j, hits = 0;
+
+    for (i = 0; i < n; i += AM_HASHTABLE_BATCH) {
+        const size_t end = AM_MIN(n, i + AM_HASHTABLE_BATCH);
+
+        for (j = i; j < end; j++)
+            AM_PREFETCH(&ht[am__hashtable_index(keys[j], sz)]);
+
+        for (j = i; j < end; j++) {
+            out[j] = ht[am__hashtable_index(keys[j], sz)].first;
+            if (out[j] != NULL)
+                AM_PREFETCH(out[j]);
+        }
+
+        for (j = i; j < end; j++) {
+            struct am_hlist_node *it = out[j];
+            while (it != NULL && !match(it, keys[j], ud))
+                it = it->next;
+            out[j] = it;
+            hits += it != NULL;
+        }
+    }
+    return hits;
+}
+
+/** @brief First occupied bucket at or after 'i', or 'sz'
+ * Bits of buckets emptied by am_hashtable_del are cleared on the way
+ */
+static AM_INLINE
+size_t am__hashtable_next_bucket(const struct am_hlist_head *ht, unsigned long *occupied, size_t sz, size_t i)
+{
+    while (i < sz) {
+        size_t w = i / AM__HASHTABLE_LONG_BITS;
+        unsigned long bits = occupied[w] & (~0UL << (i % AM__HASHTABLE_LONG_BITS));
+
+        if (bits == 0) {
+            i = (w + 1) * AM__HASHTABLE_LONG_BITS;
+            continue;
+        }
+        i = w * AM__HASHTABLE_LONG_BITS + (size_t)__builtin_ctzl(bits);
+        if (i >= sz)
+            break;
+        if (!am_hlist_is_empty(&ht[i]))
+            return i;
+        occupied[w] &= ~(1UL << (i % AM__HASHTABLE_LONG_BITS));
+        i++;
+    }
+    return sz;
+}
 
 /** @brief Determine if the hashtable is empty
+ * Only buckets marked in the occupancy bitmap are looked at, and the table
+ * is left untouched, so it may be const
  * @return true if the hashtable is empty
  */
 #define am_hashtable_is_empty(ht) \
-    am__hashtable_is_empty((ht)->_raw, AM_ARRAY_SIZE((ht)->_raw))
+    am__hashtable_is_empty((ht)->_raw, (ht)->_occupied, AM_ARRAY_SIZE((ht)->_raw))
 
 static AM_INLINE
-bool am__hashtable_is_empty(const struct am_hlist_head *ht, size_t sz)
+bool am__hashtable_is_empty(const struct am_hlist_head *ht, const unsigned long *occupied, size_t sz)
 {
-    size_t i;
-    for (i = 0; i < sz; i++)
-        if (!am_hlist_is_empty(&ht[i]))
-            return false;
+    size_t w;
 
+    for (w = 0; w < (sz + AM__HASHTABLE_LONG_BITS - 1) / AM__HASHTABLE_LONG_BITS; w++) {
+        unsigned long bits = occupied[w];
+
+        while (bits != 0) {
+            size_t i = w * AM__HASHTABLE_LONG_BITS + (size_t)__builtin_ctzl(bits);
+            if (i < sz && !am_hlist_is_empty(&ht[i]))
+                return false;
+            bits &= bits - 1;
+        }
+    }
     return true;
 }
 
-/** @brief Remove an object from a hashtable */
+/** @brief Remove an object from a hashtable
+ * Its bucket stays marked as occupied until the next iteration notices it is empty
+ */
 static AM_INLINE
 void am_hashtable_del(struct am_hlist_node *node)
 {
@@ -48,14 +293,15 @@ void am_hashtable_del(struct am_hlist_node *node)
 }
 
 /** @brief Iterate over a hashtable
+ * Only buckets marked in the occupancy bitmap are visited
  * @param ht The hashtable to iterate over
  * @param bkt Bucket to use as a loop cursor
  * @param it 'struct am_hlist_node *' to use as iterator
  */
 #define am_hashtable_foreach(ht, bkt, it) \
-    for ((bkt) = 0, (it) = NULL; \
+    for ((bkt) = am__hashtable_next_bucket((ht)->_raw, (ht)->_occupied, AM_ARRAY_SIZE((ht)->_raw), 0), (it) = NULL; \
             (it) == NULL && (bkt) < AM_ARRAY_SIZE((ht)->_raw); \
-            (bkt)++) \
+            (bkt) = am__hashtable_next_bucket((ht)->_raw, (ht)->_occupied, AM_ARRAY_SIZE((ht)->_raw), (bkt) + 1)) \
         am_hlist_foreach(it, &(ht)->_raw[bkt])
 
 /** @brief Iterate over a hashtable, safe to deletion
@@ -65,9 +311,9 @@ void am_hashtable_del(struct am_hlist_node *node)
  * @param it 'struct am_hlist_node *' to use as iterator
  */
 #define am_hashtable_foreach_safe(ht, bkt, tmp, it) \
-    for ((bkt) = 0, (it) = NULL; \
+    for ((bkt) = am__hashtable_next_bucket((ht)->_raw, (ht)->_occupied, AM_ARRAY_SIZE((ht)->_raw), 0), (it) = NULL; \
             (it) == NULL && (bkt) < AM_ARRAY_SIZE((ht)->_raw); \
-            (bkt)++) \
+            (bkt) = am__hashtable_next_bucket((ht)->_raw, (ht)->_occupied, AM_ARRAY_SIZE((ht)->_raw), (bkt) + 1)) \
         am_hlist_foreach_safe(it, tmp, &(ht)->_raw[bkt])
 
 #endif /* ifndef AM_DATA_HASHTABLE_H */
@@ -5,6 +5,7 @@
 #include <stddef.h>
 #include <stdbool.h>
 #include "am/macros.h"
+#include "am/atomic.h"
 
 /** @brief The head of the hlist */
 struct am_hlist_head {
@@ -116,4 +117,81 @@ void am_hlist_add_behind(struct am_hlist_node *n, struct am_hlist_node *prev)
 #define am_hlist_foreach_safe(it, tmp, head) \
     for (it = (head)->first; it && (tmp = it->next, 1); it = tmp)
 
+/****************************************************************************/
+
+/* RCU variants
+ *
+ * Writers still have to be serialized against each other, but readers may
+ * walk the list with am_hlist_foreach_rcu while it is being modified. A node
+ * is published with a release store once its own links are set, and readers
+ * follow links with consume loads. A removed node keeps its 'next' link so
+ * that readers standing on it can carry on; it may only be reused or freed
+ * once those readers are done, ie. through am_epoch_call.
+ */
+
+/** @brief Add a node at the front of a list read concurrently */
+AM_ATTR_NON_NULL((1, 2))
+static AM_INLINE
+void am_hlist_add_head_rcu(struct am_hlist_node *n, struct am_hlist_head *h)
+{
+    struct am_hlist_node *first = h->first;
+
+    n->next = first;
+    n->pprev = &h->first;
+    am_atomic_store_ptr_explicit((void **)&h->first, n, AM_MEMORY_ORDER_RELEASE);
+    if (first) {
+        first->pprev = &n->next;
+    }
+}
+
+/** @brief Add a node before another, in a list read concurrently */
+AM_ATTR_NON_NULL((1, 2))
+static AM_INLINE
+void am_hlist_add_before_rcu(struct am_hlist_node *n, struct am_hlist_node *next)
+{
+    n->pprev = next->pprev;
+    n->next = next;
+    am_atomic_store_ptr_explicit((void **)n->pprev, n, AM_MEMORY_ORDER_RELEASE);
+    next->pprev = &n->next;
+}
+
+/** @brief Add a node after another, in a list read concurrently */
+AM_ATTR_NON_NULL((1, 2))
+static AM_INLINE
+void am_hlist_add_behind_rcu(struct am_hlist_node *n, struct am_hlist_node *prev)
+{
+    n->next = prev->next;
+    n->pprev = &prev->next;
+    am_atomic_store_ptr_explicit((void **)&prev->next, n, AM_MEMORY_ORDER_RELEASE);
+    if (n->next) {
+        n->next->pprev = &n->next;
+    }
+}
+
+/** @brief Delete a node from a list read concurrently
+ * Unlike am_hlist_del, the node's 'next' link is left for readers to follow
+ */
+AM_ATTR_NON_NULL((1))
+static AM_INLINE
+void am_hlist_del_rcu(struct am_hlist_node *n)
+{
+    struct am_hlist_node *next = n->next;
+    struct am_hlist_node **pprev = n->pprev;
+
+    am_atomic_store_ptr_explicit((void **)pprev, next, AM_MEMORY_ORDER_RELAXED);
+    if (next) {
+        next->pprev = pprev;
+    }
+    n->pprev = NULL;
+}
+
+/** @brief Iterate over a hlist which may be modified concurrently
+ * @param it 'struct am_hlist_node *' iterator
+ * @param head 'struct am_hlist_head *' list
+ */
+#define am_hlist_foreach_rcu(it, head) \
+    for (it = am_atomic_load_ptr_explicit((void **)&(head)->first, AM_MEMORY_ORDER_CONSUME); \
+            it != NULL; \
+            it = am_atomic_load_ptr_explicit((void **)&(it)->next, AM_MEMORY_ORDER_CONSUME))
+
 #endif /* ifndef AM_DATA_HLIST_H */
@@ -0,0 +1,195 @@
+/** @file am/data/hlist_nulls.h
+ * @brief hlist whose chains end in a per-list marker instead of NULL
+ *
+ * The marker ("nulls") is an odd value carrying a number, usually the index
+ * of the hash bucket. A lockless reader which reaches the end of a chain can
+ * compare the marker with the bucket it started from: if they differ, some
+ * node it walked through was removed and added to another chain meanwhile,
+ * and the lookup has to restart.
+ *
+ * This allows nodes to be reused without waiting for a grace period, as long
+ * as their memory stays a node of the same type (ie. objects are recycled
+ * through a free list and never returned to the allocator). Readers must
+ * then confirm a match after finding it, since the node may change identity
+ * under them.
+ *
+ *     again:
+ *         am_hlist_nulls_foreach_rcu(it, &table[slot]) {
+ *             if (key_of(it) == key)
+ *                 return it;
+ *         }
+ *         if (am_hlist_nulls_value(it) != slot)
+ *             goto again;
+ *         return NULL;
+ */
+
+#ifndef AM_DATA_HLIST_NULLS_H
+#define AM_DATA_HLIST_NULLS_H 1
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "am/macros.h"
+#include "am/atomic.h"
+
+/** @brief The head of the hlist_nulls */
+struct am_hlist_nulls_head {
+    struct am_hlist_nulls_node *first;
+};
+
+/** @brief Intrusive member of the list */
+struct am_hlist_nulls_node {
+    struct am_hlist_nulls_node *next,
+                               **pprev;
+};
+
+/** @brief Marker ending a chain, carrying the value @p nulls */
+#define AM_HLIST_NULLS_MARKER(nulls) \
+    ((struct am_hlist_nulls_node *)(1UL | ((unsigned long)(nulls) << 1)))
+
+/** @brief Initializer for struct am_hlist_nulls_head */
+#define AM_HLIST_NULLS_HEAD_INITIALIZER(nulls) { AM_HLIST_NULLS_MARKER(nulls) }
+
+/****************************************************************************/
+
+/** @brief Determine if a pointer is an end-of-chain marker */
+static AM_INLINE
+bool am_hlist_nulls_is_marker(const struct am_hlist_nulls_node *p)
+{
+    return ((uintptr_t)p & 1) != 0;
+}
+
+/** @brief The value carried by an end-of-chain marker */
+static AM_INLINE
+unsigned long am_hlist_nulls_value(const struct am_hlist_nulls_node *p)
+{
+    return (unsigned long)((uintptr_t)p >> 1);
+}
+
+/** @brief Initialize a hlist_nulls_head
+ * @param nulls Value of the list's marker, smaller than ULONG_MAX / 2
+ */
+AM_ATTR_NON_NULL((1))
+static AM_INLINE
+void am_hlist_nulls_head_init(struct am_hlist_nulls_head *h, unsigned long nulls)
+{
+    h->first = AM_HLIST_NULLS_MARKER(nulls);
+}
+
+/** @brief Initialize a hlist_nulls_node */
+AM_ATTR_NON_NULL((1))
+static AM_INLINE
+void am_hlist_nulls_node_init(struct am_hlist_nulls_node *n)
+{
+    n->next = NULL;
+    n->pprev = NULL;
+}
+
+/** @brief Determine if a hlist_nulls_head is empty */
+AM_ATTR_NON_NULL((1))
+static AM_INLINE
+bool am_hlist_nulls_is_empty(const struct am_hlist_nulls_head *h)
+{
+    return am_hlist_nulls_is_marker(h->first);
+}
+
+/** @brief Determine if a node is on no list */
+AM_ATTR_NON_NULL((1))
+static AM_INLINE
+bool am_hlist_nulls_is_unhashed(const struct am_hlist_nulls_node *n)
+{
+    return n->pprev == NULL;
+}
+
+AM_ATTR_NON_NULL((1, 2))
+static AM_INLINE
+void am_hlist_nulls_add_head(struct am_hlist_nulls_node *n, struct am_hlist_nulls_head *h)
+{
+    struct am_hlist_nulls_node *first = h->first;
+
+    n->next = first;
+    n->pprev = &h->first;
+    h->first = n;
+    if (!am_hlist_nulls_is_marker(first)) {
+        first->pprev = &n->next;
+    }
+}
+
+/** @brief Delete a node from a list */
+AM_ATTR_NON_NULL((1))
+static AM_INLINE
+void am_hlist_nulls_del(struct am_hlist_nulls_node *n)
+{
+    struct am_hlist_nulls_node *next = n->next;
+    struct am_hlist_nulls_node **pprev = n->pprev;
+
+    *pprev = next;
+    if (!am_hlist_nulls_is_marker(next)) {
+        next->pprev = pprev;
+    }
+    am_hlist_nulls_node_init(n);
+}
+
+/** @brief Add a node at the front of a list read concurrently
+ * The node may have just been removed from another list, with readers still
+ * standing on it: they end up on this list's marker and restart
+ */
+AM_ATTR_NON_NULL((1, 2))
+static AM_INLINE
+void am_hlist_nulls_add_head_rcu(struct am_hlist_nulls_node *n, struct am_hlist_nulls_head *h)
+{
+    struct am_hlist_nulls_node *first = h->first;
+
+    am_atomic_store_ptr_explicit((void **)&n->next, first, AM_MEMORY_ORDER_RELAXED);
+    n->pprev = &h->first;
+    am_atomic_store_ptr_explicit((void **)&h->first, n, AM_MEMORY_ORDER_RELEASE);
+    if (!am_hlist_nulls_is_marker(first)) {
+        first->pprev = &n->next;
+    }
+}
+
+/** @brief Delete a node from a list read concurrently
+ * The node's 'next' link is left for readers to follow
+ */
+AM_ATTR_NON_NULL((1))
+static AM_INLINE
+void am_hlist_nulls_del_rcu(struct am_hlist_nulls_node *n)
+{
+    struct am_hlist_nulls_node *next = n->next;
+    struct am_hlist_nulls_node **pprev = n->pprev;
+
+    am_atomic_store_ptr_explicit((void **)pprev, next, AM_MEMORY_ORDER_RELAXED);
+    if (!am_hlist_nulls_is_marker(next)) {
+        next->pprev = pprev;
+    }
+    n->pprev = NULL;
+}
+
+/** @brief Iterate over a hlist_nulls
+ * Once done, @p it holds the list's marker
+ * @param it 'struct am_hlist_nulls_node *' iterator
+ * @param head 'struct am_hlist_nulls_head *' list
+ */
+#define am_hlist_nulls_foreach(it, head) \
+    for (it = (head)->first; !am_hlist_nulls_is_marker(it); it = it->next)
+
+/** @brief Iterate over a hlist_nulls, safe to deletion
+ * @param it 'struct am_hlist_nulls_node *' iterator
+ * @param tmp 'struct am_hlist_nulls_node *' temp
+ * @param head 'struct am_hlist_nulls_head *' list
+ */
+#define am_hlist_nulls_foreach_safe(it, tmp, head) \
+    for (it = (head)->first; !am_hlist_nulls_is_marker(it) && (tmp = it->next, 1); it = tmp)
+
+/** @brief Iterate over a hlist_nulls which may be modified concurrently
+ * Once done, @p it holds the marker of the list the walk ended on, which
+ * differs from the starting list's if a node was moved meanwhile
+ * @param it 'struct am_hlist_nulls_node *' iterator
+ * @param head 'struct am_hlist_nulls_head *' list
+ */
+#define am_hlist_nulls_foreach_rcu(it, head) \
+    for (it = am_atomic_load_ptr_explicit((void **)&(head)->first, AM_MEMORY_ORDER_CONSUME); \
+            !am_hlist_nulls_is_marker(it); \
+            it = am_atomic_load_ptr_explicit((void **)&(it)->next, AM_MEMORY_ORDER_CONSUME))
+
+#endif /* ifndef AM_DATA_HLIST_NULLS_H */
@@ -120,6 +120,81 @@ bool am_list_is_empty(struct am_list *head)
     return head->next == head;
 }
 
+/** @brief Order of two entries, as for qsort: negative if @p a goes first */
+typedef int am_list_cmp_fn(const struct am_list *a, const struct am_list *b, void *priv);
+
+AM_ATTR_NON_NULL((1, 2, 3))
+static AM_INLINE
+void am__list_splice(struct am_list *list, struct am_list *prev, struct am_list *next)
+{
+    struct am_list *first = list->next;
+    struct am_list *last = list->prev;
+
+    first->prev = prev;
+    prev->next = first;
+    last->next = next;
+    next->prev = last;
+}
+
+/** @brief Move every entry of @p list to the front of @p head
+ * @p list is left empty
+ */
+AM_ATTR_NON_NULL((1, 2))
+static AM_INLINE
+void am_list_splice(struct am_list *list, struct am_list *head)
+{
+    if (!am_list_is_empty(list)) {
+        am__list_splice(list, head, head->next);
+        am_list_head_init(list);
+    }
+}
+
+/** @brief Move every entry of @p list to the back of @p head
+ * @p list is left empty
+ */
+AM_ATTR_NON_NULL((1, 2))
+static AM_INLINE
+void am_list_splice_tail(struct am_list *list, struct am_list *head)
+{
+    if (!am_list_is_empty(list)) {
+        am__list_splice(list, head->prev, head);
+        am_list_head_init(list);
+    }
+}
+
+/** @brief Merge the sorted @p list into the sorted @p head, in linear time
+ * The merge is stable: among equal entries, those of @p head come first.
+ * @p list is left empty
+ */
+AM_ATTR_NON_NULL((1, 2, 3))
+static AM_INLINE
+void am_list_merge(struct am_list *head, struct am_list *list, am_list_cmp_fn *cmp, void *priv)
+{
+    struct am_list *pos = head->next;
+
+    while (!am_list_is_empty(list)) {
+        struct am_list *entry = list->next;
+
+        while (pos != head && cmp(pos, entry, priv) <= 0) {
+            pos = pos->next;
+        }
+        if (pos == head) {
+            am_list_splice_tail(list, head);
+            break;
+        }
+        /* Insert before pos */
+        am_list_move_tail(entry, pos);
+    }
+}
+
+/** @brief Sort a list in place
+ * A stable, bottom-up merge sort which allocates nothing and compares
+ * O(n log n) times at worst. Runs are merged as soon as two of the same
+ * size exist, so recently touched entries are merged while still in cache.
+ */
+AM_ATTR_NON_NULL((1, 2)) AM_PUBLIC
+void am_list_sort(struct am_list *head, am_list_cmp_fn *cmp, void *priv);
+
 #define am_list_foreach(pos, head) \
     for (pos = (head)->next; pos != (head); pos = pos->next)
 
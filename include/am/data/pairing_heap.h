@@ -0,0 +1,135 @@
+/** @file am/data/pairing_heap.h
+ * @brief Intrusive pairing heap
+ *
+ * A mergeable min-heap: insertion and melding link two trees in constant
+ * time, and removing the minimum pairs up the root's children, in
+ * amortized logarithmic time. Decreasing a key cuts the node's subtree off
+ * and links it with the root.
+ *
+ * Each node holds its first child, its next sibling, and its previous
+ * sibling, or parent if it is a first child. Ordering is given by a
+ * callback on each call, as for am_rbtree.
+ */
+
+#ifndef AM_DATA_PAIRING_HEAP_H
+#define AM_DATA_PAIRING_HEAP_H 1
+
+#include <stddef.h>
+#include <stdbool.h>
+#include "am/macros.h"
+
+/** @brief Intrusive member of a heap entry */
+struct am_pairing_heap_node {
+    struct am_pairing_heap_node *child, /* First child */
+                                *next,  /* Next sibling */
+                                *prev;  /* Previous sibling, or parent */
+};
+
+/** @brief The heap */
+struct am_pairing_heap {
+    struct am_pairing_heap_node *root;
+};
+
+/** @brief Initializer for struct am_pairing_heap */
+#define AM_PAIRING_HEAP_INITIALIZER { NULL }
+
+/** @brief Ordering of two nodes
+ * @return true if @p a comes out of the heap before @p b
+ */
+typedef bool am_pairing_heap_less_fn(const struct am_pairing_heap_node *a, const struct am_pairing_heap_node *b);
+
+/****************************************************************************/
+
+/** @brief Initialize a heap */
+AM_ATTR_NON_NULL((1))
+static AM_INLINE
+void am_pairing_heap_init(struct am_pairing_heap *heap)
+{
+    heap->root = NULL;
+}
+
+/** @brief Determine if a heap is empty */
+AM_ATTR_NON_NULL((1))
+static AM_INLINE
+bool am_pairing_heap_is_empty(const struct am_pairing_heap *heap)
+{
+    return heap->root == NULL;
+}
+
+/** @brief The minimum node, or NULL */
+AM_ATTR_NON_NULL((1))
+static AM_INLINE
+struct am_pairing_heap_node *am_pairing_heap_min(const struct am_pairing_heap *heap)
+{
+    return heap->root;
+}
+
+/* Link two roots, returning the new root; the loser becomes its first child */
+AM_ATTR_NON_NULL((1, 2, 3))
+static AM_INLINE
+struct am_pairing_heap_node *am__pairing_heap_link(
+        struct am_pairing_heap_node *a,
+        struct am_pairing_heap_node *b,
+        am_pairing_heap_less_fn *less)
+{
+    if (less(b, a)) {
+        struct am_pairing_heap_node *tmp = a;
+        a = b;
+        b = tmp;
+    }
+    b->next = a->child;
+    if (a->child != NULL) {
+        a->child->prev = b;
+    }
+    b->prev = a;
+    a->child = b;
+    return a;
+}
+
+/** @brief Insert a node, in constant time */
+AM_ATTR_NON_NULL((1, 2, 3))
+static AM_INLINE
+void am_pairing_heap_insert(
+        struct am_pairing_heap *heap,
+        struct am_pairing_heap_node *node,
+        am_pairing_heap_less_fn *less)
+{
+    node->child = NULL;
+    node->next = NULL;
+    node->prev = NULL;
+    heap->root = heap->root == NULL ? node : am__pairing_heap_link(heap->root, node, less);
+}
+
+/** @brief Move every node of @p other into @p heap, in constant time
+ * @p other is left empty
+ */
+AM_ATTR_NON_NULL((1, 2, 3))
+static AM_INLINE
+void am_pairing_heap_meld(struct am_pairing_heap *heap, struct am_pairing_heap *other, am_pairing_heap_less_fn *less)
+{
+    if (other->root == NULL) {
+        return;
+    }
+    heap->root = heap->root == NULL ? other->root : am__pairing_heap_link(heap->root, other->root, less);
+    other->root = NULL;
+}
+
+/** @brief Remove and return the minimum node, or NULL */
+AM_ATTR_NON_NULL((1, 2)) AM_PUBLIC
+struct am_pairing_heap_node *am_pairing_heap_pop(struct am_pairing_heap *heap, am_pairing_heap_less_fn *less);
+
+/** @brief Restore the heap after a node's key was decreased */
+AM_ATTR_NON_NULL((1, 2, 3)) AM_PUBLIC
+void am_pairing_heap_decrease(
+        struct am_pairing_heap *heap,
+        struct am_pairing_heap_node *node,
+        am_pairing_heap_less_fn *less);
+
+/** @brief Remove any node */
+AM_ATTR_NON_NULL((1, 2, 3)) AM_PUBLIC
+void am_pairing_heap_remove(
+        struct am_pairing_heap *heap,
+        struct am_pairing_heap_node *node,
+        am_pairing_heap_less_fn *less);
+
+#endif /* ifndef AM_DATA_PAIRING_HEAP_H */
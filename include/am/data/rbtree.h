@@ -0,0 +1,293 @@
+/** @file am/data/rbtree.h
+ * @brief Intrusive red-black tree
+ *
+ * Modeled after Linux's rbtree. Nodes are embedded in the user's structures
+ * and nothing is allocated. A node's parent pointer and colour share one
+ * word, the colour living in the low bit, so a node costs three pointers.
+ *
+ * The tree caches its leftmost node, so the minimum is found in constant
+ * time, as wanted by timer and priority queues.
+ *
+ * Ordering is left to the user. am_rbtree_insert and the searches take
+ * comparison callbacks; for full control, walk down the tree by hand, then
+ * call am_rbtree_link_node and am_rbtree_insert_color:
+ *
+ *     struct am_rbtree_node **link = &tree->root, *parent = NULL;
+ *     bool leftmost = true;
+ *     while (*link) {
+ *         parent = *link;
+ *         if (key < key_of(parent)) {
+ *             link = &parent->left;
+ *         } else {
+ *             link = &parent->right;
+ *             leftmost = false;
+ *         }
+ *     }
+ *     am_rbtree_link_node(node, parent, link);
+ *     am_rbtree_insert_color(tree, node, leftmost);
+ */
+
+#ifndef AM_DATA_RBTREE_H
+#define AM_DATA_RBTREE_H 1
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "am/macros.h"
+
+/** @brief Intrusive member of a tree entry */
+struct am_rbtree_node {
+    uintptr_t parent_color; /* Parent pointer, colour in the low bit */
+    struct am_rbtree_node *left,
+                          *right;
+} AM_ATTR_ALIGNED(sizeof(void *));
+
+/** @brief The tree */
+struct am_rbtree {
+    struct am_rbtree_node *root;
+    struct am_rbtree_node *leftmost; /* Smallest node, or NULL */
+};
+
+#define AM_RBTREE_RED   0
+#define AM_RBTREE_BLACK 1
+
+/** @brief Initializer for struct am_rbtree */
+#define AM_RBTREE_INITIALIZER { NULL, NULL }
+
+/** @brief Ordering of two nodes, for am_rbtree_insert
+ * @return true if @p a goes before @p b
+ */
+typedef bool am_rbtree_less_fn(const struct am_rbtree_node *a, const struct am_rbtree_node *b);
+
+/** @brief Ordering of a key against a node, for the searches
+ * @return Negative, zero or positive as @p key is below, equal to or above
+ *   the key of @p node
+ */
+typedef int am_rbtree_cmp_fn(const void *key, const struct am_rbtree_node *node);
+
+/****************************************************************************/
+
+/** @brief Initialize a tree */
+AM_ATTR_NON_NULL((1))
+static AM_INLINE
+void am_rbtree_init(struct am_rbtree *tree)
+{
+    tree->root = NULL;
+    tree->leftmost = NULL;
+}
+
+/** @brief Determine if a tree is empty */
+AM_ATTR_NON_NULL((1))
+static AM_INLINE
+bool am_rbtree_is_empty(const struct am_rbtree *tree)
+{
+    return tree->root == NULL;
+}
+
+/** @brief The parent of a node, NULL for the root */
+AM_ATTR_NON_NULL((1))
+static AM_INLINE
+struct am_rbtree_node *am_rbtree_parent(const struct am_rbtree_node *node)
+{
+    return (struct am_rbtree_node *)(node->parent_color & ~(uintptr_t)3);
+}
+
+/** @brief Smallest node, in constant time, or NULL */
+AM_ATTR_NON_NULL((1))
+static AM_INLINE
+struct am_rbtree_node *am_rbtree_first(const struct am_rbtree *tree)
+{
+    return tree->leftmost;
+}
+
+/** @brief Largest node, or NULL */
+AM_ATTR_NON_NULL((1))
+static AM_INLINE
+struct am_rbtree_node *am_rbtree_last(const struct am_rbtree *tree)
+{
+    struct am_rbtree_node *node = tree->root;
+
+    if (node != NULL) {
+        while (node->right != NULL) {
+            node = node->right;
+        }
+    }
+    return node;
+}
+
+/** @brief In-order successor of a node, or NULL */
+AM_ATTR_NON_NULL((1))
+static AM_INLINE
+struct am_rbtree_node *am_rbtree_next(const struct am_rbtree_node *node)
+{
+    struct am_rbtree_node *parent;
+
+    if (node->right != NULL) {
+        node = node->right;
+        while (node->left != NULL) {
+            node = node->left;
+        }
+        return (struct am_rbtree_node *)node;
+    }
+    while ((parent = am_rbtree_parent(node)) != NULL && node == parent->right) {
+        node = parent;
+    }
+    return parent;
+}
+
+/** @brief In-order predecessor of a node, or NULL */
+AM_ATTR_NON_NULL((1))
+static AM_INLINE
+struct am_rbtree_node *am_rbtree_prev(const struct am_rbtree_node *node)
+{
+    struct am_rbtree_node *parent;
+
+    if (node->left != NULL) {
+        node = node->left;
+        while (node->right != NULL) {
+            node = node->right;
+        }
+        return (struct am_rbtree_node *)node;
+    }
+    while ((parent = am_rbtree_parent(node)) != NULL && node == parent->left) {
+        node = parent;
+    }
+    return parent;
+}
+
+/** @brief Attach a new node as a leaf, before rebalancing
+ * @param parent The node it hangs from, NULL if the tree is empty
+ * @param link The empty child pointer of @p parent (or the root) to fill
+ */
+AM_ATTR_NON_NULL((1, 3))
+static AM_INLINE
+void am_rbtree_link_node(struct am_rbtree_node *node, struct am_rbtree_node *parent, struct am_rbtree_node **link)
+{
+    node->parent_color = (uintptr_t)parent | AM_RBTREE_RED;
+    node->left = NULL;
+    node->right = NULL;
+    *link = node;
+}
+
+/** @brief Rebalance after am_rbtree_link_node
+ * @param leftmost true if the node was linked as the new smallest node
+ */
+AM_ATTR_NON_NULL((1, 2)) AM_PUBLIC
+void am_rbtree_insert_color(struct am_rbtree *tree, struct am_rbtree_node *node, bool leftmost);
+
+/** @brief Remove a node, and rebalance */
+AM_ATTR_NON_NULL((1, 2)) AM_PUBLIC
+void am_rbtree_erase(struct am_rbtree *tree, struct am_rbtree_node *node);
+
+/** @brief Insert a node
+ * Equal nodes are kept, after those already present
+ */
+AM_ATTR_NON_NULL((1, 2, 3))
+static AM_INLINE
+void am_rbtree_insert(struct am_rbtree *tree, struct am_rbtree_node *node, am_rbtree_less_fn *less)
+{
+    struct am_rbtree_node **link = &tree->root, *parent = NULL;
+    bool leftmost = true;
+
+    while (*link != NULL) {
+        parent = *link;
+        if (less(node, parent)) {
+            link = &parent->left;
+        } else {
+            link = &parent->right;
+            leftmost = false;
+        }
+    }
+    am_rbtree_link_node(node, parent, link);
+    am_rbtree_insert_color(tree, node, leftmost);
+}
+
+/** @brief Remove and return the smallest node, or NULL */
+AM_ATTR_NON_NULL((1))
+static AM_INLINE
+struct am_rbtree_node *am_rbtree_pop_first(struct am_rbtree *tree)
+{
+    struct am_rbtree_node *node = tree->leftmost;
+
+    if (node != NULL) {
+        am_rbtree_erase(tree, node);
+    }
+    return node;
+}
+
+/** @brief First node whose key is not less than @p key, or NULL */
+AM_ATTR_NON_NULL((1, 3))
+static AM_INLINE
+struct am_rbtree_node *am_rbtree_lower_bound(const struct am_rbtree *tree, const void *key, am_rbtree_cmp_fn *cmp)
+{
+    struct am_rbtree_node *node = tree->root, *found = NULL;
+
+    while (node != NULL) {
+        if (cmp(key, node) <= 0) {
+            found = node;
+            node = node->left;
+        } else {
+            node = node->right;
+        }
+    }
+    return found;
+}
+
+/** @brief First node whose key is greater than @p key, or NULL */
+AM_ATTR_NON_NULL((1, 3))
+static AM_INLINE
+struct am_rbtree_node *am_rbtree_upper_bound(const struct am_rbtree *tree, const void *key, am_rbtree_cmp_fn *cmp)
+{
+    struct am_rbtree_node *node = tree->root, *found = NULL;
+
+    while (node != NULL) {
+        if (cmp(key, node) < 0) {
+            found = node;
+            node = node->left;
+        } else {
+            node = node->right;
+        }
+    }
+    return found;
+}
+
+/** @brief First node with the given key, or NULL */
+AM_ATTR_NON_NULL((1, 3))
+static AM_INLINE
+struct am_rbtree_node *am_rbtree_find(const struct am_rbtree *tree, const void *key, am_rbtree_cmp_fn *cmp)
+{
+    struct am_rbtree_node *node = am_rbtree_lower_bound(tree, key, cmp);
+
+    return node != NULL && cmp(key, node) == 0 ? node : NULL;
+}
+
+/** @brief Iterate over a tree in order
+ * @param it 'struct am_rbtree_node *' to use as iterator
+ * @param tree 'struct am_rbtree *' to iterate over
+ */
+#define am_rbtree_foreach(it, tree) \
+    for ((it) = am_rbtree_first(tree); (it) != NULL; (it) = am_rbtree_next(it))
+
+/** @brief Iterate over a tree in order, safe to erasing the current node
+ * @param it 'struct am_rbtree_node *' to use as iterator
+ * @param tmp 'struct am_rbtree_node *' to use as temporary
+ * @param tree 'struct am_rbtree *' to iterate over
+ */
+#define am_rbtree_foreach_safe(it, tmp, tree) \
+    for ((it) = am_rbtree_first(tree); (it) != NULL && ((tmp) = am_rbtree_next(it), true); (it) = (tmp))
+
+/** @brief Iterate in order from a node on, ie. one returned by am_rbtree_lower_bound
+ * @param it 'struct am_rbtree_node *' to use as iterator
+ * @param start The first node visited, may be NULL
+ */
+#define am_rbtree_foreach_from(it, start) \
+    for ((it) = (start); (it) != NULL; (it) = am_rbtree_next(it))
+
+/** @brief Iterate over a tree in reverse order
+ * @param it 'struct am_rbtree_node *' to use as iterator
+ * @param tree 'struct am_rbtree *' to iterate over
+ */
+#define am_rbtree_foreach_reverse(it, tree) \
+    for ((it) = am_rbtree_last(tree); (it) != NULL; (it) = am_rbtree_prev(it))
+
+#endif /* ifndef AM_DATA_RBTREE_H */
@@ -0,0 +1,317 @@
+/** @file am/data/rhashtable.h
+ * @brief Intrusive chaining hashtable which resizes itself
+ *
+ * Like am_hashtable, but the bucket array is allocated from a struct
+ * am_alloc, doubled when the table holds more entries than buckets and
+ * shrunk when it falls under a quarter full.
+ *
+ * Resizing is incremental: the new bucket array takes over at once, while
+ * the old one is drained a few buckets at a time by later additions and
+ * removals (or am_rhashtable_rehash_step). A hash is looked up in the old
+ * array until its bucket there has been moved over. No single operation
+ * rehashes more than AM_RHASHTABLE_MIGRATE buckets.
+ *
+ * Nodes remember their hash, so that they can be moved without calling back
+ * into user code.
+ */
+
+#ifndef AM_DATA_RHASHTABLE_H
+#define AM_DATA_RHASHTABLE_H 1
+
+#include <stddef.h>
+#include <stdbool.h>
+#include "am/macros.h"
+#include "am/alloc.h"
+#include "am/data/hlist.h"
+
+/** @brief Old buckets moved over by each addition or removal during a resize */
+#define AM_RHASHTABLE_MIGRATE 4
+/** @brief Smallest bucket array */
+#define AM_RHASHTABLE_MIN_BUCKETS 16
+
+/** @brief Intrusive member of a hashtable entry */
+struct am_rhashtable_node {
+    struct am_hlist_node hnode;
+    unsigned long hash;
+};
+
+struct am_rhashtable {
+    struct am_alloc *allocator;
+    struct am_hlist_head *buckets; /* mask + 1 buckets, a power of 2 */
+    unsigned long mask;
+    struct am_hlist_head *old;     /* Array being drained, or NULL */
+    unsigned long old_mask;
+    unsigned long migrated;        /* Old buckets below this are empty */
+    unsigned long min_mask;        /* Never shrink below this */
+    size_t count;
+    unsigned paused;               /* Iterators which forbid moving nodes */
+};
+
+/** @brief Iterator over every node, see am_rhashtable_iter_begin */
+struct am_rhashtable_iter {
+    struct am_hlist_head *table;
+    unsigned long bucket;
+    struct am_rhashtable_node *next;
+};
+
+/****************************************************************************/
+
+AM_ATTR_NON_NULL((1))
+static AM_INLINE
+struct am_hlist_head *am__rhashtable_alloc(struct am_alloc *allocator, unsigned long n)
+{
+    struct am_hlist_head *buckets = am_malloc(allocator, n * sizeof *buckets);
+    unsigned long i;
+
+    if (buckets != NULL) {
+        for (i = 0; i < n; i++) {
+            am_hlist_head_init(&buckets[i]);
+        }
+    }
+    return buckets;
+}
+
+/** @brief Initialize a hashtable
+ * @param allocator Allocator for the bucket arrays
+ * @param size_hint Expected number of entries, the table never shrinks below it
+ * @return false on allocation failure
+ */
+AM_ATTR_NON_NULL((1, 2)) AM_ATTR_WARN_UNUSED_RESULT
+static AM_INLINE
+bool am_rhashtable_init(struct am_rhashtable *ht, struct am_alloc *allocator, size_t size_hint)
+{
+    unsigned long n = AM_RHASHTABLE_MIN_BUCKETS;
+
+    while (n < size_hint) {
+        n *= 2;
+    }
+    ht->allocator = allocator;
+    ht->buckets = am__rhashtable_alloc(allocator, n);
+    ht->mask = n - 1;
+    ht->old = NULL;
+    ht->old_mask = 0;
+    ht->migrated = 0;
+    ht->min_mask = n - 1;
+    ht->count = 0;
+    ht->paused = 0;
+    return ht->buckets != NULL;
+}
+
+/** @brief Free the bucket arrays
+ * @note The nodes belong to the caller, and are left as they are
+ */
+AM_ATTR_NON_NULL((1))
+static AM_INLINE
+void am_rhashtable_destroy(struct am_rhashtable *ht)
+{
+    if (ht->old != NULL) {
+        am_free(ht->allocator, ht->old, (ht->old_mask + 1) * sizeof *ht->old);
+        ht->old = NULL;
+    }
+    am_free(ht->allocator, ht->buckets, (ht->mask + 1) * sizeof *ht->buckets);
+    ht->buckets = NULL;
+}
+
+/** @brief Number of entries */
+AM_ATTR_NON_NULL((1))
+static AM_INLINE
+size_t am_rhashtable_count(const struct am_rhashtable *ht)
+{
+    return ht->count;
+}
+
+/** @brief Determine if a resize is still draining the old bucket array */
+AM_ATTR_NON_NULL((1))
+static AM_INLINE
+bool am_rhashtable_is_rehashing(const struct am_rhashtable *ht)
+{
+    return ht->old != NULL;
+}
+
+/** @brief The bucket which holds, or would hold, nodes with the given hash */
+AM_ATTR_NON_NULL((1))
+static AM_INLINE
+struct am_hlist_head *am_rhashtable_bucket(const struct am_rhashtable *ht, unsigned long hash)
+{
+    if (ht->old != NULL && (hash & ht->old_mask) >= ht->migrated) {
+        return &ht->old[hash & ht->old_mask];
+    }
+    return &ht->buckets[hash & ht->mask];
+}
+
+/* Start moving entries into an array of 'n' buckets, unless already resizing */
+AM_ATTR_NON_NULL((1))
+static AM_INLINE
+void am__rhashtable_resize(struct am_rhashtable *ht, unsigned long n)
+{
+    struct am_hlist_head *buckets;
+
+    if (ht->old != NULL || ht->paused > 0) {
+        return;
+    }
+    /* On allocation failure, chains just get longer until the next attempt */
+    buckets = am__rhashtable_alloc(ht->allocator, n);
+    if (buckets == NULL) {
+        return;
+    }
+    ht->old = ht->buckets;
+    ht->old_mask = ht->mask;
+    ht->migrated = 0;
+    ht->buckets = buckets;
+    ht->mask = n - 1;
+}
+
+/* Start a resize if the load factor is out of bounds */
+AM_ATTR_NON_NULL((1))
+static AM_INLINE
+void am__rhashtable_check(struct am_rhashtable *ht)
+{
+    unsigned long n = ht->mask + 1;
+
+    if (ht->count > n) {
+        am__rhashtable_resize(ht, 2 * n);
+    } else if (n > ht->min_mask + 1 && ht->count < n / 4) {
+        /* Shrink straight to the right size, rather than halving repeatedly */
+        while (n > ht->min_mask + 1 && ht->count < n / 4) {
+            n /= 2;
+        }
+        am__rhashtable_resize(ht, n);
+    }
+}
+
+/** @brief Move up to @p n old buckets into the new array
+ * Does nothing while the table is paused by an iterator
+ * @return true if a resize is still in progress
+ */
+AM_ATTR_NON_NULL((1))
+static AM_INLINE
+bool am_rhashtable_rehash_step(struct am_rhashtable *ht, unsigned n)
+{
+    if (ht->old == NULL || ht->paused > 0) {
+        return ht->old != NULL;
+    }
+    while (n-- > 0 && ht->migrated <= ht->old_mask) {
+        struct am_hlist_head *bucket = &ht->old[ht->migrated++];
+
+        while (!am_hlist_is_empty(bucket)) {
+            struct am_rhashtable_node *node = AM_CONTAINER_OF(bucket->first, struct am_rhashtable_node, hnode);
+
+            am_hlist_del(&node->hnode);
+            am_hlist_add_head(&node->hnode, &ht->buckets[node->hash & ht->mask]);
+        }
+    }
+    if (ht->migrated > ht->old_mask) {
+        am_free(ht->allocator, ht->old, (ht->old_mask + 1) * sizeof *ht->old);
+        ht->old = NULL;
+        /* The count may have drifted out of bounds meanwhile */
+        am__rhashtable_check(ht);
+    }
+    return ht->old != NULL;
+}
+
+/** @brief Add a node
+ * Duplicate hashes are allowed, as in am_hashtable
+ */
+AM_ATTR_NON_NULL((1, 2))
+static AM_INLINE
+void am_rhashtable_add(struct am_rhashtable *ht, struct am_rhashtable_node *node, unsigned long hash)
+{
+    node->hash = hash;
+    am_hlist_add_head(&node->hnode, am_rhashtable_bucket(ht, hash));
+    ht->count++;
+    am__rhashtable_check(ht);
+    am_rhashtable_rehash_step(ht, AM_RHASHTABLE_MIGRATE);
+}
+
+/** @brief Remove a node */
+AM_ATTR_NON_NULL((1, 2))
+static AM_INLINE
+void am_rhashtable_del(struct am_rhashtable *ht, struct am_rhashtable_node *node)
+{
+    am_hlist_del(&node->hnode);
+    ht->count--;
+    am__rhashtable_check(ht);
+    am_rhashtable_rehash_step(ht, AM_RHASHTABLE_MIGRATE);
+}
+
+/* First node from 'node' on, in its chain, with the given hash */
+static AM_INLINE
+struct am_rhashtable_node *am__rhashtable_match(struct am_hlist_node *node, unsigned long hash)
+{
+    while (node != NULL) {
+        struct am_rhashtable_node *n = AM_CONTAINER_OF(node, struct am_rhashtable_node, hnode);
+        if (n->hash == hash) {
+            return n;
+        }
+        node = node->next;
+    }
+    return NULL;
+}
+
+/** @brief Iterate over the nodes with a given hash
+ * @param ht The hashtable to search
+ * @param hash The hash to look up
+ * @param it 'struct am_rhashtable_node *' to use as iterator
+ * @note The caller still has to compare keys, for hashes may collide
+ */
+#define am_rhashtable_foreach_possible(ht, hash, it) \
+    for ((it) = am__rhashtable_match(am_rhashtable_bucket((ht), (hash))->first, (hash)); \
+            (it) != NULL; \
+            (it) = am__rhashtable_match((it)->hnode.next, (hash)))
+
+/** @brief Start iterating over every node
+ * Nodes aren't moved between arrays until am_rhashtable_iter_end, so the
+ * node last returned may be removed while iterating. Nodes added meanwhile
+ * may or may not be visited
+ */
+AM_ATTR_NON_NULL((1, 2))
+static AM_INLINE
+void am_rhashtable_iter_begin(struct am_rhashtable *ht, struct am_rhashtable_iter *it)
+{
+    ht->paused++;
+    it->table = ht->old != NULL ? ht->old : ht->buckets;
+    it->bucket = 0;
+    it->next = NULL;
+}
+
+/** @brief Advance an iterator
+ * @return The next node, or NULL once every node was visited
+ */
+AM_ATTR_NON_NULL((1, 2))
+static AM_INLINE
+struct am_rhashtable_node *am_rhashtable_iter_next(struct am_rhashtable *ht, struct am_rhashtable_iter *it)
+{
+    struct am_rhashtable_node *node = it->next;
+
+    while (node == NULL) {
+        unsigned long mask = it->table == ht->old ? ht->old_mask : ht->mask;
+
+        if (it->bucket > mask) {
+            if (it->table != ht->old) {
+                return NULL;
+            }
+            it->table = ht->buckets;
+            it->bucket = 0;
+            continue;
+        }
+        if (it->table[it->bucket].first != NULL) {
+            node = AM_CONTAINER_OF(it->table[it->bucket].first, struct am_rhashtable_node, hnode);
+        }
+        it->bucket++;
+    }
+    it->next = node->hnode.next != NULL
+        ? AM_CONTAINER_OF(node->hnode.next, struct am_rhashtable_node, hnode)
+        : NULL;
+    return node;
+}
+
+/** @brief Finish iterating, allowing pending resizes to make progress */
+AM_ATTR_NON_NULL((1, 2))
+static AM_INLINE
+void am_rhashtable_iter_end(struct am_rhashtable *ht, struct am_rhashtable_iter *it)
+{
+    (void)it;
+    ht->paused--;
+}
+
+#endif /* ifndef AM_DATA_RHASHTABLE_H */
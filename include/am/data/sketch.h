@@ -0,0 +1,378 @@
+/** @file am/data/sketch.h
+ * @brief Streaming cardinality and frequency sketches
+ *
+ * struct am_hll is a HyperLogLog: it estimates the number of distinct keys
+ * added, within about 1.04 / sqrt(2^precision), in at most 2^precision
+ * bytes. Each key's hash picks a register by its top bits, and the register
+ * keeps the longest run of leading zeros seen in the remaining bits. Until
+ * they would take as much room as the dense registers, only the registers
+ * which are set are kept, as a sorted array of (register, value) pairs
+ * behind a small unsorted buffer; then they are converted to one byte per
+ * register. The estimate is Ertl's improved estimator, which needs no
+ * empirical bias correction.
+ *
+ * struct am_cms is a Count-Min sketch with conservative update: 'depth'
+ * rows of 'width' counters, one counter per row for each key. A key's count
+ * is estimated by the least of its counters, which never underestimates,
+ * and overestimates by at most e / width of the total count with
+ * probability 1 - e^-depth. Conservative update only raises the counters
+ * which are below the new estimate, which makes the overestimates much
+ * smaller on skewed streams.
+ *
+ * Both take a 64-bit hash of the key. am_sketch_hash combines
+ * am_hash_murmur_x86_32 and am_hash_fnva1_32 of a byte string; integer
+ * keys can be passed through am_hash_fmix64 to the _hash variants instead.
+ *
+ * Sketches of the same shape merge into the union of their streams, so
+ * each thread can keep its own and combine them when reading. Dense merges
+ * are byte-wise maxima and saturating 32-bit additions, done with SSE2 16
+ * bytes at a time. Define AM_SKETCH_NO_SIMD before including to use the
+ * scalar loops even when SSE2 is available.
+ *
+ * Storage comes from a struct am_alloc, and functions which may allocate
+ * return false on allocation failure.
+ */
+
+#ifndef AM_DATA_SKETCH_H
+#define AM_DATA_SKETCH_H 1
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "am/macros.h"
+#include "am/alloc.h"
+#include "am/data/hash.h"
+
+#if defined(__SSE2__) && !defined(AM_SKETCH_NO_SIMD)
+# include <emmintrin.h>
+# define AM_SKETCH_SSE2 1
+#endif
+
+/** @brief Range of HyperLogLog precisions, in bits of register index */
+#define AM_HLL_MIN_PRECISION 4
+#define AM_HLL_MAX_PRECISION 18
+/** @brief Sparse entries buffered unsorted before being merged in */
+#define AM_HLL_PENDING 32
+/** @brief Most rows of a Count-Min sketch */
+#define AM_CMS_MAX_DEPTH 16
+/** @brief How many keys ahead the batch functions prefetch */
+#define AM_SKETCH_PREFETCH_DISTANCE 8
+
+struct am_hll {
+    struct am_alloc *allocator;
+    uint8_t *registers;  /* Dense registers, or NULL while sparse */
+    uint32_t *sparse;    /* Sorted (index << 8 | value), one per index */
+    size_t sparse_len;
+    size_t sparse_capacity;
+    unsigned pending_len;
+    unsigned precision;
+    uint32_t pending[AM_HLL_PENDING];
+};
+
+struct am_cms {
+    struct am_alloc *allocator;
+    uint32_t *counters;  /* 'depth' rows of 'width' */
+    size_t width;        /* Power of two */
+    unsigned depth;
+    uint64_t total;
+};
+
+/** @brief Hash a key for either sketch */
+static AM_INLINE
+uint64_t am_sketch_hash(const void *key, unsigned len)
+{
+    uint64_t h = (uint64_t)am_hash_murmur_x86_32(key, len, UINT32_C(0x9747b28c)) << 32;
+
+    return am_hash_fmix64(h | am_hash_fnva1_32(key, len));
+}
+
+/* Element-wise maximum of two byte arrays, into the first */
+static AM_INLINE
+void am__sketch_max_u8(uint8_t *AM_RESTRICT dst, const uint8_t *AM_RESTRICT src, size_t n)
+{
+    size_t i = 0;
+
+#ifdef AM_SKETCH_SSE2
+    for (; i + 16 <= n; i += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i *)(dst + i));
+        __m128i b = _mm_loadu_si128((const __m128i *)(src + i));
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_max_epu8(a, b));
+    }
+#endif
+    for (; i < n; i++) {
+        dst[i] = AM_MAX(dst[i], src[i]);
+    }
+}
+
+/* Element-wise saturating sum of two 32-bit counter arrays, into the first */
+static AM_INLINE
+void am__sketch_add_sat_u32(uint32_t *AM_RESTRICT dst, const uint32_t *AM_RESTRICT src, size_t n)
+{
+    size_t i = 0;
+
+#ifdef AM_SKETCH_SSE2
+    /* SSE2 only compares signed words: flip the sign bits, and a sum which
+     * wrapped compares less than either addend */
+    const __m128i bias = _mm_set1_epi32(INT32_MIN);
+    for (; i + 4 <= n; i += 4) {
+        __m128i a = _mm_loadu_si128((const __m128i *)(dst + i));
+        __m128i b = _mm_loadu_si128((const __m128i *)(src + i));
+        __m128i sum = _mm_add_epi32(a, b);
+        __m128i wrapped = _mm_cmpgt_epi32(_mm_xor_si128(a, bias), _mm_xor_si128(sum, bias));
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_or_si128(sum, wrapped));
+    }
+#endif
+    for (; i < n; i++) {
+        uint32_t sum = dst[i] + src[i];
+        dst[i] = sum < dst[i] ? UINT32_MAX : sum;
+    }
+}
+
+/****************************************************************************/
+
+/** @brief Initialize an empty HyperLogLog, which allocates on first add
+ * @param precision Register index bits, from AM_HLL_MIN_PRECISION to
+ *   AM_HLL_MAX_PRECISION; 14 gives 0.8% standard error in 16KiB
+ */
+AM_ATTR_NON_NULL((1, 2)) AM_PUBLIC
+void am_hll_init(struct am_hll *hll, struct am_alloc *allocator, unsigned precision);
+
+/** @brief Free the registers */
+AM_ATTR_NON_NULL((1)) AM_PUBLIC
+void am_hll_destroy(struct am_hll *hll);
+
+/** @brief Forget every key, returning to the sparse representation */
+AM_ATTR_NON_NULL((1)) AM_PUBLIC
+void am_hll_clear(struct am_hll *hll);
+
+/** @brief Estimated number of distinct keys added */
+AM_ATTR_NON_NULL((1)) AM_PUBLIC
+double am_hll_estimate(const struct am_hll *hll);
+
+/* Merge the pending buffer into the sparse array, then go dense if it
+ * grew as large as the dense registers */
+AM_ATTR_NON_NULL((1)) AM_ATTR_WARN_UNUSED_RESULT AM_PUBLIC
+bool am__hll_flush(struct am_hll *hll);
+
+/* Fold a sparse or dense sketch into any other */
+AM_ATTR_NON_NULL((1, 2)) AM_ATTR_WARN_UNUSED_RESULT AM_PUBLIC
+bool am__hll_merge_slow(struct am_hll *dst, const struct am_hll *src);
+
+/** @brief Whether the registers are stored one byte each */
+AM_ATTR_NON_NULL((1))
+static AM_INLINE
+bool am_hll_is_dense(const struct am_hll *hll)
+{
+    return hll->registers != NULL;
+}
+
+/* Register index in the top bits, value one more than the leading zeros of the rest */
+static AM_INLINE
+uint32_t am__hll_entry(const struct am_hll *hll, uint64_t hash)
+{
+    unsigned p = hll->precision;
+    uint64_t rest = hash << p;
+    uint32_t value = rest == 0 ? 64 - p + 1 : (uint32_t)__builtin_clzll(rest) + 1;
+
+    return (uint32_t)(hash >> (64 - p)) << 8 | value;
+}
+
+AM_ATTR_NON_NULL((1)) AM_ATTR_WARN_UNUSED_RESULT
+static AM_INLINE
+bool am__hll_add_entry(struct am_hll *hll, uint32_t entry)
+{
+    if (hll->registers == NULL) {
+        if (hll->pending_len == AM_HLL_PENDING && !am__hll_flush(hll)) {
+            return false;
+        }
+        if (hll->registers == NULL) {
+            hll->pending[hll->pending_len++] = entry;
+            return true;
+        }
+    }
+    hll->registers[entry >> 8] = AM_MAX(hll->registers[entry >> 8], (uint8_t)entry);
+    return true;
+}
+
+/** @brief Add a key by its hash
+ * @return false on allocation failure
+ */
+AM_ATTR_NON_NULL((1)) AM_ATTR_WARN_UNUSED_RESULT
+static AM_INLINE
+bool am_hll_add_hash(struct am_hll *hll, uint64_t hash)
+{
+    return am__hll_add_entry(hll, am__hll_entry(hll, hash));
+}
+
+/** @brief Add a key
+ * @return false on allocation failure
+ */
+AM_ATTR_NON_NULL((1, 2)) AM_ATTR_WARN_UNUSED_RESULT
+static AM_INLINE
+bool am_hll_add(struct am_hll *hll, const void *key, unsigned len)
+{
+    return am_hll_add_hash(hll, am_sketch_hash(key, len));
+}
+
+/** @brief Add many keys by their hashes
+ * @return false on allocation failure, after adding a prefix of the keys
+ */
+AM_ATTR_NON_NULL((1, 2)) AM_ATTR_WARN_UNUSED_RESULT
+static AM_INLINE
+bool am_hll_add_batch(struct am_hll *hll, const uint64_t *hashes, size_t n)
+{
+    size_t i = 0;
+
+    /* Sparse until the registers appear */
+    for (; i < n && hll->registers == NULL; i++) {
+        if (!am_hll_add_hash(hll, hashes[i])) {
+            return false;
+        }
+    }
+    for (; i < n; i++) {
+        uint32_t entry = am__hll_entry(hll, hashes[i]);
+        hll->registers[entry >> 8] = AM_MAX(hll->registers[entry >> 8], (uint8_t)entry);
+    }
+    return true;
+}
+
+/** @brief Add every key of @p src to @p dst
+ * @return false if the precisions differ, or on allocation failure, after
+ *   which @p dst may hold some of the keys of @p src
+ */
+AM_ATTR_NON_NULL((1, 2)) AM_ATTR_WARN_UNUSED_RESULT
+static AM_INLINE
+bool am_hll_merge(struct am_hll *dst, const struct am_hll *src)
+{
+    if (dst->precision != src->precision) {
+        return false;
+    }
+    if (dst->registers != NULL && src->registers != NULL) {
+        am__sketch_max_u8(dst->registers, src->registers, (size_t)1 << dst->precision);
+        return true;
+    }
+    return am__hll_merge_slow(dst, src);
+}
+
+/****************************************************************************/
+
+/** @brief Initialize an empty Count-Min sketch
+ * @param width Counters per row, rounded up to a power of two
+ * @param depth Rows, at most AM_CMS_MAX_DEPTH
+ * @return false on allocation failure
+ */
+AM_ATTR_NON_NULL((1, 2)) AM_ATTR_WARN_UNUSED_RESULT AM_PUBLIC
+bool am_cms_init(struct am_cms *cms, struct am_alloc *allocator, size_t width, unsigned depth);
+
+/** @brief Free the counters */
+AM_ATTR_NON_NULL((1)) AM_PUBLIC
+void am_cms_destroy(struct am_cms *cms);
+
+/** @brief Reset every counter */
+AM_ATTR_NON_NULL((1)) AM_PUBLIC
+void am_cms_clear(struct am_cms *cms);
+
+/** @brief Sum of every count added */
+AM_ATTR_NON_NULL((1))
+static AM_INLINE
+uint64_t am_cms_total(const struct am_cms *cms)
+{
+    return cms->total;
+}
+
+/* The counter of row 'row' for a hash, by double hashing */
+static AM_INLINE
+uint32_t *am__cms_counter(const struct am_cms *cms, uint64_t hash, unsigned row)
+{
+    uint32_t h1 = (uint32_t)hash, h2 = (uint32_t)(hash >> 32) | 1;
+
+    return &cms->counters[row * cms->width + ((h1 + row * h2) & (cms->width - 1))];
+}
+
+/** @brief Estimated count of a key by its hash, never less than the true count */
+AM_ATTR_NON_NULL((1))
+static AM_INLINE
+uint32_t am_cms_estimate_hash(const struct am_cms *cms, uint64_t hash)
+{
+    uint32_t min = UINT32_MAX;
+    unsigned row;
+
+    for (row = 0; row < cms->depth; row++) {
+        min = AM_MIN(min, *am__cms_counter(cms, hash, row));
+    }
+    return min;
+}
+
+/** @brief Estimated count of a key, never less than the true count */
+AM_ATTR_NON_NULL((1, 2))
+static AM_INLINE
+uint32_t am_cms_estimate(const struct am_cms *cms, const void *key, unsigned len)
+{
+    return am_cms_estimate_hash(cms, am_sketch_hash(key, len));
+}
+
+/** @brief Add to a key's count by its hash, saturating at UINT32_MAX */
+AM_ATTR_NON_NULL((1))
+static AM_INLINE
+void am_cms_add_hash(struct am_cms *cms, uint64_t hash, uint32_t count)
+{
+    uint32_t *counters[AM_CMS_MAX_DEPTH];
+    uint32_t min = UINT32_MAX, target;
+    unsigned row;
+
+    for (row = 0; row < cms->depth; row++) {
+        counters[row] = am__cms_counter(cms, hash, row);
+        min = AM_MIN(min, *counters[row]);
+    }
+    /* Conservative update: raise only the counters below the new estimate */
+    target = min + count < min ? UINT32_MAX : min + count;
+    for (row = 0; row < cms->depth; row++) {
+        *counters[row] = AM_MAX(*counters[row], target);
+    }
+    cms->total += count;
+}
+
+/** @brief Add to a key's count, saturating at UINT32_MAX */
+AM_ATTR_NON_NULL((1, 2))
+static AM_INLINE
+void am_cms_add(struct am_cms *cms, const void *key, unsigned len, uint32_t count)
+{
+    am_cms_add_hash(cms, am_sketch_hash(key, len), count);
+}
+
+/** @brief Add one to the counts of many keys, by their hashes */
+AM_ATTR_NON_NULL((1, 2))
+static AM_INLINE
+void am_cms_add_batch(struct am_cms *cms, const uint64_t *hashes, size_t n)
+{
+    size_t i;
+    unsigned row;
+
+    for (i = 0; i < n; i++) {
+        if (i + AM_SKETCH_PREFETCH_DISTANCE < n) {
+            for (row = 0; row < cms->depth; row++) {
+                AM_PREFETCH(am__cms_counter(cms, hashes[i + AM_SKETCH_PREFETCH_DISTANCE], row));
+            }
+        }
+        am_cms_add_hash(cms, hashes[i], 1);
+    }
+}
+
+/** @brief Add every count of @p src to @p dst
+ * Estimates from the result still never undercount, though they may be
+ * higher than a single sketch fed both streams
+ * @return false if the sketches differ in width or depth
+ */
+AM_ATTR_NON_NULL((1, 2)) AM_ATTR_WARN_UNUSED_RESULT
+static AM_INLINE
+bool am_cms_merge(struct am_cms *dst, const struct am_cms *src)
+{
+    if (dst->width != src->width || dst->depth != src->depth) {
+        return false;
+    }
+    am__sketch_add_sat_u32(dst->counters, src->counters, dst->width * dst->depth);
+    dst->total += src->total;
+    return true;
+}
+
+#endif /* ifndef AM_DATA_SKETCH_H */
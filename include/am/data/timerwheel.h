@@ -0,0 +1,191 @@
+/** @file am/data/timerwheel.h
+ * @brief Hierarchical timing wheel
+ *
+ * Timers are intrusive, and hang in slots which are am_list heads, so arming,
+ * cancelling and re-arming a timer are constant time. Time is counted in
+ * ticks of whatever unit the user picks (ie. milliseconds).
+ *
+ * Level 0 has one slot per tick, level 1 one slot per 64 ticks, and so on,
+ * eleven levels covering every 64-bit expiry. A timer goes in the lowest
+ * level at which its expiry shares all higher digits with the current time.
+ * Cascading is lazy: a higher-level slot is only redistributed into lower
+ * levels once the wheel's time reaches it, so timers cancelled before then,
+ * the common case for timeouts, are never moved.
+ *
+ * Each level keeps a bitmap of its occupied slots, so am_timer_wheel_advance
+ * jumps straight to the next tick with work to do, and
+ * am_timer_wheel_next_expiry is a handful of bit scans.
+ *
+ * The wheel isn't threadsafe.
+ */
+
+#ifndef AM_DATA_TIMERWHEEL_H
+#define AM_DATA_TIMERWHEEL_H 1
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "am/macros.h"
+#include "am/data/list.h"
+
+/** @brief log2 of the number of slots per level */
+#define AM_TIMER_WHEEL_BITS   6
+#define AM_TIMER_WHEEL_SLOTS  (1 << AM_TIMER_WHEEL_BITS)
+/** @brief Enough levels for any 64-bit expiry */
+#define AM_TIMER_WHEEL_LEVELS ((64 + AM_TIMER_WHEEL_BITS - 1) / AM_TIMER_WHEEL_BITS)
+
+/** @brief Index of a timer which isn't armed */
+#define AM__TIMER_UNARMED UINT16_MAX
+
+/** @brief Intrusive member of a timer */
+struct am_timer {
+    struct am_list entry;
+    uint64_t expires; /* Tick the timer is due at */
+    uint16_t index;   /* level * SLOTS + slot, or AM__TIMER_UNARMED */
+};
+
+struct am_timer_wheel {
+    uint64_t now;     /* Last tick advanced to */
+    size_t count;     /* Armed timers */
+    uint64_t occupied[AM_TIMER_WHEEL_LEVELS];
+    struct am_list slots[AM_TIMER_WHEEL_LEVELS][AM_TIMER_WHEEL_SLOTS];
+};
+
+/****************************************************************************/
+
+/** @brief Initialize a timer, which starts unarmed */
+AM_ATTR_NON_NULL((1))
+static AM_INLINE
+void am_timer_init(struct am_timer *timer)
+{
+    am_list_head_init(&timer->entry);
+    timer->expires = 0;
+    timer->index = AM__TIMER_UNARMED;
+}
+
+/** @brief Determine if a timer is armed, ie. in a wheel and not fired yet */
+AM_ATTR_NON_NULL((1))
+static AM_INLINE
+bool am_timer_is_armed(const struct am_timer *timer)
+{
+    return timer->index != AM__TIMER_UNARMED;
+}
+
+/** @brief Initialize a wheel
+ * @param now The current tick
+ */
+AM_ATTR_NON_NULL((1)) AM_PUBLIC
+void am_timer_wheel_init(struct am_timer_wheel *wheel, uint64_t now);
+
+/** @brief Number of armed timers */
+AM_ATTR_NON_NULL((1))
+static AM_INLINE
+size_t am_timer_wheel_count(const struct am_timer_wheel *wheel)
+{
+    return wheel->count;
+}
+
+/* Put an unarmed timer in the slot for its expiry */
+AM_ATTR_NON_NULL((1, 2))
+static AM_INLINE
+void am__timer_wheel_place(struct am_timer_wheel *wheel, struct am_timer *timer)
+{
+    uint64_t diff = timer->expires ^ wheel->now;
+    unsigned level = diff == 0 ? 0 : (63 - (unsigned)__builtin_clzll(diff)) / AM_TIMER_WHEEL_BITS;
+    unsigned slot = (unsigned)(timer->expires >> (level * AM_TIMER_WHEEL_BITS)) & (AM_TIMER_WHEEL_SLOTS - 1);
+
+    am_list_add_tail(&timer->entry, &wheel->slots[level][slot]);
+    wheel->occupied[level] |= UINT64_C(1) << slot;
+    timer->index = (uint16_t)(level * AM_TIMER_WHEEL_SLOTS + slot);
+}
+
+/** @brief Arm a timer
+ * A timer due at or before the wheel's current tick fires on the next advance
+ * @param timer An unarmed timer
+ * @param expires The tick it is due at
+ */
+AM_ATTR_NON_NULL((1, 2))
+static AM_INLINE
+void am_timer_wheel_add(struct am_timer_wheel *wheel, struct am_timer *timer, uint64_t expires)
+{
+    timer->expires = AM_MAX(expires, wheel->now);
+    am__timer_wheel_place(wheel, timer);
+    wheel->count++;
+}
+
+/** @brief Cancel a timer
+ * A fired timer is taken off the list it was handed out on instead
+ * @return true if the timer was armed
+ */
+AM_ATTR_NON_NULL((1, 2))
+static AM_INLINE
+bool am_timer_wheel_del(struct am_timer_wheel *wheel, struct am_timer *timer)
+{
+    unsigned level, slot;
+
+    am_list_del(&timer->entry);
+    if (!am_timer_is_armed(timer)) {
+        return false;
+    }
+    level = timer->index / AM_TIMER_WHEEL_SLOTS;
+    slot = timer->index % AM_TIMER_WHEEL_SLOTS;
+    if (am_list_is_empty(&wheel->slots[level][slot])) {
+        wheel->occupied[level] &= ~(UINT64_C(1) << slot);
+    }
+    timer->index = AM__TIMER_UNARMED;
+    wheel->count--;
+    return true;
+}
+
+/** @brief Re-arm a timer, armed or not, for a new expiry */
+AM_ATTR_NON_NULL((1, 2))
+static AM_INLINE
+void am_timer_wheel_mod(struct am_timer_wheel *wheel, struct am_timer *timer, uint64_t expires)
+{
+    am_timer_wheel_del(wheel, timer);
+    am_timer_wheel_add(wheel, timer, expires);
+}
+
+/** @brief First tick at which the wheel has work to do
+ * Never later than the earliest expiry, and equal to it when that timer is
+ * due before the next multiple of 64 ticks; otherwise it is when the
+ * timer's slot cascades.
+ * Either way, advancing to it makes progress, so it is suitable for
+ * computing a poll timeout.
+ * @return false if no timer is armed
+ */
+AM_ATTR_NON_NULL((1, 2))
+static AM_INLINE
+bool am_timer_wheel_next_expiry(const struct am_timer_wheel *wheel, uint64_t *tick)
+{
+    unsigned level;
+
+    /* Occupied slots are all ahead of the current time (at level 0, possibly
+     * on it), so at each level the lowest set bit is the next, and lower
+     * levels come first */
+    for (level = 0; level < AM_TIMER_WHEEL_LEVELS; level++) {
+        if (wheel->occupied[level] != 0) {
+            unsigned shift = level * AM_TIMER_WHEEL_BITS;
+            uint64_t slot = (uint64_t)__builtin_ctzll(wheel->occupied[level]);
+            uint64_t above = shift + AM_TIMER_WHEEL_BITS >= 64
+                ? 0
+                : wheel->now & ~((UINT64_C(1) << (shift + AM_TIMER_WHEEL_BITS)) - 1);
+
+            *tick = above | (slot << shift);
+            return true;
+        }
+    }
+    return false;
+}
+
+/** @brief Move the wheel's time forward, collecting the timers due
+ * Timers due at or before @p now are unarmed and moved to the back of
+ * @p expired, in order of expiry. They may be re-armed right away
+ * @param now The current tick
+ * @param expired List receiving the timers' 'entry'
+ * @return The number of timers which fired
+ */
+AM_ATTR_NON_NULL((1, 3)) AM_PUBLIC
+size_t am_timer_wheel_advance(struct am_timer_wheel *wheel, uint64_t now, struct am_list *expired);
+
+#endif /* ifndef AM_DATA_TIMERWHEEL_H */
@@ -74,6 +74,9 @@
 /** @brief Decorator for a function returns a non-null pointer */
 #define AM_ATTR_RETURNS_NON_NULL
 
+/** @brief Decorator for a type or variable with a minimum alignment */
+#define AM_ATTR_ALIGNED(n) __attribute__((__aligned__(n)))
+
 /** @brief Decorator for a fallthrough switch case */
 #define AM_ATTR_FALLTHROUGH __attribute__((__fallthrough__))
 
@@ -96,6 +99,12 @@
 #define AM_LIKELY(x)   (__builtin_expect(!!(x), 1))
 #define AM_UNLIKELY(x) (__builtin_expect(!!(x), 0))
 #define AM_ARRAY_SIZE(a) (sizeof(a) / sizeof(a[0]))
+/** @brief Hint that the memory at @p addr will soon be read
+ * @note Never faults, so @p addr may be stale or invalid
+ */
+#define AM_PREFETCH(addr) __builtin_prefetch((addr), 0, 3)
+/** @brief Size, in bytes, of a cacheline on the target */
+#define AM_CACHELINE 64
 /** @brief Whether the compiler supports variadic macros
  * 0 - No variadic macros supported
  * 1 - C99 variadic macros supported: \#define(...)    f(__VA_ARGS__)
@@ -0,0 +1,202 @@
+
+#include <string.h>
+#include "am/macros.h"
+#include "am/concurrent/epoch.h"
+#include "am/concurrent/array.h"
+
+static
+size_t snapshot_size(unsigned length)
+{
+    return offsetof(struct am__spmc_array, values) + (size_t)length * sizeof(void *);
+}
+
+static
+struct am__spmc_array *snapshot_create(struct am_alloc *alloc, unsigned length)
+{
+    struct am__spmc_array *a;
+
+    a = am_malloc(alloc, snapshot_size(length));
+    if (a == NULL) {
+        return NULL;
+    }
+    am_atomic_init_uint(&a->num_committed, 0);
+    a->length = length;
+    a->next_retired = NULL;
+    return a;
+}
+
+static
+void snapshot_destroy(struct am_alloc *alloc, struct am__spmc_array *a)
+{
+    am_free(alloc, a, snapshot_size(a->length));
+}
+
+/* The snapshot holding every entry, committed or not */
+static
+struct am__spmc_array *array_working(struct am_spmc_array *arr)
+{
+    return arr->transaction != NULL ? arr->transaction : arr->active;
+}
+
+static
+bool array_find(struct am_spmc_array *arr, const void *val, unsigned *index)
+{
+    struct am__spmc_array *a = array_working(arr);
+    unsigned i;
+
+    for (i = 0; i < arr->num_entries; i++) {
+        if (a->values[i] == val) {
+            *index = i;
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Stage a private copy of the entries, with room for at least 'length' */
+static
+bool array_begin(struct am_spmc_array *arr, unsigned length)
+{
+    struct am__spmc_array *src = array_working(arr);
+    struct am__spmc_array *dst;
+
+    if (arr->transaction != NULL && arr->transaction->length >= length) {
+        return true;
+    }
+
+    dst = snapshot_create(arr->allocator, AM_MAX(length, src->length));
+    if (dst == NULL) {
+        return false;
+    }
+    memcpy(dst->values, src->values, arr->num_entries * sizeof(void *));
+
+    if (arr->transaction != NULL) {
+        snapshot_destroy(arr->allocator, arr->transaction);
+    }
+    arr->transaction = dst;
+    return true;
+}
+
+/*****************************************************************************/
+
+AM_ATTR_NON_NULL((1, 2)) AM_ATTR_WARN_UNUSED_RESULT AM_PUBLIC
+bool am_spmc_array_init(struct am_spmc_array *arr, struct am_alloc *allocator, unsigned length)
+{
+    arr->allocator = allocator;
+    arr->num_entries = 0;
+    arr->transaction = NULL;
+    arr->retired = NULL;
+    arr->active = snapshot_create(allocator, AM_MAX(length, 1));
+    return arr->active != NULL;
+}
+
+AM_ATTR_NON_NULL((1)) AM_PUBLIC
+bool am_spmc_array_commit(struct am_spmc_array *arr)
+{
+    struct am__spmc_array *old = arr->active;
+
+    if (arr->transaction == NULL) {
+        if (am_atomic_load_uint_explicit(&old->num_committed, AM_MEMORY_ORDER_RELAXED) == arr->num_entries) {
+            return false;
+        }
+        /* Appends landed in the active snapshot, past what readers look at */
+        am_atomic_store_uint_explicit(&old->num_committed, arr->num_entries, AM_MEMORY_ORDER_RELEASE);
+        return true;
+    }
+
+    am_atomic_init_uint(&arr->transaction->num_committed, arr->num_entries);
+    am_atomic_store_ptr_explicit((void **)&arr->active, arr->transaction, AM_MEMORY_ORDER_RELEASE);
+    arr->transaction = NULL;
+
+    old->next_retired = arr->retired;
+    arr->retired = old;
+    return true;
+}
+
+AM_ATTR_NON_NULL((1)) AM_ATTR_WARN_UNUSED_RESULT AM_PUBLIC
+bool am_spmc_array_put(struct am_spmc_array *arr, void *val)
+{
+    struct am__spmc_array *a = array_working(arr);
+
+    if (arr->num_entries == a->length) {
+        if (!array_begin(arr, a->length * 2)) {
+            return false;
+        }
+        a = arr->transaction;
+    }
+
+    am_atomic_store_ptr_explicit(&a->values[arr->num_entries], val, AM_MEMORY_ORDER_RELAXED);
+    arr->num_entries++;
+    return true;
+}
+
+AM_ATTR_NON_NULL((1)) AM_PUBLIC
+bool am_spmc_array_put_unique(struct am_spmc_array *arr, void *val)
+{
+    unsigned index;
+
+    if (array_find(arr, val, &index)) {
+        return false;
+    }
+    return am_spmc_array_put(arr, val);
+}
+
+AM_ATTR_NON_NULL((1)) AM_PUBLIC
+bool am_spmc_array_remove(struct am_spmc_array *arr, void *val)
+{
+    struct am__spmc_array *a;
+    unsigned index, last;
+
+    if (!array_find(arr, val, &index)) {
+        return false;
+    }
+
+    /* Committed entries are visible to readers, so they change in a copy */
+    if (arr->transaction == NULL
+            && index < am_atomic_load_uint_explicit(&arr->active->num_committed, AM_MEMORY_ORDER_RELAXED)) {
+        if (!array_begin(arr, arr->active->length)) {
+            return false;
+        }
+    }
+
+    a = array_working(arr);
+    last = --arr->num_entries;
+    am_atomic_store_ptr_explicit(&a->values[index], a->values[last], AM_MEMORY_ORDER_RELAXED);
+    return true;
+}
+
+AM_ATTR_NON_NULL((1)) AM_PUBLIC
+void am_spmc_array_reclaim(struct am_spmc_array *arr)
+{
+    struct am__spmc_array *a, *next;
+
+    for (a = arr->retired; a != NULL; a = next) {
+        next = a->next_retired;
+        snapshot_destroy(arr->allocator, a);
+    }
+    arr->retired = NULL;
+}
+
+AM_ATTR_NON_NULL((1, 2)) AM_PUBLIC
+void am_spmc_array_reclaim_deferred(struct am_spmc_array *arr, struct am_epoch_record *record)
+{
+    struct am__spmc_array *a, *next;
+
+    for (a = arr->retired; a != NULL; a = next) {
+        next = a->next_retired;
+        am_epoch_free(record, a, snapshot_size(a->length));
+    }
+    arr->retired = NULL;
+}
+
+AM_ATTR_NON_NULL((1)) AM_PUBLIC
+void am_spmc_array_destroy(struct am_spmc_array *arr)
+{
+    am_spmc_array_reclaim(arr);
+    if (arr->transaction != NULL) {
+        snapshot_destroy(arr->allocator, arr->transaction);
+        arr->transaction = NULL;
+    }
+    snapshot_destroy(arr->allocator, arr->active);
+    arr->active = NULL;
+}
@@ -0,0 +1,284 @@
+
+#include <string.h>
+#include "am/macros.h"
+#include "am/concurrent/epoch.h"
+
+/* Memory deferred through am_epoch_free */
+struct epoch_deferred_free {
+    struct am_epoch_entry entry;
+    struct am_alloc *allocator;
+    void *ptr;
+    size_t size;
+};
+
+static
+void epoch_deferred_free_cb(struct am_epoch_entry *entry)
+{
+    struct epoch_deferred_free *d = AM_CONTAINER_OF(entry, struct epoch_deferred_free, entry);
+
+    am_free(d->allocator, d->ptr, d->size);
+    am_free(d->allocator, d, sizeof *d);
+}
+
+/* The current epoch, ordered after any unlinking done by the caller */
+static
+unsigned epoch_read(struct am_epoch *epoch)
+{
+    am_atomic_thread_fence(AM_MEMORY_ORDER_SEQ_CST);
+    return am_atomic_load_uint_explicit(&epoch->epoch, AM_MEMORY_ORDER_RELAXED);
+}
+
+/* Advance the epoch if every active reader has observed it
+ * @return The epoch after the attempt
+ */
+static
+unsigned epoch_try_advance(struct am_epoch *epoch)
+{
+    struct am_epoch_record *record;
+    unsigned current;
+
+    current = epoch_read(epoch);
+    record = am_atomic_load_ptr_explicit((void **)&epoch->records, AM_MEMORY_ORDER_ACQUIRE);
+    for (; record != NULL; record = record->next) {
+        if (am_atomic_load_uint_explicit(&record->active, AM_MEMORY_ORDER_ACQUIRE) != 0
+                && am_atomic_load_uint_explicit(&record->epoch, AM_MEMORY_ORDER_RELAXED) != current) {
+            return current;
+        }
+    }
+
+    if (am_atomic_cas_uint(&epoch->epoch, &current, current + 1)) {
+        return current + 1;
+    }
+    /* Someone else advanced it */
+    return current;
+}
+
+static
+unsigned epoch_dispatch_list(struct am_epoch_entry *entry)
+{
+    unsigned n = 0;
+
+    while (entry != NULL) {
+        struct am_epoch_entry *next = entry->next;
+        entry->fn(entry);
+        entry = next;
+        n++;
+    }
+    return n;
+}
+
+/* Run the callbacks deferred at least two epochs before 'current' */
+static
+unsigned epoch_dispatch(struct am_epoch_record *record, unsigned current)
+{
+    unsigned i, n = 0;
+
+    for (i = 0; i < AM_EPOCH_LENGTH; i++) {
+        struct am_epoch_entry *head = record->pending[i];
+
+        if (head != NULL && (int)(current - record->pending_epoch[i]) >= 2) {
+            record->pending[i] = NULL;
+            n += epoch_dispatch_list(head);
+        }
+    }
+    record->n_pending -= n;
+    record->n_dispatched += n;
+    return n;
+}
+
+/*****************************************************************************/
+
+AM_ATTR_NON_NULL((1, 2)) AM_PUBLIC
+void am_epoch_init(struct am_epoch *epoch, struct am_alloc *allocator)
+{
+    am_atomic_init_uint(&epoch->epoch, 0);
+    epoch->records = NULL;
+    epoch->allocator = allocator;
+    am_atomic_init_int(&epoch->reclaimer_stop, 0);
+    epoch->reclaimer_running = false;
+}
+
+AM_ATTR_NON_NULL((1)) AM_PUBLIC
+void am_epoch_destroy(struct am_epoch *epoch)
+{
+    struct am_epoch_record *record, *next;
+
+    am_epoch_reclaimer_stop(epoch);
+    for (record = epoch->records; record != NULL; record = next) {
+        unsigned i;
+
+        next = record->next;
+        /* Nobody is left to read the deferred objects */
+        for (i = 0; i < AM_EPOCH_LENGTH; i++) {
+            epoch_dispatch_list(record->pending[i]);
+        }
+        am_free(epoch->allocator, record, sizeof *record);
+    }
+    epoch->records = NULL;
+}
+
+AM_ATTR_NON_NULL((1)) AM_ATTR_WARN_UNUSED_RESULT AM_PUBLIC
+struct am_epoch_record *am_epoch_register(struct am_epoch *epoch)
+{
+    struct am_epoch_record *record, *head;
+    unsigned i;
+
+    /* Recycle a record from an exited thread */
+    record = am_atomic_load_ptr_explicit((void **)&epoch->records, AM_MEMORY_ORDER_ACQUIRE);
+    for (; record != NULL; record = record->next) {
+        unsigned in_use = 0;
+        if (am_atomic_load_uint_explicit(&record->in_use, AM_MEMORY_ORDER_RELAXED) == 0
+                && am_atomic_cas_uint(&record->in_use, &in_use, 1)) {
+            return record;
+        }
+    }
+
+    record = am_malloc(epoch->allocator, sizeof *record);
+    if (record == NULL) {
+        return NULL;
+    }
+    memset(record, 0, sizeof *record);
+    am_atomic_init_uint(&record->active, 0);
+    am_atomic_init_uint(&record->epoch, 0);
+    am_atomic_init_uint(&record->in_use, 1);
+    record->global = epoch;
+    for (i = 0; i < AM_EPOCH_LENGTH; i++) {
+        record->pending[i] = NULL;
+        record->pending_epoch[i] = 0;
+    }
+    record->n_pending = 0;
+    record->n_dispatched = 0;
+
+    head = am_atomic_load_ptr_explicit((void **)&epoch->records, AM_MEMORY_ORDER_RELAXED);
+    do {
+        record->next = head;
+    } while (!am_atomic_cas_ptr_explicit((void **)&epoch->records, (void **)&head, record,
+                AM_MEMORY_ORDER_RELEASE, AM_MEMORY_ORDER_RELAXED));
+    return record;
+}
+
+AM_ATTR_NON_NULL((1)) AM_PUBLIC
+void am_epoch_unregister(struct am_epoch_record *record)
+{
+    if (record->n_pending != 0) {
+        am_epoch_barrier(record);
+    }
+    am_atomic_store_uint_explicit(&record->in_use, 0, AM_MEMORY_ORDER_RELEASE);
+}
+
+AM_ATTR_NON_NULL((1, 2, 3)) AM_PUBLIC
+void am_epoch_call(struct am_epoch_record *record, struct am_epoch_entry *entry, am_epoch_cb *fn)
+{
+    unsigned current = epoch_read(record->global);
+    unsigned i = current & (AM_EPOCH_LENGTH - 1);
+
+    /* A bucket left over from an older epoch, at least AM_EPOCH_LENGTH back, is already safe to run */
+    if (record->pending[i] != NULL && record->pending_epoch[i] != current) {
+        unsigned n = epoch_dispatch_list(record->pending[i]);
+        record->pending[i] = NULL;
+        record->n_pending -= n;
+        record->n_dispatched += n;
+    }
+
+    entry->fn = fn;
+    entry->next = record->pending[i];
+    record->pending[i] = entry;
+    record->pending_epoch[i] = current;
+
+    if (++record->n_pending >= AM_EPOCH_BATCH) {
+        (void)am_epoch_poll(record);
+    }
+}
+
+AM_ATTR_NON_NULL((1)) AM_PUBLIC
+void am_epoch_free(struct am_epoch_record *record, void *ptr, size_t size)
+{
+    struct am_alloc *allocator = record->global->allocator;
+    struct epoch_deferred_free *d;
+
+    if (ptr == NULL) {
+        return;
+    }
+
+    d = am_malloc(allocator, sizeof *d);
+    if (d == NULL) {
+        am_epoch_synchronize(record);
+        am_free(allocator, ptr, size);
+        return;
+    }
+    d->allocator = allocator;
+    d->ptr = ptr;
+    d->size = size;
+    am_epoch_call(record, &d->entry, epoch_deferred_free_cb);
+}
+
+AM_ATTR_NON_NULL((1)) AM_PUBLIC
+bool am_epoch_poll(struct am_epoch_record *record)
+{
+    unsigned current = epoch_try_advance(record->global);
+
+    return epoch_dispatch(record, current) != 0;
+}
+
+AM_ATTR_NON_NULL((1)) AM_PUBLIC
+void am_epoch_synchronize(struct am_epoch_record *record)
+{
+    struct am_epoch *epoch = record->global;
+    unsigned start = epoch_read(epoch);
+
+    /* Sections which began by 'start' have ended once the epoch moves twice */
+    while ((int)(epoch_try_advance(epoch) - start) < 2) {
+        am_thread_yield();
+    }
+}
+
+AM_ATTR_NON_NULL((1)) AM_PUBLIC
+void am_epoch_barrier(struct am_epoch_record *record)
+{
+    am_epoch_synchronize(record);
+    (void)epoch_dispatch(record, epoch_read(record->global));
+}
+
+/*****************************************************************************/
+
+/* Background reclaimer */
+
+static
+int reclaimer_main(void *ud)
+{
+    struct am_epoch *epoch = ud;
+
+    while (!am_atomic_load_int(&epoch->reclaimer_stop)) {
+        (void)epoch_try_advance(epoch);
+        (void)am_thread_sleep(&epoch->reclaimer_interval, NULL);
+    }
+    return 0;
+}
+
+AM_ATTR_NON_NULL((1, 2)) AM_ATTR_WARN_UNUSED_RESULT AM_PUBLIC
+bool am_epoch_reclaimer_start(struct am_epoch *epoch, const struct timespec *interval)
+{
+    if (epoch->reclaimer_running) {
+        return true;
+    }
+
+    epoch->reclaimer_interval = *interval;
+    am_atomic_store_int(&epoch->reclaimer_stop, 0);
+    if (am_thread_create(&epoch->reclaimer, reclaimer_main, epoch) != AM_THREAD_SUCCESS) {
+        return false;
+    }
+    epoch->reclaimer_running = true;
+    return true;
+}
+
+AM_ATTR_NON_NULL((1)) AM_PUBLIC
+void am_epoch_reclaimer_stop(struct am_epoch *epoch)
+{
+    if (!epoch->reclaimer_running) {
+        return;
+    }
+
+    am_atomic_store_int(&epoch->reclaimer_stop, 1);
+    (void)am_thread_join(epoch->reclaimer, NULL);
+    epoch->reclaimer_running = false;
+}
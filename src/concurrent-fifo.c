@@ -0,0 +1,216 @@
+
+#include "am/macros.h"
+#include "am/concurrent/fifo.h"
+
+/* Hazard slots: the node being read, and its successor */
+#define SLOT_NODE 0
+#define SLOT_NEXT 1
+#define HAZARD_SLOTS 2
+/* Retired nodes per handle before scanning the hazards */
+#define HAZARD_THRESHOLD 32
+
+static
+struct am_fifo_mpmc_node *node_alloc(struct am_fifo_mpmc_handle *handle)
+{
+    struct am_fifo_mpmc_node *node;
+    struct am_stack_entry *it, *tmp;
+
+    if (handle->cache == NULL) {
+        /* Take the whole free list: unlike am_stack_pop, this never reads
+         * the link of an entry another handle may have freed meanwhile */
+        am_stack_foreach_safe(it, tmp, am_stack_pop_all(&handle->fifo->free)) {
+            node = AM_CONTAINER_OF(it, struct am_fifo_mpmc_node, free_entry);
+            node->next = handle->cache;
+            handle->cache = node;
+            handle->n_cached++;
+        }
+    }
+
+    node = handle->cache;
+    if (node != NULL) {
+        handle->cache = node->next;
+        handle->n_cached--;
+        return node;
+    }
+    return am_malloc(handle->fifo->allocator, sizeof *node);
+}
+
+/* Runs once no hazard protects the node, on the thread which retired it
+ * A consumer which never enqueues spills its nodes to the producers
+ */
+static
+void node_recycle(struct am_hazard_entry *entry)
+{
+    struct am_fifo_mpmc_node *node = AM_CONTAINER_OF(entry, struct am_fifo_mpmc_node, hazard_entry);
+    struct am_fifo_mpmc_handle *handle = node->owner;
+
+    if (handle->n_cached < AM_FIFO_MPMC_CACHE) {
+        node->next = handle->cache;
+        handle->cache = node;
+        handle->n_cached++;
+    } else {
+        am_stack_push(&handle->fifo->free, &node->free_entry);
+    }
+}
+
+/*****************************************************************************/
+
+AM_ATTR_NON_NULL((1, 2)) AM_ATTR_WARN_UNUSED_RESULT AM_PUBLIC
+bool am_fifo_mpmc_init(struct am_fifo_mpmc *fifo, struct am_alloc *allocator)
+{
+    struct am_fifo_mpmc_node *dummy;
+
+    dummy = am_malloc(allocator, sizeof *dummy);
+    if (dummy == NULL) {
+        return false;
+    }
+    dummy->value = NULL;
+    dummy->next = NULL;
+
+    fifo->head = dummy;
+    fifo->tail = dummy;
+    fifo->allocator = allocator;
+    am_stack_init(&fifo->free);
+    am_hazard_init(&fifo->hp, allocator, HAZARD_SLOTS, HAZARD_THRESHOLD);
+    return true;
+}
+
+AM_ATTR_NON_NULL((1)) AM_PUBLIC
+void am_fifo_mpmc_destroy(struct am_fifo_mpmc *fifo)
+{
+    struct am_fifo_mpmc_node *node, *next;
+    struct am_stack_entry *it, *tmp;
+
+    for (node = fifo->head; node != NULL; node = next) {
+        next = node->next;
+        am_free(fifo->allocator, node, sizeof *node);
+    }
+    am_stack_foreach_safe(it, tmp, am_stack_pop_all(&fifo->free)) {
+        am_free(fifo->allocator, AM_CONTAINER_OF(it, struct am_fifo_mpmc_node, free_entry), sizeof *node);
+    }
+    fifo->head = NULL;
+    fifo->tail = NULL;
+    am_hazard_destroy(&fifo->hp);
+}
+
+AM_ATTR_NON_NULL((1, 2)) AM_ATTR_WARN_UNUSED_RESULT AM_PUBLIC
+bool am_fifo_mpmc_handle_init(struct am_fifo_mpmc *fifo, struct am_fifo_mpmc_handle *handle)
+{
+    handle->fifo = fifo;
+    handle->cache = NULL;
+    handle->n_cached = 0;
+    handle->hazard = am_hazard_register(&fifo->hp);
+    return handle->hazard != NULL;
+}
+
+AM_ATTR_NON_NULL((1)) AM_PUBLIC
+void am_fifo_mpmc_handle_destroy(struct am_fifo_mpmc_handle *handle)
+{
+    struct am_fifo_mpmc_node *node, *next;
+
+    /* Retired nodes point back at this handle */
+    am_hazard_purge(handle->hazard);
+    am_hazard_unregister(handle->hazard);
+
+    for (node = handle->cache; node != NULL; node = next) {
+        next = node->next;
+        am_free(handle->fifo->allocator, node, sizeof *node);
+    }
+    handle->cache = NULL;
+    handle->n_cached = 0;
+}
+
+AM_ATTR_NON_NULL((1)) AM_ATTR_WARN_UNUSED_RESULT AM_PUBLIC
+bool am_fifo_mpmc_enqueue(struct am_fifo_mpmc_handle *handle, void *value)
+{
+    struct am_fifo_mpmc *fifo = handle->fifo;
+    struct am_fifo_mpmc_node *node, *tail, *next;
+
+    node = node_alloc(handle);
+    if (node == NULL) {
+        return false;
+    }
+    node->value = value;
+    node->next = NULL;
+
+    for (;;) {
+        tail = am_hazard_protect(handle->hazard, SLOT_NODE, (void **)&fifo->tail);
+        next = am_atomic_load_ptr_explicit((void **)&tail->next, AM_MEMORY_ORDER_ACQUIRE);
+        if (am_atomic_load_ptr_explicit((void **)&fifo->tail, AM_MEMORY_ORDER_ACQUIRE) != tail) {
+            continue;
+        }
+
+        if (next != NULL) {
+            /* Help a lagging enqueuer swing the tail */
+            (void)am_atomic_cas_ptr_explicit((void **)&fifo->tail, (void **)&tail, next,
+                    AM_MEMORY_ORDER_RELEASE, AM_MEMORY_ORDER_RELAXED);
+            continue;
+        }
+
+        if (am_atomic_cas_ptr_explicit((void **)&tail->next, (void **)&next, node,
+                    AM_MEMORY_ORDER_RELEASE, AM_MEMORY_ORDER_RELAXED)) {
+            break;
+        }
+    }
+
+    (void)am_atomic_cas_ptr_explicit((void **)&fifo->tail, (void **)&tail, node,
+            AM_MEMORY_ORDER_RELEASE, AM_MEMORY_ORDER_RELAXED);
+    am_hazard_clear(handle->hazard, SLOT_NODE);
+    return true;
+}
+
+AM_ATTR_NON_NULL((1, 2)) AM_PUBLIC
+bool am_fifo_mpmc_dequeue(struct am_fifo_mpmc_handle *handle, void **value)
+{
+    struct am_fifo_mpmc *fifo = handle->fifo;
+    struct am_fifo_mpmc_node *head, *tail, *next;
+
+    for (;;) {
+        head = am_hazard_protect(handle->hazard, SLOT_NODE, (void **)&fifo->head);
+        tail = am_atomic_load_ptr_explicit((void **)&fifo->tail, AM_MEMORY_ORDER_ACQUIRE);
+        next = am_atomic_load_ptr_explicit((void **)&head->next, AM_MEMORY_ORDER_ACQUIRE);
+        am_hazard_set(handle->hazard, SLOT_NEXT, next);
+        /* 'next' stays reachable, hence unretired, while 'head' is still the head */
+        if (am_atomic_load_ptr_explicit((void **)&fifo->head, AM_MEMORY_ORDER_ACQUIRE) != head) {
+            continue;
+        }
+
+        if (next == NULL) {
+            am_hazard_clear(handle->hazard, SLOT_NODE);
+            return false;
+        }
+
+        if (head == tail) {
+            (void)am_atomic_cas_ptr_explicit((void **)&fifo->tail, (void **)&tail, next,
+                    AM_MEMORY_ORDER_RELEASE, AM_MEMORY_ORDER_RELAXED);
+            continue;
+        }
+
+        *value = next->value;
+        if (am_atomic_cas_ptr_explicit((void **)&fifo->head, (void **)&head, next,
+                    AM_MEMORY_ORDER_ACQ_REL, AM_MEMORY_ORDER_RELAXED)) {
+            break;
+        }
+    }
+
+    am_hazard_clear(handle->hazard, SLOT_NODE);
+    am_hazard_clear(handle->hazard, SLOT_NEXT);
+
+    /* 'next' is the new dummy, the old one goes back to a cache */
+    head->owner = handle;
+    am_hazard_retire(handle->hazard, &head->hazard_entry, head, node_recycle);
+    return true;
+}
+
+AM_ATTR_NON_NULL((1)) AM_PUBLIC
+bool am_fifo_mpmc_is_empty(struct am_fifo_mpmc_handle *handle)
+{
+    struct am_fifo_mpmc *fifo = handle->fifo;
+    struct am_fifo_mpmc_node *head;
+    bool empty;
+
+    head = am_hazard_protect(handle->hazard, SLOT_NODE, (void **)&fifo->head);
+    empty = am_atomic_load_ptr_explicit((void **)&head->next, AM_MEMORY_ORDER_ACQUIRE) == NULL;
+    am_hazard_clear(handle->hazard, SLOT_NODE);
+    return empty;
+}
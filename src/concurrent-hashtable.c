@@ -0,0 +1,1056 @@
+
+#include <string.h>
+#include "am/macros.h"
+#include "am/data/hash.h"
+#include "am/concurrent/epoch.h"
+#include "am/concurrent/hazard.h"
+#include "am/concurrent/hashtable.h"
+
+#define MINIMUM_SIZE  16
+
+/* Least slots of the old map moved by each write during a resize */
+#define MIGRATE_SLOTS 16
+
+/* Keys hashed and prefetched ahead of being resolved by am_hashtable_get_batch */
+#define BATCH_LENGTH 16
+
+#define INLINE_KEY_WORDS (AM_HASHTABLE_INLINE_KEY_MAX / sizeof(uintptr_t))
+
+AM_STATIC_ASSERT(sizeof(struct am_hashtable_entry_inline) == AM_CACHELINE,
+        "inline entries should fill a cacheline");
+
+struct am_hashtable_map {
+    struct am_hashtable_map *next_retired;
+    struct am_epoch_entry epoch_entry;
+    struct am_hazard_entry hazard_entry;
+    struct am_alloc *allocator;
+    size_t alloc_size;           /* Size of the allocation starting at this struct */
+    uintptr_t probe_maximum;     /* Longest probe sequence, read by readers */
+    am_atomic_uint generation;   /* Bumped whenever a live entry is relocated */
+    uint64_t probe_limit;        /* Longest probe sequence the writer may create */
+    uint64_t size;               /* Number of slots, a power of 2 */
+    uint64_t mask;
+    size_t stride;               /* Size of a slot, in bytes */
+    uint64_t bucket_length;      /* Slots probed linearly, a cacheline's worth */
+    bool inline_keys;            /* Slots are struct am_hashtable_entry_inline */
+    uintptr_t n_entries;
+    uint64_t n_tombstones;
+    struct am_hashtable_entry *entries;
+};
+
+/*****************************************************************************/
+
+/* Map management */
+
+static
+unsigned log2_u64(uint64_t x)
+{
+    unsigned r = 0;
+    while (x >>= 1) {
+        r++;
+    }
+    return r;
+}
+
+/* Smallest power-of-2 map size with room for 'capacity' entries at 50% load */
+static
+uint64_t map_size_for(uint64_t capacity)
+{
+    uint64_t size = MINIMUM_SIZE;
+    while (size / 2 < capacity) {
+        size <<= 1;
+    }
+    return size;
+}
+
+static
+struct am_hashtable_map *map_create(struct am_alloc *alloc, unsigned mode, uint64_t size)
+{
+    struct am_hashtable_map *map;
+    size_t alloc_size, stride;
+    uintptr_t entries;
+
+    stride = mode == AM_HASHTABLE_MODE_INLINE
+        ? sizeof(struct am_hashtable_entry_inline)
+        : sizeof(struct am_hashtable_entry);
+    alloc_size = sizeof *map + AM_CACHELINE - 1 + size * stride;
+    map = am_malloc(alloc, alloc_size);
+    if (map == NULL) {
+        return NULL;
+    }
+
+    entries = ((uintptr_t)(map + 1) + AM_CACHELINE - 1) & ~(uintptr_t)(AM_CACHELINE - 1);
+
+    map->next_retired = NULL;
+    map->allocator = alloc;
+    map->alloc_size = alloc_size;
+    map->probe_maximum = 0;
+    am_atomic_init_uint(&map->generation, 0);
+    map->stride = stride;
+    map->bucket_length = AM_CACHELINE / stride;
+    map->inline_keys = mode == AM_HASHTABLE_MODE_INLINE;
+    map->probe_limit = AM_MIN(size, map->bucket_length * (log2_u64(size) + 2));
+    map->size = size;
+    map->mask = size - 1;
+    map->n_entries = 0;
+    map->n_tombstones = 0;
+    map->entries = (struct am_hashtable_entry *)entries;
+    memset(map->entries, 0, size * stride);
+    return map;
+}
+
+static
+void map_destroy(struct am_alloc *alloc, struct am_hashtable_map *map)
+{
+    am_free(alloc, map, map->alloc_size);
+}
+
+static
+void map_destroy_deferred(struct am_epoch_entry *entry)
+{
+    struct am_hashtable_map *map = AM_CONTAINER_OF(entry, struct am_hashtable_map, epoch_entry);
+
+    map_destroy(map->allocator, map);
+}
+
+static
+void map_destroy_hazard(struct am_hazard_entry *entry)
+{
+    struct am_hashtable_map *map = AM_CONTAINER_OF(entry, struct am_hashtable_map, hazard_entry);
+
+    map_destroy(map->allocator, map);
+}
+
+/* Entry counts are read by am_hashtable_count/stat from any thread */
+static AM_INLINE
+void map_count_add(struct am_hashtable_map *map, intptr_t delta)
+{
+    am_atomic_store_uintptr_explicit(&map->n_entries, map->n_entries + delta, AM_MEMORY_ORDER_RELAXED);
+}
+
+static AM_INLINE
+bool slot_live(const struct am_hashtable_entry *slot)
+{
+    return slot->key != AM_HASHTABLE_KEY_EMPTY && slot->key != AM_HASHTABLE_KEY_TOMBSTONE;
+}
+
+static AM_INLINE
+struct am_hashtable_entry *map_slot(const struct am_hashtable_map *map, uint64_t i)
+{
+    return (struct am_hashtable_entry *)((char *)map->entries + i * map->stride);
+}
+
+/* Inline storage of a slot, only valid for inline maps */
+static AM_INLINE
+uintptr_t *slot_key_inline(struct am_hashtable_entry *slot)
+{
+    return ((struct am_hashtable_entry_inline *)slot)->key_inline;
+}
+
+static AM_INLINE
+bool slot_key_is_inline(struct am_hashtable_entry *slot, uintptr_t key)
+{
+    return key == (uintptr_t)slot_key_inline(slot);
+}
+
+/* The slot visited by the 'probe'th step of the sequence for 'hash'
+ * Slots within a bucket are visited linearly, and buckets are visited
+ * along triangular numbers, which covers every bucket of a power-of-2 map
+ */
+static AM_INLINE
+struct am_hashtable_entry *map_probe_slot(const struct am_hashtable_map *map, uint64_t hash, uint64_t probe)
+{
+    const uint64_t length = map->bucket_length;
+    const uint64_t step = probe / length;
+    uint64_t bucket, slot;
+
+    bucket = ((hash & map->mask) & ~(length - 1)) + length * (step * (step + 1) / 2);
+    slot = (bucket & map->mask) | ((hash + probe) & (length - 1));
+    return map_slot(map, slot);
+}
+
+static AM_INLINE
+bool entry_matches(
+        unsigned mode,
+        uintptr_t key,
+        uintptr_t hash,
+        uintptr_t key_length,
+        uint64_t query_hash,
+        const struct am_hashtable_entry *query)
+{
+    if (mode == AM_HASHTABLE_MODE_DIRECT) {
+        return key == query->key;
+    }
+    if (hash != (uintptr_t)query_hash || key_length != query->key_length) {
+        return false;
+    }
+    return key == query->key || memcmp((const void *)key, (const void *)query->key, key_length) == 0;
+}
+
+/* Read the entry for a key, safe to run concurrently with the writer */
+static
+bool map_probe_rd(
+        struct am_hashtable_map *map,
+        unsigned mode,
+        uint64_t hash,
+        struct am_hashtable_entry *entry)
+{
+    uintptr_t inline_key[INLINE_KEY_WORDS];
+    uint64_t probe, probe_maximum;
+
+    probe_maximum = am_atomic_load_uintptr_explicit(&map->probe_maximum, AM_MEMORY_ORDER_ACQUIRE);
+    for (probe = 0; probe < probe_maximum; probe++) {
+        struct am_hashtable_entry *cursor = map_probe_slot(map, hash, probe);
+        uintptr_t key, key_snapshot, h, len, value;
+
+retry:
+        key = am_atomic_load_uintptr_explicit(&cursor->key, AM_MEMORY_ORDER_ACQUIRE);
+        if (key == AM_HASHTABLE_KEY_EMPTY) {
+            return false;
+        }
+        if (key == AM_HASHTABLE_KEY_TOMBSTONE) {
+            continue;
+        }
+
+        h     = am_atomic_load_uintptr_explicit(&cursor->hash, AM_MEMORY_ORDER_RELAXED);
+        len   = am_atomic_load_uintptr_explicit(&cursor->key_length, AM_MEMORY_ORDER_RELAXED);
+        value = am_atomic_load_uintptr_explicit(&cursor->value, AM_MEMORY_ORDER_RELAXED);
+
+        /* Short keys are compared from a snapshot of the slot, so probing
+         * never leaves its cacheline. Torn copies are caught by the
+         * generation check in table_get, since reusing a slot bumps it
+         */
+        if (map->inline_keys && slot_key_is_inline(cursor, key) && h == (uintptr_t)hash) {
+            uintptr_t *src = slot_key_inline(cursor);
+            unsigned i;
+
+            for (i = 0; i < INLINE_KEY_WORDS; i++) {
+                inline_key[i] = am_atomic_load_uintptr_explicit(&src[i], AM_MEMORY_ORDER_RELAXED);
+            }
+            key_snapshot = (uintptr_t)inline_key;
+        } else {
+            key_snapshot = key;
+        }
+
+        /* The slot may have been reused while it was being read */
+        am_atomic_thread_fence(AM_MEMORY_ORDER_ACQUIRE);
+        if (am_atomic_load_uintptr_explicit(&cursor->key, AM_MEMORY_ORDER_RELAXED) != key) {
+            goto retry;
+        }
+
+        if (entry_matches(mode, key_snapshot, h, len, hash, entry)) {
+            /* An inline key can't outlive the slot, hand back the caller's */
+            if (key_snapshot == key) {
+                entry->key = key;
+            }
+            entry->value = value;
+            entry->key_length = len;
+            entry->hash = h;
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Find the slot holding a key, and the first slot available for it
+ * Writer only. Probe indices are returned through 'probe_found' and
+ * 'probe_available', when the respective slot is non-NULL
+ */
+static
+struct am_hashtable_entry *map_probe_wr(
+        struct am_hashtable_map *map,
+        unsigned mode,
+        uint64_t hash,
+        const struct am_hashtable_entry *query,
+        struct am_hashtable_entry **available,
+        uint64_t *probe_found,
+        uint64_t *probe_available)
+{
+    uint64_t probe;
+
+    *available = NULL;
+    for (probe = 0; probe < map->probe_limit; probe++) {
+        struct am_hashtable_entry *cursor = map_probe_slot(map, hash, probe);
+
+        if (cursor->key == AM_HASHTABLE_KEY_EMPTY) {
+            if (*available == NULL) {
+                *available = cursor;
+                *probe_available = probe;
+            }
+            return NULL;
+        }
+        if (cursor->key == AM_HASHTABLE_KEY_TOMBSTONE) {
+            if (*available == NULL) {
+                *available = cursor;
+                *probe_available = probe;
+            }
+            continue;
+        }
+        if (entry_matches(mode, cursor->key, cursor->hash, cursor->key_length, hash, query)) {
+            *probe_found = probe;
+            return cursor;
+        }
+        /* No key lives past the probe maximum, so only a free slot is left to find */
+        if (probe >= map->probe_maximum && *available != NULL) {
+            return NULL;
+        }
+    }
+    return NULL;
+}
+
+/* Publish an entry into a free slot
+ * Readers see the key last, after the rest of the entry
+ */
+static
+void map_slot_publish(
+        struct am_hashtable_map *map,
+        struct am_hashtable_entry *slot,
+        uint64_t probe,
+        const struct am_hashtable_entry *entry)
+{
+    uintptr_t key = entry->key;
+
+    if (slot->key == AM_HASHTABLE_KEY_TOMBSTONE) {
+        map->n_tombstones--;
+        /* Readers part-way through the old entry must notice it being overwritten:
+         * its key may come back before their re-check, paired with this value
+         */
+        am_atomic_fetch_add_uint_explicit(&map->generation, 1, AM_MEMORY_ORDER_RELAXED);
+        /* Readers still holding the old key must see the tombstone on their re-check */
+        am_atomic_thread_fence(AM_MEMORY_ORDER_RELEASE);
+    }
+
+    am_atomic_store_uintptr_explicit(&slot->value, entry->value, AM_MEMORY_ORDER_RELAXED);
+    am_atomic_store_uintptr_explicit(&slot->key_length, entry->key_length, AM_MEMORY_ORDER_RELAXED);
+    am_atomic_store_uintptr_explicit(&slot->hash, entry->hash, AM_MEMORY_ORDER_RELAXED);
+
+    if (map->inline_keys && entry->key_length <= AM_HASHTABLE_INLINE_KEY_MAX) {
+        uintptr_t words[INLINE_KEY_WORDS] = { 0 };
+        uintptr_t *dst = slot_key_inline(slot);
+        unsigned i;
+
+        /* The key may already be the inline copy of another slot */
+        memcpy(words, (const void *)key, entry->key_length);
+        for (i = 0; i < INLINE_KEY_WORDS; i++) {
+            am_atomic_store_uintptr_explicit(&dst[i], words[i], AM_MEMORY_ORDER_RELAXED);
+        }
+        key = (uintptr_t)dst;
+    }
+
+    if (probe + 1 > map->probe_maximum) {
+        am_atomic_store_uintptr_explicit(&map->probe_maximum, probe + 1, AM_MEMORY_ORDER_RELEASE);
+    }
+    am_atomic_store_uintptr_explicit(&slot->key, key, AM_MEMORY_ORDER_RELEASE);
+}
+
+/* Move a live entry into an earlier free slot of its probe sequence */
+static
+void map_relocate(
+        struct am_hashtable_map *map,
+        struct am_hashtable_entry *from,
+        struct am_hashtable_entry *to,
+        uint64_t to_probe)
+{
+    struct am_hashtable_entry snapshot = *from;
+
+    map_slot_publish(map, to, to_probe, &snapshot);
+    /* Readers that passed 'to' before the copy must notice the move */
+    am_atomic_fetch_add_uint_explicit(&map->generation, 1, AM_MEMORY_ORDER_RELEASE);
+    am_atomic_store_uintptr_explicit(&from->key, AM_HASHTABLE_KEY_TOMBSTONE, AM_MEMORY_ORDER_RELEASE);
+    map->n_tombstones++;
+}
+
+/* Copy the live entries of 'src' into 'dst'
+ * Fails if an entry doesn't fit within the probe limit of 'dst'
+ */
+static
+bool map_copy(unsigned mode, struct am_hashtable_map *dst, const struct am_hashtable_map *src)
+{
+    uint64_t i;
+
+    for (i = 0; i < src->size; i++) {
+        const struct am_hashtable_entry *entry = map_slot(src, i);
+        struct am_hashtable_entry *available;
+        uint64_t probe_found, probe_available;
+
+        if (!slot_live(entry)) {
+            continue;
+        }
+
+        (void)map_probe_wr(dst, mode, entry->hash, entry, &available, &probe_found, &probe_available);
+        if (available == NULL) {
+            return false;
+        }
+        map_slot_publish(dst, available, probe_available, entry);
+        map_count_add(dst, 1);
+    }
+    return true;
+}
+
+static
+void table_retire(struct am_hashtable *ht, struct am_hashtable_map *map)
+{
+    map->next_retired = ht->retired;
+    ht->retired = map;
+}
+
+/* Install 'map' as the only map, retiring the active and migrating maps
+ * Readers which loaded the old pair notice the change and retry
+ */
+static
+void table_replace_map(struct am_hashtable *ht, struct am_hashtable_map *map)
+{
+    struct am_hashtable_map *old = ht->map;
+    struct am_hashtable_map *migrating = ht->migrating;
+
+    am_atomic_store_ptr_explicit((void **)&ht->map, map, AM_MEMORY_ORDER_RELEASE);
+    am_atomic_store_ptr_explicit((void **)&ht->migrating, NULL, AM_MEMORY_ORDER_RELEASE);
+    table_retire(ht, old);
+    if (migrating != NULL) {
+        table_retire(ht, migrating);
+    }
+}
+
+/* Synchronously merge every entry into a map of at least 'size' slots
+ * Only used when an incremental migration can't place an entry
+ */
+static
+bool table_rebuild(struct am_hashtable *ht, uint64_t size)
+{
+    struct am_hashtable_map *map;
+
+    for (;;) {
+        map = map_create(ht->allocator, ht->mode, size);
+        if (map == NULL) {
+            return false;
+        }
+        if (map_copy(ht->mode, map, ht->map)
+                && (ht->migrating == NULL || map_copy(ht->mode, map, ht->migrating))) {
+            break;
+        }
+        /* Pathological clustering, try again with more room */
+        map_destroy(ht->allocator, map);
+        size <<= 1;
+    }
+    table_replace_map(ht, map);
+    return true;
+}
+
+/* Move a live entry of the migrating map into the active map */
+static
+bool table_migrate_entry(struct am_hashtable *ht, struct am_hashtable_entry *slot)
+{
+    struct am_hashtable_map *map = ht->map;
+    struct am_hashtable_map *old = ht->migrating;
+    struct am_hashtable_entry *available;
+    uint64_t probe_found, probe_available;
+
+    (void)map_probe_wr(map, ht->mode, slot->hash, slot, &available, &probe_found, &probe_available);
+    if (available == NULL) {
+        return false;
+    }
+
+    map_slot_publish(map, available, probe_available, slot);
+    map_count_add(map, 1);
+
+    /* Readers that missed the copy in the active map must not miss the original */
+    am_atomic_fetch_add_uint_explicit(&old->generation, 1, AM_MEMORY_ORDER_RELEASE);
+    am_atomic_store_uintptr_explicit(&slot->key, AM_HASHTABLE_KEY_TOMBSTONE, AM_MEMORY_ORDER_RELEASE);
+    map_count_add(old, -1);
+    old->n_tombstones++;
+    return true;
+}
+
+/* Migrate up to 'slots' slots of the old map, retiring it once drained */
+static
+bool table_migrate(struct am_hashtable *ht, uint64_t slots)
+{
+    struct am_hashtable_map *old = ht->migrating;
+    uintptr_t cursor = ht->migrate_cursor;
+
+    while (slots > 0 && cursor < old->size) {
+        struct am_hashtable_entry *slot = map_slot(old, cursor);
+
+        if (slot_live(slot) && !table_migrate_entry(ht, slot)) {
+            return table_rebuild(ht, ht->map->size << 1);
+        }
+        cursor++;
+        slots--;
+    }
+    am_atomic_store_uintptr_explicit(&ht->migrate_cursor, cursor, AM_MEMORY_ORDER_RELAXED);
+
+    if (cursor == old->size) {
+        am_atomic_store_ptr_explicit((void **)&ht->migrating, NULL, AM_MEMORY_ORDER_RELEASE);
+        table_retire(ht, old);
+    }
+    return true;
+}
+
+/* Slots for this write to migrate, so the old map drains before the new
+ * one reaches 50% load. Entries still in the old map count against the
+ * new one, and each write adds at most one slot, so the share only grows
+ * when the room left runs out faster than the old map
+ */
+static
+uint64_t table_migrate_pace(const struct am_hashtable *ht)
+{
+    const struct am_hashtable_map *map = ht->map;
+    const struct am_hashtable_map *old = ht->migrating;
+    uint64_t used = map->n_entries + map->n_tombstones + old->n_entries + 1;
+    uint64_t left = old->size - ht->migrate_cursor;
+    uint64_t room;
+
+    if (used >= map->size / 2) {
+        return left;
+    }
+    room = map->size / 2 - used;
+    return AM_MAX((uint64_t)MIGRATE_SLOTS, (left + room - 1) / room);
+}
+
+/* Begin migrating into a fresh map of 'size' slots
+ * A migration already in progress is completed first, which only happens
+ * when probing the active map fails, or on an explicit am_hashtable_grow
+ */
+static
+bool table_migrate_start(struct am_hashtable *ht, uint64_t size)
+{
+    struct am_hashtable_map *map = ht->map;
+
+    if (ht->migrating != NULL) {
+        if (!table_migrate(ht, UINT64_MAX)) {
+            return false;
+        }
+        /* Finishing may have rebuilt the table into a fresh map which is large enough */
+        if (ht->map != map && ht->map->size >= size) {
+            return true;
+        }
+    }
+
+    map = map_create(ht->allocator, ht->mode, size);
+    if (map == NULL) {
+        return false;
+    }
+
+    /* Readers that see the new map must also see the old one */
+    am_atomic_store_uintptr_explicit(&ht->migrate_cursor, 0, AM_MEMORY_ORDER_RELAXED);
+    am_atomic_store_ptr_explicit((void **)&ht->migrating, ht->map, AM_MEMORY_ORDER_RELEASE);
+    am_atomic_store_ptr_explicit((void **)&ht->map, map, AM_MEMORY_ORDER_RELEASE);
+    return true;
+}
+
+/* Do this write's share of the migration, and make sure the key written
+ * lives in the active map
+ */
+static
+bool table_prepare(struct am_hashtable *ht, uint64_t hash, const struct am_hashtable_entry *entry)
+{
+    struct am_hashtable_entry *found, *available;
+    uint64_t probe_found, probe_available;
+
+    if (ht->migrating == NULL) {
+        return true;
+    }
+    if (!table_migrate(ht, table_migrate_pace(ht))) {
+        return false;
+    }
+    if (ht->migrating == NULL) {
+        return true;
+    }
+
+    found = map_probe_wr(ht->migrating, ht->mode, hash, entry, &available, &probe_found, &probe_available);
+    if (found != NULL && !table_migrate_entry(ht, found)) {
+        return table_rebuild(ht, ht->map->size << 1);
+    }
+    return true;
+}
+
+/* Make room for one more entry, keeping the load factor below 50% */
+static
+bool table_reserve(struct am_hashtable *ht)
+{
+    const struct am_hashtable_map *map = ht->map;
+
+    if ((map->n_entries + map->n_tombstones + 1) * 2 <= map->size) {
+        return true;
+    }
+    /* table_migrate_pace keeps the migration ahead of the inserts,
+     * so finishing it on the spot is only a safety net */
+    if (ht->migrating != NULL) {
+        if (!table_migrate(ht, UINT64_MAX)) {
+            return false;
+        }
+        map = ht->map;
+        if ((map->n_entries + map->n_tombstones + 1) * 2 <= map->size) {
+            return true;
+        }
+    }
+    /* Mostly tombstones: a rebuild at the same size is enough */
+    if ((map->n_entries + 1) * 4 <= map->size) {
+        return table_migrate_start(ht, map->size);
+    }
+    return table_migrate_start(ht, map->size << 1);
+}
+
+/* Shrink once the table is mostly empty */
+static
+void table_trim(struct am_hashtable *ht)
+{
+    const struct am_hashtable_map *map = ht->map;
+
+    if (ht->migrating == NULL && map->size > MINIMUM_SIZE && map->n_entries * 8 < map->size) {
+        /* Failing to shrink is harmless */
+        (void)table_migrate_start(ht, map_size_for(map->n_entries * 2));
+    }
+}
+
+/*****************************************************************************/
+
+static
+uint64_t hash_default(const void *data, size_t len, uint64_t seed)
+{
+    uint64_t lo, hi;
+
+    lo = am_hash_murmur_x86_32(data, len, (uint32_t)seed);
+    hi = am_hash_murmur_x86_32(data, len, (uint32_t)(seed >> 32) ^ (uint32_t)lo);
+    return lo | (hi << 32);
+}
+
+AM_ATTR_NON_NULL((1, 4)) AM_ATTR_WARN_UNUSED_RESULT AM_PUBLIC
+bool am_hashtable_init(
+        struct am_hashtable *ht,
+        enum am_hashtable_mode mode,
+        am_hashtable_hash_fn *hash_fn,
+        struct am_alloc *allocator,
+        uint64_t initial_size,
+        uint64_t seed)
+{
+    ht->allocator = allocator;
+    ht->migrating = NULL;
+    ht->migrate_cursor = 0;
+    ht->retired = NULL;
+    ht->mode = mode;
+    ht->seed = seed;
+    ht->hash_fn = hash_fn;
+    ht->map = map_create(allocator, mode, map_size_for(initial_size));
+    return ht->map != NULL;
+}
+
+AM_ATTR_NON_NULL((1)) AM_PUBLIC
+void am_hashtable_destroy(struct am_hashtable *ht)
+{
+    am_hashtable_reclaim(ht);
+    if (ht->migrating != NULL) {
+        map_destroy(ht->allocator, ht->migrating);
+        ht->migrating = NULL;
+    }
+    map_destroy(ht->allocator, ht->map);
+    ht->map = NULL;
+}
+
+AM_ATTR_NON_NULL((1)) AM_PUBLIC
+uint64_t am_hashtable_hash(const struct am_hashtable *ht, const void *key, uint16_t key_length)
+{
+    if (ht->hash_fn != NULL) {
+        return ht->hash_fn(key, key_length, ht->seed);
+    }
+    return hash_default(key, key_length, ht->seed);
+}
+
+AM_ATTR_NON_NULL((1)) AM_PUBLIC
+uint64_t am_hashtable_hash_direct(const struct am_hashtable *ht, uintptr_t key)
+{
+    if (ht->hash_fn != NULL) {
+        return ht->hash_fn(&key, sizeof key, ht->seed);
+    }
+    return am_hash_fmix64((uint64_t)key ^ ht->seed);
+}
+
+/* Look up a key in the active and migrating maps
+ * With a hazard record, both maps are protected before being probed
+ */
+static
+bool table_get(
+        struct am_hashtable *ht,
+        struct am_hazard_record *record,
+        uint64_t hash,
+        struct am_hashtable_entry *entry)
+{
+    struct am_hashtable_map *map, *old;
+    unsigned generation, old_generation = 0;
+    bool found;
+
+    for (;;) {
+        map = am_atomic_load_ptr_explicit((void **)&ht->map, AM_MEMORY_ORDER_ACQUIRE);
+        old = am_atomic_load_ptr_explicit((void **)&ht->migrating, AM_MEMORY_ORDER_ACQUIRE);
+        if (record != NULL) {
+            am_hazard_set(record, 0, map);
+            am_hazard_set(record, 1, old);
+            if (am_atomic_load_ptr_explicit((void **)&ht->map, AM_MEMORY_ORDER_ACQUIRE) != map
+                    || am_atomic_load_ptr_explicit((void **)&ht->migrating, AM_MEMORY_ORDER_ACQUIRE) != old) {
+                continue;
+            }
+        }
+
+        generation = am_atomic_load_uint_explicit(&map->generation, AM_MEMORY_ORDER_ACQUIRE);
+        if (old != NULL) {
+            old_generation = am_atomic_load_uint_explicit(&old->generation, AM_MEMORY_ORDER_ACQUIRE);
+        }
+
+        /* Entries are moved out of the old map, so check the new one first */
+        found = map_probe_rd(map, ht->mode, hash, entry);
+        if (!found && old != NULL && old != map) {
+            found = map_probe_rd(old, ht->mode, hash, entry);
+        }
+
+        am_atomic_thread_fence(AM_MEMORY_ORDER_ACQUIRE);
+        if (am_atomic_load_uint_explicit(&map->generation, AM_MEMORY_ORDER_RELAXED) != generation) {
+            continue;
+        }
+        if (am_atomic_load_ptr_explicit((void **)&ht->map, AM_MEMORY_ORDER_RELAXED) != map
+                || am_atomic_load_ptr_explicit((void **)&ht->migrating, AM_MEMORY_ORDER_RELAXED) != old) {
+            continue;
+        }
+        if (old != NULL && am_atomic_load_uint_explicit(&old->generation, AM_MEMORY_ORDER_RELAXED) != old_generation) {
+            continue;
+        }
+        break;
+    }
+
+    if (record != NULL) {
+        am_hazard_clear(record, 0);
+        am_hazard_clear(record, 1);
+    }
+    return found;
+}
+
+AM_ATTR_NON_NULL((1, 3)) AM_PUBLIC
+bool am_hashtable_get(struct am_hashtable *ht, uint64_t hash, struct am_hashtable_entry *entry)
+{
+    return table_get(ht, NULL, hash, entry);
+}
+
+AM_ATTR_NON_NULL((1)) AM_PUBLIC
+size_t am_hashtable_get_batch(struct am_hashtable *ht, struct am_hashtable_entry *entries, bool *found, size_t n)
+{
+    size_t i, j, hits = 0;
+
+    for (i = 0; i < n; i += BATCH_LENGTH) {
+        const size_t end = AM_MIN(n, i + BATCH_LENGTH);
+        struct am_hashtable_map *map, *old;
+
+        /* Prefetching never faults, so stale maps are harmless here */
+        map = am_atomic_load_ptr_explicit((void **)&ht->map, AM_MEMORY_ORDER_ACQUIRE);
+        old = am_atomic_load_ptr_explicit((void **)&ht->migrating, AM_MEMORY_ORDER_ACQUIRE);
+        for (j = i; j < end; j++) {
+            struct am_hashtable_entry *entry = &entries[j];
+
+            if (ht->mode == AM_HASHTABLE_MODE_DIRECT) {
+                entry->hash = am_hashtable_hash_direct(ht, entry->key);
+            } else {
+                entry->hash = am_hashtable_hash(ht, (const void *)entry->key, entry->key_length);
+            }
+            AM_PREFETCH(map_probe_slot(map, entry->hash, 0));
+            if (old != NULL) {
+                AM_PREFETCH(map_probe_slot(old, entry->hash, 0));
+            }
+        }
+
+        for (j = i; j < end; j++) {
+            found[j] = table_get(ht, NULL, entries[j].hash, &entries[j]);
+            hits += found[j];
+        }
+    }
+    return hits;
+}
+
+AM_ATTR_NON_NULL((1, 2, 4)) AM_PUBLIC
+bool am_hashtable_get_hazard(
+        struct am_hashtable *ht,
+        struct am_hazard_record *record,
+        uint64_t hash,
+        struct am_hashtable_entry *entry)
+{
+    return table_get(ht, record, hash, entry);
+}
+
+AM_ATTR_NON_NULL((1, 3)) AM_PUBLIC
+bool am_hashtable_put(struct am_hashtable *ht, uint64_t hash, struct am_hashtable_entry *entry)
+{
+    struct am_hashtable_entry *found, *available;
+    uint64_t probe_found, probe_available;
+
+    if (!table_reserve(ht)) {
+        return false;
+    }
+
+    for (;;) {
+        if (!table_prepare(ht, hash, entry)) {
+            return false;
+        }
+        found = map_probe_wr(ht->map, ht->mode, hash, entry, &available, &probe_found, &probe_available);
+        if (found != NULL) {
+            return false;
+        }
+        if (available != NULL) {
+            break;
+        }
+        if (!table_migrate_start(ht, ht->map->size << 1)) {
+            return false;
+        }
+    }
+
+    entry->hash = hash;
+    map_slot_publish(ht->map, available, probe_available, entry);
+    map_count_add(ht->map, 1);
+    return true;
+}
+
+AM_ATTR_NON_NULL((1, 3)) AM_PUBLIC
+bool am_hashtable_set(struct am_hashtable *ht, uint64_t hash, struct am_hashtable_entry *entry)
+{
+    struct am_hashtable_map *map;
+    struct am_hashtable_entry *found, *available;
+    struct am_hashtable_entry previous;
+    uint64_t probe_found, probe_available;
+
+    if (!table_reserve(ht)) {
+        return false;
+    }
+
+    for (;;) {
+        if (!table_prepare(ht, hash, entry)) {
+            return false;
+        }
+        map = ht->map;
+        found = map_probe_wr(map, ht->mode, hash, entry, &available, &probe_found, &probe_available);
+        if (found != NULL || available != NULL) {
+            break;
+        }
+        if (!table_migrate_start(ht, map->size << 1)) {
+            return false;
+        }
+    }
+
+    entry->hash = hash;
+    if (found == NULL) {
+        map_slot_publish(map, available, probe_available, entry);
+        map_count_add(map, 1);
+        entry->key = AM_HASHTABLE_KEY_EMPTY;
+        return true;
+    }
+
+    previous = *found;
+    /* An inline key can't outlive the slot, hand back the caller's */
+    if (map->inline_keys && slot_key_is_inline(found, previous.key)) {
+        previous.key = entry->key;
+    }
+    if (available != NULL && probe_available < probe_found) {
+        /* Shorten the probe sequence while we're here */
+        map_slot_publish(map, available, probe_available, entry);
+        am_atomic_fetch_add_uint_explicit(&map->generation, 1, AM_MEMORY_ORDER_RELEASE);
+        am_atomic_store_uintptr_explicit(&found->key, AM_HASHTABLE_KEY_TOMBSTONE, AM_MEMORY_ORDER_RELEASE);
+        map->n_tombstones++;
+    } else if (map->inline_keys && slot_key_is_inline(found, found->key)) {
+        /* The inline key already equals the caller's */
+        am_atomic_store_uintptr_explicit(&found->value, entry->value, AM_MEMORY_ORDER_RELEASE);
+    } else {
+        am_atomic_store_uintptr_explicit(&found->value, entry->value, AM_MEMORY_ORDER_RELAXED);
+        am_atomic_store_uintptr_explicit(&found->key, entry->key, AM_MEMORY_ORDER_RELEASE);
+    }
+    *entry = previous;
+    return true;
+}
+
+AM_ATTR_NON_NULL((1, 3)) AM_PUBLIC
+bool am_hashtable_remove(struct am_hashtable *ht, uint64_t hash, struct am_hashtable_entry *entry)
+{
+    struct am_hashtable_map *map;
+    struct am_hashtable_entry *found, *available;
+    uint64_t probe_found, probe_available;
+
+    if (!table_prepare(ht, hash, entry)) {
+        return false;
+    }
+
+    map = ht->map;
+    found = map_probe_wr(map, ht->mode, hash, entry, &available, &probe_found, &probe_available);
+    if (found == NULL) {
+        return false;
+    }
+
+    if (map->inline_keys && slot_key_is_inline(found, found->key)) {
+        uintptr_t key = entry->key;
+        *entry = *found;
+        entry->key = key;
+    } else {
+        *entry = *found;
+    }
+    am_atomic_store_uintptr_explicit(&found->key, AM_HASHTABLE_KEY_TOMBSTONE, AM_MEMORY_ORDER_RELEASE);
+    map_count_add(map, -1);
+    map->n_tombstones++;
+
+    table_trim(ht);
+    return true;
+}
+
+AM_ATTR_NON_NULL((1)) AM_PUBLIC
+bool am_hashtable_gc(struct am_hashtable *ht, uint64_t cycles, uint64_t seed)
+{
+    struct am_hashtable_map *map = ht->map;
+    uint64_t i, n, probe_maximum = 0;
+
+    if (ht->migrating != NULL) {
+        return table_migrate(ht, cycles == 0 ? UINT64_MAX : cycles);
+    }
+
+    /* A full pass over a tombstone-heavy map is better spent rebuilding it */
+    if (cycles == 0 && map->n_tombstones * 4 > map->size) {
+        return table_migrate_start(ht, map->size) && table_migrate(ht, UINT64_MAX);
+    }
+
+    n = (cycles == 0 || cycles > map->size) ? map->size : cycles;
+    for (i = 0; i < n; i++) {
+        struct am_hashtable_entry *slot = map_slot(map, (seed + i) & map->mask);
+        struct am_hashtable_entry *found, *available;
+        uint64_t probe_found = 0, probe_available = 0;
+
+        if (!slot_live(slot)) {
+            continue;
+        }
+
+        found = map_probe_wr(map, ht->mode, slot->hash, slot, &available, &probe_found, &probe_available);
+        if (found == NULL) {
+            /* Only possible with an inconsistent map */
+            return false;
+        }
+        if (available != NULL && probe_available < probe_found) {
+            map_relocate(map, found, available, probe_available);
+            probe_found = probe_available;
+        }
+        probe_maximum = AM_MAX(probe_maximum, probe_found + 1);
+    }
+
+    /* Every live entry was visited, so the bound can be tightened */
+    if (n == map->size) {
+        am_atomic_store_uintptr_explicit(&map->probe_maximum, probe_maximum, AM_MEMORY_ORDER_RELEASE);
+    }
+    return true;
+}
+
+AM_ATTR_NON_NULL((1)) AM_ATTR_WARN_UNUSED_RESULT AM_PUBLIC
+bool am_hashtable_grow(struct am_hashtable *ht, uint64_t capacity)
+{
+    uint64_t size = map_size_for(capacity);
+
+    if (size <= ht->map->size) {
+        return true;
+    }
+    return table_migrate_start(ht, size);
+}
+
+AM_ATTR_NON_NULL((1)) AM_ATTR_WARN_UNUSED_RESULT AM_PUBLIC
+bool am_hashtable_reset(struct am_hashtable *ht)
+{
+    struct am_hashtable_map *map;
+
+    map = map_create(ht->allocator, ht->mode, ht->map->size);
+    if (map == NULL) {
+        return false;
+    }
+    table_replace_map(ht, map);
+    return true;
+}
+
+AM_ATTR_NON_NULL((1)) AM_PUBLIC
+void am_hashtable_reclaim(struct am_hashtable *ht)
+{
+    struct am_hashtable_map *map, *next;
+
+    for (map = ht->retired; map != NULL; map = next) {
+        next = map->next_retired;
+        map_destroy(ht->allocator, map);
+    }
+    ht->retired = NULL;
+}
+
+AM_ATTR_NON_NULL((1, 2)) AM_PUBLIC
+void am_hashtable_reclaim_deferred(struct am_hashtable *ht, struct am_epoch_record *record)
+{
+    struct am_hashtable_map *map, *next;
+
+    for (map = ht->retired; map != NULL; map = next) {
+        next = map->next_retired;
+        am_epoch_call(record, &map->epoch_entry, map_destroy_deferred);
+    }
+    ht->retired = NULL;
+}
+
+AM_ATTR_NON_NULL((1, 2)) AM_PUBLIC
+void am_hashtable_reclaim_hazard(struct am_hashtable *ht, struct am_hazard_record *record)
+{
+    struct am_hashtable_map *map, *next;
+
+    for (map = ht->retired; map != NULL; map = next) {
+        next = map->next_retired;
+        am_hazard_retire(record, &map->hazard_entry, map, map_destroy_hazard);
+    }
+    ht->retired = NULL;
+}
+
+AM_ATTR_NON_NULL((1)) AM_PUBLIC
+uint64_t am_hashtable_count(struct am_hashtable *ht)
+{
+    struct am_hashtable_stat st;
+
+    am_hashtable_stat(ht, &st);
+    return st.num_entries;
+}
+
+AM_ATTR_NON_NULL((1, 2)) AM_PUBLIC
+void am_hashtable_stat(struct am_hashtable *ht, struct am_hashtable_stat *st)
+{
+    struct am_hashtable_map *map, *old;
+
+    map = am_atomic_load_ptr_explicit((void **)&ht->map, AM_MEMORY_ORDER_ACQUIRE);
+    old = am_atomic_load_ptr_explicit((void **)&ht->migrating, AM_MEMORY_ORDER_ACQUIRE);
+
+    st->probe_maximum = am_atomic_load_uintptr_explicit(&map->probe_maximum, AM_MEMORY_ORDER_RELAXED);
+    st->num_entries = am_atomic_load_uintptr_explicit(&map->n_entries, AM_MEMORY_ORDER_RELAXED);
+    st->migration_progress = 0;
+    st->migration_total = 0;
+    if (old != NULL) {
+        st->num_entries += am_atomic_load_uintptr_explicit(&old->n_entries, AM_MEMORY_ORDER_RELAXED);
+        st->migration_progress = am_atomic_load_uintptr_explicit(&ht->migrate_cursor, AM_MEMORY_ORDER_RELAXED);
+        st->migration_total = old->size;
+    }
+}
+
+AM_ATTR_NON_NULL((1, 2, 3)) AM_PUBLIC
+bool am_hashtable_next(struct am_hashtable *ht, struct am_hashtable_iterator *it, struct am_hashtable_entry **entry)
+{
+    /* Entries still in the old map come first, at offsets below its size */
+    for (;;) {
+        struct am_hashtable_map *map = ht->map;
+        uint64_t offset = it->offset;
+        struct am_hashtable_entry *cursor;
+
+        if (ht->migrating != NULL) {
+            if (offset < ht->migrating->size) {
+                map = ht->migrating;
+            } else {
+                offset -= ht->migrating->size;
+            }
+        }
+        if (offset >= map->size) {
+            return false;
+        }
+
+        cursor = map_slot(map, offset);
+        it->offset++;
+        if (slot_live(cursor)) {
+            it->current = cursor;
+            *entry = cursor;
+            return true;
+        }
+    }
+}
@@ -0,0 +1,199 @@
+
+#include <string.h>
+#include "am/macros.h"
+#include "am/concurrent/hashtable_sharded.h"
+
+/* Take a shard's lock, counting the times somebody else held it */
+static
+struct am_hashtable_shard *shard_lock(struct am_hashtable_shard *shard)
+{
+    if (am_mutex_trylock(&shard->lock) != AM_THREAD_SUCCESS) {
+        (void)am_mutex_lock(&shard->lock);
+        shard->n_contended++;
+    }
+    shard->n_writes++;
+    return shard;
+}
+
+static
+void shard_unlock(struct am_hashtable_shard *shard)
+{
+    (void)am_mutex_unlock(&shard->lock);
+}
+
+/*****************************************************************************/
+
+AM_ATTR_NON_NULL((1, 4)) AM_ATTR_WARN_UNUSED_RESULT AM_PUBLIC
+bool am_hashtable_sharded_init(
+        struct am_hashtable_sharded *sh,
+        enum am_hashtable_mode mode,
+        am_hashtable_hash_fn *hash_fn,
+        struct am_alloc *allocator,
+        unsigned n_shards,
+        uint64_t initial_size,
+        uint64_t seed)
+{
+    unsigned i, bits = 0;
+    uintptr_t shards;
+
+    while ((1U << bits) < n_shards && bits < 16) {
+        bits++;
+    }
+    n_shards = 1U << bits;
+
+    sh->allocator = allocator;
+    sh->shard_bits = bits;
+    sh->alloc_size = n_shards * sizeof(struct am_hashtable_shard) + AM_CACHELINE - 1;
+    sh->alloc_base = am_malloc(allocator, sh->alloc_size);
+    if (sh->alloc_base == NULL) {
+        return false;
+    }
+    shards = ((uintptr_t)sh->alloc_base + AM_CACHELINE - 1) & ~(uintptr_t)(AM_CACHELINE - 1);
+    sh->shards = (struct am_hashtable_shard *)shards;
+
+    for (i = 0; i < n_shards; i++) {
+        struct am_hashtable_shard *shard = &sh->shards[i];
+
+        shard->n_writes = 0;
+        shard->n_contended = 0;
+        if (am_mutex_init(&shard->lock, AM_MUTEX_PLAIN) != AM_THREAD_SUCCESS) {
+            goto fail;
+        }
+        if (!am_hashtable_init(&shard->table, mode, hash_fn, allocator, initial_size / n_shards, seed)) {
+            am_mutex_destroy(&shard->lock);
+            goto fail;
+        }
+    }
+    return true;
+
+fail:
+    while (i-- > 0) {
+        am_hashtable_destroy(&sh->shards[i].table);
+        am_mutex_destroy(&sh->shards[i].lock);
+    }
+    am_free(allocator, sh->alloc_base, sh->alloc_size);
+    return false;
+}
+
+AM_ATTR_NON_NULL((1)) AM_PUBLIC
+void am_hashtable_sharded_destroy(struct am_hashtable_sharded *sh)
+{
+    unsigned i;
+
+    for (i = 0; i < am_hashtable_sharded_count_shards(sh); i++) {
+        am_hashtable_destroy(&sh->shards[i].table);
+        am_mutex_destroy(&sh->shards[i].lock);
+    }
+    am_free(sh->allocator, sh->alloc_base, sh->alloc_size);
+    sh->shards = NULL;
+}
+
+AM_ATTR_NON_NULL((1, 2)) AM_PUBLIC
+uint64_t am_hashtable_sharded_hash(const struct am_hashtable_sharded *sh, const void *key, uint16_t key_length)
+{
+    return am_hashtable_hash(&sh->shards[0].table, key, key_length);
+}
+
+AM_ATTR_NON_NULL((1)) AM_PUBLIC
+uint64_t am_hashtable_sharded_hash_direct(const struct am_hashtable_sharded *sh, uintptr_t key)
+{
+    return am_hashtable_hash_direct(&sh->shards[0].table, key);
+}
+
+AM_ATTR_NON_NULL((1, 3)) AM_PUBLIC
+bool am_hashtable_sharded_get(struct am_hashtable_sharded *sh, uint64_t hash, struct am_hashtable_entry *entry)
+{
+    return am_hashtable_get(&am_hashtable_sharded_shard(sh, hash)->table, hash, entry);
+}
+
+AM_ATTR_NON_NULL((1, 3)) AM_PUBLIC
+bool am_hashtable_sharded_put(struct am_hashtable_sharded *sh, uint64_t hash, struct am_hashtable_entry *entry)
+{
+    struct am_hashtable_shard *shard = shard_lock(am_hashtable_sharded_shard(sh, hash));
+    bool ret = am_hashtable_put(&shard->table, hash, entry);
+
+    shard_unlock(shard);
+    return ret;
+}
+
+AM_ATTR_NON_NULL((1, 3)) AM_PUBLIC
+bool am_hashtable_sharded_set(struct am_hashtable_sharded *sh, uint64_t hash, struct am_hashtable_entry *entry)
+{
+    struct am_hashtable_shard *shard = shard_lock(am_hashtable_sharded_shard(sh, hash));
+    bool ret = am_hashtable_set(&shard->table, hash, entry);
+
+    shard_unlock(shard);
+    return ret;
+}
+
+AM_ATTR_NON_NULL((1, 3)) AM_PUBLIC
+bool am_hashtable_sharded_remove(struct am_hashtable_sharded *sh, uint64_t hash, struct am_hashtable_entry *entry)
+{
+    struct am_hashtable_shard *shard = shard_lock(am_hashtable_sharded_shard(sh, hash));
+    bool ret = am_hashtable_remove(&shard->table, hash, entry);
+
+    shard_unlock(shard);
+    return ret;
+}
+
+AM_ATTR_NON_NULL((1)) AM_PUBLIC
+bool am_hashtable_sharded_gc(struct am_hashtable_sharded *sh, uint64_t cycles, uint64_t seed)
+{
+    bool ret = true;
+    unsigned i;
+
+    for (i = 0; i < am_hashtable_sharded_count_shards(sh); i++) {
+        struct am_hashtable_shard *shard = shard_lock(&sh->shards[i]);
+        ret &= am_hashtable_gc(&shard->table, cycles, seed);
+        shard_unlock(shard);
+    }
+    return ret;
+}
+
+AM_ATTR_NON_NULL((1)) AM_PUBLIC
+void am_hashtable_sharded_reclaim(struct am_hashtable_sharded *sh)
+{
+    unsigned i;
+
+    for (i = 0; i < am_hashtable_sharded_count_shards(sh); i++) {
+        (void)am_mutex_lock(&sh->shards[i].lock);
+        am_hashtable_reclaim(&sh->shards[i].table);
+        (void)am_mutex_unlock(&sh->shards[i].lock);
+    }
+}
+
+AM_ATTR_NON_NULL((1, 2)) AM_PUBLIC
+void am_hashtable_sharded_reclaim_deferred(struct am_hashtable_sharded *sh, struct am_epoch_record *record)
+{
+    unsigned i;
+
+    for (i = 0; i < am_hashtable_sharded_count_shards(sh); i++) {
+        (void)am_mutex_lock(&sh->shards[i].lock);
+        am_hashtable_reclaim_deferred(&sh->shards[i].table, record);
+        (void)am_mutex_unlock(&sh->shards[i].lock);
+    }
+}
+
+AM_ATTR_NON_NULL((1)) AM_PUBLIC
+uint64_t am_hashtable_sharded_count(struct am_hashtable_sharded *sh)
+{
+    uint64_t n = 0;
+    unsigned i;
+
+    for (i = 0; i < am_hashtable_sharded_count_shards(sh); i++) {
+        n += am_hashtable_count(&sh->shards[i].table);
+    }
+    return n;
+}
+
+AM_ATTR_NON_NULL((1, 3)) AM_PUBLIC
+void am_hashtable_sharded_stat(struct am_hashtable_sharded *sh, unsigned shard, struct am_hashtable_shard_stat *st)
+{
+    struct am_hashtable_shard *s = &sh->shards[shard];
+
+    (void)am_mutex_lock(&s->lock);
+    am_hashtable_stat(&s->table, &st->table);
+    st->n_writes = s->n_writes;
+    st->n_contended = s->n_contended;
+    (void)am_mutex_unlock(&s->lock);
+}
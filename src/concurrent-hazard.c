@@ -0,0 +1,271 @@
+
+#include <stdlib.h>
+#include <string.h>
+#include "am/macros.h"
+#include "am/threads.h"
+#include "am/concurrent/hazard.h"
+
+/* Memory retired through am_hazard_free */
+struct hazard_deferred_free {
+    struct am_hazard_entry entry;
+    struct am_alloc *allocator;
+    size_t size;
+};
+
+static
+void hazard_deferred_free_cb(struct am_hazard_entry *entry)
+{
+    struct hazard_deferred_free *d = AM_CONTAINER_OF(entry, struct hazard_deferred_free, entry);
+
+    am_free(d->allocator, entry->ptr, d->size);
+    am_free(d->allocator, d, sizeof *d);
+}
+
+static
+size_t hazard_record_size(const struct am_hazard *hp)
+{
+    return offsetof(struct am_hazard_record, slots) + hp->n_slots * sizeof(void *);
+}
+
+static
+int hazard_ptr_cmp(const void *a, const void *b)
+{
+    uintptr_t x = (uintptr_t)*(void *const *)a;
+    uintptr_t y = (uintptr_t)*(void *const *)b;
+
+    return (x > y) - (x < y);
+}
+
+/* Gather every published hazard into 'buf', sorted
+ * @return The number of hazards, or (size_t)-1 if 'buf' is too small
+ */
+static
+size_t hazard_snapshot(struct am_hazard *hp, void **buf, size_t cap)
+{
+    struct am_hazard_record *record;
+    size_t n = 0;
+
+    /* Pairs with the fence in am_hazard_set */
+    am_atomic_thread_fence(AM_MEMORY_ORDER_SEQ_CST);
+
+    record = am_atomic_load_ptr_explicit((void **)&hp->records, AM_MEMORY_ORDER_ACQUIRE);
+    for (; record != NULL; record = record->next) {
+        unsigned i;
+
+        for (i = 0; i < hp->n_slots; i++) {
+            /* Pairs with the release in am_hazard_clear, ordering the owner's reads before reuse */
+            void *ptr = am_atomic_load_ptr_explicit(&record->slots[i], AM_MEMORY_ORDER_ACQUIRE);
+            if (ptr == NULL) {
+                continue;
+            }
+            if (n == cap) {
+                return (size_t)-1;
+            }
+            buf[n++] = ptr;
+        }
+    }
+    qsort(buf, n, sizeof *buf, hazard_ptr_cmp);
+    return n;
+}
+
+/* Fallback when no memory is available for a snapshot */
+static
+bool hazard_is_protected(struct am_hazard *hp, const void *ptr)
+{
+    struct am_hazard_record *record;
+
+    am_atomic_thread_fence(AM_MEMORY_ORDER_SEQ_CST);
+
+    record = am_atomic_load_ptr_explicit((void **)&hp->records, AM_MEMORY_ORDER_ACQUIRE);
+    for (; record != NULL; record = record->next) {
+        unsigned i;
+        for (i = 0; i < hp->n_slots; i++) {
+            if (am_atomic_load_ptr_explicit(&record->slots[i], AM_MEMORY_ORDER_ACQUIRE) == ptr) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+/*****************************************************************************/
+
+AM_ATTR_NON_NULL((1, 2)) AM_PUBLIC
+void am_hazard_init(struct am_hazard *hp, struct am_alloc *allocator, unsigned n_slots, unsigned threshold)
+{
+    hp->records = NULL;
+    hp->allocator = allocator;
+    hp->n_slots = n_slots;
+    hp->threshold = threshold;
+    am_atomic_init_uint(&hp->n_records, 0);
+}
+
+AM_ATTR_NON_NULL((1)) AM_PUBLIC
+void am_hazard_destroy(struct am_hazard *hp)
+{
+    struct am_hazard_record *record, *next;
+
+    for (record = hp->records; record != NULL; record = next) {
+        struct am_hazard_entry *entry, *tmp;
+
+        next = record->next;
+        if (record->scan != NULL) {
+            am_free(hp->allocator, record->scan, record->scan_cap * sizeof *record->scan);
+        }
+        /* Nobody is left to hold a hazard */
+        for (entry = record->retired; entry != NULL; entry = tmp) {
+            tmp = entry->next;
+            entry->fn(entry);
+        }
+        am_free(hp->allocator, record, hazard_record_size(hp));
+    }
+    hp->records = NULL;
+}
+
+AM_ATTR_NON_NULL((1)) AM_ATTR_WARN_UNUSED_RESULT AM_PUBLIC
+struct am_hazard_record *am_hazard_register(struct am_hazard *hp)
+{
+    struct am_hazard_record *record, *head;
+    unsigned i;
+
+    /* Recycle a record from an exited thread */
+    record = am_atomic_load_ptr_explicit((void **)&hp->records, AM_MEMORY_ORDER_ACQUIRE);
+    for (; record != NULL; record = record->next) {
+        unsigned in_use = 0;
+        if (am_atomic_load_uint_explicit(&record->in_use, AM_MEMORY_ORDER_RELAXED) == 0
+                && am_atomic_cas_uint(&record->in_use, &in_use, 1)) {
+            return record;
+        }
+    }
+
+    record = am_malloc(hp->allocator, hazard_record_size(hp));
+    if (record == NULL) {
+        return NULL;
+    }
+    record->global = hp;
+    am_atomic_init_uint(&record->in_use, 1);
+    record->retired = NULL;
+    record->scan = NULL;
+    record->scan_cap = 0;
+    record->n_retired = 0;
+    record->n_reclaimed = 0;
+    for (i = 0; i < hp->n_slots; i++) {
+        record->slots[i] = NULL;
+    }
+
+    head = am_atomic_load_ptr_explicit((void **)&hp->records, AM_MEMORY_ORDER_RELAXED);
+    do {
+        record->next = head;
+    } while (!am_atomic_cas_ptr_explicit((void **)&hp->records, (void **)&head, record,
+                AM_MEMORY_ORDER_RELEASE, AM_MEMORY_ORDER_RELAXED));
+    am_atomic_fetch_add_uint(&hp->n_records, 1);
+    return record;
+}
+
+AM_ATTR_NON_NULL((1)) AM_PUBLIC
+void am_hazard_unregister(struct am_hazard_record *record)
+{
+    unsigned i;
+
+    for (i = 0; i < record->global->n_slots; i++) {
+        am_hazard_clear(record, i);
+    }
+    if (record->n_retired != 0) {
+        (void)am_hazard_reclaim(record);
+    }
+    am_atomic_store_uint_explicit(&record->in_use, 0, AM_MEMORY_ORDER_RELEASE);
+}
+
+AM_ATTR_NON_NULL((1, 2, 4)) AM_PUBLIC
+void am_hazard_retire(struct am_hazard_record *record, struct am_hazard_entry *entry, void *ptr, am_hazard_cb *fn)
+{
+    entry->fn = fn;
+    entry->ptr = ptr;
+    entry->next = record->retired;
+    record->retired = entry;
+
+    if (++record->n_retired >= record->global->threshold) {
+        (void)am_hazard_reclaim(record);
+    }
+}
+
+AM_ATTR_NON_NULL((1)) AM_PUBLIC
+void am_hazard_free(struct am_hazard_record *record, void *ptr, size_t size)
+{
+    struct am_hazard *hp = record->global;
+    struct hazard_deferred_free *d;
+
+    if (ptr == NULL) {
+        return;
+    }
+
+    d = am_malloc(hp->allocator, sizeof *d);
+    if (d == NULL) {
+        while (hazard_is_protected(hp, ptr)) {
+            am_thread_yield();
+        }
+        am_free(hp->allocator, ptr, size);
+        return;
+    }
+    d->allocator = hp->allocator;
+    d->size = size;
+    am_hazard_retire(record, &d->entry, ptr, hazard_deferred_free_cb);
+}
+
+AM_ATTR_NON_NULL((1)) AM_PUBLIC
+unsigned am_hazard_reclaim(struct am_hazard_record *record)
+{
+    struct am_hazard *hp = record->global;
+    struct am_hazard_entry *entry, *next, *keep = NULL;
+    size_t cap, n_hazards;
+    unsigned n = 0;
+
+    if (record->retired == NULL) {
+        return 0;
+    }
+
+    /* Slack for records registered during the scan */
+    cap = (am_atomic_load_uint(&hp->n_records) + 4) * (size_t)hp->n_slots;
+    if (record->scan_cap < cap) {
+        if (record->scan != NULL) {
+            am_free(hp->allocator, record->scan, record->scan_cap * sizeof *record->scan);
+        }
+        record->scan = am_malloc(hp->allocator, cap * sizeof *record->scan);
+        record->scan_cap = record->scan != NULL ? cap : 0;
+    }
+    n_hazards = record->scan != NULL ? hazard_snapshot(hp, record->scan, record->scan_cap) : (size_t)-1;
+
+    for (entry = record->retired; entry != NULL; entry = next) {
+        bool protected;
+
+        next = entry->next;
+        if (n_hazards != (size_t)-1) {
+            protected = bsearch(&entry->ptr, record->scan, n_hazards, sizeof *record->scan, hazard_ptr_cmp) != NULL;
+        } else {
+            protected = hazard_is_protected(hp, entry->ptr);
+        }
+
+        if (protected) {
+            entry->next = keep;
+            keep = entry;
+        } else {
+            entry->fn(entry);
+            n++;
+        }
+    }
+
+    record->retired = keep;
+    record->n_retired -= n;
+    record->n_reclaimed += n;
+    return n;
+}
+
+AM_ATTR_NON_NULL((1)) AM_PUBLIC
+void am_hazard_purge(struct am_hazard_record *record)
+{
+    (void)am_hazard_reclaim(record);
+    while (record->retired != NULL) {
+        am_thread_yield();
+        (void)am_hazard_reclaim(record);
+    }
+}
@@ -0,0 +1,528 @@
+
+#include <unistd.h> /* sysconf */
+#include "am/macros.h"
+#include "am/concurrent/pool.h"
+
+/* Initial number of slots in a worker's deque */
+#define DEQUE_INITIAL 64
+/* Rounds without finding work before a worker parks */
+#define SPIN_LIMIT 64
+/* Tasks allocated by am_pool_parallel_for */
+#define FOR_OWNED 1
+
+/* Circular array of a Chase-Lev deque
+ * Grown arrays stay allocated until the pool is destroyed, since thieves may
+ * still be reading from them
+ */
+struct deque_array {
+    unsigned mask;
+    struct deque_array *prev;
+    struct am_task *tasks[];
+};
+
+struct am_pool_worker {
+    /* Read by thieves */
+    am_atomic_uint top;
+    char pad0[AM_CACHELINE - sizeof(am_atomic_uint)];
+    /* Owned by the worker */
+    am_atomic_uint bottom;
+    struct deque_array *array;
+    struct am_pool *pool;
+    am_thread thread;
+    uint32_t rng;
+} AM_ATTR_ALIGNED(AM_CACHELINE);
+
+struct for_task {
+    struct am_task task;
+    struct am_pool *pool;
+    size_t lo, hi, grain;
+    am_pool_for_fn *fn;
+    void *ud;
+    int flags;
+};
+
+static
+struct deque_array *deque_array_alloc(struct am_alloc *allocator, unsigned size)
+{
+    struct deque_array *a = am_malloc(allocator, sizeof *a + size * sizeof(struct am_task *));
+
+    if (a != NULL) {
+        a->mask = size - 1;
+        a->prev = NULL;
+    }
+    return a;
+}
+
+static AM_INLINE
+struct am_task *deque_get(struct deque_array *a, unsigned i)
+{
+    return am_atomic_load_ptr_explicit((void **)&a->tasks[i & a->mask], AM_MEMORY_ORDER_RELAXED);
+}
+
+static AM_INLINE
+void deque_put(struct deque_array *a, unsigned i, struct am_task *task)
+{
+    am_atomic_store_ptr_explicit((void **)&a->tasks[i & a->mask], task, AM_MEMORY_ORDER_RELAXED);
+}
+
+/* Counters wrap, so compare them through their signed difference */
+static AM_INLINE
+int deque_size(unsigned bottom, unsigned top)
+{
+    return (int)(bottom - top);
+}
+
+/* Owner only */
+static
+bool deque_push(struct am_pool_worker *w, struct am_task *task)
+{
+    unsigned b = am_atomic_load_uint_explicit(&w->bottom, AM_MEMORY_ORDER_RELAXED);
+    unsigned t = am_atomic_load_uint_explicit(&w->top, AM_MEMORY_ORDER_ACQUIRE);
+    struct deque_array *a = w->array;
+
+    if (deque_size(b, t) > (int)a->mask) {
+        struct deque_array *grown = deque_array_alloc(w->pool->allocator, 2 * (a->mask + 1));
+        unsigned i;
+
+        if (grown == NULL) {
+            return false;
+        }
+        for (i = t; i != b; i++) {
+            deque_put(grown, i, deque_get(a, i));
+        }
+        grown->prev = a;
+        am_atomic_store_ptr_explicit((void **)&w->array, grown, AM_MEMORY_ORDER_RELEASE);
+        a = grown;
+    }
+    deque_put(a, b, task);
+    am_atomic_thread_fence(AM_MEMORY_ORDER_RELEASE);
+    am_atomic_store_uint_explicit(&w->bottom, b + 1, AM_MEMORY_ORDER_RELAXED);
+    return true;
+}
+
+/* Owner only */
+static
+struct am_task *deque_take(struct am_pool_worker *w)
+{
+    unsigned b = am_atomic_load_uint_explicit(&w->bottom, AM_MEMORY_ORDER_RELAXED) - 1;
+    struct deque_array *a = w->array;
+    struct am_task *task;
+    unsigned t;
+
+    am_atomic_store_uint_explicit(&w->bottom, b, AM_MEMORY_ORDER_RELAXED);
+    am_atomic_thread_fence(AM_MEMORY_ORDER_SEQ_CST);
+    t = am_atomic_load_uint_explicit(&w->top, AM_MEMORY_ORDER_RELAXED);
+
+    if (deque_size(b, t) < 0) {
+        am_atomic_store_uint_explicit(&w->bottom, b + 1, AM_MEMORY_ORDER_RELAXED);
+        return NULL;
+    }
+    task = deque_get(a, b);
+    if (t == b) {
+        /* Last task: race the thieves for it */
+        if (!am_atomic_cas_uint_explicit(&w->top, &t, t + 1,
+                    AM_MEMORY_ORDER_SEQ_CST, AM_MEMORY_ORDER_RELAXED)) {
+            task = NULL;
+        }
+        am_atomic_store_uint_explicit(&w->bottom, b + 1, AM_MEMORY_ORDER_RELAXED);
+    }
+    return task;
+}
+
+/* Any thread */
+static
+struct am_task *deque_steal(struct am_pool_worker *w)
+{
+    unsigned t = am_atomic_load_uint_explicit(&w->top, AM_MEMORY_ORDER_ACQUIRE);
+    unsigned b;
+    struct deque_array *a;
+    struct am_task *task;
+
+    am_atomic_thread_fence(AM_MEMORY_ORDER_SEQ_CST);
+    b = am_atomic_load_uint_explicit(&w->bottom, AM_MEMORY_ORDER_ACQUIRE);
+    if (deque_size(b, t) <= 0) {
+        return NULL;
+    }
+    a = am_atomic_load_ptr_explicit((void **)&w->array, AM_MEMORY_ORDER_ACQUIRE);
+    task = deque_get(a, t);
+    if (!am_atomic_cas_uint_explicit(&w->top, &t, t + 1,
+                AM_MEMORY_ORDER_SEQ_CST, AM_MEMORY_ORDER_RELAXED)) {
+        /* Lost to the owner or another thief */
+        return NULL;
+    }
+    return task;
+}
+
+/****************************************************************************/
+
+static
+struct am_pool_worker *current_worker(struct am_pool *pool)
+{
+    struct am_pool_worker *w = am_tss_get(pool->current);
+
+    return w != NULL && w->pool == pool ? w : NULL;
+}
+
+static
+void wake_one(struct am_pool *pool)
+{
+    /* Pairs with the fence in worker_park: either we see the sleeper, or it sees the work */
+    am_atomic_thread_fence(AM_MEMORY_ORDER_SEQ_CST);
+    if (am_atomic_load_uint_explicit(&pool->n_sleeping, AM_MEMORY_ORDER_RELAXED) > 0) {
+        am_mutex_lock(&pool->lock);
+        am_cond_signal(&pool->wakeup);
+        am_mutex_unlock(&pool->lock);
+    }
+}
+
+static
+void inject(struct am_pool *pool, struct am_task *task)
+{
+    task->next = NULL;
+    am_mutex_lock(&pool->lock);
+    if (pool->inject_tail != NULL) {
+        pool->inject_tail->next = task;
+    } else {
+        pool->inject_head = task;
+    }
+    pool->inject_tail = task;
+    am_atomic_fetch_add_uint_explicit(&pool->n_injected, 1, AM_MEMORY_ORDER_RELAXED);
+    am_mutex_unlock(&pool->lock);
+}
+
+static
+struct am_task *inject_pop(struct am_pool *pool)
+{
+    struct am_task *task;
+
+    if (am_atomic_load_uint_explicit(&pool->n_injected, AM_MEMORY_ORDER_RELAXED) == 0) {
+        return NULL;
+    }
+    am_mutex_lock(&pool->lock);
+    task = pool->inject_head;
+    if (task != NULL) {
+        pool->inject_head = task->next;
+        if (pool->inject_head == NULL) {
+            pool->inject_tail = NULL;
+        }
+        am_atomic_fetch_add_uint_explicit(&pool->n_injected, (unsigned)-1, AM_MEMORY_ORDER_RELAXED);
+    }
+    am_mutex_unlock(&pool->lock);
+    return task;
+}
+
+static
+uint32_t xorshift32(uint32_t *state)
+{
+    uint32_t x = *state;
+
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return *state = x;
+}
+
+/* Look for a task: the own deque, then the injection queue, then random victims
+ * @param w The calling thread's worker, or NULL
+ */
+static
+struct am_task *find_work(struct am_pool *pool, struct am_pool_worker *w, uint32_t *rng)
+{
+    struct am_task *task;
+    unsigned i, start;
+
+    if (w != NULL && (task = deque_take(w)) != NULL) {
+        return task;
+    }
+    if ((task = inject_pop(pool)) != NULL) {
+        return task;
+    }
+    start = xorshift32(rng) % pool->n_workers;
+    for (i = 0; i < pool->n_workers; i++) {
+        struct am_pool_worker *victim = &pool->workers[(start + i) % pool->n_workers];
+
+        if (victim != w && (task = deque_steal(victim)) != NULL) {
+            return task;
+        }
+    }
+    return NULL;
+}
+
+/* Run a task, then each continuation it completes */
+static
+void task_run(struct am_task *task)
+{
+    for (;;) {
+        struct am_task *cont = task->continuation;
+        am_task_fn *fn;
+
+        task->fn(task);
+        if (cont == NULL) {
+            return;
+        }
+        /* A completed join point may be reused as soon as it is released */
+        fn = cont->fn;
+        if (am_atomic_fetch_add_uint_explicit(&cont->pending, (unsigned)-1, AM_MEMORY_ORDER_ACQ_REL) != 1
+                || fn == NULL) {
+            return;
+        }
+        task = cont;
+    }
+}
+
+static
+bool has_work(struct am_pool *pool)
+{
+    unsigned i;
+
+    if (am_atomic_load_uint(&pool->n_injected) > 0) {
+        return true;
+    }
+    for (i = 0; i < pool->n_workers; i++) {
+        struct am_pool_worker *w = &pool->workers[i];
+
+        if (deque_size(am_atomic_load_uint(&w->bottom), am_atomic_load_uint(&w->top)) > 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static
+void worker_park(struct am_pool *pool)
+{
+    am_mutex_lock(&pool->lock);
+    am_atomic_fetch_add_uint(&pool->n_sleeping, 1);
+    am_atomic_thread_fence(AM_MEMORY_ORDER_SEQ_CST);
+    if (!am_atomic_load_int(&pool->stop) && !has_work(pool)) {
+        am_cond_wait(&pool->wakeup, &pool->lock);
+    }
+    am_atomic_fetch_add_uint(&pool->n_sleeping, (unsigned)-1);
+    am_mutex_unlock(&pool->lock);
+}
+
+static
+int worker_main(void *ud)
+{
+    struct am_pool_worker *w = ud;
+    struct am_pool *pool = w->pool;
+    unsigned spins = 0;
+
+    am_tss_set(pool->current, w);
+    while (!am_atomic_load_int_explicit(&pool->stop, AM_MEMORY_ORDER_ACQUIRE)) {
+        struct am_task *task = find_work(pool, w, &w->rng);
+
+        if (task != NULL) {
+            task_run(task);
+            spins = 0;
+        } else if (++spins < SPIN_LIMIT) {
+            am_thread_yield();
+        } else {
+            worker_park(pool);
+            spins = 0;
+        }
+    }
+    return 0;
+}
+
+/****************************************************************************/
+
+AM_ATTR_NON_NULL((1, 2)) AM_ATTR_WARN_UNUSED_RESULT AM_PUBLIC
+bool am_pool_init(struct am_pool *pool, struct am_alloc *allocator, unsigned n_workers)
+{
+    size_t alloc_size;
+    uintptr_t workers;
+    unsigned i;
+
+    if (n_workers == 0) {
+        long n = sysconf(_SC_NPROCESSORS_ONLN);
+        n_workers = n > 0 ? (unsigned)n : 1;
+    }
+
+    pool->allocator = allocator;
+    pool->n_workers = n_workers;
+    pool->inject_head = NULL;
+    pool->inject_tail = NULL;
+    am_atomic_init_uint(&pool->n_injected, 0);
+    am_atomic_init_uint(&pool->n_sleeping, 0);
+    am_atomic_init_int(&pool->stop, 0);
+
+    alloc_size = n_workers * sizeof(struct am_pool_worker) + AM_CACHELINE - 1;
+    pool->workers_base = am_malloc(allocator, alloc_size);
+    if (pool->workers_base == NULL) {
+        return false;
+    }
+    workers = ((uintptr_t)pool->workers_base + AM_CACHELINE - 1) & ~(uintptr_t)(AM_CACHELINE - 1);
+    pool->workers = (struct am_pool_worker *)workers;
+
+    if (am_tss_create(&pool->current, NULL) != AM_THREAD_SUCCESS) {
+        goto fail_tss;
+    }
+    if (am_mutex_init(&pool->lock, AM_MUTEX_PLAIN) != AM_THREAD_SUCCESS) {
+        goto fail_mutex;
+    }
+    if (am_cond_init(&pool->wakeup) != AM_THREAD_SUCCESS) {
+        goto fail_cond;
+    }
+
+    /* Deques must all exist before any thread may steal from them */
+    for (i = 0; i < n_workers; i++) {
+        struct am_pool_worker *w = &pool->workers[i];
+
+        am_atomic_init_uint(&w->top, 0);
+        am_atomic_init_uint(&w->bottom, 0);
+        w->pool = pool;
+        w->rng = 2654435761U * (i + 1);
+        w->array = deque_array_alloc(allocator, DEQUE_INITIAL);
+        if (w->array == NULL) {
+            goto fail_arrays;
+        }
+    }
+    for (i = 0; i < n_workers; i++) {
+        if (am_thread_create(&pool->workers[i].thread, worker_main, &pool->workers[i]) != AM_THREAD_SUCCESS) {
+            am_atomic_store_int(&pool->stop, 1);
+            am_mutex_lock(&pool->lock);
+            am_cond_broadcast(&pool->wakeup);
+            am_mutex_unlock(&pool->lock);
+            while (i-- > 0) {
+                am_thread_join(pool->workers[i].thread, NULL);
+            }
+            i = n_workers;
+            goto fail_arrays;
+        }
+    }
+    return true;
+
+fail_arrays:
+    while (i-- > 0) {
+        am_free(allocator, pool->workers[i].array,
+                sizeof(struct deque_array) + DEQUE_INITIAL * sizeof(struct am_task *));
+    }
+    am_cond_destroy(&pool->wakeup);
+fail_cond:
+    am_mutex_destroy(&pool->lock);
+fail_mutex:
+    am_tss_delete(pool->current);
+fail_tss:
+    am_free(allocator, pool->workers_base, alloc_size);
+    return false;
+}
+
+AM_ATTR_NON_NULL((1)) AM_PUBLIC
+void am_pool_destroy(struct am_pool *pool)
+{
+    unsigned i;
+
+    am_atomic_store_int_explicit(&pool->stop, 1, AM_MEMORY_ORDER_RELEASE);
+    am_mutex_lock(&pool->lock);
+    am_cond_broadcast(&pool->wakeup);
+    am_mutex_unlock(&pool->lock);
+
+    for (i = 0; i < pool->n_workers; i++) {
+        struct am_pool_worker *w = &pool->workers[i];
+        struct deque_array *a, *prev;
+
+        am_thread_join(w->thread, NULL);
+        for (a = w->array; a != NULL; a = prev) {
+            prev = a->prev;
+            am_free(pool->allocator, a, sizeof *a + (a->mask + 1) * sizeof(struct am_task *));
+        }
+    }
+
+    am_cond_destroy(&pool->wakeup);
+    am_mutex_destroy(&pool->lock);
+    am_tss_delete(pool->current);
+    am_free(pool->allocator, pool->workers_base,
+            pool->n_workers * sizeof(struct am_pool_worker) + AM_CACHELINE - 1);
+}
+
+AM_ATTR_NON_NULL((1, 2)) AM_ATTR_WARN_UNUSED_RESULT AM_PUBLIC
+bool am_pool_spawn(struct am_pool *pool, struct am_task *task)
+{
+    struct am_pool_worker *w = current_worker(pool);
+
+    if (w != NULL) {
+        if (!deque_push(w, task)) {
+            return false;
+        }
+    } else {
+        inject(pool, task);
+    }
+    wake_one(pool);
+    return true;
+}
+
+AM_ATTR_NON_NULL((1, 2)) AM_PUBLIC
+void am_pool_join(struct am_pool *pool, struct am_task *task)
+{
+    struct am_pool_worker *w = current_worker(pool);
+    uint32_t rng = (uint32_t)(uintptr_t)task | 1;
+
+    while (am_atomic_load_uint_explicit(&task->pending, AM_MEMORY_ORDER_ACQUIRE) != 0) {
+        struct am_task *next = find_work(pool, w, w != NULL ? &w->rng : &rng);
+
+        if (next != NULL) {
+            task_run(next);
+        } else {
+            am_thread_yield();
+        }
+    }
+}
+
+/* Split off the upper half of the range until it fits the grain, then run the rest */
+static
+void for_run(struct am_task *task)
+{
+    struct for_task *ft = AM_CONTAINER_OF(task, struct for_task, task);
+    struct am_task *cont = task->continuation;
+
+    while (ft->hi - ft->lo > ft->grain) {
+        size_t mid = ft->lo + (ft->hi - ft->lo) / 2;
+        struct for_task *child = am_malloc(ft->pool->allocator, sizeof *child);
+
+        if (child == NULL) {
+            break;
+        }
+        *child = *ft;
+        child->lo = mid;
+        child->flags = FOR_OWNED;
+        am_task_init(&child->task, for_run, cont);
+        /* The continuation can't complete while this task still runs */
+        am_task_add_children(cont, 1);
+        if (!am_pool_spawn(ft->pool, &child->task)) {
+            am_atomic_fetch_add_uint_explicit(&cont->pending, (unsigned)-1, AM_MEMORY_ORDER_RELAXED);
+            am_free(ft->pool->allocator, child, sizeof *child);
+            break;
+        }
+        ft->hi = mid;
+    }
+    ft->fn(ft->lo, ft->hi, ft->ud);
+    if (ft->flags & FOR_OWNED) {
+        am_free(ft->pool->allocator, ft, sizeof *ft);
+    }
+}
+
+AM_ATTR_NON_NULL((1, 5)) AM_PUBLIC
+void am_pool_parallel_for(struct am_pool *pool, size_t begin, size_t end, size_t grain, am_pool_for_fn *fn, void *ud)
+{
+    struct am_task done;
+    struct for_task root;
+
+    if (begin >= end) {
+        return;
+    }
+    am_task_init(&done, NULL, NULL);
+    am_task_add_children(&done, 1);
+
+    root.pool = pool;
+    root.lo = begin;
+    root.hi = end;
+    root.grain = grain > 0 ? grain : 1;
+    root.fn = fn;
+    root.ud = ud;
+    root.flags = 0;
+    am_task_init(&root.task, for_run, &done);
+
+    task_run(&root.task);
+    am_pool_join(pool, &done);
+}
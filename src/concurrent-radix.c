@@ -0,0 +1,335 @@
+
+#include <limits.h>
+#include <string.h>
+#include "am/macros.h"
+#include "am/atomic.h"
+#include "am/concurrent/radix.h"
+
+#define UINTPTR_BITS (sizeof(uintptr_t) * CHAR_BIT)
+#define SLOT_MASK ((uintptr_t)AM_RADIX_SLOTS - 1)
+
+/* Readers only rely on 'shift' and 'slots', which are set before the node
+ * is published, and on 'present', which may briefly lag behind 'slots'.
+ * The other fields belong to the writer */
+struct am_radix_node {
+    struct am_radix_node *parent;
+    struct am_alloc *allocator;
+    struct am_epoch_entry epoch_entry;
+    unsigned char shift;  /* Key bits below this level; leaves are 0 */
+    unsigned char offset; /* Slot in the parent */
+    uint64_t present;     /* Bit per non-NULL slot */
+    void *slots[AM_RADIX_SLOTS];
+};
+
+/* Largest key below a node of the given shift, relative to its first key */
+static AM_INLINE
+uintptr_t span_mask(unsigned shift)
+{
+    return shift + AM_RADIX_BITS >= UINTPTR_BITS ? UINTPTR_MAX : ((uintptr_t)1 << (shift + AM_RADIX_BITS)) - 1;
+}
+
+static AM_INLINE
+unsigned slot_of(const struct am_radix_node *node, uintptr_t index)
+{
+    return (unsigned)((index >> node->shift) & SLOT_MASK);
+}
+
+/* Shift of the shortest root holding 'index' */
+static AM_INLINE
+unsigned shift_for(uintptr_t index)
+{
+    unsigned shift = 0;
+
+    while (index > span_mask(shift)) {
+        shift += AM_RADIX_BITS;
+    }
+    return shift;
+}
+
+static AM_INLINE
+struct am_radix_node *root_load(struct am_radix *tree)
+{
+    return am_atomic_load_ptr_explicit((void **)&tree->root, AM_MEMORY_ORDER_ACQUIRE);
+}
+
+static AM_INLINE
+void root_store(struct am_radix *tree, struct am_radix_node *root)
+{
+    am_atomic_store_ptr_explicit((void **)&tree->root, root, AM_MEMORY_ORDER_RELEASE);
+}
+
+static AM_INLINE
+void *slot_load(struct am_radix_node *node, unsigned slot)
+{
+    return am_atomic_load_ptr_explicit(&node->slots[slot], AM_MEMORY_ORDER_ACQUIRE);
+}
+
+/* Fill a slot, after which the entry or child is visible to readers */
+static AM_INLINE
+void slot_publish(struct am_radix_node *node, unsigned slot, void *entry)
+{
+    am_atomic_store_ptr_explicit(&node->slots[slot], entry, AM_MEMORY_ORDER_RELEASE);
+    am_atomic_store_uint64_explicit(&node->present, node->present | (UINT64_C(1) << slot), AM_MEMORY_ORDER_RELEASE);
+}
+
+static AM_INLINE
+void slot_clear(struct am_radix_node *node, unsigned slot)
+{
+    am_atomic_store_ptr_explicit(&node->slots[slot], NULL, AM_MEMORY_ORDER_RELAXED);
+    am_atomic_store_uint64_explicit(&node->present, node->present & ~(UINT64_C(1) << slot), AM_MEMORY_ORDER_RELAXED);
+}
+
+static
+struct am_radix_node *node_new(struct am_radix *tree, unsigned shift, struct am_radix_node *parent, unsigned offset)
+{
+    struct am_radix_node *node = am_malloc(tree->allocator, sizeof *node);
+
+    if (node != NULL) {
+        node->parent = parent;
+        node->allocator = tree->allocator;
+        node->shift = (unsigned char)shift;
+        node->offset = (unsigned char)offset;
+        node->present = 0;
+        memset(node->slots, 0, sizeof node->slots);
+    }
+    return node;
+}
+
+static
+void node_free(struct am_epoch_entry *entry)
+{
+    struct am_radix_node *node = AM_CONTAINER_OF(entry, struct am_radix_node, epoch_entry);
+
+    am_free(node->allocator, node, sizeof *node);
+}
+
+static
+void node_retire(struct am_epoch_record *record, struct am_radix_node *node)
+{
+    am_epoch_call(record, &node->epoch_entry, node_free);
+}
+
+/* Free a subtree immediately */
+static
+void node_destroy(struct am_radix_node *node)
+{
+    uint64_t present = node->present;
+
+    if (node->shift != 0) {
+        while (present != 0) {
+            node_destroy(node->slots[__builtin_ctzll(present)]);
+            present &= present - 1;
+        }
+    }
+    am_free(node->allocator, node, sizeof *node);
+}
+
+/* Remove 'node' and its ancestors while they're empty, then shorten the
+ * tree while its root only has the first slot filled */
+static
+void prune(struct am_radix *tree, struct am_epoch_record *record, struct am_radix_node *node)
+{
+    struct am_radix_node *root;
+
+    while (node->present == 0) {
+        struct am_radix_node *parent = node->parent;
+
+        if (parent == NULL) {
+            root_store(tree, NULL);
+            node_retire(record, node);
+            return;
+        }
+        slot_clear(parent, node->offset);
+        node_retire(record, node);
+        node = parent;
+    }
+
+    /* Readers still holding the old root walk through slot 0 to the same
+     * child, which the retired root keeps pointing to */
+    root = tree->root;
+    while (root->shift != 0 && root->present == 1) {
+        struct am_radix_node *child = root->slots[0];
+
+        child->parent = NULL;
+        root_store(tree, child);
+        node_retire(record, root);
+        root = child;
+    }
+}
+
+/* Search the subtree under 'node' for the first key in [index, last]
+ * 'index' lies within the node's span */
+static
+bool node_find(struct am_radix_node *node, uintptr_t index, uintptr_t last, uintptr_t *found, void **value)
+{
+    unsigned shift = node->shift, start = slot_of(node, index);
+    uint64_t present = am_atomic_load_uint64_explicit(&node->present, AM_MEMORY_ORDER_ACQUIRE);
+
+    present &= ~UINT64_C(0) << start;
+    while (present != 0) {
+        unsigned slot = (unsigned)__builtin_ctzll(present);
+        void *entry;
+
+        present &= present - 1;
+        if (slot != start) {
+            /* First key under the slot */
+            index = (index & ~span_mask(shift)) | ((uintptr_t)slot << shift);
+        }
+        if (index > last) {
+            return false;
+        }
+        entry = slot_load(node, slot);
+        if (entry == NULL) {
+            /* Cleared since 'present' was read */
+            continue;
+        }
+        if (shift == 0) {
+            *found = index;
+            if (value != NULL) {
+                *value = entry;
+            }
+            return true;
+        }
+        if (node_find(entry, index, last, found, value)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+AM_ATTR_NON_NULL((1, 2)) AM_PUBLIC
+void am_radix_init(struct am_radix *tree, struct am_alloc *allocator)
+{
+    tree->allocator = allocator;
+    tree->root = NULL;
+    tree->count = 0;
+}
+
+AM_ATTR_NON_NULL((1)) AM_PUBLIC
+void am_radix_destroy(struct am_radix *tree)
+{
+    if (tree->root != NULL) {
+        node_destroy(tree->root);
+    }
+    tree->root = NULL;
+    tree->count = 0;
+}
+
+AM_ATTR_NON_NULL((1, 2)) AM_PUBLIC
+void *am_radix_get(struct am_radix *tree, struct am_epoch_record *record, uintptr_t index)
+{
+    struct am_radix_node *node;
+    void *entry = NULL;
+
+    am_epoch_begin(record);
+    node = root_load(tree);
+    if (node != NULL && index <= span_mask(node->shift)) {
+        for (;;) {
+            entry = slot_load(node, slot_of(node, index));
+            if (node->shift == 0 || entry == NULL) {
+                break;
+            }
+            node = entry;
+        }
+    }
+    am_epoch_end(record);
+    return entry;
+}
+
+AM_ATTR_NON_NULL((1, 2, 3)) AM_PUBLIC
+bool am_radix_find(struct am_radix *tree, struct am_epoch_record *record, uintptr_t *index, uintptr_t last, void **value)
+{
+    struct am_radix_node *root;
+    bool found = false;
+
+    if (*index > last) {
+        return false;
+    }
+    am_epoch_begin(record);
+    root = root_load(tree);
+    if (root != NULL && *index <= span_mask(root->shift)) {
+        found = node_find(root, *index, last, index, value);
+    }
+    am_epoch_end(record);
+    return found;
+}
+
+AM_ATTR_NON_NULL((1, 2, 4)) AM_ATTR_WARN_UNUSED_RESULT AM_PUBLIC
+bool am_radix_set(struct am_radix *tree, struct am_epoch_record *record, uintptr_t index, void *value)
+{
+    struct am_radix_node *root = tree->root, *node;
+    unsigned slot;
+
+    if (root == NULL) {
+        root = node_new(tree, shift_for(index), NULL, 0);
+        if (root == NULL) {
+            return false;
+        }
+        root_store(tree, root);
+    }
+    /* Grow upwards: the old root becomes the first child of a new one */
+    while (index > span_mask(root->shift)) {
+        node = node_new(tree, root->shift + AM_RADIX_BITS, NULL, 0);
+        if (node == NULL) {
+            prune(tree, record, root);
+            return false;
+        }
+        node->slots[0] = root;
+        node->present = 1;
+        root->parent = node;
+        root->offset = 0;
+        root_store(tree, node);
+        root = node;
+    }
+
+    node = root;
+    while (node->shift != 0) {
+        struct am_radix_node *child;
+
+        slot = slot_of(node, index);
+        child = node->slots[slot];
+        if (child == NULL) {
+            child = node_new(tree, node->shift - AM_RADIX_BITS, node, slot);
+            if (child == NULL) {
+                prune(tree, record, node);
+                return false;
+            }
+            slot_publish(node, slot, child);
+        }
+        node = child;
+    }
+
+    slot = slot_of(node, index);
+    if (node->slots[slot] == NULL) {
+        tree->count++;
+    }
+    slot_publish(node, slot, value);
+    return true;
+}
+
+AM_ATTR_NON_NULL((1, 2)) AM_PUBLIC
+void *am_radix_erase(struct am_radix *tree, struct am_epoch_record *record, uintptr_t index)
+{
+    struct am_radix_node *node = tree->root;
+    unsigned slot;
+    void *value;
+
+    if (node == NULL || index > span_mask(node->shift)) {
+        return NULL;
+    }
+    while (node->shift != 0) {
+        node = node->slots[slot_of(node, index)];
+        if (node == NULL) {
+            return NULL;
+        }
+    }
+    slot = slot_of(node, index);
+    value = node->slots[slot];
+    if (value == NULL) {
+        return NULL;
+    }
+    slot_clear(node, slot);
+    tree->count--;
+    prune(tree, record, node);
+    return value;
+}
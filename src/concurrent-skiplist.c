@@ -0,0 +1,329 @@
+
+#include "am/macros.h"
+#include "am/atomic.h"
+#include "am/data/hash.h"
+#include "am/concurrent/skiplist.h"
+
+/* Low bit of a 'next' pointer: the node owning the pointer is being removed */
+#define MARK ((uintptr_t)1)
+
+struct am_skiplist_node {
+    uint64_t key;
+    void *value;
+    struct am_alloc *allocator;
+    struct am_epoch_entry epoch_entry;
+    /* Held by the inserter until it's done linking, and by the remover which
+     * marked the bottom level until it's done unlinking; the last one
+     * retires the node */
+    am_atomic_uint refs;
+    unsigned height;
+    struct am_skiplist_node *next[1]; /* Flexible array member emulation */
+};
+
+static AM_INLINE
+size_t node_size(unsigned height)
+{
+    return offsetof(struct am_skiplist_node, next) + height * sizeof(struct am_skiplist_node *);
+}
+
+static AM_INLINE
+bool is_marked(struct am_skiplist_node *ptr)
+{
+    return ((uintptr_t)ptr & MARK) != 0;
+}
+
+static AM_INLINE
+struct am_skiplist_node *unmarked(struct am_skiplist_node *ptr)
+{
+    return (struct am_skiplist_node *)((uintptr_t)ptr & ~MARK);
+}
+
+static AM_INLINE
+struct am_skiplist_node *next_load(struct am_skiplist_node *node, unsigned level)
+{
+    return am_atomic_load_ptr_explicit((void **)&node->next[level], AM_MEMORY_ORDER_ACQUIRE);
+}
+
+static AM_INLINE
+bool next_cas(struct am_skiplist_node *node, unsigned level, struct am_skiplist_node *expected, struct am_skiplist_node *desired)
+{
+    return am_atomic_cas_ptr((void **)&node->next[level], (void **)&expected, desired);
+}
+
+/* Heights are geometric with p = 1/4 */
+static
+unsigned random_height(struct am_skiplist *list, uint64_t key)
+{
+    uint64_t h = am_hash_fmix64(key ^ list->seed);
+    unsigned height = 1;
+
+    while ((h & 3) == 0 && height < AM_SKIPLIST_MAX_HEIGHT) {
+        h >>= 2;
+        height++;
+    }
+    return height;
+}
+
+static
+void node_free(struct am_epoch_entry *entry)
+{
+    struct am_skiplist_node *node = AM_CONTAINER_OF(entry, struct am_skiplist_node, epoch_entry);
+
+    am_free(node->allocator, node, node_size(node->height));
+}
+
+/* Locate the neighbours of 'key' on every level, unlinking marked nodes on the way
+ * @return true if an unmarked node holds the key, in succs[0]
+ */
+static
+bool find(struct am_skiplist *list, uint64_t key,
+        struct am_skiplist_node **preds, struct am_skiplist_node **succs)
+{
+    struct am_skiplist_node *pred, *curr, *succ;
+    int level;
+
+retry:
+    pred = list->head;
+    for (level = AM_SKIPLIST_MAX_HEIGHT - 1; level >= 0; level--) {
+        curr = unmarked(next_load(pred, level));
+        while (curr != NULL) {
+            succ = next_load(curr, level);
+            while (is_marked(succ)) {
+                /* Fails if pred was marked, or something was linked after it */
+                if (!next_cas(pred, level, curr, unmarked(succ))) {
+                    goto retry;
+                }
+                curr = unmarked(succ);
+                if (curr == NULL) {
+                    break;
+                }
+                succ = next_load(curr, level);
+            }
+            if (curr == NULL || curr->key >= key) {
+                break;
+            }
+            pred = curr;
+            curr = succ;
+        }
+        preds[level] = pred;
+        succs[level] = curr;
+    }
+    return succs[0] != NULL && succs[0]->key == key;
+}
+
+/* Locate the first node not less than 'key', skipping marked nodes without writing */
+static
+struct am_skiplist_node *find_read(struct am_skiplist *list, uint64_t key)
+{
+    struct am_skiplist_node *pred = list->head, *curr = NULL, *succ;
+    int level;
+
+    for (level = AM_SKIPLIST_MAX_HEIGHT - 1; level >= 0; level--) {
+        curr = unmarked(next_load(pred, level));
+        while (curr != NULL) {
+            succ = next_load(curr, level);
+            if (is_marked(succ)) {
+                curr = unmarked(succ);
+            } else if (curr->key < key) {
+                pred = curr;
+                curr = succ;
+            } else {
+                break;
+            }
+        }
+    }
+    return curr;
+}
+
+/* Drop a reference, retiring the node if it was the last */
+static
+void node_release(struct am_skiplist_node *node, struct am_epoch_record *record)
+{
+    if (am_atomic_fetch_add_uint_explicit(&node->refs, (unsigned)-1, AM_MEMORY_ORDER_ACQ_REL) == 1) {
+        am_epoch_call(record, &node->epoch_entry, node_free);
+    }
+}
+
+/****************************************************************************/
+
+AM_ATTR_NON_NULL((1, 2)) AM_ATTR_WARN_UNUSED_RESULT AM_PUBLIC
+bool am_skiplist_init(struct am_skiplist *list, struct am_alloc *allocator)
+{
+    unsigned i;
+
+    list->allocator = allocator;
+    list->seed = am_hash_fmix64((uintptr_t)list);
+    list->head = am_malloc(allocator, node_size(AM_SKIPLIST_MAX_HEIGHT));
+    if (list->head == NULL) {
+        return false;
+    }
+    list->head->key = 0;
+    list->head->value = NULL;
+    list->head->allocator = allocator;
+    list->head->height = AM_SKIPLIST_MAX_HEIGHT;
+    am_atomic_init_uint(&list->head->refs, 1);
+    for (i = 0; i < AM_SKIPLIST_MAX_HEIGHT; i++) {
+        list->head->next[i] = NULL;
+    }
+    return true;
+}
+
+AM_ATTR_NON_NULL((1)) AM_PUBLIC
+void am_skiplist_destroy(struct am_skiplist *list)
+{
+    struct am_skiplist_node *node = list->head, *next;
+
+    while (node != NULL) {
+        next = unmarked(node->next[0]);
+        am_free(list->allocator, node, node_size(node->height));
+        node = next;
+    }
+    list->head = NULL;
+}
+
+AM_ATTR_NON_NULL((1, 2)) AM_PUBLIC
+bool am_skiplist_get(struct am_skiplist *list, struct am_epoch_record *record, uint64_t key, void **value)
+{
+    struct am_skiplist_node *node;
+    bool found;
+
+    am_epoch_begin(record);
+    node = find_read(list, key);
+    found = node != NULL && node->key == key;
+    if (found && value != NULL) {
+        *value = node->value;
+    }
+    am_epoch_end(record);
+    return found;
+}
+
+AM_ATTR_NON_NULL((1, 2)) AM_PUBLIC
+bool am_skiplist_put(struct am_skiplist *list, struct am_epoch_record *record, uint64_t key, void *value)
+{
+    struct am_skiplist_node *preds[AM_SKIPLIST_MAX_HEIGHT], *succs[AM_SKIPLIST_MAX_HEIGHT];
+    struct am_skiplist_node *node;
+    unsigned height = random_height(list, key);
+    unsigned level;
+
+    node = am_malloc(list->allocator, node_size(height));
+    if (node == NULL) {
+        return false;
+    }
+    node->key = key;
+    node->value = value;
+    node->allocator = list->allocator;
+    node->height = height;
+    am_atomic_init_uint(&node->refs, 2);
+
+    am_epoch_begin(record);
+    for (;;) {
+        if (find(list, key, preds, succs)) {
+            am_epoch_end(record);
+            am_free(list->allocator, node, node_size(height));
+            return false;
+        }
+        for (level = 0; level < height; level++) {
+            node->next[level] = succs[level];
+        }
+        /* Linking the bottom level inserts the key */
+        if (next_cas(preds[0], 0, succs[0], node)) {
+            break;
+        }
+    }
+
+    for (level = 1; level < height; level++) {
+        for (;;) {
+            struct am_skiplist_node *next = next_load(node, level);
+
+            /* A remover marked the tower: stop building it */
+            if (is_marked(next)) {
+                goto linked;
+            }
+            if (next != succs[level] && !next_cas(node, level, next, succs[level])) {
+                goto linked;
+            }
+            if (next_cas(preds[level], level, succs[level], node)) {
+                break;
+            }
+            find(list, key, preds, succs);
+        }
+    }
+
+linked:
+    /* Levels linked after the remover's cleanup pass are ours to unlink */
+    if (is_marked(am_atomic_load_ptr((void **)&node->next[0]))) {
+        find(list, key, preds, succs);
+    }
+    am_epoch_end(record);
+    node_release(node, record);
+    return true;
+}
+
+AM_ATTR_NON_NULL((1, 2)) AM_PUBLIC
+bool am_skiplist_remove(struct am_skiplist *list, struct am_epoch_record *record, uint64_t key, void **value)
+{
+    struct am_skiplist_node *preds[AM_SKIPLIST_MAX_HEIGHT], *succs[AM_SKIPLIST_MAX_HEIGHT];
+    struct am_skiplist_node *node, *next;
+    int level;
+
+    am_epoch_begin(record);
+    if (!find(list, key, preds, succs)) {
+        am_epoch_end(record);
+        return false;
+    }
+    node = succs[0];
+
+    for (level = (int)node->height - 1; level > 0; level--) {
+        next = next_load(node, level);
+        while (!is_marked(next) && !next_cas(node, level, next, (struct am_skiplist_node *)((uintptr_t)next | MARK))) {
+            next = next_load(node, level);
+        }
+    }
+    next = next_load(node, 0);
+    for (;;) {
+        if (is_marked(next)) {
+            /* Another remover won */
+            am_epoch_end(record);
+            return false;
+        }
+        if (next_cas(node, 0, next, (struct am_skiplist_node *)((uintptr_t)next | MARK))) {
+            break;
+        }
+        next = next_load(node, 0);
+    }
+    if (value != NULL) {
+        *value = node->value;
+    }
+    find(list, key, preds, succs);
+    am_epoch_end(record);
+    node_release(node, record);
+    return true;
+}
+
+AM_ATTR_NON_NULL((1, 2)) AM_PUBLIC
+void am_skiplist_seek(struct am_skiplist *list, struct am_skiplist_iterator *it, uint64_t lower)
+{
+    it->node = find_read(list, lower);
+}
+
+AM_ATTR_NON_NULL((1, 2)) AM_PUBLIC
+bool am_skiplist_next(struct am_skiplist_iterator *it, uint64_t *key, void **value)
+{
+    struct am_skiplist_node *node = it->node;
+
+    while (node != NULL) {
+        struct am_skiplist_node *next = next_load(node, 0);
+
+        if (!is_marked(next)) {
+            *key = node->key;
+            if (value != NULL) {
+                *value = node->value;
+            }
+            it->node = next;
+            return true;
+        }
+        node = unmarked(next);
+    }
+    it->node = NULL;
+    return false;
+}
@@ -0,0 +1,124 @@
+
+#include "am/macros.h"
+#include "am/data/list.h"
+
+/* While sorting, entries form NULL-terminated runs linked through 'next'.
+ * Pending runs are stacked through the 'prev' link of their first entry,
+ * newest first. Run sizes are powers of 2, and two runs of size 2^k are
+ * merged once 2^k more entries follow them, which keeps every merge
+ * balanced to at worst 2:1 without knowing the list's length in advance.
+ */
+
+/* Merge two runs, taking from 'a' on ties */
+static struct am_list *merge(am_list_cmp_fn *cmp, void *priv, struct am_list *a, struct am_list *b)
+{
+    struct am_list *head, **tail = &head;
+
+    for (;;) {
+        if (cmp(a, b, priv) <= 0) {
+            *tail = a;
+            tail = &a->next;
+            a = a->next;
+            if (a == NULL) {
+                *tail = b;
+                break;
+            }
+        } else {
+            *tail = b;
+            tail = &b->next;
+            b = b->next;
+            if (b == NULL) {
+                *tail = a;
+                break;
+            }
+        }
+    }
+    return head;
+}
+
+/* Merge the last two runs back into 'head', restoring the 'prev' links */
+static void merge_final(am_list_cmp_fn *cmp, void *priv, struct am_list *head, struct am_list *a, struct am_list *b)
+{
+    struct am_list *tail = head;
+
+    for (;;) {
+        if (cmp(a, b, priv) <= 0) {
+            tail->next = a;
+            a->prev = tail;
+            tail = a;
+            a = a->next;
+            if (a == NULL) {
+                break;
+            }
+        } else {
+            tail->next = b;
+            b->prev = tail;
+            tail = b;
+            b = b->next;
+            if (b == NULL) {
+                b = a;
+                break;
+            }
+        }
+    }
+    /* Relink the rest of the remaining run */
+    tail->next = b;
+    do {
+        b->prev = tail;
+        tail = b;
+        b = b->next;
+    } while (b != NULL);
+    tail->next = head;
+    head->prev = tail;
+}
+
+AM_ATTR_NON_NULL((1, 2)) AM_PUBLIC
+void am_list_sort(struct am_list *head, am_list_cmp_fn *cmp, void *priv)
+{
+    struct am_list *list = head->next, *pending = NULL;
+    size_t count = 0;
+
+    if (list == head->prev) {
+        return; /* Zero or one entry */
+    }
+    head->prev->next = NULL;
+
+    do {
+        struct am_list **tail = &pending;
+        size_t bits;
+
+        /* Find the run to merge: one per trailing one bit of count */
+        for (bits = count; bits & 1; bits >>= 1) {
+            tail = &(*tail)->prev;
+        }
+        /* Merge it with the one before it, unless count + 1 is a power of 2 */
+        if (bits != 0) {
+            struct am_list *a = *tail, *b = a->prev;
+
+            a = merge(cmp, priv, b, a);
+            a->prev = b->prev;
+            *tail = a;
+        }
+
+        /* Push the next entry as a run of 1 */
+        list->prev = pending;
+        pending = list;
+        list = list->next;
+        pending->next = NULL;
+        count++;
+    } while (list != NULL);
+
+    /* Merge the pending runs, smallest first */
+    list = pending;
+    pending = pending->prev;
+    for (;;) {
+        struct am_list *next = pending->prev;
+
+        if (next == NULL) {
+            break;
+        }
+        list = merge(cmp, priv, pending, list);
+        pending = next;
+    }
+    merge_final(cmp, priv, head, pending, list);
+}
@@ -0,0 +1,98 @@
+
+#include "am/macros.h"
+#include "am/data/pairing_heap.h"
+
+/* Combine a list of siblings into one tree, by the standard two passes:
+ * link them by pairs from left to right, then link the pairs into one
+ * from right to left. The pairs are stacked through 'next' in between,
+ * so no recursion is needed */
+static struct am_pairing_heap_node *merge_pairs(struct am_pairing_heap_node *first, am_pairing_heap_less_fn *less)
+{
+    struct am_pairing_heap_node *pairs = NULL, *root;
+
+    while (first != NULL) {
+        struct am_pairing_heap_node *a = first, *b = a->next;
+
+        if (b == NULL) {
+            first = NULL;
+        } else {
+            first = b->next;
+            a = am__pairing_heap_link(a, b, less);
+        }
+        a->prev = NULL;
+        a->next = pairs;
+        pairs = a;
+    }
+
+    root = pairs;
+    pairs = pairs->next;
+    root->next = NULL;
+    while (pairs != NULL) {
+        struct am_pairing_heap_node *next = pairs->next;
+
+        pairs->next = NULL;
+        root = am__pairing_heap_link(root, pairs, less);
+        pairs = next;
+    }
+    return root;
+}
+
+/* Detach a non-root node, with its subtree, from its parent and siblings */
+static void cut(struct am_pairing_heap_node *node)
+{
+    if (node->prev->child == node) {
+        node->prev->child = node->next;
+    } else {
+        node->prev->next = node->next;
+    }
+    if (node->next != NULL) {
+        node->next->prev = node->prev;
+    }
+    node->next = NULL;
+    node->prev = NULL;
+}
+
+AM_ATTR_NON_NULL((1, 2)) AM_PUBLIC
+struct am_pairing_heap_node *am_pairing_heap_pop(struct am_pairing_heap *heap, am_pairing_heap_less_fn *less)
+{
+    struct am_pairing_heap_node *root = heap->root;
+
+    if (root != NULL) {
+        heap->root = root->child != NULL ? merge_pairs(root->child, less) : NULL;
+        root->child = NULL;
+    }
+    return root;
+}
+
+AM_ATTR_NON_NULL((1, 2, 3)) AM_PUBLIC
+void am_pairing_heap_decrease(
+        struct am_pairing_heap *heap,
+        struct am_pairing_heap_node *node,
+        am_pairing_heap_less_fn *less)
+{
+    if (node == heap->root) {
+        return;
+    }
+    cut(node);
+    heap->root = am__pairing_heap_link(heap->root, node, less);
+}
+
+AM_ATTR_NON_NULL((1, 2, 3)) AM_PUBLIC
+void am_pairing_heap_remove(
+        struct am_pairing_heap *heap,
+        struct am_pairing_heap_node *node,
+        am_pairing_heap_less_fn *less)
+{
+    struct am_pairing_heap_node *children;
+
+    if (node == heap->root) {
+        am_pairing_heap_pop(heap, less);
+        return;
+    }
+    cut(node);
+    children = node->child;
+    node->child = NULL;
+    if (children != NULL) {
+        heap->root = am__pairing_heap_link(heap->root, merge_pairs(children, less), less);
+    }
+}
@@ -0,0 +1,252 @@
+
+#include "am/macros.h"
+#include "am/data/rbtree.h"
+
+/* Missing children are NULL and count as black */
+
+static AM_INLINE
+bool is_red(const struct am_rbtree_node *node)
+{
+    return node != NULL && (node->parent_color & 1) == AM_RBTREE_RED;
+}
+
+static AM_INLINE
+bool is_black(const struct am_rbtree_node *node)
+{
+    return !is_red(node);
+}
+
+static AM_INLINE
+uintptr_t color(const struct am_rbtree_node *node)
+{
+    return node->parent_color & 1;
+}
+
+static AM_INLINE
+void set_color(struct am_rbtree_node *node, uintptr_t color)
+{
+    node->parent_color = (node->parent_color & ~(uintptr_t)1) | color;
+}
+
+static AM_INLINE
+void set_parent(struct am_rbtree_node *node, struct am_rbtree_node *parent)
+{
+    node->parent_color = (uintptr_t)parent | color(node);
+}
+
+/* Make 'parent' (or the root, if NULL) point to 'new' instead of 'old' */
+static AM_INLINE
+void change_child(struct am_rbtree *tree, struct am_rbtree_node *parent, struct am_rbtree_node *old, struct am_rbtree_node *new)
+{
+    if (parent == NULL) {
+        tree->root = new;
+    } else if (parent->left == old) {
+        parent->left = new;
+    } else {
+        parent->right = new;
+    }
+}
+
+/*     x              y
+ *    / \            / \
+ *   a   y    =>    x   c
+ *      / \        / \
+ *     b   c      a   b
+ */
+static void rotate_left(struct am_rbtree *tree, struct am_rbtree_node *x)
+{
+    struct am_rbtree_node *y = x->right;
+    struct am_rbtree_node *parent = am_rbtree_parent(x);
+
+    x->right = y->left;
+    if (y->left != NULL) {
+        set_parent(y->left, x);
+    }
+    y->left = x;
+    set_parent(y, parent);
+    change_child(tree, parent, x, y);
+    set_parent(x, y);
+}
+
+static void rotate_right(struct am_rbtree *tree, struct am_rbtree_node *x)
+{
+    struct am_rbtree_node *y = x->left;
+    struct am_rbtree_node *parent = am_rbtree_parent(x);
+
+    x->left = y->right;
+    if (y->right != NULL) {
+        set_parent(y->right, x);
+    }
+    y->right = x;
+    set_parent(y, parent);
+    change_child(tree, parent, x, y);
+    set_parent(x, y);
+}
+
+AM_ATTR_NON_NULL((1, 2)) AM_PUBLIC
+void am_rbtree_insert_color(struct am_rbtree *tree, struct am_rbtree_node *node, bool leftmost)
+{
+    struct am_rbtree_node *parent, *gparent, *uncle;
+
+    if (leftmost) {
+        tree->leftmost = node;
+    }
+
+    /* The only violation is a red node with a red parent, pushed upwards */
+    while ((parent = am_rbtree_parent(node)) != NULL && is_red(parent)) {
+        /* A red parent isn't the root, so the grandparent exists */
+        gparent = am_rbtree_parent(parent);
+        if (parent == gparent->left) {
+            uncle = gparent->right;
+            if (is_red(uncle)) {
+                /* Recolour, and continue from the grandparent */
+                set_color(uncle, AM_RBTREE_BLACK);
+                set_color(parent, AM_RBTREE_BLACK);
+                set_color(gparent, AM_RBTREE_RED);
+                node = gparent;
+                continue;
+            }
+            if (node == parent->right) {
+                rotate_left(tree, parent);
+                parent = node;
+            }
+            set_color(parent, AM_RBTREE_BLACK);
+            set_color(gparent, AM_RBTREE_RED);
+            rotate_right(tree, gparent);
+        } else {
+            uncle = gparent->left;
+            if (is_red(uncle)) {
+                set_color(uncle, AM_RBTREE_BLACK);
+                set_color(parent, AM_RBTREE_BLACK);
+                set_color(gparent, AM_RBTREE_RED);
+                node = gparent;
+                continue;
+            }
+            if (node == parent->left) {
+                rotate_right(tree, parent);
+                parent = node;
+            }
+            set_color(parent, AM_RBTREE_BLACK);
+            set_color(gparent, AM_RBTREE_RED);
+            rotate_left(tree, gparent);
+        }
+        break;
+    }
+    set_color(tree->root, AM_RBTREE_BLACK);
+}
+
+/* 'node' (possibly NULL) under 'parent' is one black short */
+static void erase_color(struct am_rbtree *tree, struct am_rbtree_node *node, struct am_rbtree_node *parent)
+{
+    struct am_rbtree_node *sibling;
+
+    while (node != tree->root && is_black(node)) {
+        /* The sibling's subtree has a black height of at least 1, so it exists */
+        if (node == parent->left) {
+            sibling = parent->right;
+            if (is_red(sibling)) {
+                set_color(sibling, AM_RBTREE_BLACK);
+                set_color(parent, AM_RBTREE_RED);
+                rotate_left(tree, parent);
+                sibling = parent->right;
+            }
+            if (is_black(sibling->left) && is_black(sibling->right)) {
+                /* Move the shortage up */
+                set_color(sibling, AM_RBTREE_RED);
+                node = parent;
+                parent = am_rbtree_parent(node);
+                continue;
+            }
+            if (is_black(sibling->right)) {
+                set_color(sibling->left, AM_RBTREE_BLACK);
+                set_color(sibling, AM_RBTREE_RED);
+                rotate_right(tree, sibling);
+                sibling = parent->right;
+            }
+            set_color(sibling, color(parent));
+            set_color(parent, AM_RBTREE_BLACK);
+            set_color(sibling->right, AM_RBTREE_BLACK);
+            rotate_left(tree, parent);
+        } else {
+            sibling = parent->left;
+            if (is_red(sibling)) {
+                set_color(sibling, AM_RBTREE_BLACK);
+                set_color(parent, AM_RBTREE_RED);
+                rotate_right(tree, parent);
+                sibling = parent->left;
+            }
+            if (is_black(sibling->left) && is_black(sibling->right)) {
+                set_color(sibling, AM_RBTREE_RED);
+                node = parent;
+                parent = am_rbtree_parent(node);
+                continue;
+            }
+            if (is_black(sibling->left)) {
+                set_color(sibling->right, AM_RBTREE_BLACK);
+                set_color(sibling, AM_RBTREE_RED);
+                rotate_left(tree, sibling);
+                sibling = parent->left;
+            }
+            set_color(sibling, color(parent));
+            set_color(parent, AM_RBTREE_BLACK);
+            set_color(sibling->left, AM_RBTREE_BLACK);
+            rotate_right(tree, parent);
+        }
+        node = tree->root;
+        break;
+    }
+    if (node != NULL) {
+        set_color(node, AM_RBTREE_BLACK);
+    }
+}
+
+AM_ATTR_NON_NULL((1, 2)) AM_PUBLIC
+void am_rbtree_erase(struct am_rbtree *tree, struct am_rbtree_node *node)
+{
+    struct am_rbtree_node *child, *parent;
+    uintptr_t removed;
+
+    if (tree->leftmost == node) {
+        tree->leftmost = am_rbtree_next(node);
+    }
+
+    if (node->left == NULL || node->right == NULL) {
+        /* At most one child, which takes the node's place */
+        child = node->left != NULL ? node->left : node->right;
+        parent = am_rbtree_parent(node);
+        removed = color(node);
+        if (child != NULL) {
+            set_parent(child, parent);
+        }
+        change_child(tree, parent, node, child);
+    } else {
+        /* Two children: the successor, which has no left child, takes the
+         * node's place, and the successor's spot is what gets removed */
+        struct am_rbtree_node *successor = node->right;
+
+        while (successor->left != NULL) {
+            successor = successor->left;
+        }
+        child = successor->right;
+        removed = color(successor);
+        if (am_rbtree_parent(successor) == node) {
+            parent = successor;
+        } else {
+            parent = am_rbtree_parent(successor);
+            parent->left = child;
+            if (child != NULL) {
+                set_parent(child, parent);
+            }
+            successor->right = node->right;
+            set_parent(node->right, successor);
+        }
+        successor->left = node->left;
+        set_parent(node->left, successor);
+        successor->parent_color = node->parent_color;
+        change_child(tree, am_rbtree_parent(node), node, successor);
+    }
+
+    if (removed == AM_RBTREE_BLACK) {
+        erase_color(tree, child, parent);
+    }
+}
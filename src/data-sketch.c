@@ -0,0 +1,289 @@
+
+#include <math.h>
+#include <string.h>
+#include "am/macros.h"
+#include "am/data/sketch.h"
+
+/* Entries: register index above the low byte, register value in it */
+#define ENTRY_INDEX(e) ((e) >> 8)
+#define ENTRY_VALUE(e) ((uint8_t)(e))
+
+static AM_INLINE
+size_t num_registers(const struct am_hll *hll)
+{
+    return (size_t)1 << hll->precision;
+}
+
+static
+void sort_entries(uint32_t *entries, unsigned n)
+{
+    unsigned i, j;
+
+    /* Insertion sort: there are at most AM_HLL_PENDING */
+    for (i = 1; i < n; i++) {
+        uint32_t e = entries[i];
+
+        for (j = i; j > 0 && entries[j - 1] > e; j--) {
+            entries[j] = entries[j - 1];
+        }
+        entries[j] = e;
+    }
+}
+
+/* Convert a flushed sparse sketch to dense registers */
+static
+bool to_dense(struct am_hll *hll)
+{
+    uint8_t *registers = am_malloc(hll->allocator, num_registers(hll));
+    size_t i;
+
+    if (registers == NULL) {
+        return false;
+    }
+    memset(registers, 0, num_registers(hll));
+    for (i = 0; i < hll->sparse_len; i++) {
+        registers[ENTRY_INDEX(hll->sparse[i])] = ENTRY_VALUE(hll->sparse[i]);
+    }
+    if (hll->sparse_capacity != 0) {
+        am_free(hll->allocator, hll->sparse, hll->sparse_capacity * sizeof(uint32_t));
+    }
+    hll->registers = registers;
+    hll->sparse = NULL;
+    hll->sparse_len = 0;
+    hll->sparse_capacity = 0;
+    return true;
+}
+
+/* Ertl, "New cardinality estimation algorithms for HyperLogLog sketches" (2017) */
+static
+double sigma(double x)
+{
+    double y = 1, z = x, prev;
+
+    if (x == 1) {
+        return INFINITY;
+    }
+    do {
+        x *= x;
+        prev = z;
+        z += x * y;
+        y += y;
+    } while (z != prev);
+    return z;
+}
+
+static
+double tau(double x)
+{
+    double y = 1, z = 1 - x, prev;
+
+    if (x == 0 || x == 1) {
+        return 0;
+    }
+    do {
+        x = sqrt(x);
+        prev = z;
+        y *= 0.5;
+        z -= (1 - x) * (1 - x) * y;
+    } while (z != prev);
+    return z / 3;
+}
+
+AM_ATTR_NON_NULL((1, 2)) AM_PUBLIC
+void am_hll_init(struct am_hll *hll, struct am_alloc *allocator, unsigned precision)
+{
+    hll->allocator = allocator;
+    hll->registers = NULL;
+    hll->sparse = NULL;
+    hll->sparse_len = 0;
+    hll->sparse_capacity = 0;
+    hll->pending_len = 0;
+    hll->precision = AM_MIN(AM_MAX(precision, (unsigned)AM_HLL_MIN_PRECISION), (unsigned)AM_HLL_MAX_PRECISION);
+}
+
+AM_ATTR_NON_NULL((1)) AM_PUBLIC
+void am_hll_destroy(struct am_hll *hll)
+{
+    if (hll->registers != NULL) {
+        am_free(hll->allocator, hll->registers, num_registers(hll));
+    }
+    if (hll->sparse_capacity != 0) {
+        am_free(hll->allocator, hll->sparse, hll->sparse_capacity * sizeof(uint32_t));
+    }
+    am_hll_init(hll, hll->allocator, hll->precision);
+}
+
+AM_ATTR_NON_NULL((1)) AM_PUBLIC
+void am_hll_clear(struct am_hll *hll)
+{
+    if (hll->registers != NULL) {
+        am_free(hll->allocator, hll->registers, num_registers(hll));
+        hll->registers = NULL;
+    }
+    hll->sparse_len = 0;
+    hll->pending_len = 0;
+}
+
+AM_ATTR_NON_NULL((1)) AM_ATTR_WARN_UNUSED_RESULT AM_PUBLIC
+bool am__hll_flush(struct am_hll *hll)
+{
+    size_t n = hll->pending_len, len = hll->sparse_len + n, i, j, k;
+    uint32_t *sparse = hll->sparse;
+
+    if (len > hll->sparse_capacity) {
+        size_t capacity = AM_MAX(hll->sparse_capacity * 2, (size_t)AM_HLL_PENDING * 2);
+
+        while (capacity < len) {
+            capacity *= 2;
+        }
+        sparse = am_realloc(hll->allocator, sparse, hll->sparse_capacity * sizeof(uint32_t), capacity * sizeof(uint32_t));
+        if (sparse == NULL) {
+            return false;
+        }
+        hll->sparse = sparse;
+        hll->sparse_capacity = capacity;
+    }
+
+    /* Merge the sorted pending entries in from the back */
+    sort_entries(hll->pending, hll->pending_len);
+    i = hll->sparse_len;
+    j = n;
+    k = len;
+    while (j > 0) {
+        if (i > 0 && sparse[i - 1] > hll->pending[j - 1]) {
+            sparse[--k] = sparse[--i];
+        } else {
+            sparse[--k] = hll->pending[--j];
+        }
+    }
+    /* Keep the last, and greatest, entry for each index */
+    for (i = 0, k = 0; i < len; i++) {
+        if (i + 1 < len && ENTRY_INDEX(sparse[i + 1]) == ENTRY_INDEX(sparse[i])) {
+            continue;
+        }
+        sparse[k++] = sparse[i];
+    }
+    hll->sparse_len = k;
+    hll->pending_len = 0;
+
+    if (hll->sparse_len * sizeof(uint32_t) >= num_registers(hll)) {
+        return to_dense(hll);
+    }
+    return true;
+}
+
+AM_ATTR_NON_NULL((1, 2)) AM_ATTR_WARN_UNUSED_RESULT AM_PUBLIC
+bool am__hll_merge_slow(struct am_hll *dst, const struct am_hll *src)
+{
+    size_t i;
+
+    if (src->registers == NULL) {
+        for (i = 0; i < src->sparse_len; i++) {
+            if (!am__hll_add_entry(dst, src->sparse[i])) {
+                return false;
+            }
+        }
+        for (i = 0; i < src->pending_len; i++) {
+            if (!am__hll_add_entry(dst, src->pending[i])) {
+                return false;
+            }
+        }
+        return true;
+    }
+    if (dst->registers == NULL && !(am__hll_flush(dst) && (dst->registers != NULL || to_dense(dst)))) {
+        return false;
+    }
+    am__sketch_max_u8(dst->registers, src->registers, num_registers(dst));
+    return true;
+}
+
+AM_ATTR_NON_NULL((1)) AM_PUBLIC
+double am_hll_estimate(const struct am_hll *hll)
+{
+    const unsigned q = 64 - hll->precision;
+    const double m = (double)num_registers(hll);
+    size_t counts[64 + 2] = { 0 };
+    double z;
+    size_t i;
+    unsigned k;
+
+    if (hll->registers != NULL) {
+        for (i = 0; i < num_registers(hll); i++) {
+            counts[hll->registers[i]]++;
+        }
+    } else {
+        /* Walk the sparse array and the sorted pending entries together,
+         * emitting the greatest value of each index */
+        uint32_t pending[AM_HLL_PENDING];
+        size_t set = 0, j = 0;
+        uint32_t prev = 0;
+        bool have_prev = false;
+
+        memcpy(pending, hll->pending, hll->pending_len * sizeof(uint32_t));
+        sort_entries(pending, hll->pending_len);
+        i = 0;
+        while (i < hll->sparse_len || j < hll->pending_len) {
+            uint32_t e;
+
+            if (j == hll->pending_len || (i < hll->sparse_len && hll->sparse[i] < pending[j])) {
+                e = hll->sparse[i++];
+            } else {
+                e = pending[j++];
+            }
+            if (have_prev && ENTRY_INDEX(prev) != ENTRY_INDEX(e)) {
+                counts[ENTRY_VALUE(prev)]++;
+                set++;
+            }
+            prev = e;
+            have_prev = true;
+        }
+        if (have_prev) {
+            counts[ENTRY_VALUE(prev)]++;
+            set++;
+        }
+        counts[0] = num_registers(hll) - set;
+    }
+
+    z = m * tau(1 - (double)counts[q + 1] / m);
+    for (k = q; k >= 1; k--) {
+        z += (double)counts[k];
+        z *= 0.5;
+    }
+    z += m * sigma((double)counts[0] / m);
+    /* alpha_inf = 1 / (2 ln 2) */
+    return 0.7213475204444817 * m * m / z;
+}
+
+AM_ATTR_NON_NULL((1, 2)) AM_ATTR_WARN_UNUSED_RESULT AM_PUBLIC
+bool am_cms_init(struct am_cms *cms, struct am_alloc *allocator, size_t width, unsigned depth)
+{
+    size_t w = 1;
+
+    while (w < width) {
+        w *= 2;
+    }
+    cms->allocator = allocator;
+    cms->width = w;
+    cms->depth = AM_MIN(AM_MAX(depth, 1u), (unsigned)AM_CMS_MAX_DEPTH);
+    cms->total = 0;
+    cms->counters = am_malloc(allocator, cms->width * cms->depth * sizeof(uint32_t));
+    if (cms->counters == NULL) {
+        return false;
+    }
+    memset(cms->counters, 0, cms->width * cms->depth * sizeof(uint32_t));
+    return true;
+}
+
+AM_ATTR_NON_NULL((1)) AM_PUBLIC
+void am_cms_destroy(struct am_cms *cms)
+{
+    am_free(cms->allocator, cms->counters, cms->width * cms->depth * sizeof(uint32_t));
+    cms->counters = NULL;
+}
+
+AM_ATTR_NON_NULL((1)) AM_PUBLIC
+void am_cms_clear(struct am_cms *cms)
+{
+    memset(cms->counters, 0, cms->width * cms->depth * sizeof(uint32_t));
+    cms->total = 0;
+}
@@ -0,0 +1,84 @@
+
+#include "am/macros.h"
+#include "am/data/timerwheel.h"
+
+/* A timer at level L shares every digit above L with the wheel's time, and
+ * its digit L is greater (at level 0, greater or equal). So the timers of a
+ * level L slot are all due within the 64^L ticks starting where the time's
+ * digit L reaches the slot, and that is when they are cascaded down.
+ */
+
+AM_ATTR_NON_NULL((1)) AM_PUBLIC
+void am_timer_wheel_init(struct am_timer_wheel *wheel, uint64_t now)
+{
+    unsigned level, slot;
+
+    wheel->now = now;
+    wheel->count = 0;
+    for (level = 0; level < AM_TIMER_WHEEL_LEVELS; level++) {
+        wheel->occupied[level] = 0;
+        for (slot = 0; slot < AM_TIMER_WHEEL_SLOTS; slot++) {
+            am_list_head_init(&wheel->slots[level][slot]);
+        }
+    }
+}
+
+/* Redistribute a slot whose time has come into lower levels */
+static void cascade(struct am_timer_wheel *wheel, unsigned level, unsigned slot)
+{
+    struct am_list list, *it, *tmp;
+
+    am_list_head_init(&list);
+    am_list_splice(&wheel->slots[level][slot], &list);
+    wheel->occupied[level] &= ~(UINT64_C(1) << slot);
+    am_list_foreach_safe(it, tmp, &list) {
+        struct am_timer *timer = AM_CONTAINER_OF(it, struct am_timer, entry);
+
+        am_list_del(&timer->entry);
+        am__timer_wheel_place(wheel, timer);
+    }
+}
+
+AM_ATTR_NON_NULL((1, 3)) AM_PUBLIC
+size_t am_timer_wheel_advance(struct am_timer_wheel *wheel, uint64_t now, struct am_list *expired)
+{
+    size_t fired = 0;
+    uint64_t tick;
+
+    /* Jump from one tick with work to the next */
+    while (am_timer_wheel_next_expiry(wheel, &tick) && tick <= now) {
+        unsigned level, slot;
+
+        wheel->now = tick;
+        /* Highest level first, so timers can fall all the way down this tick */
+        for (level = AM_TIMER_WHEEL_LEVELS - 1; level > 0; level--) {
+            unsigned shift = level * AM_TIMER_WHEEL_BITS;
+
+            if ((tick & ((UINT64_C(1) << shift) - 1)) != 0) {
+                continue;
+            }
+            slot = (unsigned)(tick >> shift) & (AM_TIMER_WHEEL_SLOTS - 1);
+            if (wheel->occupied[level] & (UINT64_C(1) << slot)) {
+                cascade(wheel, level, slot);
+            }
+        }
+
+        slot = (unsigned)tick & (AM_TIMER_WHEEL_SLOTS - 1);
+        if (wheel->occupied[0] & (UINT64_C(1) << slot)) {
+            struct am_list *it;
+
+            am_list_foreach(it, &wheel->slots[0][slot]) {
+                AM_CONTAINER_OF(it, struct am_timer, entry)->index = AM__TIMER_UNARMED;
+                fired++;
+                wheel->count--;
+            }
+            am_list_splice_tail(&wheel->slots[0][slot], expired);
+            wheel->occupied[0] &= ~(UINT64_C(1) << slot);
+        }
+    }
+
+    if (now > wheel->now) {
+        wheel->now = now;
+    }
+    return fired;
+}
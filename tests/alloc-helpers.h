@@ -0,0 +1,37 @@
+/** @file alloc-helpers.h
+ * @brief Allocator wrapper which tracks the bytes outstanding, to catch leaks
+ */
+
+#ifndef AM_TESTS_ALLOC_HELPERS_H
+#define AM_TESTS_ALLOC_HELPERS_H 1
+
+#include <stddef.h>
+#include "am/macros.h"
+#include "am/alloc.h"
+
+/** @brief The default allocator, counting the bytes it hands out through 'alloc' */
+struct counting_alloc {
+    struct am_alloc alloc;
+    struct am_alloc inner;
+    size_t in_use;
+};
+
+static AM_INLINE
+void *counting_alloc_fn(void *ptr, size_t oldsz, size_t newsz, struct am_alloc *self)
+{
+    struct counting_alloc *c = AM_CONTAINER_OF(self, struct counting_alloc, alloc);
+
+    c->in_use += newsz - oldsz;
+    return c->inner.fn(ptr, oldsz, newsz, &c->inner);
+}
+
+/** @brief Initialize a counting allocator, with nothing outstanding */
+static AM_INLINE
+void counting_alloc_init(struct counting_alloc *c)
+{
+    c->alloc.fn = counting_alloc_fn;
+    am_alloc_init_default(&c->inner);
+    c->in_use = 0;
+}
+
+#endif /* ifndef AM_TESTS_ALLOC_HELPERS_H */
@@ -0,0 +1,21 @@
+/** @file check.h
+ * @brief Test assertion which, unlike assert, is kept under NDEBUG
+ *
+ * For checks whose expression has side effects, such as the call under test
+ */
+
+#ifndef AM_TESTS_CHECK_H
+#define AM_TESTS_CHECK_H 1
+
+#include <stdio.h>
+#include <stdlib.h>
+
+/** @brief Abort with the location and expression if 'expr' is false */
+#define check(expr) do { \
+    if (!(expr)) { \
+        fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #expr); \
+        abort(); \
+    } \
+} while (0)
+
+#endif /* ifndef AM_TESTS_CHECK_H */
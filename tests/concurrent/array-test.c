@@ -0,0 +1,159 @@
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include "am/alloc.h"
+#include "am/atomic.h"
+#include "am/threads.h"
+#include "am/concurrent/epoch.h"
+#include "am/concurrent/array.h"
+#include "check.h"
+
+#define NUM_READERS 3
+#define NUM_ROUNDS  5000
+#define LIVE        16
+#define MAGIC_ALIVE 0x600dU
+#define MAGIC_DEAD  0xdeadU
+
+struct subscriber {
+    am_atomic_uint magic;
+    unsigned id;
+    struct am_epoch_entry epoch_entry;
+};
+
+static struct am_alloc alloc;
+static struct am_epoch epoch;
+static struct am_spmc_array arr;
+static am_atomic_int done;
+
+static void subscriber_free(struct am_epoch_entry *entry)
+{
+    struct subscriber *s = AM_CONTAINER_OF(entry, struct subscriber, epoch_entry);
+    am_atomic_store_uint(&s->magic, MAGIC_DEAD);
+    am_free(&alloc, s, sizeof *s);
+}
+
+static struct subscriber *subscriber_new(unsigned id)
+{
+    struct subscriber *s = am_malloc(&alloc, sizeof *s);
+    check(s != NULL);
+    am_atomic_init_uint(&s->magic, MAGIC_ALIVE);
+    s->id = id;
+    return s;
+}
+
+int reader(void *ud)
+{
+    struct am_epoch_record *record = am_epoch_register(&epoch);
+    int reads = 0;
+    (void)ud;
+
+    check(record != NULL);
+    while (!am_atomic_load_int(&done)) {
+        struct am_spmc_array_iterator it;
+        unsigned i;
+        void *val;
+
+        am_epoch_begin(record);
+        am_spmc_array_foreach(&arr, &it, i, val) {
+            struct subscriber *s = val;
+            check(am_atomic_load_uint(&s->magic) == MAGIC_ALIVE);
+        }
+        /* A commit is atomic: the writer always keeps LIVE subscribers */
+        check(it.length == LIVE);
+        am_epoch_end(record);
+        reads++;
+    }
+    am_epoch_unregister(record);
+    return reads;
+}
+
+/* Staged changes stay invisible until committed */
+static void test_staging(void)
+{
+    struct subscriber a, b;
+    void *const *buf;
+    unsigned n;
+
+    check(am_spmc_array_init(&arr, &alloc, 1));
+    check(am_spmc_array_put(&arr, &a));
+    check(am_spmc_array_length(&arr) == 0);
+    check(am_spmc_array_commit(&arr));
+    check(!am_spmc_array_commit(&arr));
+    check(am_spmc_array_length(&arr) == 1);
+
+    check(!am_spmc_array_put_unique(&arr, &a));
+    check(am_spmc_array_put_unique(&arr, &b));
+    check(am_spmc_array_remove(&arr, &a));
+    check(!am_spmc_array_remove(&arr, &a));
+    buf = am_spmc_array_buffer(&arr, &n);
+    check(n == 1 && buf[0] == &a);
+
+    check(am_spmc_array_commit(&arr));
+    buf = am_spmc_array_buffer(&arr, &n);
+    check(n == 1 && buf[0] == &b);
+
+    am_spmc_array_destroy(&arr);
+}
+
+static void test_concurrent(void)
+{
+    struct subscriber *live[LIVE];
+    struct am_epoch_record *record;
+    am_thread readers[NUM_READERS];
+    unsigned i, round;
+
+    am_epoch_init(&epoch, &alloc);
+    am_atomic_init_int(&done, 0);
+    check(am_spmc_array_init(&arr, &alloc, 4));
+    for (i = 0; i < LIVE; i++) {
+        live[i] = subscriber_new(i);
+        check(am_spmc_array_put(&arr, live[i]));
+    }
+    check(am_spmc_array_commit(&arr));
+
+    for (i = 0; i < NUM_READERS; i++) {
+        am_thread_create(&readers[i], reader, NULL);
+    }
+
+    record = am_epoch_register(&epoch);
+    check(record != NULL);
+    for (round = 0; round < NUM_ROUNDS; round++) {
+        unsigned victim = round % LIVE;
+        struct subscriber *old = live[victim];
+
+        live[victim] = subscriber_new(LIVE + round);
+        check(am_spmc_array_put(&arr, live[victim]));
+        check(am_spmc_array_remove(&arr, old));
+        check(am_spmc_array_commit(&arr));
+
+        am_spmc_array_reclaim_deferred(&arr, record);
+        am_epoch_call(record, &old->epoch_entry, subscriber_free);
+    }
+
+    am_atomic_store_int(&done, 1);
+    for (i = 0; i < NUM_READERS; i++) {
+        int reads = 0;
+        am_thread_join(readers[i], &reads);
+        printf("Reader %u: %d reads\n", i, reads);
+    }
+
+    am_epoch_barrier(record);
+    am_epoch_unregister(record);
+    for (i = 0; i < LIVE; i++) {
+        check(am_spmc_array_remove(&arr, live[i]));
+        am_free(&alloc, live[i], sizeof *live[i]);
+    }
+    check(am_spmc_array_commit(&arr));
+    check(am_spmc_array_length(&arr) == 0);
+    am_spmc_array_destroy(&arr);
+    am_epoch_destroy(&epoch);
+}
+
+int main(void)
+{
+    am_alloc_init_default(&alloc);
+    test_staging();
+    test_concurrent();
+    return 0;
+}
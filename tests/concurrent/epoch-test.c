@@ -0,0 +1,155 @@
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <limits.h>
+#include "am/alloc.h"
+#include "am/atomic.h"
+#include "am/threads.h"
+#include "am/concurrent/epoch.h"
+#include "check.h"
+
+#define NUM_READERS 3
+#define NUM_UPDATES 20000
+#define MAGIC_ALIVE 0x600dU
+#define MAGIC_DEAD  0xdeadU
+
+struct node {
+    am_atomic_uint magic;
+    unsigned value;
+    struct am_epoch_entry epoch_entry;
+};
+
+static struct am_alloc alloc;
+static struct am_epoch epoch;
+static struct node *shared;
+static am_atomic_int done;
+static am_atomic_uint freed;
+
+/* Poison the node before freeing it, so early reclamation is caught */
+static void node_free(struct am_epoch_entry *entry)
+{
+    struct node *n = AM_CONTAINER_OF(entry, struct node, epoch_entry);
+    am_atomic_store_uint(&n->magic, MAGIC_DEAD);
+    am_atomic_fetch_add_uint(&freed, 1);
+    am_free(&alloc, n, sizeof *n);
+}
+
+static struct node *node_new(unsigned value)
+{
+    struct node *n = am_malloc(&alloc, sizeof *n);
+    check(n != NULL);
+    am_atomic_init_uint(&n->magic, MAGIC_ALIVE);
+    n->value = value;
+    return n;
+}
+
+int reader(void *ud)
+{
+    struct am_epoch_record *record = am_epoch_register(&epoch);
+    int reads = 0;
+    (void)ud;
+
+    check(record != NULL);
+    while (!am_atomic_load_int(&done)) {
+        struct node *n;
+        int i;
+
+        am_epoch_begin(record);
+        n = am_atomic_load_ptr_explicit((void **)&shared, AM_MEMORY_ORDER_ACQUIRE);
+        for (i = 0; i < 16; i++) {
+            check(am_atomic_load_uint(&n->magic) == MAGIC_ALIVE);
+        }
+        am_epoch_end(record);
+        reads++;
+    }
+    am_epoch_unregister(record);
+    return reads;
+}
+
+static void run(bool background)
+{
+    struct am_epoch_record *record;
+    am_thread readers[NUM_READERS];
+    unsigned i;
+    int j;
+
+    am_epoch_init(&epoch, &alloc);
+    if (background) {
+        struct timespec interval = { 0, 100000 };
+        check(am_epoch_reclaimer_start(&epoch, &interval));
+    }
+    am_atomic_init_int(&done, 0);
+    am_atomic_init_uint(&freed, 0);
+    shared = node_new(0);
+
+    for (j = 0; j < NUM_READERS; j++) {
+        am_thread_create(&readers[j], reader, NULL);
+    }
+
+    record = am_epoch_register(&epoch);
+    check(record != NULL);
+    for (i = 1; i <= NUM_UPDATES; i++) {
+        struct node *old = shared;
+        am_atomic_store_ptr_explicit((void **)&shared, node_new(i), AM_MEMORY_ORDER_RELEASE);
+        am_epoch_call(record, &old->epoch_entry, node_free);
+    }
+    /* Plain memory goes through the allocator */
+    am_epoch_free(record, am_malloc(&alloc, 128), 128);
+
+    am_atomic_store_int(&done, 1);
+    for (j = 0; j < NUM_READERS; j++) {
+        int reads = 0;
+        am_thread_join(readers[j], &reads);
+        printf("Reader %d: %d reads\n", j, reads);
+    }
+
+    printf("Freed %u of %u before the barrier\n", am_atomic_load_uint(&freed), NUM_UPDATES);
+    am_epoch_barrier(record);
+    check(am_atomic_load_uint(&freed) == NUM_UPDATES);
+    check(record->n_pending == 0);
+    am_epoch_unregister(record);
+
+    /* Records of exited threads are recycled */
+    record = am_epoch_register(&epoch);
+    check(record != NULL);
+    am_epoch_unregister(record);
+
+    am_free(&alloc, shared, sizeof *shared);
+    am_epoch_destroy(&epoch);
+}
+
+/* Deferrals on either side of the counter wrapping land in different buckets */
+static void test_wraparound(void)
+{
+    struct am_epoch_record *record;
+    struct node *a, *b;
+
+    am_epoch_init(&epoch, &alloc);
+    am_atomic_store_uint(&epoch.epoch, UINT_MAX);
+    am_atomic_init_uint(&freed, 0);
+    record = am_epoch_register(&epoch);
+    check(record != NULL);
+
+    a = node_new(1);
+    b = node_new(2);
+    am_epoch_call(record, &a->epoch_entry, node_free);
+
+    /* One epoch later isn't a grace period yet */
+    am_atomic_store_uint(&epoch.epoch, 0);
+    am_epoch_call(record, &b->epoch_entry, node_free);
+    check(am_atomic_load_uint(&freed) == 0);
+
+    am_epoch_unregister(record);
+    check(am_atomic_load_uint(&freed) == 2);
+    am_epoch_destroy(&epoch);
+}
+
+int main(void)
+{
+    am_alloc_init_default(&alloc);
+    run(false);
+    run(true);
+    test_wraparound();
+    return 0;
+}
@@ -0,0 +1,257 @@
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include "am/alloc.h"
+#include "am/atomic.h"
+#include "am/threads.h"
+#include "am/concurrent/fifo.h"
+#include "check.h"
+
+#define NUM_PRODUCERS 2
+#define NUM_CONSUMERS 2
+#define NUM_VALUES    50000
+
+/* Counts allocations made through the default allocator */
+struct counting_alloc {
+    struct am_alloc alloc;
+    struct am_alloc inner;
+    am_atomic_uint n_mallocs;
+};
+
+static void *counting_alloc_fn(void *ptr, size_t oldsz, size_t newsz, struct am_alloc *self)
+{
+    struct counting_alloc *c = AM_CONTAINER_OF(self, struct counting_alloc, alloc);
+
+    if (ptr == NULL && newsz != 0) {
+        am_atomic_fetch_add_uint(&c->n_mallocs, 1);
+    }
+    return c->inner.fn(ptr, oldsz, newsz, &c->inner);
+}
+
+static struct counting_alloc alloc;
+static struct am_fifo_mpmc fifo;
+static am_atomic_uint consumed;
+
+int producer(void *ud)
+{
+    struct am_fifo_mpmc_handle handle;
+    uintptr_t id = (uintptr_t)ud;
+    uintptr_t i;
+
+    check(am_fifo_mpmc_handle_init(&fifo, &handle));
+    for (i = 1; i <= NUM_VALUES; i++) {
+        check(am_fifo_mpmc_enqueue(&handle, (void *)(id << 24 | i)));
+    }
+    am_fifo_mpmc_handle_destroy(&handle);
+    return 0;
+}
+
+int consumer(void *ud)
+{
+    struct am_fifo_mpmc_handle handle;
+    uintptr_t last[NUM_PRODUCERS] = { 0 };
+    int n = 0;
+    (void)ud;
+
+    check(am_fifo_mpmc_handle_init(&fifo, &handle));
+    while (am_atomic_load_uint(&consumed) < NUM_PRODUCERS * NUM_VALUES) {
+        void *value;
+        uintptr_t id, seq;
+
+        if (!am_fifo_mpmc_dequeue(&handle, &value)) {
+            am_thread_yield();
+            continue;
+        }
+        id = (uintptr_t)value >> 24;
+        seq = (uintptr_t)value & 0xffffff;
+        check(id < NUM_PRODUCERS);
+        /* Values of one producer come out in the order they went in */
+        check(seq > last[id]);
+        last[id] = seq;
+        am_atomic_fetch_add_uint(&consumed, 1);
+        n++;
+    }
+    am_fifo_mpmc_handle_destroy(&handle);
+    return n;
+}
+
+static void test_concurrent(void)
+{
+    am_thread producers[NUM_PRODUCERS], consumers[NUM_CONSUMERS];
+    struct am_fifo_mpmc_handle handle;
+    int i, total = 0;
+
+    check(am_fifo_mpmc_init(&fifo, &alloc.alloc));
+    am_atomic_init_uint(&consumed, 0);
+
+    for (i = 0; i < NUM_CONSUMERS; i++) {
+        am_thread_create(&consumers[i], consumer, NULL);
+    }
+    for (i = 0; i < NUM_PRODUCERS; i++) {
+        am_thread_create(&producers[i], producer, (void *)(uintptr_t)i);
+    }
+    for (i = 0; i < NUM_PRODUCERS; i++) {
+        am_thread_join(producers[i], NULL);
+    }
+    for (i = 0; i < NUM_CONSUMERS; i++) {
+        int n = 0;
+        am_thread_join(consumers[i], &n);
+        printf("Consumer %d: %d values\n", i, n);
+        total += n;
+    }
+    check(total == NUM_PRODUCERS * NUM_VALUES);
+
+    check(am_fifo_mpmc_handle_init(&fifo, &handle));
+    check(am_fifo_mpmc_is_empty(&handle));
+    am_fifo_mpmc_handle_destroy(&handle);
+    am_fifo_mpmc_destroy(&fifo);
+}
+
+/* A steady-state queue runs on recycled nodes */
+static void test_recycling(void)
+{
+    struct am_fifo_mpmc_handle handle;
+    unsigned before, i;
+
+    check(am_fifo_mpmc_init(&fifo, &alloc.alloc));
+    check(am_fifo_mpmc_handle_init(&fifo, &handle));
+
+    for (i = 0; i < 8; i++) {
+        check(am_fifo_mpmc_enqueue(&handle, (void *)(uintptr_t)i));
+    }
+    before = am_atomic_load_uint(&alloc.n_mallocs);
+    for (i = 8; i < 100000; i++) {
+        void *value;
+        check(am_fifo_mpmc_enqueue(&handle, (void *)(uintptr_t)i));
+        check(am_fifo_mpmc_dequeue(&handle, &value));
+        check((uintptr_t)value == i - 8);
+    }
+    printf("Allocations in steady state: %u\n", am_atomic_load_uint(&alloc.n_mallocs) - before);
+    check(am_atomic_load_uint(&alloc.n_mallocs) - before < 100);
+
+    for (i = 99992; i < 100000; i++) {
+        void *value;
+        check(am_fifo_mpmc_dequeue(&handle, &value));
+        check((uintptr_t)value == i);
+    }
+    check(am_fifo_mpmc_is_empty(&handle));
+
+    am_fifo_mpmc_handle_destroy(&handle);
+    am_fifo_mpmc_destroy(&fifo);
+}
+
+/* Nodes dequeued through one handle come back to the handle enqueuing */
+static void test_recycling_split(void)
+{
+    struct am_fifo_mpmc_handle producer, consumer;
+    unsigned before, i;
+
+    check(am_fifo_mpmc_init(&fifo, &alloc.alloc));
+    check(am_fifo_mpmc_handle_init(&fifo, &producer));
+    check(am_fifo_mpmc_handle_init(&fifo, &consumer));
+
+    for (i = 0; i < 8; i++) {
+        check(am_fifo_mpmc_enqueue(&producer, (void *)(uintptr_t)i));
+    }
+    before = am_atomic_load_uint(&alloc.n_mallocs);
+    for (i = 8; i < 100000; i++) {
+        void *value;
+        check(am_fifo_mpmc_enqueue(&producer, (void *)(uintptr_t)i));
+        check(am_fifo_mpmc_dequeue(&consumer, &value));
+        check((uintptr_t)value == i - 8);
+    }
+    printf("Allocations in steady state, split handles: %u\n", am_atomic_load_uint(&alloc.n_mallocs) - before);
+    check(am_atomic_load_uint(&alloc.n_mallocs) - before < 200);
+
+    for (i = 99992; i < 100000; i++) {
+        void *value;
+        check(am_fifo_mpmc_dequeue(&consumer, &value));
+        check((uintptr_t)value == i);
+    }
+    check(am_fifo_mpmc_is_empty(&consumer));
+
+    am_fifo_mpmc_handle_destroy(&consumer);
+    am_fifo_mpmc_handle_destroy(&producer);
+    am_fifo_mpmc_destroy(&fifo);
+}
+
+static struct am_fifo_spsc spsc;
+
+int spsc_consumer(void *ud)
+{
+    uintptr_t expected = 1;
+    (void)ud;
+
+    while (expected <= NUM_VALUES) {
+        void *value;
+        if (!am_fifo_spsc_dequeue(&spsc, &value)) {
+            am_thread_yield();
+            continue;
+        }
+        check((uintptr_t)value == expected);
+        expected++;
+    }
+    return 0;
+}
+
+/* Consumed entries flow back to the producer */
+static void test_spsc(void)
+{
+    struct am_fifo_spsc_entry *entry, *next;
+    am_thread consumer;
+    unsigned n_fresh = 0, n_recycled = 0;
+    uintptr_t i;
+
+    entry = am_malloc(&alloc.alloc, sizeof *entry);
+    check(entry != NULL);
+    am_fifo_spsc_init(&spsc, entry);
+    check(am_fifo_spsc_is_empty(&spsc));
+
+    am_thread_create(&consumer, spsc_consumer, NULL);
+    for (i = 1; i <= NUM_VALUES; i++) {
+        entry = am_fifo_spsc_recycle(&spsc);
+        if (entry != NULL) {
+            n_recycled++;
+        } else {
+            entry = am_malloc(&alloc.alloc, sizeof *entry);
+            check(entry != NULL);
+            n_fresh++;
+        }
+        am_fifo_spsc_enqueue(&spsc, entry, (void *)i);
+    }
+    am_thread_join(consumer, NULL);
+    printf("SPSC: %u fresh entries, %u recycled\n", n_fresh, n_recycled);
+    check(n_fresh + n_recycled == NUM_VALUES);
+    check(am_fifo_spsc_is_empty(&spsc));
+
+    /* Once the consumer keeps up, every entry is a recycled one */
+    for (i = 0; i < 1000; i++) {
+        void *value;
+        entry = am_fifo_spsc_recycle(&spsc);
+        check(entry != NULL);
+        am_fifo_spsc_enqueue(&spsc, entry, (void *)i);
+        check(am_fifo_spsc_dequeue(&spsc, &value));
+        check((uintptr_t)value == i);
+    }
+
+    am_fifo_spsc_deinit(&spsc, &entry);
+    for (i = 0; entry != NULL; entry = next, i++) {
+        next = entry->next;
+        am_free(&alloc.alloc, entry, sizeof *entry);
+    }
+    check(i == n_fresh + 1);
+}
+
+int main(void)
+{
+    alloc.alloc.fn = counting_alloc_fn;
+    am_alloc_init_default(&alloc.inner);
+    am_atomic_init_uint(&alloc.n_mallocs, 0);
+
+    test_concurrent();
+    test_recycling();
+    test_recycling_split();
+    test_spsc();
+    return 0;
+}
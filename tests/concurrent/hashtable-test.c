@@ -0,0 +1,392 @@
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "am/alloc.h"
+#include "am/atomic.h"
+#include "am/threads.h"
+#include "am/concurrent/hashtable.h"
+#include "check.h"
+
+#define NUM_KEYS 10000
+#define NUM_READERS 3
+#define MAX_MIGRATE_STEP 64
+
+static struct am_hashtable ht;
+static am_atomic_int done;
+
+/* Readers must never see a key mapped to anything but its own value */
+int reader(void *ud)
+{
+    int hits = 0;
+    (void)ud;
+
+    while (!am_atomic_load_int(&done)) {
+        uintptr_t k;
+        for (k = 1; k <= NUM_KEYS; k++) {
+            struct am_hashtable_entry entry;
+            am_hashtable_entry_key_set_direct(&entry, k);
+            if (am_hashtable_get(&ht, am_hashtable_hash_direct(&ht, k), &entry)) {
+                check(am_hashtable_entry_value_direct(&entry) == k * 2);
+                hits++;
+            }
+        }
+    }
+    return hits;
+}
+
+static void test_direct(void)
+{
+    struct am_alloc alloc;
+    struct am_hashtable_stat st;
+    am_thread readers[NUM_READERS];
+    uintptr_t k;
+    int i, round;
+
+    am_alloc_init_default(&alloc);
+    check(am_hashtable_init(&ht, AM_HASHTABLE_MODE_DIRECT, NULL, &alloc, 8, 42));
+    am_atomic_init_int(&done, 0);
+
+    for (i = 0; i < NUM_READERS; i++) {
+        am_thread_create(&readers[i], reader, NULL);
+    }
+
+    for (round = 0; round < 4; round++) {
+        for (k = 1; k <= NUM_KEYS; k++) {
+            struct am_hashtable_entry entry;
+            am_hashtable_entry_set_direct(&entry, 0, k, k * 2);
+            check(am_hashtable_put(&ht, am_hashtable_hash_direct(&ht, k), &entry));
+        }
+        check(am_hashtable_count(&ht) == NUM_KEYS);
+
+        /* Remove the odd keys, then reinsert them with 'set' */
+        for (k = 1; k <= NUM_KEYS; k += 2) {
+            struct am_hashtable_entry entry;
+            am_hashtable_entry_key_set_direct(&entry, k);
+            check(am_hashtable_remove(&ht, am_hashtable_hash_direct(&ht, k), &entry));
+            check(am_hashtable_entry_value_direct(&entry) == k * 2);
+        }
+        check(am_hashtable_gc(&ht, 0, 0));
+        for (k = 1; k <= NUM_KEYS; k++) {
+            struct am_hashtable_entry entry;
+            am_hashtable_entry_set_direct(&entry, 0, k, k * 2);
+            check(am_hashtable_set(&ht, am_hashtable_hash_direct(&ht, k), &entry));
+            check((k % 2 == 1) == am_hashtable_entry_empty(&entry));
+        }
+
+        for (k = 1; k <= NUM_KEYS; k++) {
+            struct am_hashtable_entry entry;
+            am_hashtable_entry_key_set_direct(&entry, k);
+            check(am_hashtable_remove(&ht, am_hashtable_hash_direct(&ht, k), &entry));
+        }
+        check(am_hashtable_count(&ht) == 0);
+    }
+
+    am_atomic_store_int(&done, 1);
+    for (i = 0; i < NUM_READERS; i++) {
+        int hits = 0;
+        am_thread_join(readers[i], &hits);
+        printf("Reader %d: %d hits\n", i, hits);
+    }
+
+    am_hashtable_stat(&ht, &st);
+    printf("Probe maximum: %llu\n", (unsigned long long)st.probe_maximum);
+    check(st.num_entries == 0);
+    am_hashtable_destroy(&ht);
+}
+
+/* Two keys sharing a home slot, which the writer hands back and forth */
+static uintptr_t cycle_keys[2];
+
+int cycle_reader(void *ud)
+{
+    int hits = 0;
+    (void)ud;
+
+    while (!am_atomic_load_int(&done)) {
+        int i;
+        for (i = 0; i < 2; i++) {
+            uintptr_t k = cycle_keys[i];
+            struct am_hashtable_entry entry;
+            am_hashtable_entry_key_set_direct(&entry, k);
+            if (am_hashtable_get(&ht, am_hashtable_hash_direct(&ht, k), &entry)) {
+                check(am_hashtable_entry_key_direct(&entry) == k);
+                check(am_hashtable_entry_value_direct(&entry) == k * 2);
+                hits++;
+            }
+        }
+    }
+    return hits;
+}
+
+/* A slot cycling between two keys must never pair one key with the other's value */
+static void test_slot_reuse(void)
+{
+    struct am_alloc alloc;
+    am_thread readers[NUM_READERS];
+    uint64_t h0;
+    uintptr_t k;
+    int i, round;
+
+    am_alloc_init_default(&alloc);
+    check(am_hashtable_init(&ht, AM_HASHTABLE_MODE_DIRECT, NULL, &alloc, 8, 42));
+    am_atomic_init_int(&done, 0);
+
+    /* Equal low bits put both keys first in the same slot at any small size */
+    cycle_keys[0] = 1;
+    h0 = am_hashtable_hash_direct(&ht, cycle_keys[0]);
+    k = 2;
+    while (((am_hashtable_hash_direct(&ht, k) ^ h0) & 0xFFFF) != 0) {
+        k++;
+    }
+    cycle_keys[1] = k;
+
+    for (i = 0; i < NUM_READERS; i++) {
+        am_thread_create(&readers[i], cycle_reader, NULL);
+    }
+
+    for (round = 0; round < 200000; round++) {
+        struct am_hashtable_entry entry;
+        k = cycle_keys[round % 2];
+        am_hashtable_entry_set_direct(&entry, 0, k, k * 2);
+        check(am_hashtable_put(&ht, am_hashtable_hash_direct(&ht, k), &entry));
+        am_hashtable_entry_key_set_direct(&entry, k);
+        check(am_hashtable_remove(&ht, am_hashtable_hash_direct(&ht, k), &entry));
+    }
+
+    am_atomic_store_int(&done, 1);
+    for (i = 0; i < NUM_READERS; i++) {
+        int hits = 0;
+        am_thread_join(readers[i], &hits);
+        printf("Cycle reader %d: %d hits\n", i, hits);
+    }
+    check(am_hashtable_count(&ht) == 0);
+    am_hashtable_destroy(&ht);
+}
+
+/* A write may move a few slots of the old map, but must never drain it all at once */
+static void check_migration_step(const struct am_hashtable_stat *before)
+{
+    struct am_hashtable_stat after;
+
+    am_hashtable_stat(&ht, &after);
+    if (before->migration_total != 0 && after.migration_total == before->migration_total) {
+        check(after.migration_progress - before->migration_progress <= MAX_MIGRATE_STEP);
+    } else if (before->migration_total != 0) {
+        check(before->migration_total - before->migration_progress <= MAX_MIGRATE_STEP);
+    }
+}
+
+/* Every key must stay reachable while a resize is only partially done */
+static void test_migration(void)
+{
+    struct am_alloc alloc;
+    struct am_hashtable_stat st;
+    uintptr_t k, j;
+    int migrating = 0;
+
+    am_alloc_init_default(&alloc);
+    check(am_hashtable_init(&ht, AM_HASHTABLE_MODE_DIRECT, NULL, &alloc, 0, 1));
+
+    am_hashtable_stat(&ht, &st);
+    for (k = 1; k <= NUM_KEYS; k++) {
+        struct am_hashtable_entry entry;
+        am_hashtable_entry_set_direct(&entry, 0, k, k * 2);
+        check(am_hashtable_put(&ht, am_hashtable_hash_direct(&ht, k), &entry));
+        check_migration_step(&st);
+
+        am_hashtable_stat(&ht, &st);
+        check(st.num_entries == k);
+        if (st.migration_total != 0) {
+            check(st.migration_progress < st.migration_total);
+            migrating++;
+            for (j = 1; j <= k; j += 97) {
+                am_hashtable_entry_key_set_direct(&entry, j);
+                check(am_hashtable_get(&ht, am_hashtable_hash_direct(&ht, j), &entry));
+                check(am_hashtable_entry_value_direct(&entry) == j * 2);
+            }
+        }
+    }
+    check(migrating > 0);
+
+    /* Draining the table should shrink it the same way */
+    migrating = 0;
+    for (k = 1; k <= NUM_KEYS - 10; k++) {
+        struct am_hashtable_entry entry;
+        am_hashtable_entry_key_set_direct(&entry, k);
+        check(am_hashtable_remove(&ht, am_hashtable_hash_direct(&ht, k), &entry));
+        check_migration_step(&st);
+        am_hashtable_stat(&ht, &st);
+        migrating += st.migration_total != 0;
+    }
+    check(migrating > 0);
+    check(am_hashtable_gc(&ht, 0, 0));
+    am_hashtable_stat(&ht, &st);
+    check(st.migration_total == 0);
+    check(st.num_entries == 10);
+    for (k = NUM_KEYS - 9; k <= NUM_KEYS; k++) {
+        struct am_hashtable_entry entry;
+        am_hashtable_entry_key_set_direct(&entry, k);
+        check(am_hashtable_get(&ht, am_hashtable_hash_direct(&ht, k), &entry));
+    }
+
+    am_hashtable_destroy(&ht);
+}
+
+/* Every 16th key is too long to be stored inline */
+static uint16_t key_format(char *buf, unsigned i)
+{
+    if (i % 16 == 0) {
+        return (uint16_t)sprintf(buf, "a-rather-long-key-which-does-not-fit-%u", i);
+    }
+    return (uint16_t)sprintf(buf, "k%u", i);
+}
+
+static char *long_keys[2000 / 16];
+
+static const char *key_stable(const char *buf, unsigned i, uint16_t len)
+{
+    char *copy;
+
+    if (len <= AM_HASHTABLE_INLINE_KEY_MAX) {
+        return buf;
+    }
+    copy = malloc(len);
+    check(copy != NULL);
+    memcpy(copy, buf, len);
+    long_keys[i / 16] = copy;
+    return copy;
+}
+
+static void test_bytestring(void)
+{
+    static const char *const names[] = { "alpha", "beta", "gamma", "delta", "epsilon" };
+    struct am_alloc alloc;
+    struct am_hashtable_iterator it = AM_HASHTABLE_ITERATOR_INITIALIZER;
+    struct am_hashtable_entry *cursor;
+    char buf[16];
+    size_t i;
+    int n = 0;
+
+    am_alloc_init_default(&alloc);
+    check(am_hashtable_init(&ht, AM_HASHTABLE_MODE_BYTESTRING, NULL, &alloc, 0, 7));
+
+    for (i = 0; i < AM_ARRAY_SIZE(names); i++) {
+        struct am_hashtable_entry entry;
+        uint16_t len = strlen(names[i]);
+        am_hashtable_entry_set(&entry, 0, names[i], len, (void *)(i + 1));
+        check(am_hashtable_put(&ht, am_hashtable_hash(&ht, names[i], len), &entry));
+        check(!am_hashtable_put(&ht, am_hashtable_hash(&ht, names[i], len), &entry));
+    }
+
+    /* Lookups compare contents, not pointers */
+    for (i = 0; i < AM_ARRAY_SIZE(names); i++) {
+        struct am_hashtable_entry entry;
+        uint16_t len = strlen(names[i]);
+        memcpy(buf, names[i], len);
+        am_hashtable_entry_key_set(&entry, buf, len);
+        check(am_hashtable_get(&ht, am_hashtable_hash(&ht, buf, len), &entry));
+        check(am_hashtable_entry_value(&entry) == (void *)(i + 1));
+    }
+
+    while (am_hashtable_next(&ht, &it, &cursor)) {
+        printf("{ .key = %.*s, .value = %p }\n",
+                (int)am_hashtable_entry_key_length(cursor),
+                (const char *)am_hashtable_entry_key(cursor),
+                am_hashtable_entry_value(cursor));
+        n++;
+    }
+    check(n == (int)AM_ARRAY_SIZE(names));
+
+    am_hashtable_destroy(&ht);
+}
+
+/* Short keys live in the slot, so the caller's buffers may be reused */
+static void test_inline(void)
+{
+    struct am_alloc alloc;
+    struct am_hashtable_iterator it = AM_HASHTABLE_ITERATOR_INITIALIZER;
+    struct am_hashtable_entry *cursor;
+    char buf[64];
+    unsigned i;
+    int n = 0;
+
+    am_alloc_init_default(&alloc);
+    check(am_hashtable_init(&ht, AM_HASHTABLE_MODE_INLINE, NULL, &alloc, 0, 7));
+
+    /* Keys are written into a scratch buffer, long ones point at a static copy */
+    for (i = 0; i < 2000; i++) {
+        struct am_hashtable_entry entry;
+        uint16_t len = key_format(buf, i);
+        am_hashtable_entry_set(&entry, 0, key_stable(buf, i, len), len, (void *)(uintptr_t)(i + 1));
+        check(am_hashtable_put(&ht, am_hashtable_hash(&ht, buf, len), &entry));
+        memset(buf, 'x', sizeof buf);
+    }
+
+    for (i = 0; i < 2000; i += 2) {
+        struct am_hashtable_entry entry;
+        uint16_t len = key_format(buf, i);
+        am_hashtable_entry_key_set(&entry, buf, len);
+        check(am_hashtable_remove(&ht, am_hashtable_hash(&ht, buf, len), &entry));
+        check(am_hashtable_entry_key(&entry) == buf || len > AM_HASHTABLE_INLINE_KEY_MAX);
+        check(am_hashtable_entry_value(&entry) == (void *)(uintptr_t)(i + 1));
+    }
+    check(am_hashtable_gc(&ht, 0, 0));
+
+    for (i = 0; i < 2000; i++) {
+        struct am_hashtable_entry entry;
+        uint16_t len = key_format(buf, i);
+        bool found;
+        am_hashtable_entry_key_set(&entry, buf, len);
+        found = am_hashtable_get(&ht, am_hashtable_hash(&ht, buf, len), &entry);
+        check(found == (i % 2 == 1));
+        if (found) {
+            check(am_hashtable_entry_key(&entry) == buf);
+            check(am_hashtable_entry_value(&entry) == (void *)(uintptr_t)(i + 1));
+        }
+    }
+
+    /* Batches span several prefetch groups, with a partial one at the end */
+    {
+        static char keys[200][64];
+        struct am_hashtable_entry entries[200];
+        bool found[200];
+
+        for (i = 0; i < 200; i++) {
+            uint16_t len = key_format(keys[i], i);
+            am_hashtable_entry_key_set(&entries[i], keys[i], len);
+        }
+        check(am_hashtable_get_batch(&ht, entries, found, 200) == 100);
+        for (i = 0; i < 200; i++) {
+            check(found[i] == (i % 2 == 1));
+            if (found[i]) {
+                check(am_hashtable_entry_value(&entries[i]) == (void *)(uintptr_t)(i + 1));
+            }
+        }
+    }
+
+    while (am_hashtable_next(&ht, &it, &cursor)) {
+        uint16_t len = am_hashtable_entry_key_length(cursor);
+        unsigned k = (unsigned)(uintptr_t)am_hashtable_entry_value(cursor) - 1;
+        check(len == key_format(buf, k));
+        check(memcmp(am_hashtable_entry_key(cursor), buf, len) == 0);
+        n++;
+    }
+    check(n == 1000);
+
+    am_hashtable_destroy(&ht);
+    for (i = 0; i < AM_ARRAY_SIZE(long_keys); i++) {
+        free(long_keys[i]);
+    }
+}
+
+int main(void)
+{
+    test_direct();
+    test_slot_reuse();
+    test_migration();
+    test_bytestring();
+    test_inline();
+    return 0;
+}
@@ -0,0 +1,134 @@
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include "am/alloc.h"
+#include "am/atomic.h"
+#include "am/threads.h"
+#include "am/concurrent/epoch.h"
+#include "am/concurrent/hashtable_sharded.h"
+#include "check.h"
+
+#define NUM_WRITERS 4
+#define NUM_READERS 2
+#define NUM_SHARDS  8
+#define KEYS_PER_WRITER 5000
+
+static struct am_alloc alloc;
+static struct am_epoch epoch;
+static struct am_hashtable_sharded sh;
+static am_atomic_int done;
+
+int writer(void *ud)
+{
+    struct am_epoch_record *record = am_epoch_register(&epoch);
+    uintptr_t base = (uintptr_t)ud * KEYS_PER_WRITER + 1;
+    uintptr_t k;
+
+    check(record != NULL);
+    for (k = base; k < base + KEYS_PER_WRITER; k++) {
+        struct am_hashtable_entry entry;
+        am_hashtable_entry_set_direct(&entry, 0, k, k * 3);
+        check(am_hashtable_sharded_put(&sh, am_hashtable_sharded_hash_direct(&sh, k), &entry));
+    }
+    /* Drop every key of ours divisible by 3 */
+    for (k = base; k < base + KEYS_PER_WRITER; k++) {
+        struct am_hashtable_entry entry;
+        if (k % 3 != 0) {
+            continue;
+        }
+        am_hashtable_entry_key_set_direct(&entry, k);
+        check(am_hashtable_sharded_remove(&sh, am_hashtable_sharded_hash_direct(&sh, k), &entry));
+        check(am_hashtable_entry_value_direct(&entry) == k * 3);
+    }
+    am_hashtable_sharded_reclaim_deferred(&sh, record);
+    am_epoch_unregister(record);
+    return 0;
+}
+
+int reader(void *ud)
+{
+    struct am_epoch_record *record = am_epoch_register(&epoch);
+    int hits = 0;
+    (void)ud;
+
+    check(record != NULL);
+    while (!am_atomic_load_int(&done)) {
+        uintptr_t k;
+
+        am_epoch_begin(record);
+        for (k = 1; k <= NUM_WRITERS * KEYS_PER_WRITER; k += 11) {
+            struct am_hashtable_entry entry;
+            am_hashtable_entry_key_set_direct(&entry, k);
+            if (am_hashtable_sharded_get(&sh, am_hashtable_sharded_hash_direct(&sh, k), &entry)) {
+                check(am_hashtable_entry_value_direct(&entry) == k * 3);
+                hits++;
+            }
+        }
+        am_epoch_end(record);
+    }
+    am_epoch_unregister(record);
+    return hits;
+}
+
+int main(void)
+{
+    am_thread writers[NUM_WRITERS], readers[NUM_READERS];
+    struct am_epoch_record *record;
+    unsigned long n_writes = 0;
+    uint64_t n_entries = 0;
+    uintptr_t i, k;
+
+    am_alloc_init_default(&alloc);
+    am_epoch_init(&epoch, &alloc);
+    am_atomic_init_int(&done, 0);
+    check(am_hashtable_sharded_init(&sh, AM_HASHTABLE_MODE_DIRECT, NULL, &alloc, 5, 0, 9));
+    check(am_hashtable_sharded_count_shards(&sh) == NUM_SHARDS);
+
+    for (i = 0; i < NUM_READERS; i++) {
+        am_thread_create(&readers[i], reader, NULL);
+    }
+    for (i = 0; i < NUM_WRITERS; i++) {
+        am_thread_create(&writers[i], writer, (void *)i);
+    }
+    for (i = 0; i < NUM_WRITERS; i++) {
+        am_thread_join(writers[i], NULL);
+    }
+    am_atomic_store_int(&done, 1);
+    for (i = 0; i < NUM_READERS; i++) {
+        int hits = 0;
+        am_thread_join(readers[i], &hits);
+        printf("Reader %d: %d hits\n", (int)i, hits);
+    }
+
+    for (k = 1; k <= NUM_WRITERS * KEYS_PER_WRITER; k++) {
+        struct am_hashtable_entry entry;
+        am_hashtable_entry_key_set_direct(&entry, k);
+        check(am_hashtable_sharded_get(&sh, am_hashtable_sharded_hash_direct(&sh, k), &entry) == (k % 3 != 0));
+    }
+
+    /* Every shard takes a share of the keys */
+    for (i = 0; i < NUM_SHARDS; i++) {
+        struct am_hashtable_shard_stat st;
+        am_hashtable_sharded_stat(&sh, i, &st);
+        printf("Shard %d: %lu entries, %lu writes, %lu contended, probe maximum %lu\n",
+                (int)i, (unsigned long)st.table.num_entries, st.n_writes, st.n_contended,
+                (unsigned long)st.table.probe_maximum);
+        check(st.table.num_entries > 0);
+        n_entries += st.table.num_entries;
+        n_writes += st.n_writes;
+    }
+    check(n_entries == am_hashtable_sharded_count(&sh));
+    check(n_entries == NUM_WRITERS * KEYS_PER_WRITER - NUM_WRITERS * KEYS_PER_WRITER / 3);
+    check(n_writes == NUM_WRITERS * KEYS_PER_WRITER + NUM_WRITERS * KEYS_PER_WRITER / 3);
+
+    check(am_hashtable_sharded_gc(&sh, 0, 0));
+    record = am_epoch_register(&epoch);
+    check(record != NULL);
+    am_epoch_barrier(record);
+    am_epoch_unregister(record);
+
+    am_hashtable_sharded_destroy(&sh);
+    am_epoch_destroy(&epoch);
+    return 0;
+}
@@ -0,0 +1,177 @@
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include "am/alloc.h"
+#include "am/atomic.h"
+#include "am/threads.h"
+#include "am/concurrent/hazard.h"
+#include "am/concurrent/hashtable.h"
+#include "check.h"
+
+#define NUM_READERS 3
+#define NUM_UPDATES 20000
+#define NUM_KEYS    5000
+#define THRESHOLD   32
+#define MAGIC_ALIVE 0x600dU
+#define MAGIC_DEAD  0xdeadU
+
+struct node {
+    am_atomic_uint magic;
+    struct am_hazard_entry hazard_entry;
+};
+
+static struct am_alloc alloc;
+static struct am_hazard hp;
+static struct node *shared;
+static struct am_hashtable ht;
+static am_atomic_int done;
+
+static void node_free(struct am_hazard_entry *entry)
+{
+    struct node *n = AM_CONTAINER_OF(entry, struct node, hazard_entry);
+    am_atomic_store_uint(&n->magic, MAGIC_DEAD);
+    am_free(&alloc, n, sizeof *n);
+}
+
+int node_reader(void *ud)
+{
+    struct am_hazard_record *record = am_hazard_register(&hp);
+    int reads = 0;
+    (void)ud;
+
+    check(record != NULL);
+    while (!am_atomic_load_int(&done)) {
+        struct node *n = am_hazard_protect(record, 0, (void **)&shared);
+        check(am_atomic_load_uint(&n->magic) == MAGIC_ALIVE);
+        am_hazard_clear(record, 0);
+        reads++;
+    }
+    am_hazard_unregister(record);
+    return reads;
+}
+
+static void test_nodes(void)
+{
+    struct am_hazard_record *record;
+    am_thread readers[NUM_READERS];
+    unsigned i;
+    int j;
+
+    am_hazard_init(&hp, &alloc, 1, THRESHOLD);
+    am_atomic_init_int(&done, 0);
+    shared = am_malloc(&alloc, sizeof *shared);
+    am_atomic_init_uint(&shared->magic, MAGIC_ALIVE);
+
+    for (j = 0; j < NUM_READERS; j++) {
+        am_thread_create(&readers[j], node_reader, NULL);
+    }
+
+    record = am_hazard_register(&hp);
+    check(record != NULL);
+    for (i = 0; i < NUM_UPDATES; i++) {
+        struct node *old = shared;
+        struct node *n = am_malloc(&alloc, sizeof *n);
+        check(n != NULL);
+        am_atomic_init_uint(&n->magic, MAGIC_ALIVE);
+        am_atomic_store_ptr_explicit((void **)&shared, n, AM_MEMORY_ORDER_RELEASE);
+        am_hazard_retire(record, &old->hazard_entry, old, node_free);
+
+        /* Each reader pins at most one node */
+        check(record->n_retired < THRESHOLD + NUM_READERS + 1);
+    }
+
+    am_atomic_store_int(&done, 1);
+    for (j = 0; j < NUM_READERS; j++) {
+        int reads = 0;
+        am_thread_join(readers[j], &reads);
+        printf("Reader %d: %d reads\n", j, reads);
+    }
+
+    am_hazard_purge(record);
+    check(record->n_retired == 0);
+    check(record->n_reclaimed == NUM_UPDATES);
+    am_hazard_free(record, am_malloc(&alloc, 64), 64);
+    am_hazard_purge(record);
+    am_hazard_unregister(record);
+
+    am_free(&alloc, shared, sizeof *shared);
+    am_hazard_destroy(&hp);
+}
+
+int table_reader(void *ud)
+{
+    struct am_hazard_record *record = am_hazard_register(&hp);
+    int hits = 0;
+    (void)ud;
+
+    check(record != NULL);
+    while (!am_atomic_load_int(&done)) {
+        uintptr_t k;
+        for (k = 1; k <= NUM_KEYS; k += 7) {
+            struct am_hashtable_entry entry;
+            am_hashtable_entry_key_set_direct(&entry, k);
+            if (am_hashtable_get_hazard(&ht, record, am_hashtable_hash_direct(&ht, k), &entry)) {
+                check(am_hashtable_entry_value_direct(&entry) == k + 1);
+                hits++;
+            }
+        }
+    }
+    am_hazard_unregister(record);
+    return hits;
+}
+
+/* Maps retired by resizing are freed while readers still run */
+static void test_hashtable(void)
+{
+    struct am_hazard_record *record;
+    am_thread readers[NUM_READERS];
+    uintptr_t k;
+    int j, round;
+
+    am_hazard_init(&hp, &alloc, AM_HASHTABLE_HAZARD_SLOTS, 2);
+    am_atomic_init_int(&done, 0);
+    check(am_hashtable_init(&ht, AM_HASHTABLE_MODE_DIRECT, NULL, &alloc, 0, 3));
+
+    for (j = 0; j < NUM_READERS; j++) {
+        am_thread_create(&readers[j], table_reader, NULL);
+    }
+
+    record = am_hazard_register(&hp);
+    check(record != NULL);
+    for (round = 0; round < 4; round++) {
+        for (k = 1; k <= NUM_KEYS; k++) {
+            struct am_hashtable_entry entry;
+            am_hashtable_entry_set_direct(&entry, 0, k, k + 1);
+            check(am_hashtable_put(&ht, am_hashtable_hash_direct(&ht, k), &entry));
+            am_hashtable_reclaim_hazard(&ht, record);
+        }
+        for (k = 1; k <= NUM_KEYS; k++) {
+            struct am_hashtable_entry entry;
+            am_hashtable_entry_key_set_direct(&entry, k);
+            check(am_hashtable_remove(&ht, am_hashtable_hash_direct(&ht, k), &entry));
+            am_hashtable_reclaim_hazard(&ht, record);
+        }
+    }
+
+    am_atomic_store_int(&done, 1);
+    for (j = 0; j < NUM_READERS; j++) {
+        int hits = 0;
+        am_thread_join(readers[j], &hits);
+        printf("Table reader %d: %d hits\n", j, hits);
+    }
+
+    printf("Maps reclaimed: %lu\n", record->n_reclaimed);
+    am_hazard_purge(record);
+    am_hazard_unregister(record);
+    am_hashtable_destroy(&ht);
+    am_hazard_destroy(&hp);
+}
+
+int main(void)
+{
+    am_alloc_init_default(&alloc);
+    test_nodes();
+    test_hashtable();
+    return 0;
+}
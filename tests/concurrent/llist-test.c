@@ -0,0 +1,125 @@
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include "am/atomic.h"
+#include "am/threads.h"
+#include "am/concurrent/llist.h"
+#include "check.h"
+
+#define NUM_PRODUCERS 4
+#define NUM_ITEMS     50000 /* Per producer */
+#define BATCH         8
+
+struct item {
+    int producer;
+    int seq;
+    struct am_llist_node node;
+};
+
+static struct item items[NUM_PRODUCERS][NUM_ITEMS];
+static struct am_llist_head queue;
+static am_atomic_int producers_left;
+
+static void test_basic(void)
+{
+    struct am_llist_head head = AM_LLIST_HEAD_INITIALIZER;
+    struct am_llist_node nodes[5], *it, *tmp, *first;
+    int i = 0;
+
+    check(am_llist_is_empty(&head));
+    check(am_llist_del_all(&head) == NULL);
+    check(am_llist_del_first(&head) == NULL);
+    check(am_llist_add(&head, &nodes[0]));
+    check(!am_llist_add(&head, &nodes[1]));
+    /* Chain 2 -> 3 -> 4 goes on top as a whole */
+    nodes[2].next = &nodes[3];
+    nodes[3].next = &nodes[4];
+    check(!am_llist_add_batch(&head, &nodes[2], &nodes[4]));
+
+    check(am_llist_del_first(&head) == &nodes[2]);
+    first = am_llist_del_all(&head);
+    check(am_llist_is_empty(&head));
+    /* Newest first: 3, 4, 1, 0 */
+    check(first == &nodes[3] && nodes[4].next == &nodes[1]);
+
+    first = am_llist_reverse(first);
+    am_llist_foreach_safe(it, tmp, first) {
+        static const int order[] = { 0, 1, 4, 3 };
+        check(it == &nodes[order[i++]]);
+    }
+    check(i == 4);
+    check(am_llist_reverse(NULL) == NULL);
+}
+
+static int producer(void *ud)
+{
+    int p = (int)(intptr_t)ud;
+    int i;
+
+    for (i = 0; i < NUM_ITEMS; i += BATCH) {
+        int j, n = AM_MIN(BATCH, NUM_ITEMS - i);
+
+        for (j = 0; j < n; j++) {
+            items[p][i + j].producer = p;
+            items[p][i + j].seq = i + j;
+        }
+        if (i % (2 * BATCH) == 0) {
+            for (j = 0; j < n; j++)
+                am_llist_add(&queue, &items[p][i + j].node);
+        } else {
+            /* Linked newest first, so that the chain reads like single adds */
+            for (j = 1; j < n; j++)
+                items[p][i + j].node.next = &items[p][i + j - 1].node;
+            am_llist_add_batch(&queue, &items[p][i + n - 1].node, &items[p][i].node);
+        }
+    }
+    am_atomic_fetch_add_int(&producers_left, -1);
+    return 0;
+}
+
+/* The consumer sees each producer's entries exactly once, in order */
+static void test_handoff(void)
+{
+    am_thread threads[NUM_PRODUCERS];
+    int next[NUM_PRODUCERS] = { 0 };
+    long taken = 0, grabs = 0;
+    int i;
+
+    am_llist_head_init(&queue);
+    am_atomic_init_int(&producers_left, NUM_PRODUCERS);
+    for (i = 0; i < NUM_PRODUCERS; i++)
+        check(am_thread_create(&threads[i], producer, (void *)(intptr_t)i) == AM_THREAD_SUCCESS);
+
+    for (;;) {
+        bool last = am_atomic_load_int(&producers_left) == 0;
+        struct am_llist_node *it, *first = am_llist_reverse(am_llist_del_all(&queue));
+
+        am_llist_foreach(it, first) {
+            struct item *item = AM_CONTAINER_OF(it, struct item, node);
+            check(item->seq == next[item->producer]);
+            next[item->producer]++;
+            taken++;
+        }
+        grabs += first != NULL;
+        if (last)
+            break;
+        if (first == NULL)
+            am_thread_yield();
+    }
+
+    for (i = 0; i < NUM_PRODUCERS; i++) {
+        check(am_thread_join(threads[i], NULL) == AM_THREAD_SUCCESS);
+        check(next[i] == NUM_ITEMS);
+    }
+    check(taken == (long)NUM_PRODUCERS * NUM_ITEMS);
+    check(am_llist_is_empty(&queue));
+    printf("%ld entries in %ld grabs\n", taken, grabs);
+}
+
+int main(void)
+{
+    test_basic();
+    test_handoff();
+    return 0;
+}
@@ -0,0 +1,189 @@
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include "am/alloc.h"
+#include "am/atomic.h"
+#include "am/threads.h"
+#include "am/concurrent/pool.h"
+#include "check.h"
+
+#define NUM_WORKERS   4
+#define NUM_SUBMITTERS 3
+#define NUM_TASKS     10000
+#define FOR_LENGTH    1000000
+
+static struct am_pool pool;
+static struct am_alloc alloc;
+
+/* Fibonacci in continuation-passing style: each task hands its result to a sum task */
+struct fib {
+    struct am_task task;
+    int n;
+    long *out;
+};
+
+struct sum {
+    struct am_task task;
+    long a, b;
+    long *out;
+};
+
+static void sum_fn(struct am_task *task)
+{
+    struct sum *s = AM_CONTAINER_OF(task, struct sum, task);
+
+    *s->out = s->a + s->b;
+    free(s);
+}
+
+static struct fib *fib_new(int n, long *out, struct am_task *continuation);
+
+static void fib_fn(struct am_task *task)
+{
+    struct fib *f = AM_CONTAINER_OF(task, struct fib, task);
+
+    if (f->n < 2) {
+        *f->out = f->n;
+    } else {
+        struct sum *s = malloc(sizeof *s);
+        check(s != NULL);
+        s->out = f->out;
+        am_task_init(&s->task, sum_fn, task->continuation);
+        am_task_add_children(task->continuation, 1);
+        am_task_add_children(&s->task, 2);
+        check(am_pool_spawn(&pool, &fib_new(f->n - 1, &s->a, &s->task)->task));
+        check(am_pool_spawn(&pool, &fib_new(f->n - 2, &s->b, &s->task)->task));
+    }
+    free(f);
+}
+
+static struct fib *fib_new(int n, long *out, struct am_task *continuation)
+{
+    struct fib *f = malloc(sizeof *f);
+
+    check(f != NULL);
+    f->n = n;
+    f->out = out;
+    am_task_init(&f->task, fib_fn, continuation);
+    return f;
+}
+
+static void test_fib(void)
+{
+    struct am_task done;
+    long result = -1;
+
+    am_task_init(&done, NULL, NULL);
+    am_task_add_children(&done, 1);
+    check(am_pool_spawn(&pool, &fib_new(24, &result, &done)->task));
+    am_pool_join(&pool, &done);
+    printf("fib(24) = %ld\n", result);
+    check(result == 46368);
+}
+
+/* Threads outside the pool submit through the injection queue */
+static am_atomic_uint counter;
+
+static void count_fn(struct am_task *task)
+{
+    (void)task;
+    am_atomic_fetch_add_uint(&counter, 1);
+}
+
+int submitter(void *ud)
+{
+    struct am_task *tasks = malloc(NUM_TASKS * sizeof *tasks);
+    struct am_task done;
+    int i;
+    (void)ud;
+
+    check(tasks != NULL);
+    am_task_init(&done, NULL, NULL);
+    am_task_add_children(&done, NUM_TASKS);
+    for (i = 0; i < NUM_TASKS; i++) {
+        am_task_init(&tasks[i], count_fn, &done);
+        check(am_pool_spawn(&pool, &tasks[i]));
+    }
+    am_pool_join(&pool, &done);
+    free(tasks);
+    return 0;
+}
+
+static void test_inject(void)
+{
+    am_thread threads[NUM_SUBMITTERS];
+    int i;
+
+    am_atomic_init_uint(&counter, 0);
+    for (i = 0; i < NUM_SUBMITTERS; i++) {
+        am_thread_create(&threads[i], submitter, NULL);
+    }
+    for (i = 0; i < NUM_SUBMITTERS; i++) {
+        am_thread_join(threads[i], NULL);
+    }
+    check(am_atomic_load_uint(&counter) == NUM_SUBMITTERS * NUM_TASKS);
+}
+
+/* Every index is visited exactly once */
+static unsigned char *visited;
+
+static void visit(size_t lo, size_t hi, void *ud)
+{
+    size_t i;
+    (void)ud;
+
+    for (i = lo; i < hi; i++) {
+        visited[i]++;
+    }
+}
+
+/* Nested loops join from within a worker */
+static void nested(size_t lo, size_t hi, void *ud)
+{
+    size_t i, block = FOR_LENGTH / 8;
+    (void)ud;
+
+    for (i = lo; i < hi; i++) {
+        am_pool_parallel_for(&pool, i * block, (i + 1) * block, 1000, visit, NULL);
+    }
+}
+
+static void test_parallel_for(void)
+{
+    size_t i;
+
+    visited = calloc(FOR_LENGTH, 1);
+    check(visited != NULL);
+
+    am_pool_parallel_for(&pool, 0, FOR_LENGTH, 1000, visit, NULL);
+    for (i = 0; i < FOR_LENGTH; i++) {
+        check(visited[i] == 1);
+    }
+
+    am_pool_parallel_for(&pool, 0, 8, 1, nested, NULL);
+    for (i = 0; i < FOR_LENGTH; i++) {
+        check(visited[i] == 2);
+    }
+
+    /* Empty ranges, and a range smaller than the grain */
+    am_pool_parallel_for(&pool, 5, 5, 1, visit, NULL);
+    am_pool_parallel_for(&pool, 0, 10, 100, visit, NULL);
+    for (i = 0; i < 20; i++) {
+        check(visited[i] == (i < 10 ? 3 : 2));
+    }
+    free(visited);
+}
+
+int main(void)
+{
+    am_alloc_init_default(&alloc);
+    check(am_pool_init(&pool, &alloc, NUM_WORKERS));
+
+    test_fib();
+    test_inject();
+    test_parallel_for();
+
+    am_pool_destroy(&pool);
+    return 0;
+}
@@ -0,0 +1,272 @@
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include "am/alloc.h"
+#include "am/atomic.h"
+#include "am/threads.h"
+#include "am/concurrent/epoch.h"
+#include "am/concurrent/radix.h"
+#include "check.h"
+#include "alloc-helpers.h"
+
+#define NUM_READERS 2
+#define NUM_KEYS    5000
+#define NUM_ROUNDS  20
+
+/* Only the writing thread allocates, and only its epoch record frees */
+static struct counting_alloc alloc;
+static struct am_alloc epoch_alloc;
+static struct am_epoch epoch;
+static struct am_radix tree;
+static am_atomic_int done;
+
+#define VALUE(key) ((void *)(((uintptr_t)(key) << 1) | 1))
+
+static uintptr_t next_rand(uintptr_t *seed)
+{
+    *seed = *seed * 6364136223846793005u + 1442695040888963407u;
+    return *seed >> 17;
+}
+
+static void test_basic(void)
+{
+    static const uintptr_t sparse[] = { 0, 63, 64, 4095, 4096, 1u << 20, UINTPTR_MAX / 3, UINTPTR_MAX - 1, UINTPTR_MAX };
+    struct am_epoch_record *record = am_epoch_register(&epoch);
+    uintptr_t key, expected;
+    void *value;
+    size_t i, n;
+
+    check(record != NULL);
+    am_radix_init(&tree, &alloc.alloc);
+    check(am_radix_get(&tree, record, 0) == NULL);
+    key = 0;
+    check(!am_radix_find(&tree, record, &key, UINTPTR_MAX, NULL));
+    check(am_radix_erase(&tree, record, 0) == NULL);
+
+    /* Dense keys share leaves */
+    for (key = 0; key < NUM_KEYS; key++) {
+        check(am_radix_set(&tree, record, key * 7 % NUM_KEYS, VALUE(key * 7 % NUM_KEYS)));
+    }
+    check(am_radix_count(&tree) == NUM_KEYS);
+    for (key = 0; key < NUM_KEYS; key++) {
+        check(am_radix_get(&tree, record, key) == VALUE(key));
+    }
+    check(am_radix_get(&tree, record, NUM_KEYS) == NULL);
+    check(am_radix_get(&tree, record, UINTPTR_MAX) == NULL);
+
+    /* Replacing keeps the count */
+    check(am_radix_set(&tree, record, 10, VALUE(11)));
+    check(am_radix_get(&tree, record, 10) == VALUE(11));
+    check(am_radix_count(&tree) == NUM_KEYS);
+    check(am_radix_set(&tree, record, 10, VALUE(10)));
+
+    /* Remove every other key, then iterate over a range */
+    for (key = 1; key < NUM_KEYS; key += 2) {
+        check(am_radix_erase(&tree, record, key) == VALUE(key));
+        check(am_radix_erase(&tree, record, key) == NULL);
+    }
+    check(am_radix_count(&tree) == NUM_KEYS / 2);
+    expected = 100;
+    am_radix_foreach_range(&tree, record, key, value, 99, 1001) {
+        check(key == expected);
+        check(value == VALUE(key));
+        expected += 2;
+    }
+    check(expected == 1002);
+
+    /* Empty the tree: every node is retired */
+    for (key = 0; key < NUM_KEYS; key += 2) {
+        check(am_radix_erase(&tree, record, key) == VALUE(key));
+    }
+    check(am_radix_count(&tree) == 0);
+    am_epoch_barrier(record);
+    check(alloc.in_use == 0);
+
+    /* Sparse keys across the whole range; the height follows the largest */
+    for (i = 0; i < AM_ARRAY_SIZE(sparse); i++) {
+        check(am_radix_set(&tree, record, sparse[i], VALUE(i)));
+    }
+    for (i = 0; i < AM_ARRAY_SIZE(sparse); i++) {
+        check(am_radix_get(&tree, record, sparse[i]) == VALUE(i));
+        check(am_radix_get(&tree, record, sparse[i] ^ 16) == NULL);
+    }
+    n = 0;
+    am_radix_foreach_range(&tree, record, key, value, 0, UINTPTR_MAX) {
+        check(key == sparse[n]);
+        check(value == VALUE(n));
+        n++;
+    }
+    check(n == AM_ARRAY_SIZE(sparse));
+    key = 65;
+    check(am_radix_find(&tree, record, &key, UINTPTR_MAX, &value));
+    check(key == 4095 && value == VALUE(3));
+    key = 4097;
+    check(!am_radix_find(&tree, record, &key, 1u << 19, NULL));
+
+    /* Shrinks back to a single leaf once the large keys are gone */
+    for (i = AM_ARRAY_SIZE(sparse); i-- > 1; ) {
+        check(am_radix_erase(&tree, record, sparse[i]) == VALUE(i));
+    }
+    am_epoch_barrier(record);
+    check(am_radix_get(&tree, record, 0) == VALUE(0));
+    check(alloc.in_use > 0 && alloc.in_use < 1024);
+    am_radix_destroy(&tree);
+    check(alloc.in_use == 0);
+
+    /* Randomized against a flat reference */
+    {
+        static void *ref[NUM_KEYS];
+        uintptr_t seed = 3, lo, hi;
+        int op;
+
+        am_radix_init(&tree, &alloc.alloc);
+        for (op = 0; op < 100000; op++) {
+            key = next_rand(&seed) % NUM_KEYS;
+            switch (next_rand(&seed) % 4) {
+            case 0:
+            case 1:
+                check(am_radix_set(&tree, record, key, VALUE(op)));
+                ref[key] = VALUE(op);
+                break;
+            case 2:
+                check(am_radix_erase(&tree, record, key) == ref[key]);
+                ref[key] = NULL;
+                break;
+            case 3:
+                lo = key;
+                hi = lo + next_rand(&seed) % 300;
+                am_radix_foreach_range(&tree, record, key, value, lo, hi) {
+                    for (; lo < key; lo++) {
+                        check(ref[lo] == NULL);
+                    }
+                    check(ref[key] == value);
+                    lo = key + 1;
+                }
+                for (; lo <= hi && lo < NUM_KEYS; lo++) {
+                    check(ref[lo] == NULL);
+                }
+                break;
+            }
+        }
+        for (n = 0, key = 0; key < NUM_KEYS; key++) {
+            n += ref[key] != NULL;
+        }
+        check(am_radix_count(&tree) == n);
+        am_radix_destroy(&tree);
+        check(alloc.in_use == 0);
+    }
+
+    am_epoch_barrier(record);
+    am_epoch_unregister(record);
+}
+
+/* Keys below NUM_KEYS / 2 stay put, so readers must always find them;
+ * the rest come and go, along with a far key that grows and shrinks the tree */
+static int writer(void *ud)
+{
+    struct am_epoch_record *record = am_epoch_register(&epoch);
+    uintptr_t key, far = (uintptr_t)1 << (sizeof(uintptr_t) * 8 - 2);
+    int round;
+    (void)ud;
+
+    check(record != NULL);
+    for (round = 0; round < NUM_ROUNDS; round++) {
+        check(am_radix_set(&tree, record, far + (uintptr_t)round, VALUE(far + (uintptr_t)round)));
+        for (key = NUM_KEYS / 2; key < NUM_KEYS; key++) {
+            check(am_radix_set(&tree, record, key, VALUE(key)));
+        }
+        check(am_radix_erase(&tree, record, far + (uintptr_t)round) == VALUE(far + (uintptr_t)round));
+        for (key = NUM_KEYS / 2; key < NUM_KEYS; key++) {
+            check(am_radix_erase(&tree, record, key) == VALUE(key));
+        }
+        am_epoch_poll(record);
+    }
+    am_epoch_barrier(record);
+    am_epoch_unregister(record);
+    return 0;
+}
+
+static int reader(void *ud)
+{
+    struct am_epoch_record *record = am_epoch_register(&epoch);
+    uintptr_t seed = (uintptr_t)ud + 1;
+    int scans = 0;
+
+    check(record != NULL);
+    while (!am_atomic_load_int(&done)) {
+        uintptr_t key, expected = 0, last = 0;
+        void *value;
+
+        key = next_rand(&seed) % (NUM_KEYS / 2);
+        check(am_radix_get(&tree, record, key) == VALUE(key));
+        value = am_radix_get(&tree, record, NUM_KEYS / 2 + key);
+        check(value == NULL || value == VALUE(NUM_KEYS / 2 + key));
+
+        /* Whole scans see the stable keys in order, and nothing else out of place */
+        am_epoch_begin(record);
+        am_radix_foreach_range(&tree, record, key, value, 0, UINTPTR_MAX) {
+            check(value == VALUE(key));
+            check(expected == 0 || key > last);
+            if (key < NUM_KEYS / 2) {
+                check(key == expected);
+                expected++;
+            }
+            last = key;
+        }
+        am_epoch_end(record);
+        check(expected == NUM_KEYS / 2);
+        scans++;
+    }
+    am_epoch_unregister(record);
+    return scans;
+}
+
+static void test_concurrent(void)
+{
+    struct am_epoch_record *record = am_epoch_register(&epoch);
+    am_thread writer_thread, readers[NUM_READERS];
+    uintptr_t key;
+    int i;
+
+    check(record != NULL);
+    am_radix_init(&tree, &alloc.alloc);
+    for (key = 0; key < NUM_KEYS / 2; key++) {
+        check(am_radix_set(&tree, record, key, VALUE(key)));
+    }
+    am_atomic_init_int(&done, 0);
+
+    for (i = 0; i < NUM_READERS; i++) {
+        am_thread_create(&readers[i], reader, (void *)(uintptr_t)i);
+    }
+    am_thread_create(&writer_thread, writer, NULL);
+    am_thread_join(writer_thread, NULL);
+    am_atomic_store_int(&done, 1);
+    for (i = 0; i < NUM_READERS; i++) {
+        int scans = 0;
+        am_thread_join(readers[i], &scans);
+        printf("Reader %d: %d scans\n", i, scans);
+    }
+
+    check(am_radix_count(&tree) == NUM_KEYS / 2);
+    for (key = 0; key < NUM_KEYS / 2; key++) {
+        check(am_radix_erase(&tree, record, key) == VALUE(key));
+    }
+    am_epoch_barrier(record);
+    check(alloc.in_use == 0);
+    am_radix_destroy(&tree);
+    am_epoch_unregister(record);
+}
+
+int main(void)
+{
+    counting_alloc_init(&alloc);
+    am_alloc_init_default(&epoch_alloc);
+    am_epoch_init(&epoch, &epoch_alloc);
+
+    test_basic();
+    test_concurrent();
+
+    am_epoch_destroy(&epoch);
+    return 0;
+}
@@ -0,0 +1,222 @@
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include "am/alloc.h"
+#include "am/atomic.h"
+#include "am/threads.h"
+#include "am/concurrent/epoch.h"
+#include "am/concurrent/skiplist.h"
+#include "check.h"
+
+#define NUM_WRITERS 3
+#define NUM_READERS 2
+#define NUM_KEYS    3000
+#define NUM_ROUNDS  4
+
+static struct am_alloc alloc;
+static struct am_epoch epoch;
+static struct am_skiplist list;
+static am_atomic_int done;
+
+static void test_basic(void)
+{
+    struct am_epoch_record *record = am_epoch_register(&epoch);
+    struct am_skiplist_iterator it;
+    uint64_t key, expected;
+    void *value;
+    int i;
+
+    check(record != NULL);
+    check(am_skiplist_init(&list, &alloc));
+
+    /* Insert odd keys 1..199 out of order */
+    for (i = 0; i < 100; i++) {
+        key = (uint64_t)(i * 37 % 100) * 2 + 1;
+        check(am_skiplist_put(&list, record, key, (void *)(uintptr_t)(key * 10)));
+    }
+    check(!am_skiplist_put(&list, record, 37, NULL));
+    check(am_skiplist_get(&list, record, 37, &value));
+    check((uintptr_t)value == 370);
+    check(!am_skiplist_get(&list, record, 38, &value));
+    check(!am_skiplist_get(&list, record, 0, NULL));
+    check(!am_skiplist_get(&list, record, 1000, NULL));
+
+    /* Range scans start at the lower bound */
+    am_epoch_begin(record);
+    am_skiplist_seek(&list, &it, 50);
+    expected = 51;
+    while (am_skiplist_next(&it, &key, &value)) {
+        check(key == expected);
+        check((uintptr_t)value == key * 10);
+        expected += 2;
+    }
+    check(expected == 201);
+    check(!am_skiplist_next(&it, &key, NULL));
+    am_skiplist_seek(&list, &it, 200);
+    check(!am_skiplist_next(&it, &key, NULL));
+    am_epoch_end(record);
+
+    for (key = 1; key < 200; key += 4) {
+        check(am_skiplist_remove(&list, record, key, &value));
+        check((uintptr_t)value == key * 10);
+        check(!am_skiplist_remove(&list, record, key, NULL));
+    }
+    am_epoch_begin(record);
+    am_skiplist_seek(&list, &it, 0);
+    expected = 3;
+    while (am_skiplist_next(&it, &key, NULL)) {
+        check(key == expected);
+        expected += 4;
+    }
+    check(expected == 203);
+    am_epoch_end(record);
+
+    am_epoch_barrier(record);
+    am_skiplist_destroy(&list);
+    am_epoch_unregister(record);
+}
+
+/* Each writer repeatedly inserts and removes its own keys, interleaved with the others' */
+int writer(void *ud)
+{
+    struct am_epoch_record *record = am_epoch_register(&epoch);
+    uint64_t id = (uintptr_t)ud, key;
+    int round;
+
+    check(record != NULL);
+    for (round = 0; round < NUM_ROUNDS; round++) {
+        for (key = id; key < NUM_KEYS; key += NUM_WRITERS) {
+            check(am_skiplist_put(&list, record, key, (void *)(uintptr_t)(key + 1)));
+        }
+        for (key = id; key < NUM_KEYS; key += NUM_WRITERS) {
+            void *value;
+            check(am_skiplist_remove(&list, record, key, &value));
+            check((uintptr_t)value == key + 1);
+        }
+    }
+    /* Leave the keys of the last round behind */
+    for (key = id; key < NUM_KEYS; key += NUM_WRITERS) {
+        check(am_skiplist_put(&list, record, key, (void *)(uintptr_t)(key + 1)));
+    }
+    am_epoch_unregister(record);
+    return 0;
+}
+
+/* Scans always see keys in increasing order, with their own values */
+int reader(void *ud)
+{
+    struct am_epoch_record *record = am_epoch_register(&epoch);
+    int scans = 0;
+    (void)ud;
+
+    check(record != NULL);
+    while (!am_atomic_load_int(&done)) {
+        struct am_skiplist_iterator it;
+        uint64_t key, last = 0;
+        void *value;
+        bool first = true;
+
+        am_epoch_begin(record);
+        am_skiplist_seek(&list, &it, (uint64_t)scans % NUM_KEYS);
+        while (am_skiplist_next(&it, &key, &value)) {
+            check(first || key > last);
+            check((uintptr_t)value == key + 1);
+            last = key;
+            first = false;
+        }
+        am_epoch_end(record);
+        if (am_skiplist_get(&list, record, (uint64_t)scans % NUM_KEYS, &value)) {
+            check((uintptr_t)value == (uint64_t)scans % NUM_KEYS + 1);
+        }
+        scans++;
+    }
+    am_epoch_unregister(record);
+    return scans;
+}
+
+/* Removers race for the same keys: each key is removed exactly once */
+int remover(void *ud)
+{
+    struct am_epoch_record *record = am_epoch_register(&epoch);
+    uint64_t key;
+    int n = 0;
+    (void)ud;
+
+    check(record != NULL);
+    for (key = 0; key < NUM_KEYS; key++) {
+        if (am_skiplist_remove(&list, record, key, NULL)) {
+            n++;
+        }
+    }
+    am_epoch_unregister(record);
+    return n;
+}
+
+static void test_concurrent(void)
+{
+    struct am_epoch_record *record = am_epoch_register(&epoch);
+    am_thread writers[NUM_WRITERS], readers[NUM_READERS];
+    struct am_skiplist_iterator it;
+    uint64_t key, expected = 0;
+    int i, total = 0;
+
+    check(record != NULL);
+    check(am_skiplist_init(&list, &alloc));
+    am_atomic_init_int(&done, 0);
+
+    for (i = 0; i < NUM_READERS; i++) {
+        am_thread_create(&readers[i], reader, NULL);
+    }
+    for (i = 0; i < NUM_WRITERS; i++) {
+        am_thread_create(&writers[i], writer, (void *)(uintptr_t)i);
+    }
+    for (i = 0; i < NUM_WRITERS; i++) {
+        am_thread_join(writers[i], NULL);
+    }
+    am_atomic_store_int(&done, 1);
+    for (i = 0; i < NUM_READERS; i++) {
+        int scans = 0;
+        am_thread_join(readers[i], &scans);
+        printf("Reader %d: %d scans\n", i, scans);
+    }
+
+    am_epoch_begin(record);
+    am_skiplist_seek(&list, &it, 0);
+    while (am_skiplist_next(&it, &key, NULL)) {
+        check(key == expected);
+        expected++;
+    }
+    am_epoch_end(record);
+    check(expected == NUM_KEYS);
+
+    for (i = 0; i < NUM_WRITERS; i++) {
+        am_thread_create(&writers[i], remover, NULL);
+    }
+    for (i = 0; i < NUM_WRITERS; i++) {
+        int n = 0;
+        am_thread_join(writers[i], &n);
+        total += n;
+    }
+    check(total == NUM_KEYS);
+    am_epoch_begin(record);
+    am_skiplist_seek(&list, &it, 0);
+    check(!am_skiplist_next(&it, &key, NULL));
+    am_epoch_end(record);
+
+    am_epoch_barrier(record);
+    am_skiplist_destroy(&list);
+    am_epoch_unregister(record);
+}
+
+int main(void)
+{
+    am_alloc_init_default(&alloc);
+    am_epoch_init(&epoch, &alloc);
+
+    test_basic();
+    test_concurrent();
+
+    am_epoch_destroy(&epoch);
+    return 0;
+}
@@ -0,0 +1,107 @@
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "am/macros.h"
+#include "am/threads.h"
+#include "am/data/list.h"
+#include "am/concurrent/stack.h"
+
+/* Push/pop pairs on a shared free list: am_stack against an am_list behind a spinlock
+ * Usage: stack-bench [threads] [operations per thread]
+ */
+
+#define NUM_NODES 1024
+
+struct node {
+    struct am_stack_entry entry;
+    struct am_list list;
+};
+
+static struct node nodes[NUM_NODES];
+static struct am_stack stack;
+static struct am_list list;
+static am_spinlock lock;
+static long num_ops;
+
+int stack_worker(void *ud)
+{
+    long i;
+    (void)ud;
+
+    for (i = 0; i < num_ops; i++) {
+        struct am_stack_entry *e = am_stack_pop(&stack);
+        if (e != NULL) {
+            am_stack_push(&stack, e);
+        }
+    }
+    return 0;
+}
+
+int list_worker(void *ud)
+{
+    long i;
+    (void)ud;
+
+    for (i = 0; i < num_ops; i++) {
+        struct am_list *e = NULL;
+
+        am_spinlock_lock(&lock);
+        if (!am_list_is_empty(&list)) {
+            e = list.next;
+            am_list_del(e);
+        }
+        am_spinlock_unlock(&lock);
+
+        if (e != NULL) {
+            am_spinlock_lock(&lock);
+            am_list_add(e, &list);
+            am_spinlock_unlock(&lock);
+        }
+    }
+    return 0;
+}
+
+static double run(am_thread_fn fn, int n_threads)
+{
+    am_thread *threads = malloc(n_threads * sizeof *threads);
+    struct timespec start, end;
+    int i;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (i = 0; i < n_threads; i++) {
+        am_thread_create(&threads[i], fn, NULL);
+    }
+    for (i = 0; i < n_threads; i++) {
+        am_thread_join(threads[i], NULL);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    free(threads);
+
+    return (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+int main(int argc, char *argv[])
+{
+    int i, n_threads = argc > 1 ? atoi(argv[1]) : 4;
+    double t;
+
+    num_ops = argc > 2 ? atol(argv[2]) : 1000000;
+
+    am_stack_init(&stack);
+    am_list_head_init(&list);
+    am_spinlock_init(&lock);
+    for (i = 0; i < NUM_NODES; i++) {
+        am_stack_push(&stack, &nodes[i].entry);
+        am_list_add(&nodes[i].list, &list);
+    }
+
+    t = run(stack_worker, n_threads);
+    printf("am_stack:         %d threads, %.1f Mops/s\n", n_threads, 2 * n_threads * num_ops / t / 1e6);
+    t = run(list_worker, n_threads);
+    printf("am_list+spinlock: %d threads, %.1f Mops/s\n", n_threads, 2 * n_threads * num_ops / t / 1e6);
+
+    am_spinlock_destroy(&lock);
+    return 0;
+}
@@ -0,0 +1,112 @@
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include "am/atomic.h"
+#include "am/threads.h"
+#include "am/concurrent/stack.h"
+#include "check.h"
+
+#define NUM_THREADS 4
+#define NUM_NODES   64
+#define NUM_OPS     100000
+
+struct node {
+    struct am_stack_entry entry;
+    am_atomic_int owned;
+};
+
+static struct node nodes[NUM_NODES];
+static struct am_stack stack;
+
+/* Nodes circulate between threads, each held by one thread at a time */
+int worker(void *ud)
+{
+    int i, n = 0;
+    (void)ud;
+
+    for (i = 0; i < NUM_OPS; i++) {
+        struct am_stack_entry *e = am_stack_pop(&stack);
+        struct node *nd;
+        int unowned = 0;
+
+        if (e == NULL) {
+            continue;
+        }
+        nd = AM_CONTAINER_OF(e, struct node, entry);
+        check(am_atomic_cas_int(&nd->owned, &unowned, 1));
+        am_atomic_store_int(&nd->owned, 0);
+        am_stack_push(&stack, e);
+        n++;
+    }
+    return n;
+}
+
+static void test_concurrent(void)
+{
+    am_thread threads[NUM_THREADS];
+    struct am_stack_entry *it;
+    int i, count = 0;
+
+    am_stack_init(&stack);
+    for (i = 0; i < NUM_NODES; i++) {
+        am_atomic_init_int(&nodes[i].owned, 0);
+        am_stack_push(&stack, &nodes[i].entry);
+    }
+
+    for (i = 0; i < NUM_THREADS; i++) {
+        am_thread_create(&threads[i], worker, NULL);
+    }
+    for (i = 0; i < NUM_THREADS; i++) {
+        int n = 0;
+        am_thread_join(threads[i], &n);
+        printf("Thread %d: %d pops\n", i, n);
+    }
+
+    /* Nothing was lost or duplicated */
+    am_stack_foreach(it, am_stack_pop_all(&stack)) {
+        count++;
+    }
+    check(count == NUM_NODES);
+    check(am_stack_is_empty(&stack));
+}
+
+static void test_batch(void)
+{
+    struct am_stack_entry *it, *tmp, *first;
+    struct am_stack s = AM_STACK_INITIALIZER;
+    int i;
+
+    check(am_stack_pop(&s) == NULL);
+    check(am_stack_pop_all(&s) == NULL);
+
+    /* Link nodes[0] -> nodes[1] -> ... -> nodes[9] */
+    for (i = 0; i < 9; i++) {
+        nodes[i].entry.next = &nodes[i + 1].entry;
+    }
+    am_stack_push(&s, &nodes[10].entry);
+    am_stack_push_batch(&s, &nodes[0].entry, &nodes[9].entry);
+    check(am_stack_pop(&s) == &nodes[0].entry);
+
+    first = am_stack_pop_all(&s);
+    i = 1;
+    am_stack_foreach_safe(it, tmp, first) {
+        check(it == &nodes[i].entry);
+        it->next = NULL;
+        i++;
+    }
+    check(i == 11);
+    check(am_stack_is_empty(&s));
+}
+
+int main(void)
+{
+#ifdef AM_ATOMIC_HAVE_CAS_DWORD
+    printf("Using a generation-tagged head\n");
+#else
+    printf("Using serialized poppers\n");
+#endif
+    test_concurrent();
+    test_batch();
+    return 0;
+}
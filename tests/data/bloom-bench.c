@@ -0,0 +1,77 @@
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "am/alloc.h"
+#include "am/data/bloom.h"
+
+/* Negative lookups against filters from cache-resident to memory-bound,
+ * one at a time and through the prefetching batch API
+ * Usage: bloom-bench [queries]
+ */
+
+static double elapsed(const struct timespec *start)
+{
+    struct timespec end;
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return (end.tv_sec - start->tv_sec) + (end.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+int main(int argc, char *argv[])
+{
+    static const size_t sizes[] = { 10000, 1000000, 20000000 };
+    size_t n_queries = argc > 1 ? strtoul(argv[1], NULL, 10) : 10000000;
+    uint64_t *hashes = malloc(n_queries * sizeof *hashes);
+    bool *results = malloc(n_queries * sizeof *results);
+    struct am_alloc alloc;
+    size_t s, i;
+
+    if (hashes == NULL || results == NULL) {
+        return 1;
+    }
+    am_alloc_init_default(&alloc);
+#ifdef AM_BLOOM_AVX2
+    printf("AVX2\n");
+#else
+    printf("scalar\n");
+#endif
+    printf("%10s %10s %16s %16s %10s\n", "keys", "bytes", "single ns/op", "batch ns/op", "fpr");
+    for (i = 0; i < n_queries; i++) {
+        hashes[i] = am_hash_fmix64(~(uint64_t)i);
+    }
+    for (s = 0; s < AM_ARRAY_SIZE(sizes); s++) {
+        struct am_bloom bloom;
+        struct timespec start;
+        size_t single = 0, batch;
+        double ts, tb;
+
+        if (!am_bloom_init(&bloom, &alloc, sizes[s], 10)) {
+            return 1;
+        }
+        for (i = 0; i < sizes[s]; i++) {
+            am_bloom_add_hash(&bloom, am_hash_fmix64(i));
+        }
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (i = 0; i < n_queries; i++) {
+            single += am_bloom_contains_hash(&bloom, hashes[i]);
+        }
+        ts = elapsed(&start);
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        batch = am_bloom_contains_batch(&bloom, hashes, n_queries, results);
+        tb = elapsed(&start);
+
+        printf("%10zu %10zu %16.1f %16.1f %10.4f\n", sizes[s], am_bloom_size(&bloom),
+                ts / n_queries * 1e9, tb / n_queries * 1e9, (double)batch / n_queries);
+        am_bloom_destroy(&bloom);
+        if (single != batch) {
+            return 1;
+        }
+    }
+    free(hashes);
+    free(results);
+    return 0;
+}
@@ -0,0 +1,101 @@
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include "am/alloc.h"
+#include "am/data/bloom.h"
+#include "check.h"
+#include "alloc-helpers.h"
+
+#define NUM_KEYS    100000
+#define NUM_QUERIES 200000
+
+static struct counting_alloc alloc;
+static uint64_t hashes[NUM_QUERIES];
+static bool results[NUM_QUERIES];
+
+/* Recompute a key's bits independently of the header's code paths */
+static bool reference_contains(const struct am_bloom *bloom, uint64_t hash)
+{
+    static const uint32_t salt[AM_BLOOM_WORDS] = {
+        0x47b6137b, 0x44974d91, 0x8824ad5b, 0xa2b7289d, 0x705495c7, 0x2df1424b, 0x9efc4947, 0x5c6bfb31
+    };
+    const struct am_bloom_block *block = &bloom->blocks[(hash >> 32) * bloom->num_blocks >> 32];
+    int i;
+
+    for (i = 0; i < AM_BLOOM_WORDS; i++) {
+        if (!(block->words[i] >> (((uint32_t)hash * salt[i]) >> 26) & 1))
+            return false;
+    }
+    return true;
+}
+
+int main(void)
+{
+    struct am_bloom bloom;
+    unsigned long i, positives = 0;
+    double fill, fpr, measured;
+    char key[32];
+
+#ifdef AM_BLOOM_AVX2
+    if (!__builtin_cpu_supports("avx2")) {
+        printf("AVX2 not supported, skipping\n");
+        return 0;
+    }
+#endif
+
+    counting_alloc_init(&alloc);
+
+    check(am_bloom_init(&bloom, &alloc.alloc, NUM_KEYS, 10));
+    check(((uintptr_t)bloom.blocks & (AM_CACHELINE - 1)) == 0);
+    check(am_bloom_size(&bloom) >= NUM_KEYS * 10 / 8);
+    check(am_bloom_fill_ratio(&bloom) == 0);
+    check(am_bloom_false_positive_rate(&bloom) == 0);
+    check(!am_bloom_contains(&bloom, "a", 1));
+
+    /* Half the keys one at a time, as strings; half as a batch of hashes */
+    for (i = 0; i < NUM_KEYS / 2; i++) {
+        int len = snprintf(key, sizeof key, "key-%lu", i);
+        am_bloom_add(&bloom, key, (unsigned)len);
+    }
+    for (i = 0; i < NUM_KEYS / 2; i++) {
+        hashes[i] = am_hash_fmix64(i);
+    }
+    am_bloom_add_batch(&bloom, hashes, NUM_KEYS / 2);
+    check(bloom.count == NUM_KEYS);
+
+    /* No false negatives */
+    for (i = 0; i < NUM_KEYS / 2; i++) {
+        int len = snprintf(key, sizeof key, "key-%lu", i);
+        check(am_bloom_contains(&bloom, key, (unsigned)len));
+        check(reference_contains(&bloom, am_bloom_hash(key, (unsigned)len)));
+        check(am_bloom_contains_hash(&bloom, am_hash_fmix64(i)));
+    }
+    check(am_bloom_contains_batch(&bloom, hashes, NUM_KEYS / 2, results) == NUM_KEYS / 2);
+
+    /* Keys never added: the measured rate matches the estimate, and the
+     * filter agrees with the reference on every one */
+    for (i = 0; i < NUM_QUERIES; i++) {
+        hashes[i] = am_hash_fmix64(i + NUM_KEYS);
+    }
+    positives = am_bloom_contains_batch(&bloom, hashes, NUM_QUERIES, results);
+    for (i = 0; i < NUM_QUERIES; i++) {
+        check(results[i] == am_bloom_contains_hash(&bloom, hashes[i]));
+        check(results[i] == reference_contains(&bloom, hashes[i]));
+    }
+    fill = am_bloom_fill_ratio(&bloom);
+    fpr = am_bloom_false_positive_rate(&bloom);
+    measured = (double)positives / NUM_QUERIES;
+    printf("fill %.3f, estimated fpr %.4f, measured %.4f\n", fill, fpr, measured);
+    check(fill > 0.45 && fill < 0.65);
+    check(fpr > 0.002 && fpr < 0.02);
+    check(measured > fpr * 0.8 && measured < fpr * 1.2);
+
+    am_bloom_clear(&bloom);
+    check(bloom.count == 0);
+    check(am_bloom_contains_batch(&bloom, hashes, NUM_QUERIES, results) == 0);
+
+    am_bloom_destroy(&bloom);
+    check(alloc.in_use == 0);
+    return 0;
+}
@@ -0,0 +1,77 @@
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include "am/alloc.h"
+#include "am/data/dheap.h"
+#include "check.h"
+#include "alloc-helpers.h"
+
+#define NUM_ITEMS 100000
+
+struct event {
+    unsigned long when;
+    unsigned long id;
+};
+
+static bool event_less(struct event a, struct event b) { return a.when < b.when; }
+AM_DHEAP_DEFINE(eventq, struct event, event_less)
+
+static struct counting_alloc alloc;
+
+int main(void)
+{
+    static bool seen[NUM_ITEMS];
+    struct eventq q;
+    struct event e;
+    unsigned long seed = 1, last = 0, n = 0;
+    size_t i;
+
+    counting_alloc_init(&alloc);
+
+    eventq_init(&q, &alloc.alloc);
+    check(eventq_peek(&q) == NULL);
+    check(!eventq_pop(&q, &e));
+    check(alloc.in_use == 0);
+
+    for (i = 0; i < NUM_ITEMS; i++) {
+        seed = seed * 6364136223846793005ul + 1442695040888963407ul;
+        e.when = (seed >> 33) % 10000;
+        e.id = i;
+        check(eventq_push(&q, e));
+        check(eventq_peek(&q)->when <= e.when);
+    }
+    check(eventq_size(&q) == NUM_ITEMS);
+
+    /* Pop half, pushing back later times in between, as a scheduler would */
+    for (i = 0; i < NUM_ITEMS / 2; i++) {
+        check(eventq_pop(&q, &e));
+        check(e.when >= last);
+        last = e.when;
+        if (i % 4 == 0) {
+            e.when += 1 + i % 5000;
+            check(eventq_push(&q, e));
+        } else {
+            check(!seen[e.id]);
+            seen[e.id] = true;
+            n++;
+        }
+    }
+
+    last = 0;
+    while (eventq_pop(&q, &e)) {
+        check(e.when >= last);
+        check(!seen[e.id]);
+        seen[e.id] = true;
+        last = e.when;
+        n++;
+    }
+    check(n == NUM_ITEMS);
+    check(eventq_size(&q) == 0);
+
+    check(eventq_reserve(&q, 1000));
+    eventq_clear(&q);
+    eventq_destroy(&q);
+    check(alloc.in_use == 0);
+    return 0;
+}
@@ -0,0 +1,98 @@
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "am/alloc.h"
+#include "am/data/hash.h"
+#include "am/data/hashtable.h"
+#include "am/data/hashmap.h"
+
+/* Random lookups: AM_HASHMAP_DEFINE against am_hashtable chaining
+ * Usage: hashmap-bench [keys] [lookups]
+ */
+
+#define BUCKET_BITS 20
+
+static uint64_t u64_hash(uint64_t key) { return am_hash_fmix64(key); }
+static bool u64_eq(uint64_t a, uint64_t b) { return a == b; }
+AM_HASHMAP_DEFINE(u64map, uint64_t, uint64_t, u64_hash, u64_eq)
+
+struct entry {
+    uint64_t key;
+    uint64_t value;
+    struct am_hlist_node node;
+};
+
+static am_hashtable(BUCKET_BITS) table;
+
+static double elapsed(const struct timespec *start)
+{
+    struct timespec end;
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return (end.tv_sec - start->tv_sec) + (end.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+int main(int argc, char *argv[])
+{
+    size_t n_keys = argc > 1 ? strtoul(argv[1], NULL, 10) : 1000000;
+    size_t n_lookups = argc > 2 ? strtoul(argv[2], NULL, 10) : 10000000;
+    struct am_alloc alloc;
+    struct u64map map;
+    struct entry *entries;
+    struct timespec start;
+    uint64_t sum = 0, *keys;
+    size_t i;
+    double t;
+
+    am_alloc_init_default(&alloc);
+    keys = malloc(n_lookups * sizeof *keys);
+    entries = malloc(n_keys * sizeof *entries);
+    if (keys == NULL || entries == NULL) {
+        return 1;
+    }
+    for (i = 0; i < n_lookups; i++) {
+        keys[i] = am_hash_fmix64(i) % n_keys;
+    }
+
+    u64map_init(&map, &alloc);
+    am_hashtable_init(&table);
+    for (i = 0; i < n_keys; i++) {
+        if (!u64map_set(&map, i, i)) {
+            return 1;
+        }
+        entries[i].key = i;
+        entries[i].value = i;
+        am_hashtable_add(&table, u64_hash(i), &entries[i].node);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (i = 0; i < n_lookups; i++) {
+        sum += *u64map_get(&map, keys[i]);
+    }
+    t = elapsed(&start);
+    printf("am_hashmap:   %.1f ns/lookup, %.1f bytes/entry\n", t / n_lookups * 1e9,
+            (double)u64map__alloc_size(map.capacity) / n_keys);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (i = 0; i < n_lookups; i++) {
+        struct am_hlist_node *it;
+        am_hashtable_foreach_possible(&table, u64_hash(keys[i]), it) {
+            struct entry *e = AM_CONTAINER_OF(it, struct entry, node);
+            if (e->key == keys[i]) {
+                sum -= e->value;
+                break;
+            }
+        }
+    }
+    t = elapsed(&start);
+    /* Entries are normally allocated one by one, add malloc's 16-byte header */
+    printf("am_hashtable: %.1f ns/lookup, %.1f bytes/entry\n", t / n_lookups * 1e9,
+            (double)(sizeof table + n_keys * (sizeof(struct entry) + 16)) / n_keys);
+
+    u64map_destroy(&map);
+    free(entries);
+    free(keys);
+    return sum != 0;
+}
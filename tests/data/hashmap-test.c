@@ -0,0 +1,145 @@
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "am/alloc.h"
+#include "am/data/hash.h"
+#include "am/data/hashmap.h"
+#include "check.h"
+#include "alloc-helpers.h"
+
+#define NUM_KEYS 5000
+#define NUM_OPS  200000
+
+static uint64_t u64_hash(uint64_t key) { return am_hash_fmix64(key); }
+static bool u64_eq(uint64_t a, uint64_t b) { return a == b; }
+AM_HASHMAP_DEFINE(u64map, uint64_t, uint64_t, u64_hash, u64_eq)
+
+static uint64_t str_hash(const char *key) { return am_hash_fmix64(am_hash_fnva1_32(key, strlen(key))); }
+static bool str_eq(const char *a, const char *b) { return strcmp(a, b) == 0; }
+AM_HASHMAP_DEFINE(strmap, const char *, int, str_hash, str_eq)
+
+static struct counting_alloc alloc;
+
+/* Random operations, checked against a plain array */
+static void test_random(void)
+{
+    static bool present[NUM_KEYS];
+    static uint64_t expected[NUM_KEYS];
+    struct u64map map;
+    uint64_t *key, *value, removed;
+    size_t it = 0, count = 0, size = 0;
+    unsigned seed = 1;
+    int i;
+
+    u64map_init(&map, &alloc.alloc);
+    check(u64map_get(&map, 42) == NULL);
+    check(!u64map_remove(&map, 42, NULL));
+
+    for (i = 0; i < NUM_OPS; i++) {
+        uint64_t k = (uint64_t)rand_r(&seed) % NUM_KEYS;
+
+        switch (rand_r(&seed) % 3) {
+        case 0:
+            check(u64map_set(&map, k, (uint64_t)i));
+            size += !present[k];
+            present[k] = true;
+            expected[k] = (uint64_t)i;
+            break;
+        case 1:
+            check(u64map_remove(&map, k, &removed) == present[k]);
+            if (present[k]) {
+                check(removed == expected[k]);
+                size--;
+            }
+            present[k] = false;
+            break;
+        default:
+            value = u64map_get(&map, k);
+            check((value != NULL) == present[k]);
+            check(value == NULL || *value == expected[k]);
+            break;
+        }
+        check(u64map_size(&map) == size);
+    }
+
+    while (u64map_next(&map, &it, &key, &value)) {
+        check(present[*key]);
+        check(*value == expected[*key]);
+        count++;
+    }
+    check(count == size);
+
+    u64map_clear(&map);
+    check(u64map_size(&map) == 0);
+    for (i = 0; i < NUM_KEYS; i++) {
+        check(u64map_get(&map, (uint64_t)i) == NULL);
+    }
+    u64map_destroy(&map);
+    check(alloc.in_use == 0);
+}
+
+/* Tombstones are reused, so churn over a fixed key set doesn't grow the map */
+static void test_churn(void)
+{
+    struct u64map map;
+    size_t capacity;
+    uint64_t i;
+
+    u64map_init(&map, &alloc.alloc);
+    check(u64map_reserve(&map, 1000));
+    capacity = map.capacity;
+    check(capacity >= 1000);
+
+    for (i = 0; i < 100000; i++) {
+        check(u64map_set(&map, i, i));
+        if (i >= 500) {
+            check(u64map_remove(&map, i - 500, NULL));
+        }
+    }
+    check(u64map_size(&map) == 500);
+    check(map.capacity == capacity);
+    for (i = 100000 - 500; i < 100000; i++) {
+        check(*u64map_get(&map, i) == i);
+    }
+    u64map_destroy(&map);
+    check(alloc.in_use == 0);
+}
+
+static void test_strings(void)
+{
+    static const char *names[] = { "alpha", "beta", "gamma", "delta", "epsilon" };
+    struct strmap map;
+    char buf[16];
+    unsigned i;
+
+    strmap_init(&map, &alloc.alloc);
+    for (i = 0; i < AM_ARRAY_SIZE(names); i++) {
+        check(strmap_set(&map, names[i], (int)i));
+    }
+    /* Keys compare by content, not address */
+    strcpy(buf, "gamma");
+    check(*strmap_get(&map, buf) == 2);
+    check(strmap_set(&map, buf, 20));
+    check(*strmap_get(&map, "gamma") == 20);
+    check(strmap_size(&map) == AM_ARRAY_SIZE(names));
+    check(strmap_get(&map, "zeta") == NULL);
+    strmap_destroy(&map);
+    check(alloc.in_use == 0);
+}
+
+int main(void)
+{
+#ifdef AM_HASHMAP_SSE2
+    printf("Matching groups with SSE2\n");
+#else
+    printf("Matching groups with 64-bit words\n");
+#endif
+    counting_alloc_init(&alloc);
+
+    test_random();
+    test_churn();
+    test_strings();
+    return 0;
+}
@@ -15,6 +15,44 @@ struct person {
     struct am_hlist_node h;
 };
 
+static bool person_match(const struct am_hlist_node *node, unsigned long key, void *ud)
+{
+    const struct person *p = AM_CONTAINER_OF(node, struct person, h);
+    (void)key;
+    return strcmp(p->name, ud) == 0;
+}
+
+static bool id_match(const struct am_hlist_node *node, unsigned long key, void *ud)
+{
+    const struct person *p = AM_CONTAINER_OF(node, struct person, h);
+    (void)ud;
+    return (unsigned long)p->id == key;
+}
+
+struct tagged {
+    int id;
+    struct am_hashtable_node h;
+};
+
+static int compared;
+
+static bool tagged_match(const struct am_hlist_node *node, unsigned long hash, void *ud)
+{
+    const struct tagged *t = AM_CONTAINER_OF(node, struct tagged, h.node);
+    (void)hash;
+    compared++;
+    return t->id == *(int *)ud;
+}
+
+/* Counts its calls, to check that the lookup macros evaluate their key once */
+static int hashes_computed;
+
+static unsigned long counted_hash(uint64_t x)
+{
+    hashes_computed++;
+    return am_hash_fmix64(x);
+}
+
 int main(void)
 {
     int i;
@@ -34,6 +72,131 @@ int main(void)
         am_hashtable_add(&ht, hash, &p->h);
     }
 
+    {
+        const char *name = "Person 42";
+        unsigned long key = am_hash_fnva1_32(name, strlen(name));
+        struct am_hlist_node *out;
+        size_t n = am_hashtable_get_batch(&ht, &key, &out, 1, person_match, (void *)name);
+
+        assert(n == 1);
+        assert(AM_CONTAINER_OF(out, struct person, h)->id == 42);
+    }
+
+    /* Even ids were added, the rest are missing */
+    {
+        am_hashtable(6) ids;
+        struct person people[100];
+        unsigned long keys[250];
+        struct am_hlist_node *out[250];
+        size_t n;
+
+        am_hashtable_init(&ids);
+        for (i = 0; i < 100; i++) {
+            people[i].id = 2 * i;
+            am_hlist_node_init(&people[i].h);
+            am_hashtable_add(&ids, (unsigned long)people[i].id, &people[i].h);
+        }
+        for (i = 0; i < 250; i++)
+            keys[i] = (unsigned long)i;
+
+        n = am_hashtable_get_batch(&ids, keys, out, 250, id_match, NULL);
+        assert(n == 100);
+        for (i = 0; i < 250; i++) {
+            if (i % 2 == 0 && i < 200)
+                assert(out[i] == &people[i / 2].h);
+            else
+                assert(out[i] == NULL);
+        }
+    }
+
+    /* Single-key lookup, and walking a key's bucket by hand */
+    {
+        const char *name = "Person 137";
+        unsigned long key = am_hash_fnva1_32(name, strlen(name));
+        struct am_hlist_node *it, *found = NULL;
+
+        it = am_hashtable_lookup(&ht, key, person_match, (void *)name);
+        assert(it != NULL && AM_CONTAINER_OF(it, struct person, h)->id == 137);
+        am_hashtable_foreach_possible(&ht, key, it) {
+            if (person_match(it, key, (void *)name))
+                found = it;
+        }
+        assert(found == am_hashtable_lookup(&ht, key, person_match, (void *)name));
+        assert(am_hashtable_lookup(&ht, key, person_match, "Person 200") == NULL);
+    }
+
+    /* Cached hashes: the key comparison only runs when the full hash matches */
+    {
+        am_hashtable(2) small;
+        struct tagged tags[64];
+        struct am_hashtable_node *it;
+        int id, n = 0;
+
+        am_hashtable_init(&small);
+        for (i = 0; i < 64; i++) {
+            tags[i].id = i;
+            am_hashtable_add_hashed(&small, am_hash_fmix64((uint64_t)i), &tags[i].h);
+        }
+        for (id = 0; id < 64; id++) {
+            struct am_hashtable_node *found;
+            unsigned long hash = am_hash_fmix64((uint64_t)id);
+
+            compared = 0;
+            found = am_hashtable_lookup_hashed(&small, hash, tagged_match, &id);
+            assert(found == &tags[id].h);
+            assert(compared == 1);
+        }
+        am_hashtable_foreach_possible_hashed(&small, counted_hash(7), it)
+            n++;
+        assert(n == 1);
+        assert(hashes_computed == 1);
+        id = 7;
+        assert(am_hashtable_lookup_hashed(&small, counted_hash(7), tagged_match, &id) == &tags[7].h);
+        assert(hashes_computed == 2);
+        id = 64;
+        assert(am_hashtable_lookup_hashed(&small, am_hash_fmix64(64), tagged_match, &id) == NULL);
+    }
+
+    /* Iterating a sparse table visits the few occupied buckets only */
+    {
+        static am_hashtable(16) sparse;
+        struct person people[3];
+        struct am_hlist_node *it;
+        size_t bkt;
+        int seen = 0;
+
+        am_hashtable_init(&sparse);
+        assert(am_hashtable_is_empty(&sparse));
+        for (i = 0; i < 3; i++) {
+            people[i].id = i;
+            am_hashtable_add(&sparse, (unsigned long)i * 1000003, &people[i].h);
+        }
+        assert(!am_hashtable_is_empty(&sparse));
+        am_hashtable_foreach(&sparse, bkt, it) {
+            assert(it == am_hashtable_bucket(&sparse, (unsigned long)AM_CONTAINER_OF(it, struct person, h)->id * 1000003)->first);
+            seen++;
+        }
+        assert(seen == 3);
+
+        /* Removed buckets are dropped from the bitmap on the next scan */
+        am_hashtable_del(&people[1].h);
+        seen = 0;
+        am_hashtable_foreach(&sparse, bkt, it)
+            seen++;
+        assert(seen == 2);
+        am_hashtable_del(&people[0].h);
+        am_hashtable_del(&people[2].h);
+
+        /* Asking leaves the stale bits alone */
+        {
+            unsigned long occupied[AM_ARRAY_SIZE(sparse._occupied)];
+
+            memcpy(occupied, sparse._occupied, sizeof occupied);
+            assert(am_hashtable_is_empty(&sparse));
+            assert(memcmp(occupied, sparse._occupied, sizeof occupied) == 0);
+        }
+    }
+
     {
         size_t bkt;
         struct am_hlist_node *it, *tmp;
@@ -47,6 +210,7 @@ int main(void)
             am_hashtable_del(&p->h);
             free(p);
         }
+        assert(am_hashtable_is_empty(&ht));
     }
 
     return 0;
@@ -0,0 +1,110 @@
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "am/alloc.h"
+#include "am/data/pairing_heap.h"
+#include "am/data/dheap.h"
+
+/* Hold model: fill a queue, then repeatedly pop the minimum and push it back
+ * a random delay later, as an event scheduler does. am_pairing_heap against
+ * an AM_DHEAP_DEFINE 4-ary heap
+ * Usage: heap-bench [operations]
+ */
+
+struct node {
+    unsigned long key;
+    struct am_pairing_heap_node hnode;
+};
+
+static bool node_less(const struct am_pairing_heap_node *a, const struct am_pairing_heap_node *b)
+{
+    return AM_CONTAINER_OF(a, struct node, hnode)->key < AM_CONTAINER_OF(b, struct node, hnode)->key;
+}
+
+static bool key_less(unsigned long a, unsigned long b) { return a < b; }
+AM_DHEAP_DEFINE(keyheap, unsigned long, key_less)
+
+static unsigned long rng = 88172645463325252ul;
+
+static unsigned long next_rand(void)
+{
+    rng ^= rng << 13;
+    rng ^= rng >> 7;
+    rng ^= rng << 17;
+    return rng;
+}
+
+static double elapsed(const struct timespec *start)
+{
+    struct timespec end;
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return (end.tv_sec - start->tv_sec) + (end.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+int main(int argc, char *argv[])
+{
+    static const size_t sizes[] = { 100, 10000, 1000000 };
+    size_t n_ops = argc > 1 ? strtoul(argv[1], NULL, 10) : 5000000;
+    unsigned long sum = 0;
+    struct am_alloc alloc;
+    size_t s, i;
+
+    am_alloc_init_default(&alloc);
+    printf("%10s %16s %16s\n", "size", "pairing ns/op", "4-ary ns/op");
+    for (s = 0; s < AM_ARRAY_SIZE(sizes); s++) {
+        size_t n = sizes[s];
+        struct node *nodes = malloc(n * sizeof *nodes);
+        struct am_pairing_heap pheap;
+        struct keyheap dheap;
+        struct timespec start;
+        double tp, td;
+
+        if (nodes == NULL) {
+            return 1;
+        }
+
+        rng = 88172645463325252ul;
+        am_pairing_heap_init(&pheap);
+        for (i = 0; i < n; i++) {
+            nodes[i].key = next_rand() % (n * 16);
+            am_pairing_heap_insert(&pheap, &nodes[i].hnode, node_less);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (i = 0; i < n_ops; i++) {
+            struct node *min = AM_CONTAINER_OF(am_pairing_heap_pop(&pheap, node_less), struct node, hnode);
+            sum += min->key;
+            min->key += 1 + next_rand() % (n * 16);
+            am_pairing_heap_insert(&pheap, &min->hnode, node_less);
+        }
+        tp = elapsed(&start);
+
+        rng = 88172645463325252ul;
+        keyheap_init(&dheap, &alloc);
+        for (i = 0; i < n; i++) {
+            if (!keyheap_push(&dheap, next_rand() % (n * 16))) {
+                return 1;
+            }
+        }
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (i = 0; i < n_ops; i++) {
+            unsigned long key;
+            if (!keyheap_pop(&dheap, &key)) {
+                return 1;
+            }
+            sum -= key;
+            if (!keyheap_push(&dheap, key + 1 + next_rand() % (n * 16))) {
+                return 1;
+            }
+        }
+        td = elapsed(&start);
+
+        printf("%10zu %16.1f %16.1f\n", n, tp / n_ops * 1e9, td / n_ops * 1e9);
+        keyheap_destroy(&dheap);
+        free(nodes);
+    }
+    /* Both heaps saw the same keys */
+    return sum != 0;
+}
@@ -37,5 +37,27 @@ int main(void)
         free(p);
     }
 
+    /* RCU variants keep the same shape, and a removed node still leads on */
+    {
+        struct person people[4];
+        int order[3] = { 2, 0, 3 }, n = 0;
+
+        am_hlist_head_init(&head);
+        for (i = 0; i < 4; i++)
+            people[i].id = i;
+        am_hlist_add_head_rcu(&people[0].l, &head);
+        am_hlist_add_before_rcu(&people[1].l, &people[0].l);
+        am_hlist_add_behind_rcu(&people[3].l, &people[0].l);
+        am_hlist_add_head_rcu(&people[2].l, &head);
+        am_hlist_del_rcu(&people[1].l);
+        assert(people[1].l.next == &people[0].l);
+
+        am_hlist_foreach_rcu(it, &head) {
+            assert(AM_CONTAINER_OF(it, struct person, l)->id == order[n]);
+            n++;
+        }
+        assert(n == 3);
+    }
+
     return 0;
 }
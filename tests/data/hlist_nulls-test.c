@@ -0,0 +1,155 @@
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include "am/atomic.h"
+#include "am/threads.h"
+#include "am/data/hlist_nulls.h"
+#include "check.h"
+
+#define NUM_BUCKETS 8
+#define NUM_STABLE  16
+#define NUM_MOVING  16
+#define NUM_READERS 2
+#define NUM_MOVES   200000
+
+struct item {
+    volatile uintptr_t key;
+    struct am_hlist_nulls_node node;
+};
+
+static struct am_hlist_nulls_head buckets[NUM_BUCKETS];
+static struct item stable[NUM_STABLE];
+static struct item moving[NUM_MOVING];
+static am_atomic_int done;
+static am_atomic_uint restarts;
+
+static void test_basic(void)
+{
+    struct am_hlist_nulls_head head = AM_HLIST_NULLS_HEAD_INITIALIZER(5);
+    struct am_hlist_nulls_node *it, *tmp;
+    struct item items[10];
+    int i, n = 0;
+
+    check(am_hlist_nulls_is_empty(&head));
+    check(am_hlist_nulls_value(head.first) == 5);
+    for (i = 0; i < 10; i++) {
+        items[i].key = (uintptr_t)i;
+        am_hlist_nulls_add_head(&items[i].node, &head);
+    }
+    check(!am_hlist_nulls_is_empty(&head));
+
+    am_hlist_nulls_foreach(it, &head) {
+        check(AM_CONTAINER_OF(it, struct item, node)->key == (uintptr_t)(9 - n));
+        n++;
+    }
+    check(n == 10);
+    check(am_hlist_nulls_is_marker(it) && am_hlist_nulls_value(it) == 5);
+
+    am_hlist_nulls_del(&items[0].node);
+    am_hlist_nulls_del(&items[9].node);
+    am_hlist_nulls_del_rcu(&items[4].node);
+    check(am_hlist_nulls_is_unhashed(&items[4].node));
+    n = 0;
+    am_hlist_nulls_foreach_rcu(it, &head)
+        n++;
+    check(n == 7);
+    check(am_hlist_nulls_value(it) == 5);
+
+    am_hlist_nulls_foreach_safe(it, tmp, &head)
+        am_hlist_nulls_del(it);
+    check(am_hlist_nulls_is_empty(&head));
+}
+
+static unsigned long bucket_of(uintptr_t key)
+{
+    return (unsigned long)(key % NUM_BUCKETS);
+}
+
+static struct item *lookup(uintptr_t key)
+{
+    unsigned long slot = bucket_of(key);
+    struct am_hlist_nulls_node *it;
+
+again:
+    am_hlist_nulls_foreach_rcu(it, &buckets[slot]) {
+        struct item *item = AM_CONTAINER_OF(it, struct item, node);
+        if (am_atomic_load_uintptr_explicit(&item->key, AM_MEMORY_ORDER_RELAXED) == key)
+            return item;
+    }
+    if (am_hlist_nulls_value(it) != slot) {
+        /* Walked through a node which moved to another chain */
+        am_atomic_fetch_add_uint_explicit(&restarts, 1, AM_MEMORY_ORDER_RELAXED);
+        goto again;
+    }
+    return NULL;
+}
+
+/* Stable keys are always found, even though moving nodes drag readers
+ * standing on them over to other chains */
+static int reader(void *ud)
+{
+    unsigned i = 0;
+    (void)ud;
+
+    while (!am_atomic_load_int(&done)) {
+        uintptr_t key = i++ % NUM_STABLE;
+        check(lookup(key) == &stable[key]);
+    }
+    return 0;
+}
+
+static void test_reuse(void)
+{
+    am_thread threads[NUM_READERS];
+    uint64_t rng = 1;
+    unsigned long i;
+
+    am_atomic_init_int(&done, 0);
+    am_atomic_init_uint(&restarts, 0);
+    for (i = 0; i < NUM_BUCKETS; i++)
+        am_hlist_nulls_head_init(&buckets[i], i);
+    for (i = 0; i < NUM_STABLE; i++) {
+        stable[i].key = i;
+        am_hlist_nulls_add_head_rcu(&stable[i].node, &buckets[bucket_of(i)]);
+    }
+    for (i = 0; i < NUM_MOVING; i++) {
+        moving[i].key = NUM_STABLE + i;
+        am_hlist_nulls_add_head_rcu(&moving[i].node, &buckets[bucket_of(moving[i].key)]);
+    }
+
+    for (i = 0; i < NUM_READERS; i++)
+        check(am_thread_create(&threads[i], reader, NULL) == AM_THREAD_SUCCESS);
+
+    /* Nodes are reused at once, without waiting for readers */
+    for (i = 0; i < NUM_MOVES; i++) {
+        struct item *item;
+        uintptr_t key;
+
+        rng ^= rng << 13;
+        rng ^= rng >> 7;
+        rng ^= rng << 17;
+        item = &moving[rng % NUM_MOVING];
+        key = NUM_STABLE + (uintptr_t)(rng >> 32) % 1000;
+        am_hlist_nulls_del_rcu(&item->node);
+        am_atomic_store_uintptr_explicit(&item->key, key, AM_MEMORY_ORDER_RELAXED);
+        am_hlist_nulls_add_head_rcu(&item->node, &buckets[bucket_of(key)]);
+        if (i % 1024 == 0)
+            am_thread_yield();
+    }
+
+    am_atomic_store_int(&done, 1);
+    for (i = 0; i < NUM_READERS; i++)
+        check(am_thread_join(threads[i], NULL) == AM_THREAD_SUCCESS);
+    printf("%u restarts\n", am_atomic_load_uint(&restarts));
+
+    for (i = 0; i < NUM_STABLE; i++)
+        check(lookup(i) == &stable[i]);
+}
+
+int main(void)
+{
+    test_basic();
+    test_reuse();
+    return 0;
+}
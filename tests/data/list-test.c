@@ -11,6 +11,125 @@ struct person {
     char name[30];
 };
 
+struct item {
+    unsigned key;
+    unsigned seq; /* Insertion order, to check stability */
+    struct am_list l;
+};
+
+static int item_cmp(const struct am_list *a, const struct am_list *b, void *priv)
+{
+    const struct item *x = AM_CONTAINER_OF(a, struct item, l);
+    const struct item *y = AM_CONTAINER_OF(b, struct item, l);
+    unsigned *compares = priv;
+
+    (*compares)++;
+    return (x->key > y->key) - (x->key < y->key);
+}
+
+/* Sorted by key, equal keys in insertion order, and prev links intact */
+static void check_sorted(struct am_list *head, size_t n)
+{
+    struct am_list *it, *prev = head;
+    const struct item *last = NULL;
+    size_t count = 0;
+
+    am_list_foreach(it, head) {
+        const struct item *x = AM_CONTAINER_OF(it, struct item, l);
+        assert(it->prev == prev);
+        if (last != NULL)
+            assert(last->key < x->key || (last->key == x->key && last->seq < x->seq));
+        last = x;
+        prev = it;
+        count++;
+    }
+    assert(head->prev == prev);
+    assert(count == n);
+}
+
+static void test_sort(void)
+{
+    static struct item items[100000];
+    static const size_t sizes[] = { 0, 1, 2, 3, 7, 64, 100, 1000, 100000 };
+    unsigned seed = 1;
+    size_t s, i;
+
+    for (s = 0; s < AM_ARRAY_SIZE(sizes); s++) {
+        size_t n = sizes[s];
+        int order;
+
+        /* Random keys with many duplicates, then ascending, then descending */
+        for (order = 0; order < 3; order++) {
+            struct am_list head;
+            unsigned compares = 0;
+            size_t log2n = 0;
+
+            am_list_head_init(&head);
+            for (i = 0; i < n; i++) {
+                seed = seed * 1103515245 + 12345;
+                items[i].key = order == 0 ? (seed >> 16) % (n / 4 + 1)
+                             : order == 1 ? (unsigned)i
+                             : (unsigned)(n - i);
+                items[i].seq = (unsigned)i;
+                am_list_add_tail(&items[i].l, &head);
+            }
+            am_list_sort(&head, item_cmp, &compares);
+            check_sorted(&head, n);
+            while ((size_t)1 << log2n < n)
+                log2n++;
+            assert(compares <= n * log2n);
+        }
+    }
+}
+
+static void test_merge_splice(void)
+{
+    struct item items[40];
+    struct am_list a, b, c;
+    unsigned compares = 0;
+    int i;
+
+    am_list_head_init(&a);
+    am_list_head_init(&b);
+    am_list_head_init(&c);
+    /* Even keys in a, multiples of 3 in b: 0, 6, 12... appear in both */
+    for (i = 0; i < 20; i++) {
+        items[i].key = 2 * (unsigned)i;
+        items[i].seq = (unsigned)i;
+        am_list_add_tail(&items[i].l, &a);
+        items[20 + i].key = 3 * (unsigned)i;
+        items[20 + i].seq = 20 + (unsigned)i;
+        am_list_add_tail(&items[20 + i].l, &b);
+    }
+    am_list_merge(&a, &b, item_cmp, &compares);
+    assert(am_list_is_empty(&b));
+    check_sorted(&a, 40);
+
+    /* Split in two and splice back, in order then rotated */
+    for (i = 0; i < 20; i++)
+        am_list_move(a.prev, &c);
+    am_list_splice_tail(&c, &a);
+    assert(am_list_is_empty(&c));
+    check_sorted(&a, 40);
+    for (i = 0; i < 20; i++)
+        am_list_move_tail(a.next, &c);
+    am_list_splice(&c, &a);
+    assert(am_list_is_empty(&c));
+    check_sorted(&a, 40);
+
+    /* Rotate, then sorting again restores the order */
+    for (i = 0; i < 13; i++)
+        am_list_move_tail(a.next, &a);
+    {
+        struct am_list *it;
+        unsigned seq = 0;
+        am_list_foreach(it, &a)
+            AM_CONTAINER_OF(it, struct item, l)->seq = seq++;
+    }
+    am_list_sort(&a, item_cmp, &compares);
+    check_sorted(&a, 40);
+}
+
 int main(void)
 {
     int i;
@@ -37,5 +156,7 @@ int main(void)
         free(p);
     }
 
+    test_sort();
+    test_merge_splice();
     return 0;
 }
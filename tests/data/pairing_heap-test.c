@@ -0,0 +1,148 @@
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include "am/macros.h"
+#include "am/data/pairing_heap.h"
+#include "check.h"
+
+#define NUM_ITEMS 2000
+#define NUM_OPS   200000
+
+struct task {
+    long priority;
+    int heap;     /* Which heap the task is in, or -1 */
+    struct am_pairing_heap_node node;
+};
+
+static struct task tasks[NUM_ITEMS];
+static struct am_pairing_heap heaps[2];
+
+static bool task_less(const struct am_pairing_heap_node *a, const struct am_pairing_heap_node *b)
+{
+    return AM_CONTAINER_OF(a, struct task, node)->priority < AM_CONTAINER_OF(b, struct task, node)->priority;
+}
+
+/* Reference: smallest priority among tasks in heap 'h' */
+static long ref_min(int h)
+{
+    long min = -1;
+    int i;
+
+    for (i = 0; i < NUM_ITEMS; i++) {
+        if (tasks[i].heap == h && (min < 0 || tasks[i].priority < min))
+            min = tasks[i].priority;
+    }
+    return min;
+}
+
+static void check_min(int h)
+{
+    struct am_pairing_heap_node *min = am_pairing_heap_min(&heaps[h]);
+    long expected = ref_min(h);
+
+    if (expected < 0) {
+        check(min == NULL);
+    } else {
+        check(min != NULL);
+        check(AM_CONTAINER_OF(min, struct task, node)->priority == expected);
+    }
+}
+
+int main(void)
+{
+    unsigned seed = 7;
+    long counts[2] = { 0, 0 };
+    int op, i;
+
+    am_pairing_heap_init(&heaps[0]);
+    am_pairing_heap_init(&heaps[1]);
+    check(am_pairing_heap_pop(&heaps[0], task_less) == NULL);
+    for (i = 0; i < NUM_ITEMS; i++)
+        tasks[i].heap = -1;
+
+    for (op = 0; op < NUM_OPS; op++) {
+        struct task *t;
+        int h;
+
+        seed = seed * 1103515245 + 12345;
+        t = &tasks[(seed >> 8) % NUM_ITEMS];
+        h = (int)((seed >> 4) & 1);
+        seed = seed * 1103515245 + 12345;
+
+        switch ((seed >> 16) % 8) {
+        case 0:
+        case 1:
+        case 2:
+            if (t->heap < 0) {
+                t->priority = (long)((seed >> 3) % 100000);
+                t->heap = h;
+                am_pairing_heap_insert(&heaps[h], &t->node, task_less);
+                counts[h]++;
+            }
+            break;
+        case 3:
+        case 4:
+            if (t->heap >= 0) {
+                t->priority -= (long)((seed >> 3) % 1000);
+                if (t->priority < 0)
+                    t->priority = 0;
+                am_pairing_heap_decrease(&heaps[t->heap], &t->node, task_less);
+            }
+            break;
+        case 5:
+            if (t->heap >= 0) {
+                am_pairing_heap_remove(&heaps[t->heap], &t->node, task_less);
+                counts[t->heap]--;
+                t->heap = -1;
+            }
+            break;
+        case 6: {
+            struct am_pairing_heap_node *min = am_pairing_heap_min(&heaps[h]);
+            struct am_pairing_heap_node *popped = am_pairing_heap_pop(&heaps[h], task_less);
+
+            check(popped == min);
+            if (popped != NULL) {
+                struct task *p = AM_CONTAINER_OF(popped, struct task, node);
+                check(p->priority <= ref_min(h) || ref_min(h) < 0);
+                p->heap = -1;
+                counts[h]--;
+            }
+            break;
+        }
+        case 7:
+            /* Occasionally move everything into the other heap */
+            if ((seed >> 20) % 64 == 0) {
+                am_pairing_heap_meld(&heaps[h], &heaps[1 - h], task_less);
+                check(am_pairing_heap_is_empty(&heaps[1 - h]));
+                for (i = 0; i < NUM_ITEMS; i++) {
+                    if (tasks[i].heap == 1 - h)
+                        tasks[i].heap = h;
+                }
+                counts[h] += counts[1 - h];
+                counts[1 - h] = 0;
+            }
+            break;
+        }
+        if (op % 64 == 0) {
+            check_min(0);
+            check_min(1);
+        }
+    }
+
+    /* Drain in order */
+    for (i = 0; i < 2; i++) {
+        struct am_pairing_heap_node *it;
+        long last = -1, n = 0;
+
+        while ((it = am_pairing_heap_pop(&heaps[i], task_less)) != NULL) {
+            struct task *t = AM_CONTAINER_OF(it, struct task, node);
+            check(t->heap == i && t->priority >= last);
+            last = t->priority;
+            t->heap = -1;
+            n++;
+        }
+        check(n == counts[i]);
+    }
+    return 0;
+}
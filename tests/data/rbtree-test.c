@@ -0,0 +1,190 @@
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include "am/macros.h"
+#include "am/data/rbtree.h"
+#include "check.h"
+
+#define NUM_ITEMS 20000
+#define KEY_RANGE 5000 /* Plenty of duplicates */
+
+struct item {
+    int key;
+    int seq;
+    bool present;
+    struct am_rbtree_node node;
+};
+
+static struct item items[NUM_ITEMS];
+
+static int key_of(const struct am_rbtree_node *node)
+{
+    return AM_CONTAINER_OF(node, struct item, node)->key;
+}
+
+static bool item_less(const struct am_rbtree_node *a, const struct am_rbtree_node *b)
+{
+    return key_of(a) < key_of(b);
+}
+
+static int item_cmp(const void *key, const struct am_rbtree_node *node)
+{
+    int k = *(const int *)key;
+    return (k > key_of(node)) - (k < key_of(node));
+}
+
+static bool is_red(const struct am_rbtree_node *node)
+{
+    return node != NULL && (node->parent_color & 1) == AM_RBTREE_RED;
+}
+
+/* Returns the black height, checking links and colours below 'node' */
+static int check_subtree(const struct am_rbtree_node *node, const struct am_rbtree_node *parent, size_t *count)
+{
+    int left, right;
+
+    if (node == NULL)
+        return 1;
+    check(am_rbtree_parent(node) == parent);
+    check(!(is_red(node) && is_red(parent)));
+    if (node->left != NULL)
+        check(key_of(node->left) <= key_of(node));
+    if (node->right != NULL)
+        check(key_of(node->right) >= key_of(node));
+    left = check_subtree(node->left, node, count);
+    right = check_subtree(node->right, node, count);
+    check(left == right);
+    (*count)++;
+    return left + !is_red(node);
+}
+
+static void check_tree(const struct am_rbtree *tree, size_t expected)
+{
+    const struct am_rbtree_node *it, *prev = NULL;
+    size_t count = 0, walked = 0;
+
+    check(!is_red(tree->root));
+    check_subtree(tree->root, NULL, &count);
+    check(count == expected);
+
+    /* In order, equal keys in insertion order, ending on the last node */
+    am_rbtree_foreach(it, tree) {
+        const struct item *x = AM_CONTAINER_OF(it, struct item, node);
+        if (prev != NULL) {
+            const struct item *p = AM_CONTAINER_OF(prev, struct item, node);
+            check(p->key < x->key || (p->key == x->key && p->seq < x->seq));
+            check(am_rbtree_prev(it) == prev);
+        } else {
+            check(it == tree->leftmost);
+        }
+        prev = it;
+        walked++;
+    }
+    check(walked == expected);
+    check(prev == am_rbtree_last(tree));
+    check((tree->leftmost == NULL) == (expected == 0));
+}
+
+static void check_bounds(const struct am_rbtree *tree)
+{
+    int key;
+
+    for (key = -1; key <= KEY_RANGE; key += 7) {
+        const struct item *lo = NULL, *hi = NULL;
+        struct am_rbtree_node *lower, *upper, *found;
+        int i;
+
+        /* The first present item, in tree order, with key >= / > 'key' */
+        for (i = 0; i < NUM_ITEMS; i++) {
+            const struct item *x = &items[i];
+            if (!x->present)
+                continue;
+            if (x->key >= key && (lo == NULL || x->key < lo->key || (x->key == lo->key && x->seq < lo->seq)))
+                lo = x;
+            if (x->key > key && (hi == NULL || x->key < hi->key || (x->key == hi->key && x->seq < hi->seq)))
+                hi = x;
+        }
+        lower = am_rbtree_lower_bound(tree, &key, item_cmp);
+        upper = am_rbtree_upper_bound(tree, &key, item_cmp);
+        found = am_rbtree_find(tree, &key, item_cmp);
+        check(lower == (lo != NULL ? &lo->node : NULL));
+        check(upper == (hi != NULL ? &hi->node : NULL));
+        check(found == (lo != NULL && lo->key == key ? &lo->node : NULL));
+    }
+}
+
+int main(void)
+{
+    struct am_rbtree tree = AM_RBTREE_INITIALIZER;
+    struct am_rbtree_node *it, *tmp;
+    unsigned seed = 1;
+    size_t n = 0;
+    int i, last;
+
+    check(am_rbtree_is_empty(&tree));
+    check(am_rbtree_pop_first(&tree) == NULL);
+    for (i = 0; i < NUM_ITEMS; i++) {
+        seed = seed * 1103515245 + 12345;
+        items[i].key = (int)((seed >> 16) % KEY_RANGE);
+        items[i].seq = i;
+        items[i].present = true;
+        am_rbtree_insert(&tree, &items[i].node, item_less);
+        n++;
+        if (i % 1000 == 0)
+            check_tree(&tree, n);
+    }
+    check_tree(&tree, n);
+    check_bounds(&tree);
+
+    /* Erase about half, at random, including the leftmost node at times */
+    for (i = 0; i < NUM_ITEMS; i++) {
+        seed = seed * 1103515245 + 12345;
+        if ((seed >> 16) % 2 == 0 || i % 97 == 0) {
+            struct am_rbtree_node *victim = i % 97 == 0 ? am_rbtree_first(&tree) : &items[i].node;
+            struct item *x = AM_CONTAINER_OF(victim, struct item, node);
+            if (!x->present)
+                continue;
+            am_rbtree_erase(&tree, victim);
+            x->present = false;
+            n--;
+            if (i % 1000 == 0)
+                check_tree(&tree, n);
+        }
+    }
+    check_tree(&tree, n);
+    check_bounds(&tree);
+
+    /* From lower_bound on */
+    {
+        int key = KEY_RANGE / 2;
+        am_rbtree_foreach_from(it, am_rbtree_lower_bound(&tree, &key, item_cmp))
+            check(key_of(it) >= key);
+    }
+
+    /* Reverse iteration */
+    last = KEY_RANGE;
+    am_rbtree_foreach_reverse(it, &tree) {
+        check(key_of(it) <= last);
+        last = key_of(it);
+    }
+
+    /* Erase the odd keys while iterating, then drain in order */
+    am_rbtree_foreach_safe(it, tmp, &tree) {
+        if (key_of(it) % 2 != 0) {
+            am_rbtree_erase(&tree, it);
+            n--;
+        }
+    }
+    check_tree(&tree, n);
+    last = -1;
+    while ((it = am_rbtree_pop_first(&tree)) != NULL) {
+        check(key_of(it) % 2 == 0 && key_of(it) >= last);
+        last = key_of(it);
+        n--;
+    }
+    check(n == 0);
+    check(am_rbtree_is_empty(&tree));
+    check(am_rbtree_first(&tree) == NULL);
+    return 0;
+}
@@ -0,0 +1,146 @@
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include "am/alloc.h"
+#include "am/data/hash.h"
+#include "am/data/rhashtable.h"
+#include "check.h"
+#include "alloc-helpers.h"
+
+#define NUM_ITEMS 100000
+/* Just past a resize from 512 to 1024 buckets */
+#define NUM_ITER  520
+
+struct item {
+    unsigned long key;
+    struct am_rhashtable_node node;
+};
+
+static struct counting_alloc alloc;
+static struct item items[NUM_ITEMS];
+
+static unsigned long key_hash(unsigned long key)
+{
+    return (unsigned long)am_hash_fmix64(key);
+}
+
+static struct item *lookup(struct am_rhashtable *ht, unsigned long key)
+{
+    struct am_rhashtable_node *it;
+
+    am_rhashtable_foreach_possible(ht, key_hash(key), it) {
+        struct item *item = AM_CONTAINER_OF(it, struct item, node);
+        if (item->key == key) {
+            return item;
+        }
+    }
+    return NULL;
+}
+
+static size_t longest_chain(struct am_rhashtable *ht)
+{
+    size_t longest = 0;
+    unsigned long i;
+
+    for (i = 0; i <= ht->mask; i++) {
+        struct am_hlist_node *it;
+        size_t n = 0;
+        am_hlist_foreach(it, &ht->buckets[i]) {
+            n++;
+        }
+        longest = AM_MAX(longest, n);
+    }
+    return longest;
+}
+
+static void test_grow_shrink(void)
+{
+    struct am_rhashtable ht;
+    unsigned long i;
+    unsigned resizes = 0;
+    bool rehashing = false;
+
+    check(am_rhashtable_init(&ht, &alloc.alloc, 0));
+    for (i = 0; i < NUM_ITEMS; i++) {
+        items[i].key = i;
+        am_rhashtable_add(&ht, &items[i].node, key_hash(i));
+        resizes += !rehashing && am_rhashtable_is_rehashing(&ht);
+        rehashing = am_rhashtable_is_rehashing(&ht);
+        /* Everything stays reachable while a resize is in progress */
+        if (i % 997 == 0) {
+            unsigned long j;
+            for (j = 0; j <= i; j += 13) {
+                check(lookup(&ht, j) == &items[j]);
+            }
+        }
+    }
+    printf("%u resizes, %lu buckets, longest chain %zu\n", resizes, ht.mask + 1, longest_chain(&ht));
+    check(resizes > 10);
+    check(am_rhashtable_count(&ht) == NUM_ITEMS);
+    check(ht.mask + 1 >= NUM_ITEMS / 2);
+    check(lookup(&ht, NUM_ITEMS) == NULL);
+
+    for (i = 0; i < NUM_ITEMS; i++) {
+        if (i % 100 != 0) {
+            am_rhashtable_del(&ht, &items[i].node);
+        }
+    }
+    while (am_rhashtable_rehash_step(&ht, 64)) {
+    }
+    printf("After removals: %lu buckets\n", ht.mask + 1);
+    check(am_rhashtable_count(&ht) == NUM_ITEMS / 100);
+    check(ht.mask + 1 <= NUM_ITEMS / 100 * 4);
+    for (i = 0; i < NUM_ITEMS; i++) {
+        check(lookup(&ht, i) == (i % 100 == 0 ? &items[i] : NULL));
+    }
+
+    am_rhashtable_destroy(&ht);
+    check(alloc.in_use == 0);
+}
+
+/* Iteration sees every node once, even mid-resize, and tolerates removals */
+static void test_iter(void)
+{
+    static bool seen[NUM_ITEMS];
+    struct am_rhashtable ht;
+    struct am_rhashtable_iter it;
+    struct am_rhashtable_node *node;
+    unsigned long i, n = 0;
+
+    check(am_rhashtable_init(&ht, &alloc.alloc, 0));
+    for (i = 0; i < NUM_ITER; i++) {
+        items[i].key = i;
+        am_rhashtable_add(&ht, &items[i].node, key_hash(i));
+    }
+    check(am_rhashtable_is_rehashing(&ht));
+
+    am_rhashtable_iter_begin(&ht, &it);
+    while ((node = am_rhashtable_iter_next(&ht, &it)) != NULL) {
+        struct item *item = AM_CONTAINER_OF(node, struct item, node);
+        check(!seen[item->key]);
+        seen[item->key] = true;
+        if (item->key % 2 == 0) {
+            am_rhashtable_del(&ht, node);
+        }
+        n++;
+    }
+    am_rhashtable_iter_end(&ht, &it);
+    check(n == NUM_ITER);
+    check(am_rhashtable_count(&ht) == NUM_ITER / 2);
+    for (i = 0; i < NUM_ITER; i++) {
+        check(lookup(&ht, i) == (i % 2 == 1 ? &items[i] : NULL));
+    }
+
+    am_rhashtable_destroy(&ht);
+    check(alloc.in_use == 0);
+}
+
+int main(void)
+{
+    counting_alloc_init(&alloc);
+
+    test_grow_shrink();
+    test_iter();
+    return 0;
+}
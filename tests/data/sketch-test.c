@@ -0,0 +1,189 @@
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "am/alloc.h"
+#include "am/data/sketch.h"
+#include "check.h"
+#include "alloc-helpers.h"
+
+#define NUM_SHARDS 4
+#define NUM_ITEMS  5000
+
+static struct counting_alloc alloc;
+static uint64_t hashes[1000000];
+
+static void test_hll(void)
+{
+    static const unsigned long sizes[] = { 1, 10, 100, 1000, 5000, 20000, 100000, 1000000 };
+    struct am_hll hll, shards[NUM_SHARDS], merged;
+    char key[32];
+    size_t s, i;
+
+    /* Accurate across the sparse and dense ranges, at precision 12 (1.6%) */
+    for (s = 0; s < AM_ARRAY_SIZE(sizes); s++) {
+        double estimate, error;
+
+        am_hll_init(&hll, &alloc.alloc, 12);
+        check(am_hll_estimate(&hll) == 0);
+        for (i = 0; i < sizes[s]; i++) {
+            int len = snprintf(key, sizeof key, "user:%zu", i);
+            check(am_hll_add(&hll, key, (unsigned)len));
+            /* Repeats don't count */
+            if (i % 3 == 0) {
+                check(am_hll_add(&hll, key, (unsigned)len));
+            }
+        }
+        estimate = am_hll_estimate(&hll);
+        error = fabs(estimate - (double)sizes[s]) / (double)sizes[s];
+        printf("hll %8lu: %10.1f (%s, error %.4f)\n", sizes[s], estimate,
+                am_hll_is_dense(&hll) ? "dense" : "sparse", error);
+        check(am_hll_is_dense(&hll) == (sizes[s] >= 5000));
+        check(sizes[s] > 100 || fabs(estimate - (double)sizes[s]) < 1);
+        check(error < 4 * 1.04 / 64);
+        am_hll_destroy(&hll);
+        check(alloc.in_use == 0);
+    }
+
+    /* Shards fed a part each, some staying sparse, merge into the sketch of the whole */
+    for (i = 0; i < AM_ARRAY_SIZE(hashes); i++) {
+        hashes[i] = am_hash_fmix64(i);
+    }
+    am_hll_init(&hll, &alloc.alloc, 14);
+    check(am_hll_add_batch(&hll, hashes, AM_ARRAY_SIZE(hashes)));
+    for (s = 0; s < NUM_SHARDS; s++) {
+        am_hll_init(&shards[s], &alloc.alloc, 14);
+    }
+    for (i = 0; i < AM_ARRAY_SIZE(hashes); i++) {
+        /* Shard 0 gets a few keys, the others split the rest */
+        s = i < 100 ? 0 : 1 + i % (NUM_SHARDS - 1);
+        check(am_hll_add_hash(&shards[s], hashes[i]));
+    }
+    check(!am_hll_is_dense(&shards[0]) && am_hll_is_dense(&shards[1]));
+    am_hll_init(&merged, &alloc.alloc, 14);
+    for (s = 0; s < NUM_SHARDS; s++) {
+        check(am_hll_merge(&merged, &shards[s]));
+    }
+    check(am_hll_is_dense(&merged));
+    check(memcmp(merged.registers, hll.registers, (size_t)1 << 14) == 0);
+    check(am_hll_estimate(&merged) == am_hll_estimate(&hll));
+    printf("hll merged %zu: %.1f\n", AM_ARRAY_SIZE(hashes), am_hll_estimate(&merged));
+
+    /* Sparse into sparse stays sparse, and a dense source makes the destination dense */
+    am_hll_clear(&merged);
+    check(!am_hll_is_dense(&merged) && am_hll_estimate(&merged) == 0);
+    check(am_hll_merge(&merged, &shards[0]));
+    check(!am_hll_is_dense(&merged));
+    check(fabs(am_hll_estimate(&merged) - am_hll_estimate(&shards[0])) < 1e-9);
+    am_hll_destroy(&merged);
+    am_hll_init(&merged, &alloc.alloc, 13);
+    check(!am_hll_merge(&merged, &hll));
+
+    am_hll_destroy(&merged);
+    am_hll_destroy(&hll);
+    for (s = 0; s < NUM_SHARDS; s++) {
+        am_hll_destroy(&shards[s]);
+    }
+    check(alloc.in_use == 0);
+}
+
+static void test_cms(void)
+{
+    static uint32_t truth[NUM_ITEMS];
+    struct am_cms cms, batch, shards[2];
+    unsigned long total = 0, within = 0;
+    double bound;
+    char key[32];
+    size_t i, j;
+
+    check(am_cms_init(&cms, &alloc.alloc, 2000, 4));
+    check(cms.width == 2048 && cms.depth == 4);
+    check(am_cms_estimate(&cms, "x", 1) == 0);
+
+    /* Zipf-like: item i occurs about NUM_ITEMS / (i + 1) times */
+    for (i = 0; i < NUM_ITEMS; i++) {
+        int len = snprintf(key, sizeof key, "item-%zu", i);
+        truth[i] = NUM_ITEMS / (uint32_t)(i + 1);
+        am_cms_add(&cms, key, (unsigned)len, truth[i]);
+        total += truth[i];
+    }
+    check(am_cms_total(&cms) == total);
+
+    /* Never under; over by at most e / width of the total, almost always */
+    bound = M_E / (double)cms.width * (double)total;
+    for (i = 0; i < NUM_ITEMS; i++) {
+        int len = snprintf(key, sizeof key, "item-%zu", i);
+        uint32_t estimate = am_cms_estimate(&cms, key, (unsigned)len);
+
+        check(estimate >= truth[i]);
+        within += estimate - truth[i] <= bound;
+        /* The heavy hitters are nearly exact */
+        if (i < 10) {
+            check(estimate - truth[i] <= truth[i] / 100);
+        }
+    }
+    printf("cms: %lu of %d within the bound of %.1f\n", within, NUM_ITEMS, bound);
+    check(within >= NUM_ITEMS * 98 / 100);
+
+    /* Batches match single adds */
+    for (i = 0; i < 100000; i++) {
+        hashes[i] = am_hash_fmix64(i % 777);
+    }
+    check(am_cms_init(&batch, &alloc.alloc, 512, 3));
+    check(am_cms_init(&shards[0], &alloc.alloc, 512, 3));
+    check(am_cms_init(&shards[1], &alloc.alloc, 512, 3));
+    am_cms_add_batch(&batch, hashes, 100000);
+    for (i = 0; i < 100000; i++) {
+        am_cms_add_hash(&shards[i % 2], hashes[i], 1);
+    }
+    {
+        struct am_cms single;
+
+        check(am_cms_init(&single, &alloc.alloc, 512, 3));
+        for (i = 0; i < 100000; i++) {
+            am_cms_add_hash(&single, hashes[i], 1);
+        }
+        check(memcmp(batch.counters, single.counters, 512 * 3 * sizeof(uint32_t)) == 0);
+        am_cms_destroy(&single);
+    }
+
+    /* Merged shards still never undercount, and keep the total */
+    check(am_cms_merge(&shards[0], &shards[1]));
+    check(am_cms_total(&shards[0]) == 100000);
+    for (i = 0; i < 777; i++) {
+        check(am_cms_estimate_hash(&shards[0], am_hash_fmix64(i)) >= 100000 / 777);
+    }
+    check(!am_cms_merge(&shards[0], &cms));
+
+    /* Merges saturate */
+    for (j = 0; j < 512 * 3; j++) {
+        shards[1].counters[j] = UINT32_MAX - (uint32_t)(j % 3);
+        shards[0].counters[j] = (uint32_t)(j % 5);
+    }
+    check(am_cms_merge(&shards[0], &shards[1]));
+    for (j = 0; j < 512 * 3; j++) {
+        uint64_t sum = (uint64_t)(UINT32_MAX - j % 3) + j % 5;
+        check(shards[0].counters[j] == (sum > UINT32_MAX ? UINT32_MAX : sum));
+    }
+    am_cms_add_hash(&shards[0], hashes[0], 10);
+    check(am_cms_estimate_hash(&shards[0], hashes[0]) == UINT32_MAX);
+
+    am_cms_clear(&cms);
+    check(am_cms_total(&cms) == 0 && am_cms_estimate(&cms, "item-0", 6) == 0);
+    am_cms_destroy(&cms);
+    am_cms_destroy(&batch);
+    am_cms_destroy(&shards[0]);
+    am_cms_destroy(&shards[1]);
+    check(alloc.in_use == 0);
+}
+
+int main(void)
+{
+    counting_alloc_init(&alloc);
+
+    test_hll();
+    test_cms();
+    return 0;
+}
@@ -0,0 +1,175 @@
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include "am/macros.h"
+#include "am/data/timerwheel.h"
+#include "check.h"
+
+#define NUM_TIMERS 5000
+#define NUM_ROUNDS 3000
+
+struct conn {
+    struct am_timer timer;
+    uint64_t deadline; /* Reference model */
+    bool armed;
+};
+
+static struct conn conns[NUM_TIMERS];
+static struct am_timer_wheel wheel;
+static uint64_t rng = 88172645463325252ull;
+
+static uint64_t next_rand(void)
+{
+    rng ^= rng << 13;
+    rng ^= rng >> 7;
+    rng ^= rng << 17;
+    return rng;
+}
+
+/* Delays spread over every level: a few ticks to about 2^40 */
+static uint64_t random_delay(void)
+{
+    unsigned bits = (unsigned)(next_rand() % 41);
+    return next_rand() & ((UINT64_C(1) << bits) - 1);
+}
+
+static void test_basic(void)
+{
+    struct am_timer a, b, c;
+    struct am_list expired;
+    uint64_t tick;
+
+    am_timer_wheel_init(&wheel, 1000);
+    am_list_head_init(&expired);
+    am_timer_init(&a);
+    am_timer_init(&b);
+    am_timer_init(&c);
+    check(!am_timer_wheel_next_expiry(&wheel, &tick));
+    check(!am_timer_wheel_del(&wheel, &a));
+
+    am_timer_wheel_add(&wheel, &a, 1010);
+    am_timer_wheel_add(&wheel, &b, 1005);
+    am_timer_wheel_add(&wheel, &c, 900000);
+    check(am_timer_wheel_count(&wheel) == 3);
+    check(am_timer_wheel_next_expiry(&wheel, &tick) && tick == 1005);
+
+    check(am_timer_wheel_advance(&wheel, 1004, &expired) == 0);
+    check(am_timer_wheel_advance(&wheel, 1010, &expired) == 2);
+    check(expired.next == &b.entry && expired.prev == &a.entry);
+    check(!am_timer_is_armed(&a) && !am_timer_is_armed(&b));
+
+    /* Cancelling a fired timer takes it off the expired list */
+    check(!am_timer_wheel_del(&wheel, &b));
+    check(expired.next == &a.entry);
+    /* Re-arming one right away, in the past, fires on the next advance */
+    am_timer_wheel_mod(&wheel, &a, 5);
+    check(am_timer_is_armed(&a));
+    check(am_list_is_empty(&expired));
+    check(am_timer_wheel_advance(&wheel, 1010, &expired) == 1);
+    check(expired.next == &a.entry);
+    am_list_del(&a.entry);
+
+    /* A far timer gives an early, but useful, next expiry */
+    check(am_timer_wheel_next_expiry(&wheel, &tick) && tick > 1010 && tick <= 900000);
+    check(am_timer_wheel_del(&wheel, &c));
+    check(am_timer_wheel_count(&wheel) == 0);
+    check(!am_timer_wheel_next_expiry(&wheel, &tick));
+}
+
+/* Random arms, cancels and re-arms against a reference model */
+static void test_random(void)
+{
+    struct am_list expired;
+    uint64_t now = 12345;
+    size_t armed = 0;
+    int round, i;
+
+    am_timer_wheel_init(&wheel, now);
+    am_list_head_init(&expired);
+    for (i = 0; i < NUM_TIMERS; i++) {
+        am_timer_init(&conns[i].timer);
+        conns[i].armed = false;
+    }
+
+    for (round = 0; round < NUM_ROUNDS; round++) {
+        struct am_list *it, *tmp;
+        uint64_t target, next, last = 0, min = UINT64_MAX;
+        size_t fired, due = 0;
+
+        for (i = 0; i < 20; i++) {
+            struct conn *c = &conns[next_rand() % NUM_TIMERS];
+            uint64_t op = next_rand() % 4;
+
+            if (op == 0 && c->armed) {
+                check(am_timer_wheel_del(&wheel, &c->timer));
+                c->armed = false;
+                armed--;
+            } else {
+                c->deadline = now + random_delay();
+                armed += !c->armed;
+                c->armed = true;
+                am_timer_wheel_mod(&wheel, &c->timer, c->deadline);
+            }
+        }
+        check(am_timer_wheel_count(&wheel) == armed);
+
+        /* Mostly small steps, sometimes straight to the next expiry, sometimes a leap */
+        switch (next_rand() % 8) {
+        case 0:
+            target = now + random_delay();
+            break;
+        case 1:
+            target = am_timer_wheel_next_expiry(&wheel, &next) ? next : now;
+            break;
+        default:
+            target = now + next_rand() % 100;
+            break;
+        }
+
+        for (i = 0; i < NUM_TIMERS; i++) {
+            if (conns[i].armed) {
+                due += conns[i].deadline <= target;
+                min = AM_MIN(min, conns[i].deadline);
+            }
+        }
+        if (am_timer_wheel_next_expiry(&wheel, &next)) {
+            check(next <= min);
+            check(next >= now);
+            check(min >> AM_TIMER_WHEEL_BITS != now >> AM_TIMER_WHEEL_BITS || next == min);
+        } else {
+            check(armed == 0);
+        }
+
+        fired = am_timer_wheel_advance(&wheel, target, &expired);
+        check(fired == due);
+        am_list_foreach_safe(it, tmp, &expired) {
+            struct conn *c = AM_CONTAINER_OF(it, struct conn, timer.entry);
+            check(c->armed && c->deadline <= target);
+            check(c->deadline >= last);
+            check(!am_timer_is_armed(&c->timer));
+            last = c->deadline;
+            c->armed = false;
+            armed--;
+            am_list_del(it);
+        }
+        now = target;
+    }
+    printf("%zu timers still armed at tick %llu\n", armed, (unsigned long long)now);
+
+    /* Everything fires eventually */
+    while (am_timer_wheel_count(&wheel) > 0) {
+        uint64_t next;
+        check(am_timer_wheel_next_expiry(&wheel, &next));
+        armed -= am_timer_wheel_advance(&wheel, next, &expired);
+        am_list_head_init(&expired);
+    }
+    check(armed == 0);
+}
+
+int main(void)
+{
+    test_basic();
+    test_random();
+    return 0;
+}